@@ -8,6 +8,7 @@
 #include <tuple>
 #include <type_traits>
 
+#include "zeek/ConnArena.h"
 #include "zeek/Dict.h"
 #include "zeek/Timer.h"
 #include "zeek/Rule.h"
@@ -71,7 +72,7 @@ static inline int addr_port_canon_lt(const IPAddr& addr1, uint32_t p1,
 	return addr1 < addr2 || (addr1 == addr2 && p1 < p2);
 	}
 
-class Connection final : public Obj {
+class Connection final : public Obj, public detail::ConnArenaObject {
 public:
 
 	Connection(NetSessions* s, const detail::ConnIDKey& k, double t, const ConnID* id,
@@ -356,7 +357,7 @@ protected:
 
 namespace detail {
 
-class ConnectionTimer final : public Timer {
+class ConnectionTimer final : public Timer, public ConnArenaObject {
 public:
 	ConnectionTimer(Connection* arg_conn, timer_func arg_timer,
 	                double arg_t, bool arg_do_expire, TimerType arg_type)
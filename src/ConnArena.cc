@@ -0,0 +1,316 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ConnArena.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <cstddef>
+#include <unordered_map>
+
+#include "zeek/3rdparty/doctest.h"
+
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// Precedes every object. Its size keeps the object aligned like malloc()
+// would.
+struct alignas(alignof(std::max_align_t)) Header {
+	uint64_t size;
+	uint16_t size_class;
+	ConnArena::Protocol protocol;
+};
+
+constexpr uint16_t HEAP_CLASS = 0xffff;
+constexpr size_t NUM_CLASSES = ConnArena::MAX_OBJECT_SIZE / ConnArena::GRANULARITY;
+constexpr size_t MAX_PROTOCOLS = 256;
+
+static_assert(ConnArena::GRANULARITY % alignof(std::max_align_t) == 0,
+              "arena granularity must preserve alignment");
+static_assert(ConnArena::MAX_OBJECT_SIZE % ConnArena::GRANULARITY == 0,
+              "maximum arena object size must be a multiple of the granularity");
+
+struct ProtocolUsage {
+	uint64_t objects;
+	uint64_t bytes;
+};
+
+// Released chunks of each size class, linked through their first word.
+void* free_lists[NUM_CLASSES];
+
+// All slabs, linked through their first word, and the unused remainder
+// of the most recent one.
+char* slabs = nullptr;
+char* slab_pos = nullptr;
+char* slab_end = nullptr;
+
+uint64_t num_slabs = 0;
+uint64_t used_bytes = 0;
+uint64_t heap_objects = 0;
+uint64_t heap_bytes = 0;
+
+ProtocolUsage usage[MAX_PROTOCOLS];
+std::vector<std::string> protocol_names = { "other" };
+std::unordered_map<std::string, ConnArena::Protocol> protocol_ids;
+
+size_t size_class(size_t size)
+	{
+	return size ? (size - 1) / ConnArena::GRANULARITY : 0;
+	}
+
+size_t chunk_size(size_t cls)
+	{
+	return sizeof(Header) + (cls + 1) * ConnArena::GRANULARITY;
+	}
+
+Header* carve(size_t n)
+	{
+	if ( static_cast<size_t>(slab_end - slab_pos) < n )
+		{
+		// The remainder of the current slab is too small to be of
+		// any use, it's simply left alone.
+		char* slab = static_cast<char*>(util::safe_malloc(ConnArena::SLAB_SIZE));
+		*reinterpret_cast<char**>(slab) = slabs;
+		slabs = slab;
+		slab_pos = slab + sizeof(Header);
+		slab_end = slab + ConnArena::SLAB_SIZE;
+		++num_slabs;
+		}
+
+	auto h = reinterpret_cast<Header*>(slab_pos);
+	slab_pos += n;
+	return h;
+	}
+
+} // namespace
+
+ConnArena::Protocol ConnArena::current_protocol = ConnArena::OTHER;
+bool ConnArena::enabled = false;
+uint64_t ConnArena::live_objects = 0;
+
+void* ConnArena::Allocate(size_t size)
+	{
+	++live_objects;
+
+	if ( ! enabled )
+		return util::safe_malloc(size ? size : 1);
+
+	Header* h;
+
+	if ( size <= MAX_OBJECT_SIZE )
+		{
+		size_t cls = size_class(size);
+		h = static_cast<Header*>(free_lists[cls]);
+
+		if ( h )
+			free_lists[cls] = *reinterpret_cast<void**>(h);
+		else
+			h = carve(chunk_size(cls));
+
+		h->size_class = cls;
+		used_bytes += chunk_size(cls);
+		}
+	else
+		{
+		h = static_cast<Header*>(util::safe_malloc(sizeof(Header) + size));
+		h->size_class = HEAP_CLASS;
+		++heap_objects;
+		heap_bytes += size;
+		}
+
+	h->size = size;
+	h->protocol = current_protocol;
+
+	++usage[current_protocol].objects;
+	usage[current_protocol].bytes += size;
+
+	return h + 1;
+	}
+
+void ConnArena::Free(void* p)
+	{
+	if ( ! p )
+		return;
+
+	--live_objects;
+
+	if ( ! enabled )
+		{
+		free(p);
+		return;
+		}
+
+	Header* h = static_cast<Header*>(p) - 1;
+
+	--usage[h->protocol].objects;
+	usage[h->protocol].bytes -= h->size;
+
+	if ( h->size_class == HEAP_CLASS )
+		{
+		--heap_objects;
+		heap_bytes -= h->size;
+		free(h);
+		return;
+		}
+
+	used_bytes -= chunk_size(h->size_class);
+	*reinterpret_cast<void**>(h) = free_lists[h->size_class];
+	free_lists[h->size_class] = h;
+	}
+
+bool ConnArena::SetEnabled(bool arg_enabled)
+	{
+	if ( arg_enabled == enabled )
+		return true;
+
+	if ( live_objects )
+		return false;
+
+	enabled = arg_enabled;
+	current_protocol = OTHER;
+	return true;
+	}
+
+ConnArena::Protocol ConnArena::RegisterProtocol(const std::string& name)
+	{
+	auto it = protocol_ids.find(name);
+
+	if ( it != protocol_ids.end() )
+		return it->second;
+
+	if ( protocol_names.size() >= MAX_PROTOCOLS )
+		return OTHER;
+
+	Protocol p = protocol_names.size();
+	protocol_names.emplace_back(name);
+	protocol_ids.emplace(name, p);
+	return p;
+	}
+
+void ConnArena::GetStats(Stats* stats)
+	{
+	stats->slabs = num_slabs;
+	stats->slab_bytes = num_slabs * SLAB_SIZE;
+	stats->free_bytes = stats->slab_bytes - used_bytes;
+	stats->heap_objects = heap_objects;
+	stats->heap_bytes = heap_bytes;
+	stats->protocols.clear();
+
+	for ( size_t i = 0; i < protocol_names.size(); ++i )
+		{
+		if ( usage[i].objects )
+			stats->protocols.push_back({protocol_names[i], usage[i].objects, usage[i].bytes});
+		}
+	}
+
+TEST_SUITE_BEGIN("ConnArena");
+
+TEST_CASE("conn arena reuse")
+	{
+	bool was_enabled = ConnArena::Enabled();
+	ConnArena::SetEnabled(true);
+
+	ConnArena::Stats before;
+	ConnArena::GetStats(&before);
+
+	void* a = ConnArena::Allocate(40);
+	void* b = ConnArena::Allocate(48);
+	void* c = ConnArena::Allocate(ConnArena::MAX_OBJECT_SIZE + 1);
+
+	CHECK(reinterpret_cast<uintptr_t>(a) % alignof(std::max_align_t) == 0);
+	CHECK(reinterpret_cast<uintptr_t>(b) % alignof(std::max_align_t) == 0);
+	CHECK(a != b);
+
+	memset(a, 0xaa, 40);
+	memset(b, 0xbb, 48);
+	memset(c, 0xcc, ConnArena::MAX_OBJECT_SIZE + 1);
+
+	ConnArena::Stats during;
+	ConnArena::GetStats(&during);
+	CHECK(during.heap_objects == before.heap_objects + 1);
+	CHECK(during.slabs >= 1);
+
+	// Same size class, so the chunk gets reused right away.
+	ConnArena::Free(a);
+	CHECK(ConnArena::Allocate(33) == a);
+
+	ConnArena::Free(a);
+	ConnArena::Free(b);
+	ConnArena::Free(c);
+	ConnArena::Free(nullptr);
+
+	ConnArena::Stats after;
+	ConnArena::GetStats(&after);
+	CHECK(after.heap_objects == before.heap_objects);
+	CHECK(after.heap_bytes == before.heap_bytes);
+	CHECK(after.free_bytes - before.free_bytes == during.slab_bytes - before.slab_bytes);
+
+	ConnArena::SetEnabled(was_enabled);
+	}
+
+TEST_CASE("conn arena protocol accounting")
+	{
+	bool was_enabled = ConnArena::Enabled();
+	auto p = ConnArena::RegisterProtocol("ConnArenaTest");
+	CHECK(p != ConnArena::OTHER);
+	CHECK(ConnArena::RegisterProtocol("ConnArenaTest") == p);
+
+	auto find = [](const ConnArena::Stats& s) -> const ConnArena::ProtocolStats*
+		{
+		for ( const auto& ps : s.protocols )
+			if ( ps.name == "ConnArenaTest" )
+				return &ps;
+
+		return nullptr;
+		};
+
+	ConnArena::Stats s;
+	void* mem[3];
+
+	// Disabled, there's neither a header nor accounting.
+	REQUIRE(ConnArena::SetEnabled(false));
+
+		{
+		ConnArenaScope scope(p);
+		CHECK(ConnArena::CurrentProtocol() == ConnArena::OTHER);
+		mem[0] = ConnArena::Allocate(100);
+		}
+
+	ConnArena::GetStats(&s);
+	CHECK(find(s) == nullptr);
+
+	// The mode can't change while memory is in use.
+	CHECK_FALSE(ConnArena::SetEnabled(true));
+	ConnArena::Free(mem[0]);
+	REQUIRE(ConnArena::SetEnabled(true));
+
+		{
+		ConnArenaScope scope(p);
+		mem[0] = ConnArena::Allocate(100);
+		mem[1] = ConnArena::Allocate(3000);
+		mem[2] = ConnArena::Allocate(0);
+		CHECK(ConnArena::CurrentProtocol() == p);
+		}
+
+	CHECK(ConnArena::CurrentProtocol() != p);
+
+	ConnArena::GetStats(&s);
+	auto ps = find(s);
+	REQUIRE(ps);
+	CHECK(ps->objects == 3);
+	CHECK(ps->bytes == 3100);
+
+	for ( auto m : mem )
+		ConnArena::Free(m);
+
+	ConnArena::GetStats(&s);
+	CHECK(find(s) == nullptr);
+
+	ConnArena::SetEnabled(was_enabled);
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
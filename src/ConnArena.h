@@ -0,0 +1,169 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace zeek::detail {
+
+/**
+ * A slab allocator for per-connection state such as analyzers, TCP
+ * endpoints, reassemblers and their data blocks, and connection timers.
+ *
+ * Objects up to MAX_OBJECT_SIZE bytes are carved from large slabs and go
+ * onto a free list for their size class once released, where they get
+ * picked up by the next connection needing an object of similar size.
+ * That keeps the high churn of connection setup and teardown away from
+ * the general-purpose heap, and its fragmentation. Slabs are retained
+ * for reuse, so the arena's footprint is bounded by the peak amount of
+ * per-connection state.
+ *
+ * Each allocation is charged to the protocol that's currently active
+ * (see ConnArenaScope), so that memory statistics can break usage down
+ * by analyzer. When the arena is disabled, objects are simply passed on
+ * to malloc() and free(), without any accounting or per-object overhead.
+ *
+ * The arena is not thread-safe; it must only be used from the main
+ * thread.
+ */
+class ConnArena {
+public:
+	using Protocol = uint8_t;
+
+	struct ProtocolStats {
+		std::string name;
+		uint64_t objects;	// currently allocated
+		uint64_t bytes;		// currently allocated, as requested
+	};
+
+	struct Stats {
+		uint64_t slabs;
+		uint64_t slab_bytes;
+		uint64_t free_bytes;	// in slabs, but not in use
+		uint64_t heap_objects;	// larger than MAX_OBJECT_SIZE
+		uint64_t heap_bytes;
+
+		// Only protocols with allocations are included.
+		std::vector<ProtocolStats> protocols;
+	};
+
+	/**
+	 * Allocates memory for an object of the given size. The memory is
+	 * suitably aligned for any type.
+	 */
+	static void* Allocate(size_t size);
+
+	/**
+	 * Releases memory returned by Allocate(). Passing nullptr is a
+	 * no-op.
+	 */
+	static void Free(void* p);
+
+	/**
+	 * Enables or disables use of the slabs. The mode can only be
+	 * switched while no memory allocated from the arena is in use, as
+	 * it determines how memory gets released.
+	 *
+	 * @return False if memory is in use and the mode stays unchanged.
+	 */
+	static bool SetEnabled(bool enabled);
+
+	static bool Enabled()	{ return enabled; }
+
+	/**
+	 * Returns the identifier for a protocol name, registering it on
+	 * first use. Once all identifiers are taken, further names map to
+	 * OTHER.
+	 */
+	static Protocol RegisterProtocol(const std::string& name);
+
+	/**
+	 * Returns the protocol that new allocations are currently charged
+	 * to. That's always OTHER while the arena is disabled.
+	 */
+	static Protocol CurrentProtocol()	{ return current_protocol; }
+
+	static void SetCurrentProtocol(Protocol p)	{ current_protocol = p; }
+
+	static void GetStats(Stats* stats);
+
+	static constexpr Protocol OTHER = 0;
+
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+	static constexpr size_t MAX_OBJECT_SIZE = 2048;
+	static constexpr size_t GRANULARITY = 16;
+
+private:
+	static Protocol current_protocol;
+	static bool enabled;
+	static uint64_t live_objects;
+};
+
+/**
+ * Charges all allocations from the arena to the given protocol for as long
+ * as the instance is in scope. Does nothing while the arena is disabled.
+ */
+class ConnArenaScope {
+public:
+	explicit ConnArenaScope(ConnArena::Protocol p)
+		: prev(ConnArena::CurrentProtocol())
+		{
+		if ( ConnArena::Enabled() )
+			ConnArena::SetCurrentProtocol(p);
+		}
+
+	~ConnArenaScope()
+		{
+		if ( ConnArena::Enabled() )
+			ConnArena::SetCurrentProtocol(prev);
+		}
+
+	ConnArenaScope(const ConnArenaScope&) = delete;
+	ConnArenaScope& operator=(const ConnArenaScope&) = delete;
+
+private:
+	ConnArena::Protocol prev;
+};
+
+/**
+ * Base class for types whose instances are allocated from the arena.
+ */
+class ConnArenaObject {
+public:
+	static void* operator new(size_t size)	{ return ConnArena::Allocate(size); }
+	static void operator delete(void* p)	{ ConnArena::Free(p); }
+};
+
+/**
+ * A standard allocator using the arena, for the nodes of per-connection
+ * containers.
+ */
+template <typename T>
+class ConnArenaAllocator {
+public:
+	using value_type = T;
+
+	ConnArenaAllocator() = default;
+
+	template <typename U>
+	ConnArenaAllocator(const ConnArenaAllocator<U>&)	{ }
+
+	T* allocate(size_t n)
+		{ return static_cast<T*>(ConnArena::Allocate(n * sizeof(T))); }
+
+	void deallocate(T* p, size_t)
+		{ ConnArena::Free(p); }
+
+	template <typename U>
+	bool operator==(const ConnArenaAllocator<U>&) const	{ return true; }
+
+	template <typename U>
+	bool operator!=(const ConnArenaAllocator<U>&) const	{ return false; }
+};
+
+} // namespace zeek::detail
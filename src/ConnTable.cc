@@ -0,0 +1,373 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/ConnTable.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+// Resize once more than 3/4 of the buckets are in use.
+static inline bool over_load_factor(size_t entries, size_t capacity)
+	{
+	return entries * 4 > capacity * 3;
+	}
+
+void ConnTable::const_iterator::Advance()
+	{
+	if ( in_old )
+		{
+		while ( pos <= table->old_mask && ! table->old_slots[pos].hash )
+			++pos;
+
+		if ( pos <= table->old_mask )
+			{
+			entry.key = &table->old_keys[pos];
+			entry.conn = table->old_slots[pos].conn;
+			return;
+			}
+
+		in_old = false;
+		pos = 0;
+		}
+
+	while ( pos <= table->mask && ! table->slots[pos].hash )
+		++pos;
+
+	if ( pos <= table->mask )
+		{
+		entry.key = &table->keys[pos];
+		entry.conn = table->slots[pos].conn;
+		}
+	else
+		entry = { nullptr, nullptr };
+	}
+
+ConnTable::ConnTable(size_t initial_capacity)
+	{
+	size_t capacity = 16;
+
+	while ( capacity < initial_capacity )
+		capacity <<= 1;
+
+	Allocate(capacity, &slots, &keys);
+	mask = capacity - 1;
+	}
+
+ConnTable::~ConnTable()
+	{
+	delete [] slots;
+	delete [] keys;
+	delete [] old_slots;
+	delete [] old_keys;
+	}
+
+void ConnTable::Allocate(size_t capacity, Slot** s, ConnIDKey** k)
+	{
+	*s = new Slot[capacity]();
+	*k = new ConnIDKey[capacity];
+	}
+
+ptrdiff_t ConnTable::Find(const Slot* s, const ConnIDKey* k, size_t m,
+                          const ConnIDKey& key, hash_t hash)
+	{
+	for ( size_t pos = hash & m; s[pos].hash; pos = (pos + 1) & m )
+		{
+		if ( s[pos].hash == hash && k[pos] == key )
+			return pos;
+		}
+
+	return -1;
+	}
+
+void ConnTable::PutNew(Slot* s, ConnIDKey* k, size_t m,
+                       const ConnIDKey& key, hash_t hash, Connection* conn)
+	{
+	size_t pos = hash & m;
+
+	while ( s[pos].hash )
+		pos = (pos + 1) & m;
+
+	s[pos].hash = hash;
+	s[pos].conn = conn;
+	k[pos] = key;
+	}
+
+void ConnTable::EraseAt(Slot* s, ConnIDKey* k, size_t m, size_t pos)
+	{
+	// Backward-shift deletion: move later members of the probe
+	// sequence into the hole as long as that doesn't place them
+	// in front of their home bucket.
+	size_t hole = pos;
+
+	for ( size_t next = (hole + 1) & m; s[next].hash; next = (next + 1) & m )
+		{
+		size_t home = s[next].hash & m;
+
+		// Distance of home and hole from next, going backwards.
+		size_t dist_home = (next - home) & m;
+		size_t dist_hole = (next - hole) & m;
+
+		if ( dist_home >= dist_hole )
+			{
+			s[hole] = s[next];
+			k[hole] = k[next];
+			hole = next;
+			}
+		}
+
+	s[hole].hash = 0;
+	s[hole].conn = nullptr;
+	}
+
+Connection* ConnTable::Lookup(const ConnIDKey& key, hash_t hash) const
+	{
+	auto pos = Find(slots, keys, mask, key, hash);
+
+	if ( pos >= 0 )
+		return slots[pos].conn;
+
+	if ( old_slots )
+		{
+		pos = Find(old_slots, old_keys, old_mask, key, hash);
+
+		if ( pos >= 0 )
+			return old_slots[pos].conn;
+		}
+
+	return nullptr;
+	}
+
+Connection* ConnTable::Insert(const ConnIDKey& key, hash_t hash, Connection* conn)
+	{
+	if ( old_slots )
+		Migrate(MIGRATE_STEP);
+
+	auto pos = Find(slots, keys, mask, key, hash);
+
+	if ( pos >= 0 )
+		{
+		Connection* prev = slots[pos].conn;
+		slots[pos].conn = conn;
+		return prev;
+		}
+
+	Connection* prev = nullptr;
+
+	if ( old_slots )
+		{
+		pos = Find(old_slots, old_keys, old_mask, key, hash);
+
+		if ( pos >= 0 )
+			{
+			prev = old_slots[pos].conn;
+			EraseAt(old_slots, old_keys, old_mask, pos);
+			--num_entries;
+			}
+		}
+
+	if ( over_load_factor(num_entries + 1, mask + 1) )
+		StartResize();
+
+	PutNew(slots, keys, mask, key, hash, conn);
+	++num_entries;
+
+	return prev;
+	}
+
+Connection* ConnTable::Remove(const ConnIDKey& key, hash_t hash)
+	{
+	if ( old_slots )
+		Migrate(MIGRATE_STEP);
+
+	auto pos = Find(slots, keys, mask, key, hash);
+
+	if ( pos >= 0 )
+		{
+		Connection* prev = slots[pos].conn;
+		EraseAt(slots, keys, mask, pos);
+		--num_entries;
+		return prev;
+		}
+
+	if ( old_slots )
+		{
+		pos = Find(old_slots, old_keys, old_mask, key, hash);
+
+		if ( pos >= 0 )
+			{
+			Connection* prev = old_slots[pos].conn;
+			EraseAt(old_slots, old_keys, old_mask, pos);
+			--num_entries;
+			return prev;
+			}
+		}
+
+	return nullptr;
+	}
+
+void ConnTable::StartResize()
+	{
+	// A previous resize that hasn't finished yet gets completed
+	// first. With MIGRATE_STEP buckets moved per insertion this
+	// doesn't happen in practice, since the new table reaches
+	// its load factor only long after the old one has drained.
+	if ( old_slots )
+		Migrate(old_mask + 1);
+
+	old_slots = slots;
+	old_keys = keys;
+	old_mask = mask;
+	migrate_pos = 0;
+
+	size_t capacity = (mask + 1) << 1;
+	Allocate(capacity, &slots, &keys);
+	mask = capacity - 1;
+	}
+
+void ConnTable::Migrate(size_t n)
+	{
+	// All buckets below migrate_pos are empty, so erasing from the
+	// old table can never shift an entry back into the part we have
+	// already processed. When we erase at migrate_pos, a later entry
+	// may move into it, hence we only advance over empty buckets.
+	while ( n-- > 0 && migrate_pos <= old_mask )
+		{
+		while ( migrate_pos <= old_mask && old_slots[migrate_pos].hash )
+			{
+			const Slot& s = old_slots[migrate_pos];
+			PutNew(slots, keys, mask, old_keys[migrate_pos], s.hash, s.conn);
+			EraseAt(old_slots, old_keys, old_mask, migrate_pos);
+			}
+
+		++migrate_pos;
+		}
+
+	if ( migrate_pos > old_mask )
+		{
+		delete [] old_slots;
+		delete [] old_keys;
+		old_slots = nullptr;
+		old_keys = nullptr;
+		old_mask = 0;
+		migrate_pos = 0;
+		}
+	}
+
+void ConnTable::Clear()
+	{
+	delete [] old_slots;
+	delete [] old_keys;
+	old_slots = nullptr;
+	old_keys = nullptr;
+	old_mask = 0;
+	migrate_pos = 0;
+
+	for ( size_t i = 0; i <= mask; ++i )
+		slots[i] = { 0, nullptr };
+
+	num_entries = 0;
+	}
+
+size_t ConnTable::MemoryAllocation() const
+	{
+	size_t bucket_size = sizeof(Slot) + sizeof(ConnIDKey);
+	size_t mem = padded_sizeof(*this) + util::pad_size((mask + 1) * bucket_size);
+
+	if ( old_slots )
+		mem += util::pad_size((old_mask + 1) * bucket_size);
+
+	return mem;
+	}
+
+TEST_SUITE_BEGIN("ConnTable");
+
+static ConnIDKey make_test_key(uint32_t n)
+	{
+	ConnIDKey key;
+	memcpy(&key.ip1, &n, sizeof(n));
+	key.port1 = n & 0xffff;
+	key.port2 = 80;
+	return key;
+	}
+
+static Connection* make_test_conn(uint32_t n)
+	{
+	return reinterpret_cast<Connection*>(static_cast<uintptr_t>(n) * 8 + 8);
+	}
+
+TEST_CASE("conntable operation")
+	{
+	ConnTable t(16);
+	auto k1 = make_test_key(1);
+	auto k2 = make_test_key(2);
+
+	CHECK(t.Empty());
+	CHECK(t.Lookup(k1) == nullptr);
+
+	CHECK(t.Insert(k1, make_test_conn(1)) == nullptr);
+	CHECK(t.Insert(k2, make_test_conn(2)) == nullptr);
+	CHECK(t.Size() == 2);
+	CHECK(t.Lookup(k1) == make_test_conn(1));
+	CHECK(t.Lookup(k2) == make_test_conn(2));
+
+	CHECK(t.Insert(k1, make_test_conn(3)) == make_test_conn(1));
+	CHECK(t.Size() == 2);
+	CHECK(t.Lookup(k1) == make_test_conn(3));
+
+	CHECK(t.Remove(k1) == make_test_conn(3));
+	CHECK(t.Remove(k1) == nullptr);
+	CHECK(t.Lookup(k1) == nullptr);
+	CHECK(t.Lookup(k2) == make_test_conn(2));
+	CHECK(t.Size() == 1);
+
+	t.Clear();
+	CHECK(t.Empty());
+	CHECK(t.Lookup(k2) == nullptr);
+	}
+
+TEST_CASE("conntable incremental resize")
+	{
+	ConnTable t(16);
+	const uint32_t n = 5000;
+
+	for ( uint32_t i = 0; i < n; ++i )
+		{
+		t.Insert(make_test_key(i), make_test_conn(i));
+
+		// Everything inserted so far must remain reachable
+		// while entries are spread over both bucket arrays.
+		if ( t.Resizing() )
+			{
+			CHECK(t.Lookup(make_test_key(0)) == make_test_conn(0));
+			CHECK(t.Lookup(make_test_key(i / 2)) == make_test_conn(i / 2));
+			}
+		}
+
+	CHECK(t.Size() == n);
+	CHECK(t.Capacity() >= n);
+
+	size_t iterated = 0;
+	for ( const auto& e : t )
+		{
+		uint32_t i = 0;
+		memcpy(&i, &e.key->ip1, sizeof(i));
+		CHECK(e.conn == make_test_conn(i));
+		++iterated;
+		}
+
+	CHECK(iterated == n);
+
+	for ( uint32_t i = 0; i < n; i += 2 )
+		CHECK(t.Remove(make_test_key(i)) == make_test_conn(i));
+
+	CHECK(t.Size() == n / 2);
+
+	for ( uint32_t i = 0; i < n; ++i )
+		CHECK(t.Lookup(make_test_key(i)) == (i % 2 ? make_test_conn(i) : nullptr));
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
@@ -0,0 +1,193 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <iterator>
+
+#include "zeek/IPAddr.h"
+#include "zeek/Hash.h"
+
+namespace zeek {
+
+class Connection;
+
+namespace detail {
+
+/**
+ * An open-addressing hash table mapping ConnIDKeys to connections.
+ *
+ * Slots are laid out as a flat array of (hash, connection) pairs with the
+ * keys kept in a parallel array, so that probing only touches the compact
+ * slot array and compares a full key only on a hash match. Collisions are
+ * resolved by linear probing and removal uses backward-shift deletion, so
+ * there are no tombstones.
+ *
+ * Growing the table is incremental: once the load factor is exceeded a
+ * table of twice the size is allocated and the entries of the old one are
+ * moved over a few buckets at a time on subsequent insertions/removals.
+ * This avoids the latency spike of rehashing millions of flows at once.
+ */
+class ConnTable {
+public:
+	struct Entry {
+		const ConnIDKey* key;
+		Connection* conn;
+	};
+
+	class const_iterator {
+	public:
+		using value_type = Entry;
+		using reference = const Entry&;
+		using pointer = const Entry*;
+		using difference_type = ptrdiff_t;
+		using iterator_category = std::forward_iterator_tag;
+
+		reference operator*() const	{ return entry; }
+		pointer operator->() const	{ return &entry; }
+
+		const_iterator& operator++()	{ ++pos; Advance(); return *this; }
+		const_iterator operator++(int)	{ auto tmp = *this; ++(*this); return tmp; }
+
+		bool operator==(const const_iterator& o) const
+			{ return table == o.table && in_old == o.in_old && pos == o.pos; }
+		bool operator!=(const const_iterator& o) const	{ return ! (*this == o); }
+
+	private:
+		friend class ConnTable;
+
+		const_iterator(const ConnTable* t, bool old, size_t p)
+			: table(t), in_old(old), pos(p)	{ Advance(); }
+
+		void Advance();
+
+		const ConnTable* table;
+		bool in_old;
+		size_t pos;
+		Entry entry = { nullptr, nullptr };
+	};
+
+	explicit ConnTable(size_t initial_capacity = DEFAULT_CAPACITY);
+	~ConnTable();
+
+	ConnTable(const ConnTable&) = delete;
+	ConnTable& operator=(const ConnTable&) = delete;
+
+	/**
+	 * Computes the hash under which a key is stored. Callers on the
+	 * packet path compute this once and pass it to all other methods.
+	 * The hash is keyed (see KeyedHash), so flow tables cannot be
+	 * attacked with crafted collisions. It is never zero.
+	 */
+	static hash_t Hash(const ConnIDKey& key)
+		{
+		hash_t h = KeyedHash::Hash64(&key, sizeof(key));
+		return h ? h : 1;
+		}
+
+	/**
+	 * Returns the connection stored under the given key, or nullptr if
+	 * there is none.
+	 */
+	Connection* Lookup(const ConnIDKey& key, hash_t hash) const;
+	Connection* Lookup(const ConnIDKey& key) const
+		{ return Lookup(key, Hash(key)); }
+
+	/**
+	 * Stores a connection under the given key, replacing any existing
+	 * one. The table does not take a reference to the connection.
+	 *
+	 * @return The connection previously stored under the key, or nullptr.
+	 */
+	Connection* Insert(const ConnIDKey& key, hash_t hash, Connection* conn);
+	Connection* Insert(const ConnIDKey& key, Connection* conn)
+		{ return Insert(key, Hash(key), conn); }
+
+	/**
+	 * Removes the entry for the given key.
+	 *
+	 * @return The connection that was stored under the key, or nullptr
+	 * if there was none.
+	 */
+	Connection* Remove(const ConnIDKey& key, hash_t hash);
+	Connection* Remove(const ConnIDKey& key)
+		{ return Remove(key, Hash(key)); }
+
+	/**
+	 * Hints to the CPU that a lookup for the given hash is coming up,
+	 * so that the slot's cache line can be fetched while other work
+	 * (e.g., parsing of the next packet) is still going on.
+	 */
+	void Prefetch(hash_t hash) const
+		{
+		__builtin_prefetch(&slots[hash & mask]);
+
+		if ( old_slots )
+			__builtin_prefetch(&old_slots[hash & old_mask]);
+		}
+
+	/**
+	 * Removes all entries. Does not touch the connections themselves.
+	 */
+	void Clear();
+
+	size_t Size() const	{ return num_entries; }
+	bool Empty() const	{ return num_entries == 0; }
+	size_t Capacity() const	{ return mask + 1; }
+
+	/**
+	 * Returns true if a resize is currently in progress, i.e., entries
+	 * are still spread across the old and the new bucket arrays.
+	 */
+	bool Resizing() const	{ return old_slots != nullptr; }
+
+	/**
+	 * Returns the number of bytes allocated for the bucket arrays.
+	 */
+	size_t MemoryAllocation() const;
+
+	const_iterator begin() const	{ return const_iterator(this, old_slots != nullptr, migrate_pos); }
+	const_iterator end() const	{ return const_iterator(this, false, mask + 1); }
+
+	static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+	// Number of old buckets moved over per mutating operation
+	// while a resize is in progress.
+	static constexpr size_t MIGRATE_STEP = 8;
+
+private:
+	struct Slot {
+		hash_t hash;	// zero marks an empty slot
+		Connection* conn;
+	};
+
+	static void Allocate(size_t capacity, Slot** slots, ConnIDKey** keys);
+
+	static ptrdiff_t Find(const Slot* s, const ConnIDKey* k, size_t m,
+	                      const ConnIDKey& key, hash_t hash);
+	static void PutNew(Slot* s, ConnIDKey* k, size_t m,
+	                   const ConnIDKey& key, hash_t hash, Connection* conn);
+	static void EraseAt(Slot* s, ConnIDKey* k, size_t m, size_t pos);
+
+	void StartResize();
+	void Migrate(size_t n);
+
+	Slot* slots = nullptr;
+	ConnIDKey* keys = nullptr;
+	size_t mask = 0;
+
+	// Set while a resize is in progress. All old buckets below
+	// migrate_pos have been moved over already.
+	Slot* old_slots = nullptr;
+	ConnIDKey* old_keys = nullptr;
+	size_t old_mask = 0;
+	size_t migrate_pos = 0;
+
+	size_t num_entries = 0;
+};
+
+} // namespace detail
+} // namespace zeek
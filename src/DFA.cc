@@ -3,6 +3,12 @@
 #include "zeek/zeek-config.h"
 
 #include "zeek/DFA.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "zeek/3rdparty/doctest.h"
+
 #include "zeek/EquivClass.h"
 #include "zeek/Desc.h"
 #include "zeek/Hash.h"
@@ -29,6 +35,21 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 		xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
 	}
 
+DFA_State::DFA_State(int arg_state_num, int arg_num_sym, AcceptingSet* arg_accept)
+	{
+	state_num = arg_state_num;
+	num_sym = arg_num_sym;
+	nfa_states = nullptr;
+	accept = arg_accept;
+	meta_ec = nullptr;
+	mark = nullptr;
+
+	xtions = new DFA_State*[num_sym];
+
+	for ( int i = 0; i < num_sym; ++i )
+		xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
+	}
+
 DFA_State::~DFA_State()
 	{
 	delete [] xtions;
@@ -77,6 +98,9 @@ void DFA_State::SymPartition(const EquivClass* ec)
 
 DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	{
+	// Precompiled states come with all of their transitions.
+	assert(meta_ec);
+
 	int equiv_sym = meta_ec->EquivRep(sym);
 	if ( xtions[equiv_sym] != DFA_UNCOMPUTED_STATE_PTR )
 		{
@@ -105,7 +129,10 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	if ( sym != equiv_sym )
 		AddXtion(sym, next_d);
 
-	return xtions[sym];
+	if ( machine->Cache()->OverLimit() )
+		machine->EvictStates(this, next_d);
+
+	return next_d;
 	}
 
 void DFA_State::AppendIfNew(int sym, int_list* sym_list)
@@ -292,10 +319,15 @@ unsigned int DFA_State::Size()
 
 DFA_State_Cache::DFA_State_Cache()
 	{
-	hits = misses = 0;
+	hits = misses = precompiled = evicted = 0;
 	}
 
 DFA_State_Cache::~DFA_State_Cache()
+	{
+	Clear();
+	}
+
+void DFA_State_Cache::Clear()
 	{
 	for ( auto& entry : states )
 		{
@@ -304,6 +336,10 @@ DFA_State_Cache::~DFA_State_Cache()
 		}
 
 	states.clear();
+	clock.clear();
+	clock_hand = 0;
+	mem = 0;
+	precompiled = 0;
 	}
 
 DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest)
@@ -353,10 +389,107 @@ DFA_State* DFA_State_Cache::Lookup(const NFA_state_list& nfas, DigestStr* digest
 
 DFA_State* DFA_State_Cache::Insert(DFA_State* state, DigestStr digest)
 	{
-	states.emplace(std::move(digest), state);
+	auto it = states.emplace(std::move(digest), state).first;
+
+	clock.push_back(it);
+	mem += StateMem(state);
+
 	return state;
 	}
 
+DFA_State* DFA_State_Cache::InsertPrecompiled(DFA_State* state)
+	{
+	// Precompiled states are never looked up by their NFA states, so
+	// any key that can't collide with an MD5 will do.
+	int num = state->StateNum();
+	DigestStr key(reinterpret_cast<const u_char*>(&num), sizeof(num));
+
+	++precompiled;
+	return Insert(state, std::move(key));
+	}
+
+uint64_t DFA_State_Cache::StateMem(DFA_State* s)
+	{
+	return util::pad_size(s->Size()) + padded_sizeof(*s);
+	}
+
+void DFA_State_Cache::Evict(const DFA_State* const* keep, int num_keep)
+	{
+	uint64_t target = max_mem - max_mem / 4;
+	size_t num_victims = 0;
+
+	// Two rounds at most: the first one may just clear the reference
+	// bits.
+	for ( size_t n = 0; mem > target && n < 2 * clock.size(); ++n )
+		{
+		if ( clock_hand >= clock.size() )
+			clock_hand = 0;
+
+		DFA_State* s = clock[clock_hand++]->second;
+
+		if ( s->evicted )
+			continue;
+
+		if ( s->referenced )
+			{
+			s->referenced = false;
+			continue;
+			}
+
+		// Precompiled states can't compute their transitions again,
+		// and states referenced from elsewhere (such as a matcher's
+		// current state) are in use.
+		if ( ! s->nfa_states || s->RefCnt() > 1 ||
+		     std::find(keep, keep + num_keep, s) != keep + num_keep )
+			continue;
+
+		s->evicted = true;
+		mem -= StateMem(s);
+		++num_victims;
+		}
+
+	if ( num_victims == 0 )
+		return;
+
+	// The surviving states may have transitions into evicted ones.
+	for ( const auto& it : clock )
+		{
+		DFA_State* s = it->second;
+
+		if ( s->evicted )
+			continue;
+
+		for ( int i = 0; i < s->num_sym; ++i )
+			{
+			DFA_State* x = s->xtions[i];
+
+			if ( x && x != DFA_UNCOMPUTED_STATE_PTR && x->evicted )
+				s->xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
+			}
+		}
+
+	size_t j = 0;
+
+	for ( size_t i = 0; i < clock.size(); ++i )
+		{
+		auto it = clock[i];
+
+		if ( it->second->evicted )
+			{
+			if ( i < clock_hand )
+				--clock_hand;
+
+			Unref(it->second);
+			states.erase(it);
+			}
+		else
+			clock[j++] = it;
+		}
+
+	clock.resize(j);
+	evicted += num_victims;
+	}
+
 void DFA_State_Cache::GetStats(Stats* s)
 	{
 	s->dfa_states = 0;
@@ -366,6 +499,8 @@ void DFA_State_Cache::GetStats(Stats* s)
 	s->mem = 0;
 	s->hits = hits;
 	s->misses = misses;
+	s->precompiled = precompiled;
+	s->evicted = evicted;
 
 	for ( const auto& state : states )
 		{
@@ -432,6 +567,119 @@ unsigned int DFA_Machine::MemoryAllocation() const
 		+ nfa->MemoryAllocation();
 	}
 
+void DFA_Machine::EvictStates(DFA_State* current, DFA_State* next)
+	{
+	const DFA_State* keep[] = { start_state, current, next };
+	dfa_state_cache->Evict(keep, 3);
+	}
+
+bool DFA_Machine::Export(int max_states, std::vector<int32_t>* xtions,
+			std::vector<uint32_t>* accept_index,
+			std::vector<int32_t>* accepts)
+	{
+	// Evicting states while we're collecting them would leave us with
+	// dangling pointers.
+	uint64_t max_mem = dfa_state_cache->MaxMem();
+	dfa_state_cache->SetMaxMem(0);
+
+	bool complete = ExportStates(max_states, xtions, accept_index, accepts);
+
+	dfa_state_cache->SetMaxMem(max_mem);
+	return complete;
+	}
+
+bool DFA_Machine::ExportStates(int max_states, std::vector<int32_t>* xtions,
+			std::vector<uint32_t>* accept_index,
+			std::vector<int32_t>* accepts)
+	{
+	int num_sym = ec->NumClasses();
+
+	xtions->clear();
+	accept_index->clear();
+	accepts->clear();
+
+	if ( ! start_state )
+		return false;
+
+	// Breadth-first, numbering the states in the order we reach them.
+	std::vector<DFA_State*> states;
+	std::unordered_map<DFA_State*, int32_t> index;
+
+	states.push_back(start_state);
+	index[start_state] = 0;
+
+	for ( size_t i = 0; i < states.size(); ++i )
+		{
+		DFA_State* d = states[i];
+
+		for ( int sym = 0; sym < num_sym; ++sym )
+			{
+			DFA_State* next = d->Xtion(sym, this);
+
+			if ( ! next )
+				{
+				xtions->push_back(-1);
+				continue;
+				}
+
+			auto [it, inserted] = index.emplace(next, states.size());
+
+			if ( inserted )
+				{
+				if ( static_cast<int>(states.size()) >= max_states )
+					return false;
+
+				states.push_back(next);
+				}
+
+			xtions->push_back(it->second);
+			}
+
+		accept_index->push_back(accepts->size());
+
+		if ( d->Accept() )
+			accepts->insert(accepts->end(), d->Accept()->begin(), d->Accept()->end());
+		}
+
+	accept_index->push_back(accepts->size());
+	return true;
+	}
+
+void DFA_Machine::Import(int num_states, const int32_t* xtions,
+			const uint32_t* accept_index, const int32_t* accepts)
+	{
+	int num_sym = ec->NumClasses();
+
+	dfa_state_cache->Clear();
+
+	std::vector<DFA_State*> states;
+	states.reserve(num_states);
+
+	for ( int i = 0; i < num_states; ++i )
+		{
+		AcceptingSet* accept = nullptr;
+
+		if ( accept_index[i] < accept_index[i + 1] )
+			accept = new AcceptingSet(accepts + accept_index[i],
+			                          accepts + accept_index[i + 1]);
+
+		states.push_back(new DFA_State(i, num_sym, accept));
+		}
+
+	for ( int i = 0; i < num_states; ++i )
+		{
+		const int32_t* row = xtions + static_cast<size_t>(i) * num_sym;
+
+		for ( int sym = 0; sym < num_sym; ++sym )
+			states[i]->AddXtion(sym, row[sym] < 0 ? nullptr : states[row[sym]]);
+
+		dfa_state_cache->InsertPrecompiled(states[i]);
+		}
+
+	start_state = num_states > 0 ? states[0] : nullptr;
+	state_count = num_states;
+	}
+
 bool DFA_Machine::StateSetToDFA_State(NFA_state_list* state_set,
 				DFA_State*& d, const EquivClass* ec)
 	{
@@ -472,4 +720,68 @@ int DFA_Machine::Rep(int sym)
 	return -1;
 	}
 
+TEST_SUITE_BEGIN("DFA");
+
+TEST_CASE("dfa state cache eviction")
+	{
+	// The DFA for this has a state for each combination of the last
+	// ten bytes being an 'a' or not.
+	string_list exprs;
+	int_list ids;
+	exprs.push_back(util::copy_string(".*a[ab]{9}c"));
+	ids.push_back(1);
+	exprs.push_back(util::copy_string(".*b[ab]{4}c"));
+	ids.push_back(2);
+
+	Specific_RE_Matcher unbounded(MATCH_EXACTLY, 1);
+	Specific_RE_Matcher bounded(MATCH_EXACTLY, 1);
+	REQUIRE(unbounded.CompileSet(exprs, ids));
+	REQUIRE(bounded.CompileSet(exprs, ids));
+
+	const uint64_t max_mem = 64 * 1024;
+	bounded.DFA()->Cache()->SetMaxMem(max_mem);
+
+	RE_Match_State unbounded_state(&unbounded);
+	RE_Match_State bounded_state(&bounded);
+
+	uint32_t rnd = 1;
+	u_char buf[1000];
+
+	for ( int round = 0; round < 50; ++round )
+		{
+		for ( auto& c : buf )
+			{
+			rnd = rnd * 1103515245 + 12345;
+			int r = (rnd >> 16) % 100;
+			c = r < 49 ? 'a' : (r < 98 ? 'b' : 'c');
+			}
+
+		bool new_unbounded = unbounded_state.Match(buf, sizeof(buf), round == 0, false, false);
+		bool new_bounded = bounded_state.Match(buf, sizeof(buf), round == 0, false, false);
+		CHECK(new_unbounded == new_bounded);
+		CHECK(unbounded_state.AcceptedMatches() == bounded_state.AcceptedMatches());
+		}
+
+	DFA_State_Cache::Stats stats;
+	bounded.DFA()->Cache()->GetStats(&stats);
+	CHECK(stats.evicted > 0);
+	CHECK(stats.mem <= max_mem);
+
+	unbounded.DFA()->Cache()->GetStats(&stats);
+	CHECK(stats.evicted == 0);
+	CHECK(stats.mem > max_mem);
+
+	// Starting over works with whatever states are left.
+	const u_char* input = reinterpret_cast<const u_char*>("aababbababc");
+	bounded_state.Clear();
+	CHECK(bounded_state.Match(input, 11, true, true, false));
+	CHECK(bounded_state.AcceptedMatches().count(1) == 1);
+	CHECK(bounded_state.AcceptedMatches().count(2) == 1);
+
+	for ( auto e : exprs )
+		delete [] e;
+	}
+
+TEST_SUITE_END();
+
 } // namespace zeek::detail
@@ -5,8 +5,10 @@
 
 #include <assert.h>
 #include <sys/types.h> // for u_char
+#include <stdint.h>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "zeek/NFA.h"
 #include "zeek/RE.h" // for typedef AcceptingSet
@@ -26,10 +28,16 @@ class DFA_State : public Obj {
 public:
 	DFA_State(int state_num, const EquivClass* ec,
 			NFA_state_list* nfa_states, AcceptingSet* accept);
+
+	// A state loaded from a precompiled DFA (see DFA_Machine::Import()).
+	// It has no NFA states to compute transitions from, so all of them
+	// need to be added right away.
+	DFA_State(int state_num, int num_sym, AcceptingSet* accept);
+
 	~DFA_State() override;
 
 	int StateNum() const		{ return state_num; }
-	int NFAStateNum() const		{ return nfa_states->length(); }
+	int NFAStateNum() const		{ return nfa_states ? nfa_states->length() : 0; }
 	void AddXtion(int sym, DFA_State* next_state);
 
 	inline DFA_State* Xtion(int sym, DFA_Machine* machine);
@@ -54,6 +62,7 @@ public:
 
 protected:
 	friend class DFA_State_Cache;
+	friend class DFA_Machine;
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
@@ -68,6 +77,11 @@ protected:
 	EquivClass* meta_ec;	// which ec's make same transition
 	DFA_State* mark;
 
+	// For the cache's eviction: whether the state has been used since
+	// the cache last looked, and whether it's on its way out.
+	bool referenced = true;
+	bool evicted = false;
+
 	static unsigned int transition_counter;	// see Xtion()
 };
 
@@ -84,8 +98,27 @@ public:
 	// Takes ownership of state; digest is the one returned by Lookup().
 	DFA_State* Insert(DFA_State* state, DigestStr digest);
 
+	// Takes ownership of a state loaded from a precompiled DFA.
+	DFA_State* InsertPrecompiled(DFA_State* state);
+
+	// Removes (and unrefs) all states.
+	void Clear();
+
 	int NumEntries() const	{ return states.size(); }
 
+	// Limits the memory that the states may take up; 0 means no limit.
+	// Once it's exceeded, states that haven't been used recently are
+	// evicted, down to 3/4 of the limit.
+	void SetMaxMem(uint64_t arg_max_mem)	{ max_mem = arg_max_mem; }
+	uint64_t MaxMem() const	{ return max_mem; }
+
+	bool OverLimit() const	{ return max_mem && mem > max_mem; }
+
+	// Evicts states as described for SetMaxMem(), apart from the ones
+	// in keep and the ones referenced from elsewhere. Transitions into
+	// evicted states are reset to be computed again.
+	void Evict(const DFA_State* const* keep, int num_keep);
+
 	struct Stats {
 		// Sum of all NFA states
 		unsigned int nfa_states;
@@ -95,16 +128,32 @@ public:
 		unsigned int mem;
 		unsigned int hits;
 		unsigned int misses;
+		unsigned int precompiled;
+		unsigned int evicted;
 	};
 
 	void GetStats(Stats* s);
 
 private:
+	using StateMap = std::map<DigestStr, DFA_State*>;
+
+	static uint64_t StateMem(DFA_State* s);
+
 	int hits;	// Statistics
 	int misses;
+	int precompiled;
+	int evicted;
 
 	// Hash indexed by NFA states (MD5s of them, actually).
-	std::map<DigestStr, DFA_State*> states;
+	StateMap states;
+
+	// The states in the order they're visited for eviction (CLOCK),
+	// and the next one to visit.
+	std::vector<StateMap::iterator> clock;
+	size_t clock_hand = 0;
+
+	uint64_t mem = 0;
+	uint64_t max_mem = 0;
 };
 
 class DFA_Machine : public Obj {
@@ -125,10 +174,34 @@ public:
 
 	unsigned int MemoryAllocation() const;
 
+	// Computes all states of the DFA and their transitions, and stores
+	// them in tables: for each state, the index of the next state for
+	// each equivalence class (-1 for jamming), and the range of the
+	// accepts array with the state's accepted patterns. The start state
+	// gets index 0. Returns false if there are more than max_states
+	// states, in which case the tables are left incomplete.
+	bool Export(int max_states, std::vector<int32_t>* xtions,
+			std::vector<uint32_t>* accept_index,
+			std::vector<int32_t>* accepts);
+
+	// Replaces the DFA's states with ones loaded from tables produced by
+	// Export() for the same NFA and equivalence classes. The tables
+	// must be consistent; they're not checked here.
+	void Import(int num_states, const int32_t* xtions,
+			const uint32_t* accept_index, const int32_t* accepts);
+
 protected:
 	friend class DFA_State;	// for DFA_State::ComputeXtion
 	friend class DFA_State_Cache;
 
+	bool ExportStates(int max_states, std::vector<int32_t>* xtions,
+			std::vector<uint32_t>* accept_index,
+			std::vector<int32_t>* accepts);
+
+	// Called with the state whose transition has just been computed
+	// and the one it leads to, which must both stay.
+	void EvictStates(DFA_State* current, DFA_State* next);
+
 	int state_count;
 
 	// The state list has to be sorted according to IDs.
@@ -145,6 +218,8 @@ protected:
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
 	{
+	referenced = true;
+
 	if ( xtions[sym] == DFA_UNCOMPUTED_STATE_PTR )
 		return ComputeXtion(sym, machine);
 	else
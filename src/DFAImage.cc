@@ -0,0 +1,369 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/DFAImage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zeek/3rdparty/doctest.h"
+
+#include "zeek/DFA.h"
+#include "zeek/EquivClass.h"
+#include "zeek/RE.h"
+#include "zeek/digest.h"
+
+namespace zeek::detail {
+
+constexpr char DFA_Image::MAGIC[8];
+
+// Tables start at multiples of this.
+static constexpr uint64_t TABLE_ALIGN = 8;
+
+static uint64_t align_table(uint64_t n)
+	{
+	return (n + TABLE_ALIGN - 1) & ~(TABLE_ALIGN - 1);
+	}
+
+DFA_Image::~DFA_Image()
+	{
+	if ( data )
+		munmap(const_cast<u_char*>(data), size);
+	}
+
+DFA_Image::Key DFA_Image::SetKey(const string_list& exprs, const int_list& ids)
+	{
+	EVP_MD_CTX* ctx = hash_init(Hash_MD5);
+
+	loop_over_list(exprs, i)
+		{
+		// Including the terminating null, to separate them.
+		hash_update(ctx, exprs[i], strlen(exprs[i]) + 1);
+
+		int32_t id = ids[i];
+		hash_update(ctx, &id, sizeof(id));
+		}
+
+	Key key;
+	hash_final(ctx, key.data());
+	return key;
+	}
+
+uint64_t DFA_Image::TableSize(const SetEntry& e)
+	{
+	return (NUM_SYM + uint64_t(e.num_states) * e.num_sym +
+	        (e.num_states + 1) + e.num_accepts) * sizeof(int32_t);
+	}
+
+bool DFA_Image::Open(const char* file, const Key& key, std::string* error)
+	{
+	int fd = open(file, O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		*error = util::fmt("can't open %s: %s", file, strerror(errno));
+		return false;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 )
+		{
+		*error = util::fmt("can't stat %s: %s", file, strerror(errno));
+		close(fd);
+		return false;
+		}
+
+	if ( static_cast<size_t>(st.st_size) < sizeof(Header) )
+		{
+		*error = util::fmt("%s is not a signature DFA file", file);
+		close(fd);
+		return false;
+		}
+
+	void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( p == MAP_FAILED )
+		{
+		*error = util::fmt("can't map %s: %s", file, strerror(errno));
+		return false;
+		}
+
+	data = static_cast<const u_char*>(p);
+	size = st.st_size;
+
+	const Header* hdr = reinterpret_cast<const Header*>(data);
+
+	if ( memcmp(hdr->magic, MAGIC, sizeof(MAGIC)) != 0 || hdr->version != FORMAT_VERSION )
+		{
+		*error = util::fmt("%s is not a signature DFA file of this version", file);
+		return false;
+		}
+
+	if ( hdr->key != key )
+		{
+		*error = util::fmt("%s has been built for different signatures", file);
+		return false;
+		}
+
+	if ( (size - sizeof(Header)) / sizeof(SetEntry) < hdr->num_sets )
+		{
+		*error = util::fmt("%s is truncated", file);
+		return false;
+		}
+
+	const SetEntry* entries = reinterpret_cast<const SetEntry*>(data + sizeof(Header));
+
+	for ( uint32_t i = 0; i < hdr->num_sets; ++i )
+		{
+		const SetEntry& e = entries[i];
+
+		if ( e.offset % TABLE_ALIGN || e.offset > size ||
+		     TableSize(e) > size - e.offset )
+			{
+			*error = util::fmt("%s is truncated", file);
+			sets.clear();
+			return false;
+			}
+
+		sets[e.key] = &e;
+		}
+
+	return true;
+	}
+
+int DFA_Image::Load(const Key& key, Specific_RE_Matcher* re) const
+	{
+	auto it = sets.find(key);
+
+	if ( it == sets.end() )
+		return 0;
+
+	const SetEntry& e = *it->second;
+	const int32_t* ecs = reinterpret_cast<const int32_t*>(data + e.offset);
+	const int32_t* xtions = ecs + NUM_SYM;
+	const uint32_t* accept_index = reinterpret_cast<const uint32_t*>(
+		xtions + uint64_t(e.num_states) * e.num_sym);
+	const int32_t* accepts = reinterpret_cast<const int32_t*>(
+		accept_index + e.num_states + 1);
+
+	// The equivalence classes follow from the patterns, so they should
+	// be the same. If they aren't, the DFA wouldn't fit.
+	EquivClass* ec = re->EC();
+
+	if ( e.num_states == 0 || e.num_sym != static_cast<uint32_t>(ec->NumClasses()) ||
+	     memcmp(ecs, ec->EquivClasses(), NUM_SYM * sizeof(int32_t)) != 0 )
+		return 0;
+
+	for ( uint64_t i = 0; i < uint64_t(e.num_states) * e.num_sym; ++i )
+		if ( xtions[i] < -1 || xtions[i] >= static_cast<int64_t>(e.num_states) )
+			return 0;
+
+	for ( uint32_t i = 0; i < e.num_states; ++i )
+		if ( accept_index[i] > accept_index[i + 1] )
+			return 0;
+
+	if ( accept_index[e.num_states] != e.num_accepts )
+		return 0;
+
+	re->DFA()->Import(e.num_states, xtions, accept_index, accepts);
+	return e.num_states;
+	}
+
+bool DFA_ImageWriter::Add(const DFA_Image::Key& key, Specific_RE_Matcher* re, int max_states)
+	{
+	Set s;
+	s.key = key;
+	s.num_sym = re->EC()->NumClasses();
+
+	const int* ecs = re->EC()->EquivClasses();
+	s.ecs.assign(ecs, ecs + NUM_SYM);
+
+	if ( ! re->DFA()->Export(max_states, &s.xtions, &s.accept_index, &s.accepts) )
+		return false;
+
+	num_states += s.accept_index.size() - 1;
+	sets.push_back(std::move(s));
+	return true;
+	}
+
+bool DFA_ImageWriter::Write(const char* file, const DFA_Image::Key& key, std::string* error) const
+	{
+	DFA_Image::Header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DFA_Image::MAGIC, sizeof(hdr.magic));
+	hdr.version = DFA_Image::FORMAT_VERSION;
+	hdr.num_sets = sets.size();
+	hdr.key = key;
+
+	std::vector<DFA_Image::SetEntry> entries;
+	uint64_t offset = align_table(sizeof(hdr) + sets.size() * sizeof(DFA_Image::SetEntry));
+
+	for ( const auto& s : sets )
+		{
+		DFA_Image::SetEntry e;
+		memset(&e, 0, sizeof(e));
+		e.key = s.key;
+		e.offset = offset;
+		e.num_sym = s.num_sym;
+		e.num_states = s.accept_index.size() - 1;
+		e.num_accepts = s.accepts.size();
+		entries.push_back(e);
+
+		offset = align_table(offset + DFA_Image::TableSize(e));
+		}
+
+	// Write to a temporary file first, so that a process reading the
+	// file at the same time never sees a partial one.
+	std::string tmp = util::fmt("%s.tmp", file);
+	FILE* f = fopen(tmp.c_str(), "wb");
+
+	if ( ! f )
+		{
+		*error = util::fmt("can't open %s: %s", tmp.c_str(), strerror(errno));
+		return false;
+		}
+
+	static const char padding[TABLE_ALIGN] = { 0 };
+	uint64_t written = 0;
+
+	auto write = [&](const void* p, size_t n)
+		{
+		written += n;
+		return fwrite(p, 1, n, f) == n;
+		};
+
+	auto pad = [&]()
+		{
+		return write(padding, align_table(written) - written);
+		};
+
+	bool ok = write(&hdr, sizeof(hdr)) &&
+	          write(entries.data(), entries.size() * sizeof(DFA_Image::SetEntry)) &&
+	          pad();
+
+	for ( const auto& s : sets )
+		{
+		if ( ! ok )
+			break;
+
+		ok = write(s.ecs.data(), s.ecs.size() * sizeof(int32_t)) &&
+		     write(s.xtions.data(), s.xtions.size() * sizeof(int32_t)) &&
+		     write(s.accept_index.data(), s.accept_index.size() * sizeof(uint32_t)) &&
+		     write(s.accepts.data(), s.accepts.size() * sizeof(int32_t)) &&
+		     pad();
+		}
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), file) < 0 )
+		{
+		*error = util::fmt("can't write %s: %s", file, strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+TEST_SUITE_BEGIN("DFAImage");
+
+static Specific_RE_Matcher* compile_test_set(const string_list& exprs, const int_list& ids)
+	{
+	auto re = new Specific_RE_Matcher(MATCH_EXACTLY, 1);
+	re->CompileSet(exprs, ids);
+	return re;
+	}
+
+static std::string match_test_input(Specific_RE_Matcher* re, const char* input)
+	{
+	RE_Match_State state(re);
+	state.Match(reinterpret_cast<const u_char*>(input), strlen(input), true, true, false);
+
+	std::string result;
+
+	for ( const auto& [idx, pos] : state.AcceptedMatches() )
+		result += util::fmt("%d@%d ", idx, static_cast<int>(pos));
+
+	return result;
+	}
+
+TEST_CASE("dfa image round trip")
+	{
+	string_list exprs;
+	int_list ids;
+	exprs.push_back(util::copy_string(".*GET /[a-z]+"));
+	ids.push_back(1);
+	exprs.push_back(util::copy_string("(?i:.*user-agent:)"));
+	ids.push_back(2);
+	exprs.push_back(util::copy_string("\\x7fELF"));
+	ids.push_back(3);
+
+	auto key = DFA_Image::SetKey(exprs, ids);
+	DFA_Image::Key file_key = key;
+	file_key[0] ^= 1;
+
+	auto lazy = compile_test_set(exprs, ids);
+	auto eager = compile_test_set(exprs, ids);
+
+	DFA_ImageWriter writer;
+	CHECK(! writer.Add(key, eager, 2));
+	CHECK(writer.Add(key, eager, 1000));
+	CHECK(writer.NumSets() == 1);
+
+	char file[] = "/tmp/zeek-dfa-test-XXXXXX";
+	int fd = mkstemp(file);
+	REQUIRE(fd >= 0);
+	close(fd);
+
+	std::string error;
+	REQUIRE(writer.Write(file, file_key, &error));
+
+	DFA_Image wrong;
+	DFA_Image::Key other_key = file_key;
+	other_key[1] ^= 1;
+	CHECK(! wrong.Open(file, other_key, &error));
+
+	DFA_Image image;
+	REQUIRE(image.Open(file, file_key, &error));
+	CHECK(image.NumSets() == 1);
+	CHECK(image.Load(other_key, lazy) == 0);
+
+	auto loaded = compile_test_set(exprs, ids);
+	int n = image.Load(key, loaded);
+	CHECK(n == static_cast<int>(writer.NumStates()));
+
+	DFA_State_Cache::Stats stats;
+	loaded->DFA()->Cache()->GetStats(&stats);
+	CHECK(stats.precompiled == static_cast<unsigned int>(n));
+	CHECK(stats.dfa_states == static_cast<unsigned int>(n));
+
+	const char* inputs[] = {
+		"GET /index.html HTTP/1.1\r\nUser-Agent: x\r\n",
+		"\x7f" "ELF\x02\x01",
+		"POST / HTTP/1.0\r\nUSER-AGENT: y",
+		"",
+	};
+
+	for ( auto input : inputs )
+		CHECK(match_test_input(loaded, input) == match_test_input(lazy, input));
+
+	unlink(file);
+	delete lazy;
+	delete eager;
+	delete loaded;
+
+	for ( auto e : exprs )
+		delete [] e;
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
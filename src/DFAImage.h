@@ -0,0 +1,154 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "zeek/RE.h"
+
+namespace zeek::detail {
+
+/**
+ * A file holding fully computed DFAs of signature pattern sets, so that
+ * they don't need to be built up state by state while matching.
+ *
+ * The file starts with a key identifying the signatures it was built
+ * from, followed by a directory of the pattern sets, each identified by a
+ * key of its own (see SetKey()). For each set, it holds the equivalence
+ * classes, a table of transitions indexed by state and equivalence class,
+ * and the patterns that each state accepts (see DFA_Machine::Export()).
+ * The tables are laid out such that they can be used right from a
+ * memory-mapped file. All values are in host byte order; a file written
+ * on a machine with a different one is rejected as invalid.
+ */
+class DFA_Image {
+public:
+	using Key = std::array<u_char, 16>;
+
+	static constexpr uint32_t FORMAT_VERSION = 1;
+
+	DFA_Image() = default;
+	~DFA_Image();
+
+	DFA_Image(const DFA_Image&) = delete;
+	DFA_Image& operator=(const DFA_Image&) = delete;
+
+	/**
+	 * Computes the key identifying a pattern set compiled with
+	 * Specific_RE_Matcher::CompileSet().
+	 */
+	static Key SetKey(const string_list& exprs, const int_list& ids);
+
+	/**
+	 * Maps a file into memory.
+	 *
+	 * @param file The name of the file.
+	 *
+	 * @param key The key that the file must have been written with.
+	 *
+	 * @param error Set to a description of the problem on failure.
+	 *
+	 * @return False if the file can't be read, isn't valid, or has a
+	 * different key.
+	 */
+	bool Open(const char* file, const Key& key, std::string* error);
+
+	/**
+	 * Replaces the DFA of a matcher with the precompiled one for its
+	 * pattern set, if the file has one.
+	 *
+	 * @param key The set's key, as returned by SetKey().
+	 *
+	 * @param re A matcher that the set has been compiled into.
+	 *
+	 * @return The number of states loaded, or 0 if the file has no (or
+	 * no usable) DFA for the set.
+	 */
+	int Load(const Key& key, Specific_RE_Matcher* re) const;
+
+	size_t NumSets() const	{ return sets.size(); }
+
+private:
+	friend class DFA_ImageWriter;
+
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t num_sets;
+		Key key;
+	};
+
+	struct SetEntry {
+		Key key;
+		uint64_t offset;
+		uint32_t num_sym;
+		uint32_t num_states;
+		uint32_t num_accepts;
+		uint32_t reserved;
+	};
+
+	static constexpr char MAGIC[8] = "ZEEKDFA";
+
+	// Returns the size of the tables of a set.
+	static uint64_t TableSize(const SetEntry& e);
+
+	const u_char* data = nullptr;
+	size_t size = 0;
+	std::map<Key, const SetEntry*> sets;
+};
+
+/**
+ * Collects the DFAs of pattern sets and writes them to a file in the
+ * format read by DFA_Image.
+ */
+class DFA_ImageWriter {
+public:
+	/**
+	 * Computes the full DFA of a matcher and adds it.
+	 *
+	 * @param key The key of the matcher's pattern set, as returned by
+	 * DFA_Image::SetKey().
+	 *
+	 * @param re A matcher that the set has been compiled into.
+	 *
+	 * @param max_states The maximum number of states. Larger DFAs are
+	 * left out, and will be built up as needed instead.
+	 *
+	 * @return False if the DFA has been left out.
+	 */
+	bool Add(const DFA_Image::Key& key, Specific_RE_Matcher* re, int max_states);
+
+	/**
+	 * Writes the DFAs added so far to a file.
+	 *
+	 * @param key The key to identify the file's signatures with.
+	 *
+	 * @param error Set to a description of the problem on failure.
+	 */
+	bool Write(const char* file, const DFA_Image::Key& key, std::string* error) const;
+
+	size_t NumSets() const	{ return sets.size(); }
+	size_t NumStates() const	{ return num_states; }
+
+private:
+	struct Set {
+		DFA_Image::Key key;
+		uint32_t num_sym;
+		std::vector<int32_t> ecs;
+		std::vector<int32_t> xtions;
+		std::vector<uint32_t> accept_index;
+		std::vector<int32_t> accepts;
+	};
+
+	std::vector<Set> sets;
+	size_t num_states = 0;
+};
+
+} // namespace zeek::detail
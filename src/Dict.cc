@@ -530,6 +530,90 @@ TEST_CASE("dict iterator invalidation")
 	delete key3;
 	}
 
+TEST_CASE("dict inline keys and batch lookup")
+	{
+	PDict<uint32_t> dict;
+	const int n = 2000;
+	std::vector<uint32_t> vals(n);
+	std::vector<std::unique_ptr<detail::HashKey>> keys;
+
+	// Alternate between 8-byte keys, which get stored inline, and
+	// 20-byte ones, which don't.
+	for ( int i = 0; i < n; i++ )
+		{
+		uint32_t k[5] = { static_cast<uint32_t>(i), 0xdeadbeef, 0, static_cast<uint32_t>(i) * 7, 0 };
+		keys.emplace_back(new detail::HashKey(static_cast<const void*>(k), i % 2 ? 8 : 20));
+		vals[i] = i;
+		}
+
+	for ( int i = 0; i < n; i += 2 )
+		dict.Insert(keys[i].get(), &vals[i]);
+
+	CHECK(dict.Length() == n / 2);
+
+	std::vector<const detail::HashKey*> key_ptrs;
+	for ( const auto& k : keys )
+		key_ptrs.push_back(k.get());
+
+	std::vector<uint32_t*> results(n);
+	dict.Lookup(n, key_ptrs.data(), results.data());
+
+	int mismatches = 0;
+	for ( int i = 0; i < n; i++ )
+		{
+		if ( results[i] != (i % 2 ? nullptr : &vals[i]) )
+			++mismatches;
+
+		if ( results[i] != dict.Lookup(keys[i].get()) )
+			++mismatches;
+		}
+
+	CHECK(mismatches == 0);
+
+	for ( int i = 0; i < n; i += 4 )
+		dict.Remove(keys[i].get());
+
+	dict.Lookup(n, key_ptrs.data(), results.data());
+
+	mismatches = 0;
+	for ( int i = 0; i < n; i++ )
+		if ( results[i] != (i % 4 == 2 ? &vals[i] : nullptr) )
+			++mismatches;
+
+	CHECK(mismatches == 0);
+	CHECK(dict.Length() == n / 4);
+	}
+
+TEST_CASE("dict probing within clusters")
+	{
+	Dictionary dict;
+	const int n = 512;
+	std::vector<uint32_t> vals(n);
+
+	// Keys with the same size and hash differ only in their bytes, so
+	// every probe sees a long run of matching headers.
+	for ( int i = 0; i < n; i++ )
+		{
+		vals[i] = i;
+		uint32_t k = i;
+		dict.Insert(&k, sizeof(k), i % 3, &vals[i], true);
+		}
+
+	CHECK(dict.Length() == n);
+
+	int mismatches = 0;
+	for ( int i = 0; i < n; i++ )
+		{
+		uint32_t k = i;
+		if ( dict.Lookup(&k, sizeof(k), i % 3) != &vals[i] )
+			++mismatches;
+		if ( dict.Lookup(&k, sizeof(k), (i + 1) % 3) )
+			++mismatches;
+		}
+
+	CHECK(mismatches == 0);
+	}
+
 TEST_SUITE_END();
 
 /////////////////////////////////////////////////////////////////////////////////////////////////
@@ -732,7 +816,7 @@ size_t Dictionary::MemoryAllocation() const
 		{
 		size += zeek::util::pad_size(Capacity() * sizeof(detail::DictEntry));
 		for ( int i = Capacity()-1; i>=0; i-- )
-			if ( ! table[i].Empty() && table[i].key_size > 8 )
+			if ( ! table[i].Empty() && ! table[i].KeyIsInline() )
 				size += zeek::util::pad_size(table[i].key_size);
 		}
 
@@ -948,6 +1032,22 @@ void* Dictionary::Lookup(const void* key, int key_size, detail::hash_t h) const
 	return position >= 0 ? table[position].value : nullptr;
 	}
 
+void Dictionary::Lookup(int n, const detail::HashKey* const* keys, void** vals) const
+	{
+	int ahead = std::min(n, static_cast<int>(detail::DICT_PREFETCH_AHEAD));
+
+	for ( int i = 0; i < ahead; i++ )
+		Prefetch(keys[i]->Hash());
+
+	for ( int i = 0; i < n; i++ )
+		{
+		if ( i + ahead < n )
+			Prefetch(keys[i + ahead]->Hash());
+
+		vals[i] = Lookup(keys[i]);
+		}
+	}
+
 //for verification purposes
 int Dictionary::LinearLookupIndex(const void* key, int key_size, detail::hash_t hash) const
 	{
@@ -1017,9 +1117,12 @@ int Dictionary::LookupIndex(const void* key, int key_size, detail::hash_t hash,
                             int* insert_position/*output*/, int* insert_distance/*output*/)
 	{
 	ASSERT(bucket>=0 && bucket < Buckets());
+	uint64_t header = detail::DictEntry::MakeHeader(0, key_size, hash);
+	bool match;
 	int i = bucket;
-	for ( ; i < end && ! table[i].Empty() && BucketByPosition(i) <= bucket; i++ )
-		if ( BucketByPosition(i) == bucket && table[i].Equal((char*)key, key_size, hash) )
+
+	for ( ; (i = Probe(bucket, i, end, header, &match)), match; i++ )
+		if ( memcmp(table[i].GetKey(), key, key_size) == 0 )
 			return i;
 
 	//no such cluster, or not found in the cluster.
@@ -1032,6 +1135,33 @@ int Dictionary::LookupIndex(const void* key, int key_size, detail::hash_t hash,
 	return -1;
 	}
 
+// The entries of a bucket's cluster are contiguous and an entry at position i belongs
+// to the bucket iff its distance is i - bucket. Since the distance is part of an entry's
+// header, comparing the header against the expected one checks bucket, key size and hash
+// in one go. The cluster ends at the first entry that is empty or whose distance is
+// smaller than expected.
+int Dictionary::Probe(int bucket, int position, int end, uint64_t header, bool* match) const
+	{
+	int i = position;
+
+	for ( ; i < end; i++ )
+		{
+		const detail::DictEntry& e = table[i];
+
+		if ( e.Empty() || BucketByPosition(i) > bucket )
+			break;
+
+		if ( e.Header() == header + (i - bucket) )
+			{
+			*match = true;
+			return i;
+			}
+		}
+
+	*match = false;
+	return i;
+	}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Insert
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -51,6 +51,14 @@ constexpr uint8_t DICT_THRESHOLD_BITS = 3;
 // bucket at which to start looking for the next value to return.
 constexpr uint16_t TOO_FAR_TO_REACH = 0xFFFF;
 
+// Keys up to this size are stored directly in the entry, in the space the
+// pointer to a longer key takes otherwise.
+constexpr int DICT_INLINE_KEY_SIZE = 8;
+
+// Number of lookups that Dictionary::Lookup() prefetches ahead when given
+// a batch of keys.
+constexpr int DICT_PREFETCH_AHEAD = 8;
+
 /**
  * An entry stored in the dictionary.
  */
@@ -64,8 +72,8 @@ public:
 	// Distance from the expected position in the table. 0xFFFF means that the entry is empty.
 	uint16_t distance = TOO_FAR_TO_REACH;
 
-	// The size of the key. Less than 8 bytes we'll store directly in the entry, otherwise we'll
-	// store it as a pointer. This avoids extra allocations if we can help it.
+	// The size of the key. Up to DICT_INLINE_KEY_SIZE bytes we'll store directly in the entry,
+	// otherwise we'll store it as a pointer. This avoids extra allocations if we can help it.
 	uint16_t key_size = 0;
 
 	// Lower 4 bytes of the 8-byte hash, which is used to calculate the position in the table.
@@ -73,7 +81,7 @@ public:
 
 	void* value = nullptr;
 	union {
-		char key_here[8]; //hold key len<=8. when over 8, it's a pointer to real keys.
+		char key_here[DICT_INLINE_KEY_SIZE]; //hold short keys. when longer, it's a pointer to real keys.
 		char* key;
 	};
 
@@ -84,7 +92,7 @@ public:
 		if ( ! arg_key )
 			return;
 
-		if ( key_size <= 8 )
+		if ( key_size <= DICT_INLINE_KEY_SIZE )
 			{
 			memcpy(key_here, arg_key, key_size);
 			if ( ! copy_key )
@@ -120,12 +128,13 @@ public:
 
 	void Clear()
 		{
-		if( key_size > 8 )
+		if( key_size > DICT_INLINE_KEY_SIZE )
 			delete [] key;
 		SetEmpty();
 		}
 
-	const char* GetKey() const { return key_size <= 8 ? key_here : key; }
+	bool KeyIsInline() const { return key_size <= DICT_INLINE_KEY_SIZE; }
+	const char* GetKey() const { return KeyIsInline() ? key_here : key; }
 	std::unique_ptr<detail::HashKey> GetHashKey() const
 		{
 		return std::make_unique<detail::HashKey>(GetKey(), key_size, hash);
@@ -134,6 +143,12 @@ public:
 	template <typename T>
 	T GetValue() const { return static_cast<T>(value); }
 
+	// Distance, key size and hash packed into one word, so that probing
+	// can check all of them with a single comparison.
+	static uint64_t MakeHeader(uint16_t distance, uint16_t key_size, uint32_t hash)
+		{ return uint64_t(distance) | (uint64_t(key_size) << 16) | (uint64_t(hash) << 32); }
+	uint64_t Header() const { return MakeHeader(distance, key_size, hash); }
+
 	bool Equal(const char* arg_key, int arg_key_size, hash_t arg_hash) const
 		{//only 40-bit hash comparison.
 		return ( 0 == ((hash ^ arg_hash) & HASH_MASK) )
@@ -246,11 +261,31 @@ public:
 	void* Lookup(const detail::HashKey* key) const;
 	void* Lookup(const void* key, int key_size, detail::hash_t h) const;
 
+	// Looks up n keys at once, setting vals[i] to the value of keys[i]
+	// (or nullptr if there's none). The table positions of upcoming keys
+	// get prefetched while earlier ones are looked up, so that the cache
+	// misses of the batch overlap instead of occurring one after another.
+	void Lookup(int n, const detail::HashKey* const* keys, void** vals) const;
+
+	// Hints to the CPU that a lookup for the given hash is coming up.
+	void Prefetch(detail::hash_t h) const
+		{
+		if ( table )
+			__builtin_prefetch(&table[BucketByHash(h, log2_buckets)]);
+		}
+
 	// Returns previous value, or 0 if none.
 	// If iterators_invalidated is supplied, its value is set to true
 	// if the removal may have invalidated any existing iterators.
 	void* Insert(detail::HashKey* key, void* val, bool* iterators_invalidated = nullptr)
-		{ return Insert(key->TakeKey(), key->Size(), key->Hash(), val, false, iterators_invalidated); }
+		{
+		// Short keys get copied into the entry, so there's no need to
+		// have the HashKey hand over (and perhaps allocate) its key.
+		if ( key->Size() <= detail::DICT_INLINE_KEY_SIZE )
+			return Insert(const_cast<void*>(key->Key()), key->Size(), key->Hash(), val, true, iterators_invalidated);
+
+		return Insert(key->TakeKey(), key->Size(), key->Hash(), val, false, iterators_invalidated);
+		}
 
 	// If copy_key is true, then the key is copied, otherwise it's assumed
 	// that it's a heap pointer that now belongs to the Dictionary to
@@ -426,6 +461,12 @@ private:
 	int LookupIndex(const void* key, int key_size, detail::hash_t hash, int begin, int end,
 		int* insert_position = nullptr, int* insert_distance  = nullptr);
 
+	// Scans the cluster of the given bucket starting at position, up to end. Returns
+	// the first position holding an entry for the bucket whose key size and hash
+	// match the given header (with a distance of zero), setting *match. Otherwise
+	// returns the position just past the bucket's entries.
+	int Probe(int bucket, int position, int end, uint64_t header, bool* match) const;
+
 	/// Insert entry, Adjust cookies when necessary.
 	void InsertRelocateAndAdjust(detail::DictEntry& entry, int insert_position);
 
@@ -514,6 +555,8 @@ public:
 		}
 	T* Lookup(const detail::HashKey* key) const
 		{ return (T*) Dictionary::Lookup(key); }
+	void Lookup(int n, const detail::HashKey* const* keys, T** vals) const
+		{ Dictionary::Lookup(n, keys, reinterpret_cast<void**>(vals)); }
 	T* Insert(const char* key, T* val, bool* iterators_invalidated = nullptr)
 		{
 		detail::HashKey h(key);
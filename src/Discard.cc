@@ -24,6 +24,14 @@ Discarder::Discarder()
 	check_icmp = id::find_func("discarder_check_icmp");
 
 	discarder_maxlen = static_cast<int>(id::find_val("discarder_maxlen")->AsCount());
+
+	if ( id::find_val("discarder_native_filters")->AsBool() )
+		{
+		filter_ip = DiscardFilter::Compile(check_ip);
+		filter_tcp = DiscardFilter::Compile(check_tcp);
+		filter_udp = DiscardFilter::Compile(check_udp);
+		filter_icmp = DiscardFilter::Compile(check_icmp);
+		}
 	}
 
 Discarder::~Discarder()
@@ -39,25 +47,21 @@ bool Discarder::NextPacket(const std::unique_ptr<IP_Hdr>& ip, int len, int caple
 	{
 	bool discard_packet = false;
 
+	DiscardPacket pkt;
+	pkt.ip = ip.get();
+	pkt.proto = ip->NextProto();
+	pkt.l4 = ip->Payload();
+	pkt.l4_caplen = caplen - ip->HdrLen();
+
 	if ( check_ip )
 		{
-		zeek::Args args{ip->ToPktHdrVal()};
-
-		try
-			{
-			discard_packet = check_ip->Invoke(&args)->AsBool();
-			}
-
-		catch ( InterpreterException& e )
-			{
-			discard_packet = false;
-			}
+		discard_packet = Check(check_ip, filter_ip.get(), pkt, false);
 
 		if ( discard_packet )
 			return discard_packet;
 		}
 
-	int proto = ip->NextProto();
+	int proto = pkt.proto;
 	if ( proto != IPPROTO_TCP && proto != IPPROTO_UDP &&
 	     proto != IPPROTO_ICMP )
 		// This is not a protocol we understand.
@@ -93,20 +97,8 @@ bool Discarder::NextPacket(const std::unique_ptr<IP_Hdr>& ip, int len, int caple
 			const struct tcphdr* tp = (const struct tcphdr*) data;
 			int th_len = tp->th_off * 4;
 
-			zeek::Args args{
-				ip->ToPktHdrVal(),
-				{AdoptRef{}, BuildData(data, th_len, len, caplen)},
-			};
-
-			try
-				{
-				discard_packet = check_tcp->Invoke(&args)->AsBool();
-				}
-
-			catch ( InterpreterException& e )
-				{
-				discard_packet = false;
-				}
+			SetData(pkt, data, th_len, len, caplen);
+			discard_packet = Check(check_tcp, filter_tcp.get(), pkt, true);
 			}
 		}
 
@@ -114,58 +106,58 @@ bool Discarder::NextPacket(const std::unique_ptr<IP_Hdr>& ip, int len, int caple
 		{
 		if ( check_udp )
 			{
-			const struct udphdr* up = (const struct udphdr*) data;
 			int uh_len = sizeof (struct udphdr);
 
-			zeek::Args args{
-				ip->ToPktHdrVal(),
-				{AdoptRef{}, BuildData(data, uh_len, len, caplen)},
-			};
-
-			try
-				{
-				discard_packet = check_udp->Invoke(&args)->AsBool();
-				}
-
-			catch ( InterpreterException& e )
-				{
-				discard_packet = false;
-				}
+			SetData(pkt, data, uh_len, len, caplen);
+			discard_packet = Check(check_udp, filter_udp.get(), pkt, true);
 			}
 		}
 
 	else
 		{
 		if ( check_icmp )
-			{
-			const struct icmp* ih = (const struct icmp*) data;
+			discard_packet = Check(check_icmp, filter_icmp.get(), pkt, false);
+		}
 
-			zeek::Args args{ip->ToPktHdrVal()};
+	return discard_packet;
+	}
 
-			try
-				{
-				discard_packet = check_icmp->Invoke(&args)->AsBool();
-				}
+bool Discarder::Check(const FuncPtr& f, const DiscardFilter* filter,
+                      const DiscardPacket& pkt, bool with_data)
+	{
+	bool discard_packet = false;
 
-			catch ( InterpreterException& e )
-				{
-				discard_packet = false;
-				}
-			}
+	if ( filter && filter->Match(pkt, discard_packet) )
+		return discard_packet;
+
+	zeek::Args args{pkt.ip->ToPktHdrVal()};
+
+	if ( with_data )
+		args.emplace_back(make_intrusive<StringVal>(
+			new String(pkt.data, pkt.data_len, true)));
+
+	try
+		{
+		discard_packet = f->Invoke(&args)->AsBool();
+		}
+
+	catch ( InterpreterException& e )
+		{
+		discard_packet = false;
 		}
 
 	return discard_packet;
 	}
 
-Val* Discarder::BuildData(const u_char* data, int hdrlen, int len, int caplen)
+void Discarder::SetData(DiscardPacket& pkt, const u_char* data, int hdrlen,
+                        int len, int caplen)
 	{
 	len -= hdrlen;
 	caplen -= hdrlen;
 	data += hdrlen;
 
-	len = std::max(std::min(std::min(len, caplen), discarder_maxlen), 0);
-
-	return new StringVal(new String(data, len, true));
+	pkt.data = data;
+	pkt.data_len = std::max(std::min(std::min(len, caplen), discarder_maxlen), 0);
 	}
 
 } // namespace zeek::detail
@@ -6,11 +6,11 @@
 #include <memory>
 
 #include "zeek/IntrusivePtr.h"
+#include "zeek/DiscardFilter.h"
 
 namespace zeek {
 
 class IP_Hdr;
-class Val;
 class Func;
 using FuncPtr = IntrusivePtr<Func>;
 
@@ -26,13 +26,26 @@ public:
 	bool NextPacket(const std::unique_ptr<IP_Hdr>& ip, int len, int caplen);
 
 protected:
-	Val* BuildData(const u_char* data, int hdrlen, int len, int caplen);
+	// Sets the payload passed to the TCP/UDP functions.
+	void SetData(DiscardPacket& pkt, const u_char* data, int hdrlen,
+	             int len, int caplen);
+
+	// Returns the verdict of the given discarder function, using its
+	// native filter if it has one.
+	bool Check(const FuncPtr& f, const DiscardFilter* filter,
+	           const DiscardPacket& pkt, bool with_data);
 
 	FuncPtr check_ip;
 	FuncPtr check_tcp;
 	FuncPtr check_udp;
 	FuncPtr check_icmp;
 
+	// The functions translated into native filters, where possible.
+	std::unique_ptr<DiscardFilter> filter_ip;
+	std::unique_ptr<DiscardFilter> filter_tcp;
+	std::unique_ptr<DiscardFilter> filter_udp;
+	std::unique_ptr<DiscardFilter> filter_icmp;
+
 	// Maximum amount of application data passed to filtering functions.
 	int discarder_maxlen;
 };
@@ -0,0 +1,753 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/zeek-config.h"
+
+#include "zeek/DiscardFilter.h"
+
+#include <string.h>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "zeek/Expr.h"
+#include "zeek/Func.h"
+#include "zeek/ID.h"
+#include "zeek/IP.h"
+#include "zeek/PrefixTable.h"
+#include "zeek/Stmt.h"
+#include "zeek/Val.h"
+#include "zeek/ZeekString.h"
+
+namespace zeek::detail {
+
+// The fields of pkt_hdr.
+enum DiscardHeader { DH_IP, DH_IP6, DH_TCP, DH_UDP, DH_ICMP };
+
+// The fields of the headers.
+enum DiscardField {
+	DF_IP_HL, DF_IP_TOS, DF_IP_LEN, DF_IP_ID, DF_IP_TTL, DF_IP_P,
+	DF_IP_SRC, DF_IP_DST,
+	DF_IP6_CLASS, DF_IP6_FLOW, DF_IP6_LEN, DF_IP6_NXT, DF_IP6_HLIM,
+	DF_IP6_SRC, DF_IP6_DST,
+	DF_TCP_SPORT, DF_TCP_DPORT, DF_TCP_SEQ, DF_TCP_ACK, DF_TCP_HL,
+	DF_TCP_DL, DF_TCP_RESERVED, DF_TCP_FLAGS, DF_TCP_WIN,
+	DF_UDP_SPORT, DF_UDP_DPORT, DF_UDP_ULEN,
+	DF_ICMP_TYPE,
+};
+
+struct DiscardFieldInfo {
+	const char* hdr_name;
+	const char* field_name;
+	DiscardHeader hdr;
+	DiscardField field;
+	TypeTag type;
+};
+
+static const DiscardFieldInfo discard_fields[] = {
+	{ "ip", "hl", DH_IP, DF_IP_HL, TYPE_COUNT },
+	{ "ip", "tos", DH_IP, DF_IP_TOS, TYPE_COUNT },
+	{ "ip", "len", DH_IP, DF_IP_LEN, TYPE_COUNT },
+	{ "ip", "id", DH_IP, DF_IP_ID, TYPE_COUNT },
+	{ "ip", "ttl", DH_IP, DF_IP_TTL, TYPE_COUNT },
+	{ "ip", "p", DH_IP, DF_IP_P, TYPE_COUNT },
+	{ "ip", "src", DH_IP, DF_IP_SRC, TYPE_ADDR },
+	{ "ip", "dst", DH_IP, DF_IP_DST, TYPE_ADDR },
+	{ "ip6", "class", DH_IP6, DF_IP6_CLASS, TYPE_COUNT },
+	{ "ip6", "flow", DH_IP6, DF_IP6_FLOW, TYPE_COUNT },
+	{ "ip6", "len", DH_IP6, DF_IP6_LEN, TYPE_COUNT },
+	{ "ip6", "nxt", DH_IP6, DF_IP6_NXT, TYPE_COUNT },
+	{ "ip6", "hlim", DH_IP6, DF_IP6_HLIM, TYPE_COUNT },
+	{ "ip6", "src", DH_IP6, DF_IP6_SRC, TYPE_ADDR },
+	{ "ip6", "dst", DH_IP6, DF_IP6_DST, TYPE_ADDR },
+	{ "tcp", "sport", DH_TCP, DF_TCP_SPORT, TYPE_PORT },
+	{ "tcp", "dport", DH_TCP, DF_TCP_DPORT, TYPE_PORT },
+	{ "tcp", "seq", DH_TCP, DF_TCP_SEQ, TYPE_COUNT },
+	{ "tcp", "ack", DH_TCP, DF_TCP_ACK, TYPE_COUNT },
+	{ "tcp", "hl", DH_TCP, DF_TCP_HL, TYPE_COUNT },
+	{ "tcp", "dl", DH_TCP, DF_TCP_DL, TYPE_COUNT },
+	{ "tcp", "reserved", DH_TCP, DF_TCP_RESERVED, TYPE_COUNT },
+	{ "tcp", "flags", DH_TCP, DF_TCP_FLAGS, TYPE_COUNT },
+	{ "tcp", "win", DH_TCP, DF_TCP_WIN, TYPE_COUNT },
+	{ "udp", "sport", DH_UDP, DF_UDP_SPORT, TYPE_PORT },
+	{ "udp", "dport", DH_UDP, DF_UDP_DPORT, TYPE_PORT },
+	{ "udp", "ulen", DH_UDP, DF_UDP_ULEN, TYPE_COUNT },
+	{ "icmp", "icmp_type", DH_ICMP, DF_ICMP_TYPE, TYPE_COUNT },
+};
+
+enum DiscardOp {
+	DO_CONST,	// val
+	DO_NOT,		// ! n1
+	DO_AND,		// n1 && n2
+	DO_OR,		// n1 || n2
+	DO_COND,	// n1 ? n2 : n3
+	DO_HAS_HDR,	// p?$<hdr>
+	DO_CMP,		// (<field> & mask) <cmp> c
+	DO_IN_NETS,	// <addr field> in nets
+	DO_IN_SET,	// <count/port field> in set
+	DO_PREFIX,	// starts_with(d, prefix)
+};
+
+struct DiscardNode {
+	explicit DiscardNode(DiscardOp arg_op) : op(arg_op)	{}
+
+	DiscardOp op;
+	std::unique_ptr<DiscardNode> n1, n2, n3;
+
+	bool val = false;
+	const DiscardFieldInfo* field = nullptr;
+	DiscardHeader hdr = DH_IP;
+
+	bro_uint_t mask = ~bro_uint_t(0);
+	BroExprTag cmp = EXPR_EQ;
+	bro_uint_t c = 0;
+
+	std::unique_ptr<PrefixTable> nets;
+	std::unordered_set<bro_uint_t> set;
+	std::string prefix;
+};
+
+using DiscardNodePtr = std::unique_ptr<DiscardNode>;
+
+// Translating function bodies into nodes.
+
+// Upper limit on the size of the decision tree, as we replicate the
+// statements following an "if" into both of its branches.
+static constexpr int MAX_DISCARD_NODES = 10000;
+
+using StmtSeq = std::vector<const Stmt*>;
+
+class DiscardCompiler {
+public:
+	DiscardNodePtr CompileSeq(const StmtSeq& seq, size_t i);
+
+protected:
+	DiscardNodePtr CompileExpr(const Expr* e);
+	DiscardNodePtr CompileCmp(const Expr* e);
+	DiscardNodePtr CompileIn(const Expr* e);
+	DiscardNodePtr CompileCall(const Expr* e);
+
+	DiscardNodePtr NewNode(DiscardOp op);
+
+	int num_nodes = 0;
+};
+
+static void flatten(const Stmt* s, StmtSeq& seq)
+	{
+	if ( s->Tag() == STMT_LIST )
+		{
+		for ( const auto& sub : s->AsStmtList()->Stmts() )
+			flatten(sub, seq);
+		}
+
+	else if ( s->Tag() != STMT_NULL )
+		seq.push_back(s);
+	}
+
+// Returns true if the expression is the function's n'th parameter.
+static bool is_param(const Expr* e, int n)
+	{
+	if ( e->Tag() != EXPR_NAME )
+		return false;
+
+	auto id = e->AsNameExpr()->Id();
+	return ! id->IsGlobal() && id->Offset() == n;
+	}
+
+// Returns the value of a literal or a global constant, or nil if the
+// expression is neither.
+static const Val* const_val(const Expr* e)
+	{
+	if ( e->Tag() == EXPR_CONST )
+		return e->AsConstExpr()->Value();
+
+	if ( e->Tag() == EXPR_NAME )
+		{
+		auto id = e->AsNameExpr()->Id();
+		if ( id->IsGlobal() && id->IsConst() && ! id->IsOption() )
+			return id->GetVal().get();
+		}
+
+	return nullptr;
+	}
+
+// Matches p$<hdr>$<field>.
+static const DiscardFieldInfo* field_of(const Expr* e)
+	{
+	if ( e->Tag() != EXPR_FIELD )
+		return nullptr;
+
+	auto hdr = e->GetOp1();
+
+	if ( hdr->Tag() != EXPR_FIELD || ! is_param(hdr->GetOp1().get(), 0) )
+		return nullptr;
+
+	auto hdr_name = hdr->AsFieldExpr()->FieldName();
+	auto field_name = e->AsFieldExpr()->FieldName();
+
+	for ( const auto& fi : discard_fields )
+		if ( util::streq(fi.hdr_name, hdr_name) &&
+		     util::streq(fi.field_name, field_name) )
+			return &fi;
+
+	return nullptr;
+	}
+
+// Matches <field> and <field> & <constant>.
+static const DiscardFieldInfo* masked_field_of(const Expr* e, bro_uint_t& mask)
+	{
+	if ( e->Tag() != EXPR_AND )
+		return field_of(e);
+
+	auto f = e->GetOp1().get();
+	auto c = const_val(e->GetOp2().get());
+
+	if ( ! c )
+		{
+		f = e->GetOp2().get();
+		c = const_val(e->GetOp1().get());
+		}
+
+	if ( ! c || c->GetType()->Tag() != TYPE_COUNT )
+		return nullptr;
+
+	auto fi = field_of(f);
+
+	if ( ! fi || fi->type != TYPE_COUNT )
+		return nullptr;
+
+	mask = c->AsCount();
+	return fi;
+	}
+
+DiscardNodePtr DiscardCompiler::NewNode(DiscardOp op)
+	{
+	if ( ++num_nodes > MAX_DISCARD_NODES )
+		return nullptr;
+
+	return std::make_unique<DiscardNode>(op);
+	}
+
+DiscardNodePtr DiscardCompiler::CompileSeq(const StmtSeq& seq, size_t i)
+	{
+	if ( i >= seq.size() )
+		// Falling off the end of the function.
+		return nullptr;
+
+	auto s = seq[i];
+
+	if ( s->Tag() == STMT_RETURN )
+		{
+		auto e = s->AsReturnStmt()->StmtExpr();
+		return e ? CompileExpr(e) : nullptr;
+		}
+
+	if ( s->Tag() != STMT_IF )
+		return nullptr;
+
+	auto is = s->AsIfStmt();
+	auto n = NewNode(DO_COND);
+
+	if ( ! n || ! (n->n1 = CompileExpr(is->StmtExpr())) )
+		return nullptr;
+
+	// Each branch continues with the statements after the "if".
+	StmtSeq t_seq;
+	StmtSeq f_seq;
+
+	if ( is->TrueBranch() )
+		flatten(is->TrueBranch(), t_seq);
+	if ( is->FalseBranch() )
+		flatten(is->FalseBranch(), f_seq);
+
+	t_seq.insert(t_seq.end(), seq.begin() + i + 1, seq.end());
+	f_seq.insert(f_seq.end(), seq.begin() + i + 1, seq.end());
+
+	if ( ! (n->n2 = CompileSeq(t_seq, 0)) || ! (n->n3 = CompileSeq(f_seq, 0)) )
+		return nullptr;
+
+	return n;
+	}
+
+DiscardNodePtr DiscardCompiler::CompileExpr(const Expr* e)
+	{
+	if ( e->GetType()->Tag() != TYPE_BOOL )
+		return nullptr;
+
+	if ( auto c = const_val(e) )
+		{
+		auto n = NewNode(DO_CONST);
+		if ( n )
+			n->val = c->AsBool();
+		return n;
+		}
+
+	switch ( e->Tag() ) {
+	case EXPR_NOT:
+		{
+		auto n = NewNode(DO_NOT);
+		if ( ! n || ! (n->n1 = CompileExpr(e->GetOp1().get())) )
+			return nullptr;
+		return n;
+		}
+
+	case EXPR_AND_AND:
+	case EXPR_OR_OR:
+		{
+		auto n = NewNode(e->Tag() == EXPR_AND_AND ? DO_AND : DO_OR);
+		if ( ! n || ! (n->n1 = CompileExpr(e->GetOp1().get())) ||
+		     ! (n->n2 = CompileExpr(e->GetOp2().get())) )
+			return nullptr;
+		return n;
+		}
+
+	case EXPR_HAS_FIELD:
+		{
+		if ( ! is_param(e->GetOp1().get(), 0) )
+			return nullptr;
+
+		auto field_name = e->AsHasFieldExpr()->FieldName();
+
+		for ( const auto& fi : discard_fields )
+			if ( util::streq(fi.hdr_name, field_name) )
+				{
+				auto n = NewNode(DO_HAS_HDR);
+				if ( n )
+					n->hdr = fi.hdr;
+				return n;
+				}
+
+		return nullptr;
+		}
+
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_GT:
+	case EXPR_GE:
+		return CompileCmp(e);
+
+	case EXPR_IN:
+		return CompileIn(e);
+
+	case EXPR_CALL:
+		return CompileCall(e);
+
+	default:
+		return nullptr;
+	}
+	}
+
+DiscardNodePtr DiscardCompiler::CompileCmp(const Expr* e)
+	{
+	auto cmp = e->Tag();
+	auto f = e->GetOp1().get();
+	auto c = const_val(e->GetOp2().get());
+
+	if ( ! c )
+		{
+		// Put the constant on the right-hand side.
+		f = e->GetOp2().get();
+		c = const_val(e->GetOp1().get());
+
+		switch ( cmp ) {
+		case EXPR_LT:	cmp = EXPR_GT; break;
+		case EXPR_LE:	cmp = EXPR_GE; break;
+		case EXPR_GT:	cmp = EXPR_LT; break;
+		case EXPR_GE:	cmp = EXPR_LE; break;
+		default:	break;
+		}
+		}
+
+	if ( ! c )
+		return nullptr;
+
+	bro_uint_t mask = ~bro_uint_t(0);
+	auto fi = masked_field_of(f, mask);
+
+	if ( ! fi || fi->type != c->GetType()->Tag() )
+		return nullptr;
+
+	if ( fi->type == TYPE_ADDR )
+		{
+		if ( cmp != EXPR_EQ && cmp != EXPR_NE )
+			return nullptr;
+
+		auto n = NewNode(DO_IN_NETS);
+		if ( ! n )
+			return nullptr;
+
+		n->field = fi;
+		n->nets = std::make_unique<PrefixTable>();
+		n->nets->Insert(c);
+
+		if ( cmp == EXPR_EQ )
+			return n;
+
+		auto nn = NewNode(DO_NOT);
+		if ( nn )
+			nn->n1 = std::move(n);
+		return nn;
+		}
+
+	auto n = NewNode(DO_CMP);
+	if ( ! n )
+		return nullptr;
+
+	n->field = fi;
+	n->mask = mask;
+	n->cmp = cmp;
+	n->c = c->AsCount();
+
+	return n;
+	}
+
+DiscardNodePtr DiscardCompiler::CompileIn(const Expr* e)
+	{
+	auto f = e->GetOp1().get();
+	auto c = const_val(e->GetOp2().get());
+
+	if ( ! c )
+		return nullptr;
+
+	if ( f->Tag() == EXPR_LIST )
+		{
+		const auto& exprs = f->AsListExpr()->Exprs();
+		if ( exprs.length() != 1 )
+			return nullptr;
+
+		f = exprs[0];
+		}
+
+	auto fi = field_of(f);
+
+	if ( ! fi )
+		return nullptr;
+
+	const auto& ct = c->GetType();
+
+	if ( ct->Tag() == TYPE_SUBNET )
+		{
+		if ( fi->type != TYPE_ADDR )
+			return nullptr;
+
+		auto n = NewNode(DO_IN_NETS);
+		if ( ! n )
+			return nullptr;
+
+		n->field = fi;
+		n->nets = std::make_unique<PrefixTable>();
+		n->nets->Insert(c);
+		return n;
+		}
+
+	if ( ct->Tag() != TYPE_TABLE || ! ct->IsSet() )
+		return nullptr;
+
+	const auto& itypes = ct->AsSetType()->GetIndexTypes();
+
+	if ( itypes.size() != 1 )
+		return nullptr;
+
+	auto it = itypes[0]->Tag();
+	auto n = NewNode(DO_IN_SET);
+
+	if ( ! n )
+		return nullptr;
+
+	n->field = fi;
+
+	auto elems = c->AsTableVal()->ToPureListVal();
+
+	if ( fi->type == TYPE_ADDR && (it == TYPE_ADDR || it == TYPE_SUBNET) )
+		{
+		n->op = DO_IN_NETS;
+		n->nets = std::make_unique<PrefixTable>();
+
+		for ( int i = 0; i < elems->Length(); ++i )
+			n->nets->Insert(elems->Idx(i).get());
+		}
+
+	else if ( fi->type == it && (it == TYPE_COUNT || it == TYPE_PORT) )
+		{
+		for ( int i = 0; i < elems->Length(); ++i )
+			n->set.insert(elems->Idx(i)->AsCount());
+		}
+
+	else
+		return nullptr;
+
+	return n;
+	}
+
+DiscardNodePtr DiscardCompiler::CompileCall(const Expr* e)
+	{
+	auto call = e->AsCallExpr();
+	auto func = call->Func();
+
+	if ( func->Tag() != EXPR_NAME )
+		return nullptr;
+
+	auto id = func->AsNameExpr()->Id();
+
+	if ( ! id->IsGlobal() || ! util::streq(id->Name(), "starts_with") ||
+	     ! id->GetVal() ||
+	     id->GetVal()->AsFunc()->GetKind() != Func::BUILTIN_FUNC )
+		return nullptr;
+
+	const auto& args = call->Args()->Exprs();
+
+	if ( args.length() != 2 || ! is_param(args[0], 1) )
+		return nullptr;
+
+	auto c = const_val(args[1]);
+
+	if ( ! c || c->GetType()->Tag() != TYPE_STRING )
+		return nullptr;
+
+	auto n = NewNode(DO_PREFIX);
+	if ( ! n )
+		return nullptr;
+
+	auto s = c->AsString();
+	n->prefix.assign(reinterpret_cast<const char*>(s->Bytes()), s->Len());
+
+	return n;
+	}
+
+// Evaluating nodes.
+
+static bool has_header(const DiscardPacket& pkt, DiscardHeader hdr)
+	{
+	switch ( hdr ) {
+	case DH_IP:	return pkt.ip->IP4_Hdr() != nullptr;
+	case DH_IP6:	return pkt.ip->IP4_Hdr() == nullptr;
+	case DH_TCP:	return pkt.proto == IPPROTO_TCP;
+	case DH_UDP:	return pkt.proto == IPPROTO_UDP;
+	case DH_ICMP:	return pkt.proto == IPPROTO_ICMP ||
+			       pkt.proto == IPPROTO_ICMPV6;
+	}
+
+	return false;
+	}
+
+// Returns false if the packet doesn't have the field's header, or we
+// didn't capture it.
+static bool header_present(const DiscardPacket& pkt, DiscardHeader hdr)
+	{
+	if ( ! has_header(pkt, hdr) )
+		return false;
+
+	switch ( hdr ) {
+	case DH_TCP:	return pkt.l4_caplen >= int(sizeof(struct tcphdr));
+	case DH_UDP:	return pkt.l4_caplen >= int(sizeof(struct udphdr));
+	case DH_ICMP:	return pkt.l4_caplen >= 1;
+	default:	return true;
+	}
+	}
+
+static bool get_count(const DiscardPacket& pkt, const DiscardFieldInfo* fi,
+                      bro_uint_t& v)
+	{
+	if ( ! header_present(pkt, fi->hdr) )
+		return false;
+
+	auto ip4 = pkt.ip->IP4_Hdr();
+	auto ip6 = pkt.ip->IP6_Hdr();
+	auto tp = (const struct tcphdr*) pkt.l4;
+	auto up = (const struct udphdr*) pkt.l4;
+
+	switch ( fi->field ) {
+	case DF_IP_HL:		v = ip4->ip_hl * 4; break;
+	case DF_IP_TOS:		v = ip4->ip_tos; break;
+	case DF_IP_LEN:		v = ntohs(ip4->ip_len); break;
+	case DF_IP_ID:		v = ntohs(ip4->ip_id); break;
+	case DF_IP_TTL:		v = ip4->ip_ttl; break;
+	case DF_IP_P:		v = ip4->ip_p; break;
+
+	case DF_IP6_CLASS:	v = (ntohl(ip6->ip6_flow) & 0x0ff00000) >> 20; break;
+	case DF_IP6_FLOW:	v = ntohl(ip6->ip6_flow) & 0x000fffff; break;
+	case DF_IP6_LEN:	v = ntohs(ip6->ip6_plen); break;
+	case DF_IP6_NXT:	v = ip6->ip6_nxt; break;
+	case DF_IP6_HLIM:	v = ip6->ip6_hlim; break;
+
+	case DF_TCP_SPORT:
+		v = PortVal::Mask(ntohs(tp->th_sport), TRANSPORT_TCP);
+		break;
+	case DF_TCP_DPORT:
+		v = PortVal::Mask(ntohs(tp->th_dport), TRANSPORT_TCP);
+		break;
+	case DF_TCP_SEQ:	v = ntohl(tp->th_seq); break;
+	case DF_TCP_ACK:	v = ntohl(tp->th_ack); break;
+	case DF_TCP_HL:		v = tp->th_off * 4; break;
+	case DF_TCP_DL:
+		{
+		int dl = pkt.ip->PayloadLen() - tp->th_off * 4;
+		if ( dl < 0 )
+			// Leave the oddity to the script.
+			return false;
+		v = dl;
+		break;
+		}
+	case DF_TCP_RESERVED:	v = tp->th_x2; break;
+	case DF_TCP_FLAGS:	v = tp->th_flags; break;
+	case DF_TCP_WIN:	v = ntohs(tp->th_win); break;
+
+	case DF_UDP_SPORT:
+		v = PortVal::Mask(ntohs(up->uh_sport), TRANSPORT_UDP);
+		break;
+	case DF_UDP_DPORT:
+		v = PortVal::Mask(ntohs(up->uh_dport), TRANSPORT_UDP);
+		break;
+	case DF_UDP_ULEN:	v = ntohs(up->uh_ulen); break;
+
+	case DF_ICMP_TYPE:	v = pkt.l4[0]; break;
+
+	default:
+		return false;
+	}
+
+	return true;
+	}
+
+static bool get_addr(const DiscardPacket& pkt, const DiscardFieldInfo* fi,
+                     IPAddr& a)
+	{
+	if ( ! header_present(pkt, fi->hdr) )
+		return false;
+
+	switch ( fi->field ) {
+	case DF_IP_SRC:
+	case DF_IP6_SRC:
+		a = pkt.ip->IPHeaderSrcAddr();
+		return true;
+
+	case DF_IP_DST:
+	case DF_IP6_DST:
+		a = pkt.ip->IPHeaderDstAddr();
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+// Returns false if the script needs to take over.
+static bool eval(const DiscardNode* n, const DiscardPacket& pkt, bool& res)
+	{
+	switch ( n->op ) {
+	case DO_CONST:
+		res = n->val;
+		return true;
+
+	case DO_NOT:
+		if ( ! eval(n->n1.get(), pkt, res) )
+			return false;
+		res = ! res;
+		return true;
+
+	case DO_AND:
+	case DO_OR:
+		if ( ! eval(n->n1.get(), pkt, res) )
+			return false;
+		if ( res == (n->op == DO_OR) )
+			// Short-circuit, like the script does.
+			return true;
+		return eval(n->n2.get(), pkt, res);
+
+	case DO_COND:
+		if ( ! eval(n->n1.get(), pkt, res) )
+			return false;
+		return eval(res ? n->n2.get() : n->n3.get(), pkt, res);
+
+	case DO_HAS_HDR:
+		res = has_header(pkt, n->hdr);
+		return true;
+
+	case DO_CMP:
+		{
+		bro_uint_t v;
+		if ( ! get_count(pkt, n->field, v) )
+			return false;
+
+		v &= n->mask;
+
+		switch ( n->cmp ) {
+		case EXPR_EQ:	res = v == n->c; break;
+		case EXPR_NE:	res = v != n->c; break;
+		case EXPR_LT:	res = v < n->c; break;
+		case EXPR_LE:	res = v <= n->c; break;
+		case EXPR_GT:	res = v > n->c; break;
+		case EXPR_GE:	res = v >= n->c; break;
+		default:	return false;
+		}
+
+		return true;
+		}
+
+	case DO_IN_NETS:
+		{
+		IPAddr a;
+		if ( ! get_addr(pkt, n->field, a) )
+			return false;
+
+		res = n->nets->Lookup(a, 128) != nullptr;
+		return true;
+		}
+
+	case DO_IN_SET:
+		{
+		bro_uint_t v;
+		if ( ! get_count(pkt, n->field, v) )
+			return false;
+
+		res = n->set.count(v) > 0;
+		return true;
+		}
+
+	case DO_PREFIX:
+		res = pkt.data_len >= int(n->prefix.size()) &&
+		      memcmp(pkt.data, n->prefix.data(), n->prefix.size()) == 0;
+		return true;
+	}
+
+	return false;
+	}
+
+std::unique_ptr<DiscardFilter> DiscardFilter::Compile(const FuncPtr& f)
+	{
+	if ( ! f || f->GetKind() != Func::SCRIPT_FUNC )
+		return nullptr;
+
+	const auto& bodies = f->GetBodies();
+
+	if ( bodies.size() != 1 )
+		return nullptr;
+
+	StmtSeq seq;
+	flatten(bodies[0].stmts.get(), seq);
+
+	DiscardCompiler dc;
+	auto root = dc.CompileSeq(seq, 0);
+
+	if ( ! root )
+		return nullptr;
+
+	return std::unique_ptr<DiscardFilter>(new DiscardFilter(std::move(root)));
+	}
+
+DiscardFilter::DiscardFilter(std::unique_ptr<DiscardNode> arg_root)
+	: root(std::move(arg_root))
+	{
+	}
+
+DiscardFilter::~DiscardFilter()
+	{
+	}
+
+bool DiscardFilter::Match(const DiscardPacket& pkt, bool& discard) const
+	{
+	return eval(root.get(), pkt, discard);
+	}
+
+} // namespace zeek::detail
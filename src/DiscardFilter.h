@@ -0,0 +1,79 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Native evaluation of discarder_check_* functions.
+//
+// Discarder functions that stay within a restricted subset of the
+// language get translated into a decision tree that we evaluate directly
+// on the packet's headers, rather than building a pkt_hdr record and
+// calling into the interpreter for each packet.  The subset is a sequence
+// of "if ( <cond> ) return <cond>;" statements ending in a final
+// "return <cond>;", where conditions combine the following using !, &&
+// and || (with the header fields optionally masked via "&"):
+//
+//	p?$tcp
+//	p$tcp$flags & TH_SYN != 0		(comparing against a constant)
+//	p$ip$src in 10.0.0.0/8			(or == 10.1.2.3)
+//	p$ip$src in some_nets			(a constant set[addr] or set[subnet])
+//	p$tcp$dport in some_ports		(a constant set[port] or set[count])
+//	starts_with(d, "GET ")
+//
+// Constants are literals or global "const"s.  Functions using anything
+// else remain with the interpreter, and packets for which the script
+// would run into an error (such as accessing a header the packet doesn't
+// have) get handed to the script function as well, so that it reports
+// them as usual.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+#include <memory>
+
+#include "zeek/IntrusivePtr.h"
+
+namespace zeek {
+
+class IP_Hdr;
+class Func;
+using FuncPtr = IntrusivePtr<Func>;
+
+namespace detail {
+
+// The parts of a packet that a discarder function gets to see.
+struct DiscardPacket {
+	const IP_Hdr* ip = nullptr;
+	int proto = 0;
+
+	// The transport header, and how much of it (plus what follows)
+	// got captured.
+	const u_char* l4 = nullptr;
+	int l4_caplen = 0;
+
+	// The payload as passed to the function, if it has a payload
+	// parameter.
+	const u_char* data = nullptr;
+	int data_len = 0;
+};
+
+struct DiscardNode;
+
+class DiscardFilter {
+public:
+	// Returns nil if the function isn't a script function whose body
+	// falls within the subset we support.
+	static std::unique_ptr<DiscardFilter> Compile(const FuncPtr& f);
+
+	~DiscardFilter();
+
+	// Returns false if the packet needs to be passed to the script
+	// function after all; otherwise, sets discard to the function's
+	// result.
+	bool Match(const DiscardPacket& pkt, bool& discard) const;
+
+protected:
+	explicit DiscardFilter(std::unique_ptr<DiscardNode> root);
+
+	std::unique_ptr<DiscardNode> root;
+};
+
+} // namespace detail
+} // namespace zeek
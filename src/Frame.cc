@@ -15,8 +15,13 @@ std::vector<zeek::detail::Frame*> g_frame_stack;
 
 namespace zeek::detail {
 
+uint64_t Frame::total_allocated = 0;
+uint64_t Frame::total_reused = 0;
+
 Frame::Frame(int arg_size, const ScriptFunc* func, const zeek::Args* fn_args)
 	{
+	++total_allocated;
+
 	size = arg_size;
 	frame = std::make_unique<Element[]>(size);
 	function = func;
@@ -168,6 +173,32 @@ void Frame::Reset(int startIdx)
 		ClearElement(i);
 	}
 
+bool Frame::Recycle()
+	{
+	if ( RefCnt() != 1 || delayed || closure || ! outer_ids.empty() ||
+	     offset_map || functions_with_closure_frame_reference )
+		return false;
+
+	for ( int i = 0; i < size; ++i )
+		ClearElement(i);
+
+	trigger = nullptr;
+	call = nullptr;
+	func_args = nullptr;
+	next_stmt = nullptr;
+	break_before_next_stmt = false;
+	break_on_return = false;
+	current_offset = 0;
+
+	return true;
+	}
+
+void Frame::Reuse(const zeek::Args* fn_args)
+	{
+	++total_reused;
+	func_args = fn_args;
+	}
+
 void Frame::Describe(ODesc* d) const
 	{
 	if ( ! d->IsBinary() )
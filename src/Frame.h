@@ -112,6 +112,40 @@ public:
 	 */
 	void Reset(int startIdx);
 
+	/**
+	 * Prepares the frame for reuse by another call of its function,
+	 * releasing its values and per-call state. Fails if anything
+	 * other than the caller still refers to the frame, or if it has
+	 * state that outlives the call (closures, delayed execution).
+	 *
+	 * @return true if the frame can be reused.
+	 */
+	bool Recycle();
+
+	/**
+	 * Starts another call of the frame's function with a frame that
+	 * has been recycled.
+	 *
+	 * @param fn_args the arguments being passed to the function.
+	 */
+	void Reuse(const zeek::Args* fn_args);
+
+	/**
+	 * @return the number of vals that can be stored in this frame.
+	 */
+	int Size() const	{ return size; }
+
+	/**
+	 * @return the number of frames allocated so far.
+	 */
+	static uint64_t TotalAllocated()	{ return total_allocated; }
+
+	/**
+	 * @return the number of function calls so far that reused a frame
+	 * rather than allocating one.
+	 */
+	static uint64_t TotalReused()	{ return total_reused; }
+
 	/**
 	 * Describes the frame and all of its values.
 	 */
@@ -392,6 +426,9 @@ private:
 	const CallExpr* call;
 
 	std::unique_ptr<std::vector<ScriptFunc*>> functions_with_closure_frame_reference;
+
+	static uint64_t total_allocated;
+	static uint64_t total_reused;
 };
 
 } // namespace detail
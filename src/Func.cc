@@ -310,6 +310,13 @@ ScriptFunc::ScriptFunc(const IDPtr& arg_id, StmtPtr arg_body,
 		}
 	}
 
+// Defined here rather than in the header, as it needs Frame to be a
+// complete type for cleaning up frame_pool.
+ScriptFunc::ScriptFunc()
+	: Func(SCRIPT_FUNC)
+	{
+	}
+
 ScriptFunc::~ScriptFunc()
 	{
 	if ( ! weak_closure_ref )
@@ -351,7 +358,7 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 		return Flavor() == FUNC_FLAVOR_HOOK ? val_mgr->True() : nullptr;
 		}
 
-	auto f = make_intrusive<Frame>(frame_size, this, args);
+	auto f = NewFrame(args);
 
 	if ( closure )
 		f->CaptureClosure(closure, outer_ids);
@@ -465,10 +472,38 @@ ValPtr ScriptFunc::Invoke(zeek::Args* args, Frame* parent) const
 		}
 
 	g_frame_stack.pop_back();
+	RecycleFrame(std::move(f));
 
 	return result;
 	}
 
+// The number of frames each function keeps for reuse.
+static constexpr size_t MAX_POOLED_FRAMES = 4;
+
+FramePtr ScriptFunc::NewFrame(const zeek::Args* args) const
+	{
+	while ( ! frame_pool.empty() )
+		{
+		auto f = std::move(frame_pool.back());
+		frame_pool.pop_back();
+
+		// The frame size changes if script optimization adds locals.
+		if ( f->Size() != static_cast<int>(frame_size) )
+			continue;
+
+		f->Reuse(args);
+		return f;
+		}
+
+	return make_intrusive<Frame>(frame_size, this, args);
+	}
+
+void ScriptFunc::RecycleFrame(FramePtr f) const
+	{
+	if ( frame_pool.size() < MAX_POOLED_FRAMES && f->Recycle() )
+		frame_pool.emplace_back(std::move(f));
+	}
+
 void ScriptFunc::CreateCaptures(Frame* f)
 	{
 	const auto& captures = type->GetCaptures();
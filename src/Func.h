@@ -261,7 +261,7 @@ public:
 	void Describe(ODesc* d) const override;
 
 protected:
-	ScriptFunc() : Func(SCRIPT_FUNC)	{}
+	ScriptFunc();
 
 	StmtPtr AddInits(
 		StmtPtr body,
@@ -288,9 +288,25 @@ protected:
 	 */
 	virtual void SetCaptures(Frame* f);
 
+	/**
+	 * Returns a frame for a call of the function, reusing one of an
+	 * earlier call if available.
+	 */
+	IntrusivePtr<Frame> NewFrame(const zeek::Args* args) const;
+
+	/**
+	 * Keeps the frame of a finished call for reuse, if nothing else
+	 * refers to it anymore.
+	 */
+	void RecycleFrame(IntrusivePtr<Frame> f) const;
+
 private:
 	size_t frame_size;
 
+	// Frames of finished calls, ready for reuse.  We keep a few, as
+	// recursive calls need one each.
+	mutable std::vector<IntrusivePtr<Frame>> frame_pool;
+
 	// List of the outer IDs used in the function.
 	IDPList outer_ids;
 
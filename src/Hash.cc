@@ -190,9 +190,19 @@ HashKey::HashKey(const void* arg_key, int arg_size, hash_t arg_hash,
 HashKey::HashKey(const void* bytes, int arg_size)
 	{
 	size = arg_size;
-	key = CopyKey(bytes, size);
+
+	if ( size <= static_cast<int>(sizeof(key_u.bytes)) )
+		{
+		memcpy(key_u.bytes, bytes, size);
+		key = (void*) &key_u;
+		}
+	else
+		{
+		key = CopyKey(bytes, size);
+		is_our_dynamic = true;
+		}
+
 	hash = HashBytes(key, size);
-	is_our_dynamic = true;
 	}
 
 void* HashKey::TakeKey()
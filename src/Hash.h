@@ -242,7 +242,8 @@ public:
 	// Same, but automatically copies the key.
 	HashKey(const void* key, int size, hash_t hash);
 
-	// Builds a key from the given chunk of bytes.
+	// Builds a key from the given chunk of bytes. Chunks of up to 16
+	// bytes (e.g., IPv6 addresses) are stored inside the HashKey itself.
 	HashKey(const void* bytes, int size);
 
 	// Create a Hashkey given all of its components *without*
@@ -272,6 +273,7 @@ protected:
 		uint32_t u32;
 		double d;
 		const void* p;
+		char bytes[16];
 	} key_u;
 
 	void* key;
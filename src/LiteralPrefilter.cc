@@ -0,0 +1,653 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/LiteralPrefilter.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <numeric>
+
+// The vectorized scans are compiled for the CPU features they need and
+// picked at runtime, so that they're available without building for a
+// specific CPU.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PREFILTER_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// Characters that have a special meaning outside of character classes
+// and quotes (see re-scan.l).
+const char* const META_CHARS = "^\"{}$[]|*+?.()\\\n";
+
+bool is_meta(char c)
+	{
+	return c == '\0' || strchr(META_CHARS, c);
+	}
+
+// Parses the escape sequence starting at s, which must point to the
+// backslash, like the ESCSEQ rule in re-scan.l. Returns the length of
+// the sequence, or zero if it's one that the scanner and
+// expand_escape() disagree about.
+int parse_escape(const char* s, const char* end, int* value)
+	{
+	if ( s + 1 >= end || s[1] == '\n' )
+		return 0;
+
+	if ( s[1] >= '0' && s[1] <= '7' )
+		{
+		const char* p = s + 1;
+
+		while ( p < end && *p >= '0' && *p <= '7' )
+			++p;
+
+		if ( p - (s + 1) > 3 )
+			return 0;
+		}
+
+	else if ( s[1] == 'x' )
+		{
+		if ( s + 3 >= end || ! isxdigit(s[2]) || ! isxdigit(s[3]) )
+			return 0;
+		}
+
+	const char* p = s + 1;
+	*value = static_cast<u_char>(util::detail::expand_escape(p));
+	return p - s;
+	}
+
+// Parses the quoted string starting at s, which must point to the
+// opening quote. Returns the position after the closing quote, or
+// nullptr if the string is malformed.
+const char* parse_quoted(const char* s, const char* end, std::string* str)
+	{
+	for ( ++s; s < end; )
+		{
+		if ( *s == '"' )
+			return s + 1;
+
+		if ( *s == '\n' )
+			return nullptr;
+
+		if ( *s == '\\' )
+			{
+			int c;
+			int n = parse_escape(s, end, &c);
+
+			if ( ! n )
+				return nullptr;
+
+			str->push_back(c);
+			s += n;
+			}
+		else
+			str->push_back(*s++);
+		}
+
+	return nullptr;
+	}
+
+// Returns the position after the character class starting at s, which
+// must point to the opening bracket, or nullptr if it's malformed.
+const char* skip_ccl(const char* s, const char* end)
+	{
+	++s;
+
+	if ( s < end && *s == '^' )
+		++s;
+
+	if ( s < end && *s == ']' )
+		++s;
+
+	while ( s < end && *s != ']' )
+		{
+		if ( *s == '\\' )
+			{
+			int c;
+			int n = parse_escape(s, end, &c);
+
+			if ( ! n )
+				return nullptr;
+
+			s += n;
+			}
+
+		else if ( *s == '[' && s + 1 < end && s[1] == ':' )
+			{
+			// An expression like "[:alpha:]".
+			const char* e = strstr(s, ":]");
+
+			if ( ! e || e >= end )
+				return nullptr;
+
+			s = e + 2;
+			}
+
+		else
+			++s;
+		}
+
+	return s < end ? s + 1 : nullptr;
+	}
+
+// Checks that the parentheses are balanced and that there's no
+// alternation at the top level, which would let matches start with
+// something other than the literal.
+bool check_structure(const char* s, const char* end)
+	{
+	int depth = 0;
+
+	while ( s < end )
+		{
+		switch ( *s ) {
+		case '\\':
+			{
+			int c;
+			int n = parse_escape(s, end, &c);
+
+			if ( ! n )
+				return false;
+
+			s += n;
+			continue;
+			}
+
+		case '"':
+			{
+			std::string dummy;
+			s = parse_quoted(s, end, &dummy);
+
+			if ( ! s )
+				return false;
+
+			continue;
+			}
+
+		case '[':
+			s = skip_ccl(s, end);
+
+			if ( ! s )
+				return false;
+
+			continue;
+
+		case '(':
+			++depth;
+			break;
+
+		case ')':
+			if ( --depth < 0 )
+				return false;
+			break;
+
+		case '|':
+			if ( depth == 0 )
+				return false;
+			break;
+
+		case '\n':
+			return false;
+		}
+
+		++s;
+		}
+
+	return depth == 0;
+	}
+
+// Returns true if the token ending at s is optional, or may repeat.
+bool is_quantified(const char* s, const char* end, bool* repeats)
+	{
+	*repeats = false;
+
+	if ( s >= end )
+		return false;
+
+	if ( *s == '*' || *s == '?' || *s == '{' )
+		return true;
+
+	*repeats = (*s == '+');
+	return false;
+	}
+
+// ASCII-only, unlike tolower() and toupper().
+u_char fold(u_char c)
+	{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+	}
+
+u_char unfold(u_char c)
+	{
+	return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+	}
+
+} // namespace
+
+bool LiteralPrefilter::Extract(const char* pattern, Literal* literal)
+	{
+	const char* s = pattern;
+	const char* end = s + strlen(s);
+
+	literal->bytes.clear();
+	literal->caseless = false;
+
+	// Case-insensitive signature patterns come wrapped into "(?i:...)".
+	// The check below makes sure that the closing parenthesis at the
+	// end belongs to the opening one.
+	static const char ci_prefix[] = "(?i:";
+	static const size_t ci_len = sizeof(ci_prefix) - 1;
+
+	if ( strncmp(s, ci_prefix, ci_len) == 0 )
+		{
+		if ( end - s <= static_cast<ptrdiff_t>(ci_len) || end[-1] != ')' )
+			return false;
+
+		s += ci_len;
+		--end;
+		literal->caseless = true;
+		}
+
+	if ( ! check_structure(s, end) )
+		return false;
+
+	// Patterns are anchored at the beginning of the input, unless they
+	// start with ".*".
+	if ( end - s < 2 || strncmp(s, ".*", 2) != 0 )
+		return false;
+
+	while ( end - s >= 2 && strncmp(s, ".*", 2) == 0 )
+		s += 2;
+
+	while ( s < end )
+		{
+		std::string token;
+		const char* next;
+
+		if ( *s == '\\' )
+			{
+			int c;
+			int n = parse_escape(s, end, &c);
+
+			if ( ! n )
+				break;
+
+			token.push_back(c);
+			next = s + n;
+			}
+
+		else if ( *s == '"' )
+			{
+			next = parse_quoted(s, end, &token);
+
+			if ( ! next || token.empty() )
+				break;
+			}
+
+		else if ( is_meta(*s) )
+			break;
+
+		else
+			{
+			token.push_back(*s);
+			next = s + 1;
+			}
+
+		bool repeats;
+
+		if ( is_quantified(next, end, &repeats) )
+			break;
+
+		literal->bytes += token;
+
+		if ( repeats )
+			break;
+
+		s = next;
+		}
+
+	return ! literal->bytes.empty();
+	}
+
+LiteralPrefilter::LiteralPrefilter(const std::vector<Literal>& literals)
+	{
+	num_literals = literals.size();
+	fingerprint_len = MAX_FINGERPRINT;
+
+	memset(masks, 0, sizeof(masks));
+	memset(lo_masks, 0, sizeof(lo_masks));
+	memset(hi_masks, 0, sizeof(hi_masks));
+
+	for ( const auto& l : literals )
+		fingerprint_len = std::min(fingerprint_len, static_cast<int>(l.bytes.size()));
+
+	// Literals with similar fingerprints share a bucket, which keeps the
+	// number of byte values accepted per bucket and position low.
+	auto fingerprint = [&](size_t i)
+		{
+		std::string fp = literals[i].bytes.substr(0, fingerprint_len);
+
+		if ( literals[i].caseless )
+			std::transform(fp.begin(), fp.end(), fp.begin(), fold);
+
+		return fp;
+		};
+
+	std::vector<size_t> order(num_literals);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+		{
+		return fingerprint(a) < fingerprint(b);
+		});
+
+	for ( size_t rank = 0; rank < num_literals; ++rank )
+		{
+		const Literal& l = literals[order[rank]];
+		int bucket = rank * NUM_BUCKETS / num_literals;
+
+		for ( int j = 0; j < fingerprint_len; ++j )
+			{
+			u_char c = l.bytes[j];
+			AddByte(bucket, j, c);
+
+			if ( l.caseless )
+				{
+				AddByte(bucket, j, fold(c));
+				AddByte(bucket, j, unfold(c));
+				}
+			}
+		}
+	}
+
+void LiteralPrefilter::AddByte(int bucket, int pos, u_char c)
+	{
+	uint8_t bit = 1 << bucket;
+	masks[pos][c] |= bit;
+	lo_masks[pos][c & 0x0f] |= bit;
+	hi_masks[pos][c >> 4] |= bit;
+	}
+
+int LiteralPrefilter::NonCandidateByte() const
+	{
+	for ( int c = 0; c < 256; ++c )
+		{
+		if ( ! masks[0][c] )
+			return c;
+		}
+
+	return -1;
+	}
+
+bool LiteralPrefilter::IsCandidate(const u_char* data, int pos, int len) const
+	{
+	uint8_t buckets = 0xff;
+
+	for ( int j = 0; j < fingerprint_len && pos + j < len; ++j )
+		buckets &= masks[j][data[pos + j]];
+
+	return buckets != 0;
+	}
+
+int LiteralPrefilter::ScanScalar(const u_char* data, int pos, int len) const
+	{
+	for ( ; pos < len; ++pos )
+		{
+		if ( masks[0][data[pos]] && IsCandidate(data, pos, len) )
+			return pos;
+		}
+
+	return len;
+	}
+
+LiteralPrefilter::Kernel LiteralPrefilter::DetectKernel()
+	{
+#ifdef PREFILTER_X86_KERNELS
+	__builtin_cpu_init();
+
+	if ( __builtin_cpu_supports("avx2") )
+		return AVX2;
+
+	if ( __builtin_cpu_supports("ssse3") )
+		return SSSE3;
+#endif
+
+	return SCALAR;
+	}
+
+LiteralPrefilter::Kernel LiteralPrefilter::kernel = LiteralPrefilter::DetectKernel();
+
+int LiteralPrefilter::Scan(const u_char* data, int len) const
+	{
+	// The vectorized loops look at the blocks for which all fingerprint
+	// bytes are available, and leave the rest to the scalar one.
+	int pos = 0;
+
+#ifdef PREFILTER_X86_KERNELS
+	if ( kernel == AVX2 && ScanAVX2(data, len, &pos) )
+		return pos;
+
+	if ( kernel == SSSE3 && ScanSSSE3(data, len, &pos) )
+		return pos;
+#endif
+
+	return ScanScalar(data, pos, len);
+	}
+
+#ifdef PREFILTER_X86_KERNELS
+
+// The nibble tables are coarser than the byte tables, so the lanes they
+// report need to be double-checked.
+
+__attribute__((target("avx2")))
+bool LiteralPrefilter::ScanAVX2(const u_char* data, int len, int* pos) const
+	{
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i lo[MAX_FINGERPRINT];
+	__m256i hi[MAX_FINGERPRINT];
+
+	for ( int j = 0; j < fingerprint_len; ++j )
+		{
+		lo[j] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(lo_masks[j])));
+		hi[j] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(hi_masks[j])));
+		}
+
+	for ( int p = 0; p + 32 + fingerprint_len - 1 <= len; p += 32 )
+		{
+		__m256i acc = _mm256_set1_epi8(-1);
+
+		for ( int j = 0; j < fingerprint_len; ++j )
+			{
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + p + j));
+			__m256i l = _mm256_shuffle_epi8(lo[j], _mm256_and_si256(v, nibble));
+			__m256i h = _mm256_shuffle_epi8(hi[j], _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+			acc = _mm256_and_si256(acc, _mm256_and_si256(l, h));
+			}
+
+		uint32_t hits = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, zero)));
+
+		while ( hits )
+			{
+			int k = __builtin_ctz(hits);
+
+			if ( IsCandidate(data, p + k, len) )
+				{
+				*pos = p + k;
+				return true;
+				}
+
+			hits &= hits - 1;
+			}
+
+		*pos = p + 32;
+		}
+
+	return false;
+	}
+
+__attribute__((target("ssse3")))
+bool LiteralPrefilter::ScanSSSE3(const u_char* data, int len, int* pos) const
+	{
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo[MAX_FINGERPRINT];
+	__m128i hi[MAX_FINGERPRINT];
+
+	for ( int j = 0; j < fingerprint_len; ++j )
+		{
+		lo[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(lo_masks[j]));
+		hi[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(hi_masks[j]));
+		}
+
+	for ( int p = 0; p + 16 + fingerprint_len - 1 <= len; p += 16 )
+		{
+		__m128i acc = _mm_set1_epi8(-1);
+
+		for ( int j = 0; j < fingerprint_len; ++j )
+			{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + p + j));
+			__m128i l = _mm_shuffle_epi8(lo[j], _mm_and_si128(v, nibble));
+			__m128i h = _mm_shuffle_epi8(hi[j], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+			acc = _mm_and_si128(acc, _mm_and_si128(l, h));
+			}
+
+		uint32_t hits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) & 0xffff;
+
+		while ( hits )
+			{
+			int k = __builtin_ctz(hits);
+
+			if ( IsCandidate(data, p + k, len) )
+				{
+				*pos = p + k;
+				return true;
+				}
+
+			hits &= hits - 1;
+			}
+
+		*pos = p + 16;
+		}
+
+	return false;
+	}
+
+#endif
+
+void LiteralPrefilter::SetKernel(Kernel k)
+	{
+	kernel = (k <= DetectKernel()) ? k : SCALAR;
+	}
+
+TEST_SUITE_BEGIN("LiteralPrefilter");
+
+TEST_CASE("literal prefilter extraction")
+	{
+	LiteralPrefilter::Literal l;
+
+	CHECK(LiteralPrefilter::Extract(".*foo", &l));
+	CHECK(l.bytes == "foo");
+	CHECK_FALSE(l.caseless);
+
+	CHECK(LiteralPrefilter::Extract(".*.*\\x00\\x01ab*", &l));
+	CHECK(l.bytes == std::string("\x00\x01" "a", 3));
+
+	CHECK(LiteralPrefilter::Extract("(?i:.*GET /)", &l));
+	CHECK(l.bytes == "GET /");
+	CHECK(l.caseless);
+
+	CHECK(LiteralPrefilter::Extract(".*\"a|b\"+c", &l));
+	CHECK(l.bytes == "a|b");
+
+	CHECK(LiteralPrefilter::Extract(".*ab[cd](e|f)", &l));
+	CHECK(l.bytes == "ab");
+
+	CHECK(LiteralPrefilter::Extract(".*\\r\\n\\.\\101$", &l));
+	CHECK(l.bytes == "\r\n.A");
+
+	// Anchored, or not starting with a literal.
+	CHECK_FALSE(LiteralPrefilter::Extract("foo", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract("^.*foo", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".+foo", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*(foo)", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*[f]oo", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*f?oo", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*\"fo\"*o", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*\\x4", &l));
+
+	// Alternatives that may start elsewhere.
+	CHECK_FALSE(LiteralPrefilter::Extract(".*foo|bar", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract("(?i:.*foo)|(bar)", &l));
+	CHECK_FALSE(LiteralPrefilter::Extract(".*foo)|(bar", &l));
+	CHECK(LiteralPrefilter::Extract(".*foo(a|b)[|]\"|\"", &l));
+	CHECK(l.bytes == "foo");
+	}
+
+static void test_scan()
+	{
+	std::vector<LiteralPrefilter::Literal> literals;
+	const char* words[] = { "HTTP/", "\x7f" "ELF", "PK\x03\x04", "MZ", "%PDF", "GIF8",
+	                        "\x89PNG", "<?xml", "SMB", "\xff\xd8\xff" };
+
+	for ( auto w : words )
+		literals.push_back({w, false});
+
+	literals.push_back({"select", true});
+
+	LiteralPrefilter pf(literals);
+	CHECK(pf.NumLiterals() == 11);
+	CHECK(pf.NonCandidateByte() == 0);
+
+	// Positions at which a literal starts must never be skipped, no
+	// matter where the input gets cut off.
+	std::string data(200, 'x');
+	data.replace(37, 2, "MZ");
+	data.replace(90, 6, "SeLeCt");
+	data.replace(150, 3, "SMB");
+
+	auto d = reinterpret_cast<const u_char*>(data.data());
+	int len = data.size();
+
+	for ( int start = 0; start <= len; ++start )
+		{
+		int next = start <= 37 ? 37 : start <= 90 ? 90 : start <= 150 ? 150 : len;
+		CHECK(start + pf.Scan(d + start, len - start) == next);
+		}
+
+	for ( int end = 0; end <= len; ++end )
+		CHECK(pf.Scan(d, end) == std::min(end, 37));
+
+	CHECK(pf.Scan(d, len) == 37);
+	CHECK(pf.Scan(d + 38, len - 38) == 90 - 38);
+	CHECK(pf.Scan(d + 91, len - 91) == 150 - 91);
+	CHECK(pf.Scan(d + 151, len - 151) == len - 151);
+
+	// Incomplete fingerprints at the end of the input.
+	CHECK(pf.Scan(d + 140, 11) == 10);
+	CHECK(pf.Scan(d + 140, 12) == 10);
+	CHECK(pf.Scan(d + 141, 8) == 8);
+	CHECK(pf.Scan(d, 0) == 0);
+	}
+
+TEST_CASE("literal prefilter scan")
+	{
+	auto k = LiteralPrefilter::GetKernel();
+
+	for ( auto test_kernel : { LiteralPrefilter::SCALAR, LiteralPrefilter::SSSE3,
+	                           LiteralPrefilter::AVX2 } )
+		{
+		LiteralPrefilter::SetKernel(test_kernel);
+		test_scan();
+		}
+
+	LiteralPrefilter::SetKernel(k);
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::detail
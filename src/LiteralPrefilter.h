@@ -0,0 +1,115 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "zeek/util.h"
+
+namespace zeek::detail {
+
+/**
+ * A prefilter that quickly skips over input in which none of a set of
+ * literals can start.
+ *
+ * The prefilter looks at the first few bytes (the "fingerprint") of each
+ * literal only. The literals are distributed across eight buckets, and
+ * for each fingerprint position a table records which buckets accept
+ * which byte values. A position is a candidate if there's a bucket
+ * accepting all of the bytes following it. That's the scheme of the
+ * Teddy algorithm, which on CPUs with SSSE3 or AVX2 checks 16 or 32
+ * positions at a time using nibble-indexed shuffles.
+ *
+ * Candidates may be false positives, but a position at which one of the
+ * literals starts is never skipped. That holds across chunk boundaries
+ * as well: when a fingerprint extends past the end of the input, the
+ * position is reported as long as the bytes that are there match.
+ */
+class LiteralPrefilter {
+public:
+	struct Literal {
+		std::string bytes;
+		bool caseless = false;
+	};
+
+	/**
+	 * Determines the literal that every match of a signature pattern
+	 * starts with, if the pattern allows matches to start anywhere in
+	 * the input. That is the case for patterns of the form ".*<literal>
+	 * <rest>", possibly wrapped into "(?i:...)".
+	 *
+	 * @return False if the pattern isn't of that form, or the literal
+	 * would be empty.
+	 */
+	static bool Extract(const char* pattern, Literal* literal);
+
+	/**
+	 * Constructor.
+	 *
+	 * @param literals The literals to look for. Must not be empty, and
+	 * none of them may be empty.
+	 */
+	explicit LiteralPrefilter(const std::vector<Literal>& literals);
+
+	/**
+	 * Returns the offset of the first candidate position in the input,
+	 * or len if there's none.
+	 */
+	int Scan(const u_char* data, int len) const;
+
+	/**
+	 * Returns a byte value that can't start any of the literals, or -1
+	 * if there's no such value.
+	 */
+	int NonCandidateByte() const;
+
+	size_t NumLiterals() const	{ return num_literals; }
+
+	// Implementations of Scan(). By default, the best one that the CPU
+	// supports is used.
+	enum Kernel { SCALAR, SSSE3, AVX2 };
+
+	static Kernel GetKernel()	{ return kernel; }
+
+	/**
+	 * Selects the implementation of Scan() to use, for testing. Falls
+	 * back to the scalar one if the CPU doesn't support the given one.
+	 */
+	static void SetKernel(Kernel k);
+
+	static constexpr int MAX_FINGERPRINT = 3;
+	static constexpr int NUM_BUCKETS = 8;
+
+private:
+	static Kernel DetectKernel();
+
+	bool IsCandidate(const u_char* data, int pos, int len) const;
+	int ScanScalar(const u_char* data, int pos, int len) const;
+
+	// Return true if they found a candidate, and in any case set pos
+	// to where they stopped.
+	bool ScanAVX2(const u_char* data, int len, int* pos) const;
+	bool ScanSSSE3(const u_char* data, int len, int* pos) const;
+
+	void AddByte(int bucket, int pos, u_char c);
+
+	size_t num_literals;
+	int fingerprint_len;
+
+	// For each fingerprint position and byte value, the buckets that
+	// accept the byte there.
+	uint8_t masks[MAX_FINGERPRINT][256];
+
+	// The same split up by the low and high nibbles of the bytes, for
+	// the vectorized scan.
+	alignas(16) uint8_t lo_masks[MAX_FINGERPRINT][16];
+	alignas(16) uint8_t hi_masks[MAX_FINGERPRINT][16];
+
+	static Kernel kernel;
+};
+
+} // namespace zeek::detail
@@ -3,6 +3,8 @@
 #include "zeek/zeek-config.h"
 
 #include "zeek/NetVar.h"
+#include "zeek/ConnArena.h"
+#include "zeek/Reporter.h"
 #include "zeek/Var.h"
 #include "zeek/EventHandler.h"
 #include "zeek/Val.h"
@@ -112,6 +114,7 @@ int watchdog_interval;
 int max_timer_expires;
 
 int ignore_checksums;
+GlobalPrefixSet* ignore_checksums_nets;
 int partial_connection_ok;
 int tcp_SYN_ack_ok;
 int tcp_match_undelivered;
@@ -180,6 +183,8 @@ int load_sample_freq;
 int packet_filter_default;
 
 int sig_max_group_size;
+int sig_literal_prefilter;
+bro_uint_t sig_max_dfa_mem;
 
 int dpd_reassemble_first_packets;
 int dpd_buffer_size;
@@ -240,6 +245,8 @@ void init_general_global_var()
 	table_incremental_step = id::find_val("table_incremental_step")->AsCount();
 	packet_filter_default = id::find_val("packet_filter_default")->AsBool();
 	sig_max_group_size = id::find_val("sig_max_group_size")->AsCount();
+	sig_literal_prefilter = id::find_val("sig_literal_prefilter")->AsBool();
+	sig_max_dfa_mem = id::find_val("sig_max_dfa_mem")->AsCount();
 	check_for_unused_event_handlers = id::find_val("check_for_unused_event_handlers")->AsBool();
 	record_all_packets = id::find_val("record_all_packets")->AsBool();
 	bits_per_uid = id::find_val("bits_per_uid")->AsCount();
@@ -256,6 +263,7 @@ void init_net_var()
 	bif_init_net_var();
 
 	ignore_checksums = id::find_val("ignore_checksums")->AsBool();
+	ignore_checksums_nets = new GlobalPrefixSet("ignore_checksums_nets");
 	partial_connection_ok = id::find_val("partial_connection_ok")->AsBool();
 	tcp_SYN_ack_ok = id::find_val("tcp_SYN_ack_ok")->AsBool();
 	tcp_match_undelivered = id::find_val("tcp_match_undelivered")->AsBool();
@@ -302,6 +310,9 @@ void init_net_var()
 
 	max_timer_expires = id::find_val("max_timer_expires")->AsCount();
 
+	if ( ! ConnArena::SetEnabled(id::find_val("use_conn_arena")->AsBool()) )
+		reporter->InternalWarning("use_conn_arena set with per-connection state in use already");
+
 	mime_segment_length = id::find_val("mime_segment_length")->AsCount();
 	mime_segment_overlap_length = id::find_val("mime_segment_overlap_length")->AsCount();
 
@@ -5,6 +5,7 @@
 #include "zeek/Val.h"
 #include "zeek/EventRegistry.h"
 #include "zeek/Stats.h"
+#include "zeek/PrefixSet.h"
 
 namespace zeek::detail {
 
@@ -13,6 +14,7 @@ extern int watchdog_interval;
 extern int max_timer_expires;
 
 extern int ignore_checksums;
+extern GlobalPrefixSet* ignore_checksums_nets;
 extern int partial_connection_ok;
 extern int tcp_SYN_ack_ok;
 extern int tcp_match_undelivered;
@@ -81,6 +83,8 @@ extern int load_sample_freq;
 extern int packet_filter_default;
 
 extern int sig_max_group_size;
+extern int sig_literal_prefilter;
+extern bro_uint_t sig_max_dfa_mem;
 
 extern int dpd_reassemble_first_packets;
 extern int dpd_buffer_size;
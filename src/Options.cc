@@ -15,6 +15,7 @@
 #include <sstream>
 
 #include "zeek/bsd-getopt-long.h"
+#include "zeek/Timer.h"
 #include "zeek/logging/writers/ascii/Ascii.h"
 
 namespace zeek {
@@ -40,6 +41,7 @@ void Options::filter_supervised_node_options()
 	ignore_checksums = og.ignore_checksums;
 	use_watchdog = og.use_watchdog;
 	pseudo_realtime = og.pseudo_realtime;
+	timer_wheel_resolution = og.timer_wheel_resolution;
 	dns_mode = og.dns_mode;
 
 	bare_mode = og.bare_mode;
@@ -122,6 +124,8 @@ void usage(const char* prog, int code)
 #endif
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]  | enable pseudo-realtime for performance evaluation (default 1)\n");
 	fprintf(stderr, "    -j|--jobs                      | enable supervisor mode\n");
+	fprintf(stderr, "    --precompile-signatures <file> | write the fully computed DFAs of all signatures to file and exit\n");
+	fprintf(stderr, "    --timer-wheel[=<resolution>]   | use timing-wheel timer manager with given slot width in seconds (default %g)\n", detail::Wheel_TimerMgr::DEFAULT_RESOLUTION);
 
 #ifdef USE_IDMEF
 	fprintf(stderr, "    -n|--idmef-dtd <idmef-msg.dtd> | specify path to IDMEF DTD file\n");
@@ -165,6 +169,7 @@ static void set_analysis_option(const char* opt, Options& opts)
 		fprintf(stderr, "    optimize-AST	optimize the (transformed) AST; implies xform\n");
 		fprintf(stderr, "    recursive	report on recursive functions and exit\n");
 		fprintf(stderr, "    xform	tranform scripts to \"reduced\" form\n");
+		fprintf(stderr, "    ZAM	compile scripts to ZAM instructions; implies xform\n");
 		exit(0);
 		}
 
@@ -182,6 +187,8 @@ static void set_analysis_option(const char* opt, Options& opts)
 		a_o.activate = true;
 	else if ( util::streq(opt, "optimize-AST") )
 		a_o.activate = a_o.optimize_AST = true;
+	else if ( util::streq(opt, "ZAM") )
+		a_o.activate = a_o.gen_ZAM_code = true;
 
 	else
 		{
@@ -325,6 +332,8 @@ Options parse_cmdline(int argc, char** argv)
 
 		{"pseudo-realtime",	optional_argument, nullptr,	'E'},
 		{"jobs",	optional_argument, nullptr,	'j'},
+		{"timer-wheel",	optional_argument, nullptr,	'L'},
+		{"precompile-signatures",	required_argument, nullptr,	'K'},
 		{"test",		no_argument,		nullptr,	'#'},
 
 		{nullptr,			0,			nullptr,	0},
@@ -439,6 +448,22 @@ Options parse_cmdline(int argc, char** argv)
 			if ( optarg )
 				rval.pseudo_realtime = atof(optarg);
 			break;
+		case 'L':
+			rval.timer_wheel_resolution = detail::Wheel_TimerMgr::DEFAULT_RESOLUTION;
+			if ( optarg )
+				{
+				rval.timer_wheel_resolution = atof(optarg);
+
+				if ( *rval.timer_wheel_resolution <= 0 )
+					{
+					fprintf(stderr, "ERROR: --timer-wheel resolution must be positive.\n");
+					exit(1);
+					}
+				}
+			break;
+		case 'K':
+			rval.signature_dfa_output_file = optarg;
+			break;
 		case 'F':
 			if ( rval.dns_mode != detail::DNS_DEFAULT )
 				usage(zargs[0], 1);
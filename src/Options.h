@@ -46,6 +46,7 @@ struct Options {
 	bool ignore_checksums = false;
 	bool use_watchdog = false;
 	double pseudo_realtime = 0;
+	std::optional<double> timer_wheel_resolution;
 	detail::DNS_MgrMode dns_mode = detail::DNS_DEFAULT;
 
 	bool supervisor_mode = false;
@@ -64,6 +65,7 @@ struct Options {
 	std::optional<std::string> interface;
 	std::optional<std::string> pcap_file;
 	std::vector<std::string> signature_files;
+	std::optional<std::string> signature_dfa_output_file;
 
 	std::optional<std::string> pcap_output_file;
 	std::optional<std::string> random_seed_input_file;
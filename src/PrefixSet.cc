@@ -0,0 +1,307 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/PrefixSet.h"
+
+#include <algorithm>
+#include <bitset>
+
+#include "zeek/ID.h"
+#include "zeek/Reporter.h"
+#include "zeek/Val.h"
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+// The upper 96 bits of IPv4-mapped IPv6 addresses.
+static constexpr uint64_t V4_MAPPED_HI = 0;
+static constexpr uint64_t V4_MAPPED_LO = 0x0000ffff00000000ULL;
+
+static inline uint64_t hi_mask(int len)
+	{
+	return len <= 0 ? 0 : (len >= 64 ? ~uint64_t(0) : ~uint64_t(0) << (64 - len));
+	}
+
+static inline uint64_t lo_mask(int len)
+	{
+	return hi_mask(len - 64);
+	}
+
+static inline int popcount(uint64_t x)
+	{
+	return std::bitset<64>(x).count();
+	}
+
+// Returns the six bits starting at the given offset, counting from the
+// most significant one, padded with zeros past the end of the address.
+static inline uint32_t chunk_at(uint64_t hi, uint64_t lo, int off)
+	{
+	uint64_t bits;
+
+	if ( off <= 58 )
+		bits = hi >> (58 - off);
+	else if ( off < 64 )
+		bits = (hi << (off - 58)) | (lo >> (122 - off));
+	else if ( off <= 122 )
+		bits = lo >> (122 - off);
+	else
+		bits = lo << (off - 122);
+
+	return bits & 0x3f;
+	}
+
+PrefixSet::PrefixSet(const std::vector<IPPrefix>& prefixes)
+	{
+	std::vector<Prefix6> v6;
+
+	for ( const auto& p : prefixes )
+		{
+		uint32_t w[4];
+		p.Prefix().CopyIPv6(w, IPAddr::Host);
+
+		Prefix6 p6;
+		p6.hi = (uint64_t(w[0]) << 32) | w[1];
+		p6.lo = (uint64_t(w[2]) << 32) | w[3];
+		p6.len = p.LengthIPv6();
+
+		// Whether the prefix covers any IPv4 addresses, and whether
+		// it lies entirely within them.
+		int cmp_len = std::min(p6.len, 96);
+		bool has_v4 =
+			((p6.hi ^ V4_MAPPED_HI) & hi_mask(cmp_len)) == 0 &&
+			((p6.lo ^ V4_MAPPED_LO) & lo_mask(cmp_len)) == 0;
+
+		if ( has_v4 )
+			{
+			uint32_t mask4 = p6.len <= 96 ? 0 : uint32_t(lo_mask(p6.len));
+			uint32_t lo4 = uint32_t(p6.lo) & mask4;
+			v4_ranges.emplace_back(lo4, lo4 | ~mask4);
+
+			if ( p6.len >= 96 )
+				continue;
+			}
+
+		v6.push_back(p6);
+		}
+
+	// Merge overlapping and adjacent ranges.
+	std::sort(v4_ranges.begin(), v4_ranges.end());
+
+	size_t n = 0;
+
+	for ( const auto& r : v4_ranges )
+		{
+		if ( n > 0 && (v4_ranges[n-1].second == UINT32_MAX ||
+		               r.first <= v4_ranges[n-1].second + 1) )
+			v4_ranges[n-1].second = std::max(v4_ranges[n-1].second, r.second);
+		else
+			v4_ranges[n++] = r;
+		}
+
+	v4_ranges.resize(n);
+
+	if ( v6.empty() )
+		return;
+
+	std::vector<const Prefix6*> root;
+
+	for ( const auto& p6 : v6 )
+		root.push_back(&p6);
+
+	v6_nodes.resize(1);
+	BuildNode(0, 0, root);
+	}
+
+void PrefixSet::BuildNode(uint32_t idx, int off, const std::vector<const Prefix6*>& prefixes)
+	{
+	bool leaf[64] = { false };
+	std::vector<const Prefix6*> below[64];
+
+	// Prefixes ending within our six bits cover a range of children;
+	// longer ones go further down.
+	for ( auto p : prefixes )
+		{
+		auto c = chunk_at(p->hi, p->lo, off);
+
+		if ( p->len <= off + 6 )
+			{
+			int free_bits = off + 6 - p->len;
+			uint32_t first = (c >> free_bits) << free_bits;
+
+			for ( uint32_t i = first; i < first + (1U << free_bits); ++i )
+				leaf[i] = true;
+			}
+		else
+			below[c].push_back(p);
+		}
+
+	Node node;
+	node.vector = 0;
+	node.leafvec = 0;
+	node.base0 = v6_leaves.size();
+	node.base1 = v6_nodes.size();
+
+	for ( int c = 0; c < 64; ++c )
+		{
+		if ( ! leaf[c] && ! below[c].empty() )
+			{
+			node.vector |= uint64_t(1) << c;
+			continue;
+			}
+
+		if ( v6_leaves.size() == node.base0 || v6_leaves.back() != leaf[c] )
+			{
+			node.leafvec |= uint64_t(1) << c;
+			v6_leaves.push_back(leaf[c]);
+			}
+		}
+
+	v6_nodes[idx] = node;
+	v6_nodes.resize(v6_nodes.size() + popcount(node.vector));
+
+	uint32_t child = node.base1;
+
+	for ( int c = 0; c < 64; ++c )
+		if ( node.vector & (uint64_t(1) << c) )
+			BuildNode(child++, off + 6, below[c]);
+	}
+
+bool PrefixSet::Contains(const IPAddr& a) const
+	{
+	if ( a.GetFamily() == IPv4 )
+		{
+		if ( v4_ranges.empty() )
+			return false;
+
+		in4_addr in4;
+		a.CopyIPv4(&in4);
+		uint32_t a4 = ntohl(in4.s_addr);
+
+		// The last range starting at or before the address.
+		auto it = std::upper_bound(v4_ranges.begin(), v4_ranges.end(),
+		                           std::make_pair(a4, UINT32_MAX));
+
+		return it != v4_ranges.begin() && a4 <= (--it)->second;
+		}
+
+	if ( v6_nodes.empty() )
+		return false;
+
+	uint32_t w[4];
+	a.CopyIPv6(w, IPAddr::Host);
+	uint64_t hi = (uint64_t(w[0]) << 32) | w[1];
+	uint64_t lo = (uint64_t(w[2]) << 32) | w[3];
+
+	const Node* n = &v6_nodes[0];
+
+	for ( int off = 0; ; off += 6 )
+		{
+		auto c = chunk_at(hi, lo, off);
+		uint64_t upto = (uint64_t(2) << c) - 1;
+
+		if ( ! (n->vector & (uint64_t(1) << c)) )
+			return v6_leaves[n->base0 + popcount(n->leafvec & upto) - 1];
+
+		n = &v6_nodes[n->base1 + popcount(n->vector & upto) - 1];
+		}
+	}
+
+GlobalPrefixSet::GlobalPrefixSet(const char* name)
+	{
+	id = id::find(name);
+
+	if ( ! id )
+		reporter->InternalError("global %s is not defined", name);
+
+	notifier::detail::registry.Register(id.get(), this);
+	}
+
+GlobalPrefixSet::~GlobalPrefixSet()
+	{
+	notifier::detail::registry.Unregister(id.get(), this);
+
+	if ( table )
+		notifier::detail::registry.Unregister(table.get(), this);
+	}
+
+void GlobalPrefixSet::Rebuild()
+	{
+	const auto& v = id->GetVal();
+
+	if ( v.get() != table.get() )
+		{
+		if ( table )
+			notifier::detail::registry.Unregister(table.get(), this);
+
+		table = nullptr;
+
+		if ( v && v->GetType()->Tag() == TYPE_TABLE )
+			{
+			table = {NewRef{}, v->AsTableVal()};
+			notifier::detail::registry.Register(table.get(), this);
+			}
+		}
+
+	std::vector<IPPrefix> elems;
+
+	if ( table )
+		{
+		for ( const auto& te : *table->AsTable() )
+			{
+			auto k = te.GetHashKey();
+			auto index = table->RecreateIndex(*k);
+
+			if ( index->Length() != 1 )
+				continue;
+
+			const auto& iv = index->Idx(0);
+
+			if ( iv->GetType()->Tag() == TYPE_SUBNET )
+				elems.push_back(iv->AsSubNet());
+			else if ( iv->GetType()->Tag() == TYPE_ADDR )
+				elems.emplace_back(iv->AsAddr(), 128, true);
+			}
+		}
+
+	prefixes = PrefixSet(elems);
+	dirty = false;
+	}
+
+TEST_CASE("prefix set")
+	{
+	std::vector<IPPrefix> nets = {
+		IPPrefix(IPAddr("10.0.0.0"), 8),
+		IPPrefix(IPAddr("192.168.1.0"), 24),
+		IPPrefix(IPAddr("192.168.2.0"), 24),
+		IPPrefix(IPAddr("2001:db8::"), 32),
+		IPPrefix(IPAddr("2001:db8:1::1"), 128),
+		IPPrefix(IPAddr("fe80::"), 10),
+	};
+
+	PrefixSet s(nets);
+
+	CHECK(s.Contains(IPAddr("10.1.2.3")));
+	CHECK(s.Contains(IPAddr("192.168.1.255")));
+	CHECK(s.Contains(IPAddr("192.168.2.0")));
+	CHECK_FALSE(s.Contains(IPAddr("192.168.3.0")));
+	CHECK_FALSE(s.Contains(IPAddr("11.0.0.0")));
+	CHECK(s.Contains(IPAddr("2001:db8:ffff::1")));
+	CHECK_FALSE(s.Contains(IPAddr("2001:db9::")));
+	CHECK(s.Contains(IPAddr("febf::1")));
+	CHECK_FALSE(s.Contains(IPAddr("fec0::1")));
+	CHECK_FALSE(s.Contains(IPAddr("::1")));
+
+	PrefixSet all_v6({IPPrefix(IPAddr("::"), 0)});
+
+	// ::/0 covers the IPv4-mapped addresses as well.
+	CHECK(all_v6.Contains(IPAddr("1.2.3.4")));
+	CHECK(all_v6.Contains(IPAddr("::1")));
+
+	PrefixSet empty;
+
+	CHECK(empty.Empty());
+	CHECK_FALSE(empty.Contains(IPAddr("10.1.2.3")));
+	CHECK_FALSE(empty.Contains(IPAddr("::1")));
+	}
+
+} // namespace zeek::detail
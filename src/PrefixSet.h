@@ -0,0 +1,97 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Compiled sets of subnets, for code that needs to check addresses
+// against script-level sets on a per-packet basis.
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "zeek/IPAddr.h"
+#include "zeek/IntrusivePtr.h"
+#include "zeek/Notifier.h"
+
+namespace zeek {
+
+class TableVal;
+using TableValPtr = IntrusivePtr<TableVal>;
+
+namespace detail {
+
+class ID;
+using IDPtr = IntrusivePtr<ID>;
+
+// An immutable set of prefixes supporting fast membership tests.  The
+// parts covering IPv4 addresses go into a sorted table of disjoint
+// address ranges that we binary-search, the IPv6 ones into a poptrie
+// (Asai and Ohara, "Poptrie: A Compressed Trie with Population Count
+// for Fast and Scalable Software IP Routing Table Lookup", SIGCOMM 2015).
+class PrefixSet {
+public:
+	PrefixSet() = default;
+	explicit PrefixSet(const std::vector<IPPrefix>& prefixes);
+
+	bool Contains(const IPAddr& a) const;
+
+	bool Empty() const	{ return v4_ranges.empty() && v6_nodes.empty(); }
+
+protected:
+	struct Prefix6 {
+		uint64_t hi, lo;
+		int len;
+	};
+
+	// Poptrie nodes consume six bits of the address.  Their children
+	// that are nodes themselves are consecutive in v6_nodes, starting
+	// at base1, and the others are leaves, stored in v6_leaves starting
+	// at base0, with runs of equal leaves collapsed into one.
+	struct Node {
+		uint64_t vector;	// Which children are nodes.
+		uint64_t leafvec;	// Where runs of leaves start.
+		uint32_t base0;
+		uint32_t base1;
+	};
+
+	void BuildNode(uint32_t idx, int off, const std::vector<const Prefix6*>& prefixes);
+
+	// Sorted, disjoint and non-adjacent ranges, in host order.
+	std::vector<std::pair<uint32_t, uint32_t>> v4_ranges;
+
+	std::vector<Node> v6_nodes;
+	std::vector<uint8_t> v6_leaves;
+};
+
+// A PrefixSet tracking the contents of a global set or table indexed by
+// subnets or addresses.  It gets rebuilt upon the first lookup after the
+// global's value changed, or the global changed to a different value.
+class GlobalPrefixSet : public notifier::detail::Receiver {
+public:
+	explicit GlobalPrefixSet(const char* name);
+	~GlobalPrefixSet() override;
+
+	bool Contains(const IPAddr& a)
+		{
+		if ( dirty )
+			Rebuild();
+
+		return prefixes.Contains(a);
+		}
+
+	// As the registry may be in the midst of iterating over its
+	// receivers, we only take note of the change here.
+	void Modified(notifier::detail::Modifiable* m) override
+		{ dirty = true; }
+
+protected:
+	void Rebuild();
+
+	IDPtr id;
+	TableValPtr table;
+	PrefixSet prefixes;
+	bool dirty = true;
+};
+
+} // namespace detail
+} // namespace zeek
@@ -9,6 +9,7 @@
 #include "zeek/DFA.h"
 #include "zeek/CCL.h"
 #include "zeek/EquivClass.h"
+#include "zeek/LiteralPrefilter.h"
 #include "zeek/Reporter.h"
 #include "zeek/ZeekString.h"
 
@@ -34,6 +35,8 @@ Specific_RE_Matcher::Specific_RE_Matcher(match_type arg_mt, int arg_multiline)
 	dfa = nullptr;
 	ecs = nullptr;
 	accepted = new AcceptingSet();
+	prefilter = nullptr;
+	prefilter_idle_state = nullptr;
 	}
 
 Specific_RE_Matcher::~Specific_RE_Matcher()
@@ -41,9 +44,11 @@ Specific_RE_Matcher::~Specific_RE_Matcher()
 	for ( int i = 0; i < ccl_list.length(); ++i )
 		delete ccl_list[i];
 
+	Unref(prefilter_idle_state);
 	Unref(dfa);
 	delete [] pattern_text;
 	delete accepted;
+	delete prefilter;
 	}
 
 CCL* Specific_RE_Matcher::AnyCCL()
@@ -197,6 +202,37 @@ bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx
 	return true;
 	}
 
+bool Specific_RE_Matcher::SetPrefilter(LiteralPrefilter* arg_prefilter)
+	{
+	// After a byte that can't start any of the literals, only the
+	// leading ".*" of the expressions remains active. From there, the
+	// DFA should stay put on further such bytes.
+	DFA_State* idle = nullptr;
+	int c = arg_prefilter->NonCandidateByte();
+
+	if ( dfa && c >= 0 )
+		{
+		idle = dfa->StartState()->Xtion(ecs[c], dfa);
+
+		if ( idle && idle->Xtion(ecs[c], dfa) != idle )
+			idle = nullptr;
+		}
+
+	if ( ! idle )
+		{
+		delete arg_prefilter;
+		return false;
+		}
+
+	Ref(idle);
+	Unref(prefilter_idle_state);
+	delete prefilter;
+
+	prefilter = arg_prefilter;
+	prefilter_idle_state = idle;
+	return true;
+	}
+
 std::string Specific_RE_Matcher::LookupDef(const std::string& def)
 	{
 	const auto& iter = defs.find(def);
@@ -310,9 +346,39 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as,
 		accepted_matches.insert(am_idx(*it, position));
 	}
 
+RE_Match_State::~RE_Match_State()
+	{
+	Unref(current_state);
+	}
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+	Unref(current_state);
+	current_state = nullptr;
+	accepted_matches.clear();
+	}
+
 bool RE_Match_State::Match(const u_char* bv, int n,
 				bool bol, bool eol, bool clear)
 	{
+	DFA_State* prev_state = current_state;
+	bool rval = DoMatch(bv, n, bol, eol, clear);
+
+	if ( current_state != prev_state )
+		{
+		if ( current_state )
+			Ref(current_state);
+
+		Unref(prev_state);
+		}
+
+	return rval;
+	}
+
+bool RE_Match_State::DoMatch(const u_char* bv, int n,
+				bool bol, bool eol, bool clear)
+	{
 	if ( current_pos == -1 )
 		{
 		// First call to Match().
@@ -349,6 +415,25 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 			ec = ecs[SYM_BOL];
 		else if ( m == -1 )
 			ec = ecs[SYM_EOL];
+		else if ( prefilter && (current_state == idle_state ||
+		                        current_state == dfa->StartState()) )
+			{
+			// No match in progress, so we can skip ahead to where
+			// the next one may start. Nothing gets lost by resuming
+			// the DFA there: any match needs to begin with one of
+			// the literals.
+			int skip = prefilter->Scan(bv, m + 1);
+			bv += skip;
+			current_pos += skip;
+			m -= skip;
+
+			if ( m >= 0 )
+				ec = ecs[*(bv++)];
+			else if ( eol )
+				ec = ecs[SYM_EOL];
+			else
+				break;
+			}
 		else
 			ec = ecs[*(bv++)];
 
@@ -29,6 +29,7 @@ class DFA_Machine;
 class DFA_State;
 class Specific_RE_Matcher;
 class CCL;
+class LiteralPrefilter;
 
 extern int case_insensitive;
 extern CCL* curr_ccl;
@@ -96,6 +97,19 @@ public:
 	// to the matching expressions.  (idx must not contain zeros).
 	bool CompileSet(const string_list& set, const int_list& idx);
 
+	// Installs a prefilter for a set compiled with CompileSet(), which
+	// lets RE_Match_State skip input that can't start a match. All the
+	// expressions of the set must start with ".*", followed by one of
+	// the prefilter's literals. Takes ownership of the prefilter.
+	// Returns false, and discards the prefilter, if it can't be used.
+	bool SetPrefilter(LiteralPrefilter* prefilter);
+
+	const LiteralPrefilter* Prefilter() const	{ return prefilter; }
+
+	// The DFA state in which no match is in progress, if there's a
+	// prefilter.
+	DFA_State* PrefilterIdleState() const	{ return prefilter_idle_state; }
+
 	// Returns the position in s just beyond where the first match
 	// occurs, or 0 if there is no such position in s.  Note that
 	// if the pattern matches empty strings, matching continues
@@ -141,6 +155,8 @@ protected:
 	DFA_Machine* dfa;
 	CCL* any_ccl;
 	AcceptingSet* accepted;
+	LiteralPrefilter* prefilter;
+	DFA_State* prefilter_idle_state;
 };
 
 class RE_Match_State {
@@ -149,10 +165,17 @@ public:
 		{
 		dfa = matcher->DFA() ? matcher->DFA() : nullptr;
 		ecs = matcher->EC()->EquivClasses();
+		prefilter = matcher->Prefilter();
+		idle_state = matcher->PrefilterIdleState();
 		current_pos = -1;
 		current_state = nullptr;
 		}
 
+	~RE_Match_State();
+
+	RE_Match_State(const RE_Match_State&) = delete;
+	RE_Match_State& operator=(const RE_Match_State&) = delete;
+
 	const AcceptingMatchSet& AcceptedMatches() const
 		{ return accepted_matches; }
 
@@ -163,20 +186,25 @@ public:
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = nullptr;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
 protected:
+	bool DoMatch(const u_char* bv, int n, bool bol, bool eol, bool clear);
+
 	DFA_Machine* dfa;
 	int* ecs;
 
+	// While the DFA is in the idle state (or the start state), input
+	// that the prefilter rules out is skipped.
+	const LiteralPrefilter* prefilter;
+	DFA_State* idle_state;
+
 	AcceptingMatchSet accepted_matches;
+
+	// We hold a reference to it between calls to Match(), so that the
+	// DFA's state cache doesn't evict it.
 	DFA_State* current_state;
 	int current_pos;
 };
@@ -18,7 +18,7 @@ DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
 	{
 	seq = arg_seq;
 	upper = seq + size;
-	block = new u_char[size];
+	block = static_cast<u_char*>(detail::ConnArena::Allocate(size));
 	memcpy(block, data, size);
 	}
 
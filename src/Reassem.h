@@ -9,6 +9,7 @@
 #include <map>
 
 #include "zeek/Obj.h"
+#include "zeek/ConnArena.h"
 
 namespace zeek {
 
@@ -42,7 +43,7 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		auto size = other.Size();
-		block = new u_char[size];
+		block = static_cast<u_char*>(detail::ConnArena::Allocate(size));
 		memcpy(block, other.block, size);
 		}
 
@@ -62,8 +63,8 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		auto size = other.Size();
-		delete [] block;
-		block = new u_char[size];
+		detail::ConnArena::Free(block);
+		block = static_cast<u_char*>(detail::ConnArena::Allocate(size));
 		memcpy(block, other.block, size);
 		return *this;
 		}
@@ -75,14 +76,14 @@ public:
 
 		seq = other.seq;
 		upper = other.upper;
-		delete [] block;
+		detail::ConnArena::Free(block);
 		block = other.block;
 		other.block = nullptr;
 		return *this;
 		}
 
 	~DataBlock()
-		{ delete [] block; }
+		{ detail::ConnArena::Free(block); }
 
 	/**
 	 * @return length of the data block
@@ -92,10 +93,11 @@ public:
 
 	uint64_t seq;
 	uint64_t upper;
-	u_char* block;
+	u_char* block;	// allocated from the connection arena
 };
 
-using DataBlockMap = std::map<uint64_t, DataBlock>;
+using DataBlockMap = std::map<uint64_t, DataBlock, std::less<uint64_t>,
+                              detail::ConnArenaAllocator<std::pair<const uint64_t, DataBlock>>>;
 
 
 /**
@@ -251,7 +253,7 @@ private:
 	DataBlockMap block_map;
 };
 
-class Reassembler : public Obj {
+class Reassembler : public Obj, public detail::ConnArenaObject {
 public:
 	Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
 	~Reassembler() override	{}
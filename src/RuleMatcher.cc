@@ -14,6 +14,7 @@
 #include "zeek/IP.h"
 #include "zeek/analyzer/Analyzer.h"
 #include "zeek/DFA.h"
+#include "zeek/digest.h"
 #include "zeek/DebugLogger.h"
 #include "zeek/NetVar.h"
 #include "zeek/Scope.h"
@@ -42,6 +43,10 @@ namespace zeek::detail {
 
 uint32_t RuleHdrTest::idcounter = 0;
 
+// The maximum number of states of a pattern set's DFA for precompiling
+// it. Larger DFAs are left to be built up while matching, as usual.
+static constexpr int MAX_PRECOMPILED_STATES = 10000;
+
 static bool is_member_of(const int_list& l, int_list::value_type v)
 	{
 	return std::find(l.begin(), l.end(), v) != l.end();
@@ -252,7 +257,8 @@ void RuleMatcher::Delete(RuleHdrTest* node)
 	delete node;
 	}
 
-bool RuleMatcher::ReadFiles(const std::vector<std::string>& files)
+bool RuleMatcher::ReadFiles(const std::vector<std::string>& files,
+                            const char* dfa_file)
 	{
 #ifdef USE_PERFTOOLS_DEBUG
 	HeapLeakChecker::Disabler disabler;
@@ -260,6 +266,11 @@ bool RuleMatcher::ReadFiles(const std::vector<std::string>& files)
 
 	parse_error = false;
 
+	// Precompiled DFAs are only valid for the signatures, and the
+	// version of the regular expression engine, they've been built from.
+	EVP_MD_CTX* key_ctx = hash_init(Hash_MD5);
+	hash_update(key_ctx, VERSION, strlen(VERSION) + 1);
+
 	for ( const auto& f : files )
 		{
 		rules_in = util::open_file(util::find_file(f, util::zeek_path(), ".sig"));
@@ -267,27 +278,102 @@ bool RuleMatcher::ReadFiles(const std::vector<std::string>& files)
 		if ( ! rules_in )
 			{
 			reporter->Error("Can't open signature file %s", f.data());
+			hash_final(key_ctx, rules_key.data());
 			return false;
 			}
 
+		char buf[8192];
+		size_t n;
+		uint64_t size = 0;
+
+		while ( (n = fread(buf, 1, sizeof(buf), rules_in)) > 0 )
+			{
+			hash_update(key_ctx, buf, n);
+			size += n;
+			}
+
+		hash_update(key_ctx, &size, sizeof(size));
+		rewind(rules_in);
+
 		rules_line_number = 0;
 		current_rule_file = f.data();
 		rules_parse();
 		fclose(rules_in);
 		}
 
+	hash_final(key_ctx, rules_key.data());
+
 	if ( parse_error )
 		return false;
 
+	if ( dfa_file && *dfa_file )
+		{
+		std::string error;
+		dfa_image = std::make_unique<DFA_Image>();
+
+		if ( ! dfa_image->Open(dfa_file, rules_key, &error) )
+			{
+			reporter->Warning("not using precompiled signature DFAs: %s", error.c_str());
+			dfa_image.reset();
+			}
+		}
+
 	BuildRulesTree();
 
 	string_list exprs[Rule::TYPES];
 	int_list ids[Rule::TYPES];
 	BuildRegEx(root, exprs, ids);
 
+	dfa_image.reset();
+
 	return ! parse_error;
 	}
 
+bool RuleMatcher::PrecompileDFAs(const char* dfa_file)
+	{
+	DFA_ImageWriter writer;
+	int left_out = PrecompileDFAs(&writer, root);
+
+	std::string error;
+
+	if ( ! writer.Write(dfa_file, rules_key, &error) )
+		{
+		reporter->Error("can't precompile signatures: %s", error.c_str());
+		return false;
+		}
+
+	reporter->Info("precompiled %zu signature pattern sets with %zu DFA states into %s"
+	               " (%d sets left out for exceeding %d states)",
+	               writer.NumSets(), writer.NumStates(), dfa_file,
+	               left_out, MAX_PRECOMPILED_STATES);
+
+	return true;
+	}
+
+int RuleMatcher::PrecompileDFAs(DFA_ImageWriter* writer, RuleHdrTest* hdr_test)
+	{
+	int left_out = 0;
+
+	for ( int i = 0; i < Rule::TYPES; ++i )
+		{
+		for ( const auto& set : hdr_test->psets[i] )
+			{
+			if ( ! set->re->DFA() )
+				continue;
+
+			auto key = DFA_Image::SetKey(set->patterns, set->ids);
+
+			if ( ! writer->Add(key, set->re, MAX_PRECOMPILED_STATES) )
+				++left_out;
+			}
+		}
+
+	for ( RuleHdrTest* h = hdr_test->child; h; h = h->sibling )
+		left_out += PrecompileDFAs(writer, h);
+
+	return left_out;
+	}
+
 void RuleMatcher::AddRule(Rule* rule)
 	{
 	if ( rules_by_id.find(rule->ID()) != rules_by_id.end() )
@@ -439,10 +525,50 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 	{
 	assert(static_cast<size_t>(exprs.length()) == ids.size());
 
+	// Patterns that may match anywhere, starting with a literal, go into
+	// groups of their own. Their matchers skip over the input with a
+	// prefilter until one of the literals shows up, which a single
+	// pattern without such a literal would prevent.
+	string_list plain_exprs;
+	int_list plain_ids;
+	string_list literal_exprs;
+	int_list literal_ids;
+	std::vector<LiteralPrefilter::Literal> literals;
+
+	loop_over_list(exprs, i)
+		{
+		LiteralPrefilter::Literal literal;
+
+		if ( sig_literal_prefilter &&
+		     LiteralPrefilter::Extract(exprs[i], &literal) )
+			{
+			literal_exprs.push_back(exprs[i]);
+			literal_ids.push_back(ids[i]);
+			literals.push_back(std::move(literal));
+			}
+		else
+			{
+			plain_exprs.push_back(exprs[i]);
+			plain_ids.push_back(ids[i]);
+			}
+		}
+
+	if ( plain_exprs.length() )
+		BuildPatternGroups(dst, plain_exprs, plain_ids, nullptr);
+
+	if ( literal_exprs.length() )
+		BuildPatternGroups(dst, literal_exprs, literal_ids, &literals);
+	}
+
+void RuleMatcher::BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+                                     const string_list& exprs, const int_list& ids,
+                                     const std::vector<LiteralPrefilter::Literal>* literals)
+	{
 	// We build groups of at most sig_max_group_size regexps.
 
 	string_list group_exprs;
 	int_list group_ids;
+	std::vector<LiteralPrefilter::Literal> group_literals;
 
 	for ( int i = 0; i < exprs.length() + 1 /* sic! */; i++ )
 		{
@@ -450,6 +576,9 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 			{
 			group_exprs.push_back(exprs[i]);
 			group_ids.push_back(ids[i]);
+
+			if ( literals )
+				group_literals.push_back((*literals)[i]);
 			}
 
 		if ( group_exprs.length() > sig_max_group_size ||
@@ -461,10 +590,21 @@ void RuleMatcher::BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 			set->re->CompileSet(group_exprs, group_ids);
 			set->patterns = group_exprs;
 			set->ids = group_ids;
+
+			if ( dfa_image && set->re->DFA() )
+				dfa_image->Load(DFA_Image::SetKey(group_exprs, group_ids), set->re);
+
+			if ( set->re->DFA() )
+				set->re->DFA()->Cache()->SetMaxMem(sig_max_dfa_mem);
+
+			if ( literals && ! group_literals.empty() )
+				set->re->SetPrefilter(new LiteralPrefilter(group_literals));
+
 			dst->push_back(set);
 
 			group_exprs.clear();
 			group_ids.clear();
+			group_literals.clear();
 			}
 		}
 	}
@@ -1202,6 +1342,8 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 		stats->hits = 0;
 		stats->misses = 0;
 		stats->nfa_states = 0;
+		stats->precompiled = 0;
+		stats->evicted = 0;
 		hdr_test = root;
 		}
 
@@ -1222,6 +1364,8 @@ void RuleMatcher::GetStats(Stats* stats, RuleHdrTest* hdr_test)
 			stats->hits += cstats.hits;
 			stats->misses += cstats.misses;
 			stats->nfa_states += cstats.nfa_states;
+			stats->precompiled += cstats.precompiled;
+			stats->evicted += cstats.evicted;
 			}
 		}
 
@@ -1238,8 +1382,9 @@ void RuleMatcher::DumpStats(File* f)
 	                         "computed trans. = %d; matchers = %d; mem = %d\n",
 	                         run_state::network_time, stats.dfa_states, stats.computed,
 	                         stats.matchers, stats.mem));
-	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d\n", run_state::network_time,
-	                         stats.hits, stats.misses));
+	f->Write(util::fmt("%.6f DFA cache hits = %d; misses = %d; evicted = %d\n",
+	                         run_state::network_time, stats.hits, stats.misses,
+	                         stats.evicted));
 
 	DumpStateStats(f, root);
 	}
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <functional>
 #include <set>
 #include <string>
@@ -12,6 +13,8 @@
 #include "zeek/Rule.h"
 #include "zeek/RE.h"
 #include "zeek/CCL.h"
+#include "zeek/DFAImage.h"
+#include "zeek/LiteralPrefilter.h"
 
 //#define MATCHER_PRINT_STATS
 
@@ -223,8 +226,15 @@ public:
 	RuleMatcher(int RE_level = 4);
 	~RuleMatcher();
 
-	// Parse the given files and built up data structures.
-	bool ReadFiles(const std::vector<std::string>& files);
+	// Parse the given files and built up data structures. If dfa_file
+	// is given, the DFAs of the pattern sets are loaded from there as
+	// far as it has them (see PrecompileDFAs()).
+	bool ReadFiles(const std::vector<std::string>& files,
+	               const char* dfa_file = nullptr);
+
+	// Computes the full DFAs of all pattern sets and writes them to the
+	// given file, for ReadFiles() to load them from.
+	bool PrecompileDFAs(const char* dfa_file);
 
 	/**
 	 * Inititialize a state object for matching file magic signatures.
@@ -305,6 +315,13 @@ public:
 		// # cache hits (sampled, multiply by MOVE_TO_FRONT_SAMPLE_SIZE)
 		unsigned int hits;
 		unsigned int misses;	// # cache misses
+
+		// # DFA states loaded from precompiled DFAs rather than
+		// computed; included in dfa_states
+		unsigned int precompiled;
+
+		// # DFA states evicted to stay within sig_max_dfa_mem
+		unsigned int evicted;
 	};
 
 	Val* BuildRuleStateValue(const Rule* rule,
@@ -331,6 +348,13 @@ private:
 	void BuildPatternSets(RuleHdrTest::pattern_set_list* dst,
 				const string_list& exprs, const int_list& ids);
 
+	// Used by the above. If literals is given, it holds the literal
+	// that each of the expressions starts with, and the groups get a
+	// prefilter for them.
+	void BuildPatternGroups(RuleHdrTest::pattern_set_list* dst,
+				const string_list& exprs, const int_list& ids,
+				const std::vector<LiteralPrefilter::Literal>* literals);
+
 	// Check an arbitrary rule if it's satisfied right now.
 	// eos signals end of stream
 	void ExecRule(Rule* rule, RuleEndpointState* state, bool eos);
@@ -356,6 +380,10 @@ private:
 
 	void DumpStateStats(File* f, RuleHdrTest* hdr_test);
 
+	// Adds the DFAs of the tree's pattern sets to writer; returns the
+	// number of sets left out.
+	int PrecompileDFAs(DFA_ImageWriter* writer, RuleHdrTest* hdr_test);
+
 	static bool AllRulePatternsMatched(const Rule* r, MatchPos matchpos,
 	                                   const AcceptingMatchSet& ams);
 
@@ -365,6 +393,12 @@ private:
 	RuleHdrTest* root;
 	rule_list rules;
 	rule_dict rules_by_id;
+
+	// Identifies the signature files read.
+	DFA_Image::Key rules_key;
+
+	// Precompiled DFAs being loaded while building the pattern sets.
+	std::unique_ptr<DFA_Image> dfa_image;
 };
 
 // Keeps bi-directional matching-state.
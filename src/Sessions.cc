@@ -61,11 +61,11 @@ NetSessions::~NetSessions()
 	delete stp_manager;
 
 	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
+		Unref(entry.conn);
 	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
+		Unref(entry.conn);
 	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+		Unref(entry.conn);
 
 	detail::fragment_mgr->Clear();
 	}
@@ -160,20 +160,35 @@ void NetSessions::ProcessTransportLayer(double t, const Packet* pkt, size_t rema
 		return;
 	}
 
-	detail::ConnIDKey key = detail::BuildConnIDKey(id);
-	Connection* conn = nullptr;
+	// The packet pipeline, or PktSrc's prefetching, may have determined
+	// the key already. It only does so for unfragmented TCP and UDP
+	// packets right inside the link layer, without IPv6 extension
+	// headers, so if it did, it's the same as ours. Encapsulated packets
+	// and reassembled fragments never come with a key.
+	detail::ConnIDKey key;
+	detail::hash_t hash;
+
+	if ( pkt->flow_hash && pkt->flow_proto == proto )
+		{
+		key = pkt->flow_key;
+		hash = pkt->flow_hash;
+		assert(key == detail::BuildConnIDKey(id));
+		}
+	else
+		{
+		key = detail::BuildConnIDKey(id);
+		hash = detail::ConnTable::Hash(key);
+		}
 
 	// FIXME: The following is getting pretty complex. Need to split up
 	// into separate functions.
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
+	Connection* conn = d->Lookup(key, hash);
 
 	if ( ! conn )
 		{
 		conn = NewConn(key, t, &id, data, proto, ip_hdr->FlowLabel(), pkt);
 		if ( conn )
-			InsertConnection(d, key, conn);
+			InsertConnection(d, key, hash, conn);
 		}
 	else
 		{
@@ -185,7 +200,7 @@ void NetSessions::ProcessTransportLayer(double t, const Packet* pkt, size_t rema
 			Remove(conn);
 			conn = NewConn(key, t, &id, data, proto, ip_hdr->FlowLabel(), pkt);
 			if ( conn )
-				InsertConnection(d, key, conn);
+				InsertConnection(d, key, hash, conn);
 			}
 		else
 			{
@@ -374,12 +389,7 @@ Connection* NetSessions::FindConnection(Val* v)
 		return nullptr;
 		}
 
-	Connection* conn = nullptr;
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
-
-	return conn;
+	return d->Lookup(key);
 	}
 
 void NetSessions::Remove(Connection* c)
@@ -407,26 +417,13 @@ void NetSessions::Remove(Connection* c)
 		// longer in the dictionary.
 		c->ClearKey();
 
-		switch ( c->ConnTransport() ) {
-		case TRANSPORT_TCP:
-			if ( tcp_conns.erase(key) == 0 )
-				reporter->InternalWarning("connection missing");
-			break;
-
-		case TRANSPORT_UDP:
-			if ( udp_conns.erase(key) == 0 )
-				reporter->InternalWarning("connection missing");
-			break;
-
-		case TRANSPORT_ICMP:
-			if ( icmp_conns.erase(key) == 0 )
+		if ( ConnectionMap* d = ConnsForTransport(c->ConnTransport()) )
+			{
+			if ( ! d->Remove(key) )
 				reporter->InternalWarning("connection missing");
-			break;
-
-		case TRANSPORT_UNKNOWN:
+			}
+		else
 			reporter->InternalWarning("unknown transport when removing connection");
-			break;
-		}
 
 		Unref(c);
 		}
@@ -436,35 +433,18 @@ void NetSessions::Insert(Connection* c)
 	{
 	assert(c->IsKeyValid());
 
-	Connection* old = nullptr;
+	ConnectionMap* d = ConnsForTransport(c->ConnTransport());
 
-	switch ( c->ConnTransport() ) {
-	// Remove first. Otherwise the map would still reference the old key for
-	// already existing connections.
-
-	case TRANSPORT_TCP:
-		old = LookupConn(tcp_conns, c->Key());
-		tcp_conns.erase(c->Key());
-		InsertConnection(&tcp_conns, c->Key(), c);
-		break;
-
-	case TRANSPORT_UDP:
-		old = LookupConn(udp_conns, c->Key());
-		udp_conns.erase(c->Key());
-		InsertConnection(&udp_conns, c->Key(), c);
-		break;
-
-	case TRANSPORT_ICMP:
-		old = LookupConn(icmp_conns, c->Key());
-		icmp_conns.erase(c->Key());
-		InsertConnection(&icmp_conns, c->Key(), c);
-		break;
-
-	default:
+	if ( ! d )
+		{
 		reporter->InternalWarning("unknown connection type");
 		Unref(c);
 		return;
-	}
+		}
+
+	// The table keeps a copy of the key, so replacing an existing
+	// entry in place doesn't leave a reference to the old one's key.
+	Connection* old = InsertConnection(d, c->Key(), detail::ConnTable::Hash(c->Key()), c);
 
 	if ( old && old != c )
 		{
@@ -480,21 +460,21 @@ void NetSessions::Drain()
 	{
 	for ( const auto& entry : tcp_conns )
 		{
-		Connection* tc = entry.second;
+		Connection* tc = entry.conn;
 		tc->Done();
 		tc->RemovalEvent();
 		}
 
 	for ( const auto& entry : udp_conns )
 		{
-		Connection* uc = entry.second;
+		Connection* uc = entry.conn;
 		uc->Done();
 		uc->RemovalEvent();
 		}
 
 	for ( const auto& entry : icmp_conns )
 		{
-		Connection* ic = entry.second;
+		Connection* ic = entry.conn;
 		ic->Done();
 		ic->RemovalEvent();
 		}
@@ -503,26 +483,26 @@ void NetSessions::Drain()
 void NetSessions::Clear()
 	{
 	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
+		Unref(entry.conn);
 	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
+		Unref(entry.conn);
 	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+		Unref(entry.conn);
 
-	tcp_conns.clear();
-	udp_conns.clear();
-	icmp_conns.clear();
+	tcp_conns.Clear();
+	udp_conns.Clear();
+	icmp_conns.Clear();
 
 	detail::fragment_mgr->Clear();
 	}
 
 void NetSessions::GetStats(SessionStats& s) const
 	{
-	s.num_TCP_conns = tcp_conns.size();
+	s.num_TCP_conns = tcp_conns.Size();
 	s.cumulative_TCP_conns = stats.cumulative_TCP_conns;
-	s.num_UDP_conns = udp_conns.size();
+	s.num_UDP_conns = udp_conns.Size();
 	s.cumulative_UDP_conns = stats.cumulative_UDP_conns;
-	s.num_ICMP_conns = icmp_conns.size();
+	s.num_ICMP_conns = icmp_conns.Size();
 	s.cumulative_ICMP_conns = stats.cumulative_ICMP_conns;
 	s.num_fragments = detail::fragment_mgr->Size();
 	s.num_packets = packet_mgr->PacketsProcessed();
@@ -533,6 +513,14 @@ void NetSessions::GetStats(SessionStats& s) const
 	s.max_fragments = detail::fragment_mgr->MaxFragments();
 	}
 
+void NetSessions::PrefetchFlow(const Packet* pkt) const
+	{
+	if ( pkt->flow_proto == IPPROTO_TCP )
+		tcp_conns.Prefetch(pkt->flow_hash);
+	else if ( pkt->flow_proto == IPPROTO_UDP )
+		udp_conns.Prefetch(pkt->flow_hash);
+	}
+
 Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const ConnID* id,
                                  const u_char* data, int proto, uint32_t flow_label,
                                  const Packet* pkt)
@@ -574,6 +562,16 @@ Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const Con
 	if ( ! WantConnection(src_h, dst_h, tproto, flags, flip) )
 		return nullptr;
 
+	// The connection and its initial analyzer tree are accounted to the
+	// transport protocol in arena statistics.
+	static const detail::ConnArena::Protocol arena_protocols[] = {
+		detail::ConnArena::OTHER,
+		detail::ConnArena::RegisterProtocol("TCP"),
+		detail::ConnArena::RegisterProtocol("UDP"),
+		detail::ConnArena::RegisterProtocol("ICMP"),
+	};
+
+	detail::ConnArenaScope arena_scope(arena_protocols[tproto]);
 	Connection* conn = new Connection(this, k, t, id, flow_label, pkt);
 	conn->SetTransport(tproto);
 
@@ -595,11 +593,21 @@ Connection* NetSessions::NewConn(const detail::ConnIDKey& k, double t, const Con
 
 Connection* NetSessions::LookupConn(const ConnectionMap& conns, const detail::ConnIDKey& key)
 	{
-	auto it = conns.find(key);
-	if ( it != conns.end() )
-		return it->second;
+	return conns.Lookup(key);
+	}
 
-	return nullptr;
+NetSessions::ConnectionMap* NetSessions::ConnsForTransport(TransportProto proto)
+	{
+	switch ( proto ) {
+	case TRANSPORT_TCP:
+		return &tcp_conns;
+	case TRANSPORT_UDP:
+		return &udp_conns;
+	case TRANSPORT_ICMP:
+		return &icmp_conns;
+	default:
+		return nullptr;
+	}
 	}
 
 bool NetSessions::IsLikelyServerPort(uint32_t port, TransportProto proto) const
@@ -711,13 +719,13 @@ unsigned int NetSessions::ConnectionMemoryUsage()
 		return 0;
 
 	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocation();
+		mem += entry.conn->MemoryAllocation();
 
 	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocation();
+		mem += entry.conn->MemoryAllocation();
 
 	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocation();
+		mem += entry.conn->MemoryAllocation();
 
 	return mem;
 	}
@@ -731,13 +739,13 @@ unsigned int NetSessions::ConnectionMemoryUsageConnVals()
 		return 0;
 
 	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+		mem += entry.conn->MemoryAllocationConnVal();
 
 	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+		mem += entry.conn->MemoryAllocationConnVal();
 
 	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+		mem += entry.conn->MemoryAllocationConnVal();
 
 	return mem;
 	}
@@ -750,37 +758,40 @@ unsigned int NetSessions::MemoryAllocation()
 
 	return ConnectionMemoryUsage()
 		+ padded_sizeof(*this)
-		+ (tcp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (udp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (icmp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
+		+ tcp_conns.MemoryAllocation()
+		+ udp_conns.MemoryAllocation()
+		+ icmp_conns.MemoryAllocation()
 		+ detail::fragment_mgr->MemoryAllocation();
 		// FIXME: MemoryAllocation() not implemented for rest.
 		;
 	}
 
-void NetSessions::InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key, Connection* conn)
+Connection* NetSessions::InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key,
+                                          detail::hash_t hash, Connection* conn)
 	{
-	(*m)[key] = conn;
+	Connection* old = m->Insert(key, hash, conn);
 
 	switch ( conn->ConnTransport() )
 		{
 		case TRANSPORT_TCP:
 			stats.cumulative_TCP_conns++;
-			if ( m->size() > stats.max_TCP_conns )
-				stats.max_TCP_conns = m->size();
+			if ( m->Size() > stats.max_TCP_conns )
+				stats.max_TCP_conns = m->Size();
 			break;
 		case TRANSPORT_UDP:
 			stats.cumulative_UDP_conns++;
-			if ( m->size() > stats.max_UDP_conns )
-				stats.max_UDP_conns = m->size();
+			if ( m->Size() > stats.max_UDP_conns )
+				stats.max_UDP_conns = m->Size();
 			break;
 		case TRANSPORT_ICMP:
 			stats.cumulative_ICMP_conns++;
-			if ( m->size() > stats.max_ICMP_conns )
-				stats.max_ICMP_conns = m->size();
+			if ( m->Size() > stats.max_ICMP_conns )
+				stats.max_ICMP_conns = m->Size();
 			break;
 		default: break;
 		}
+
+	return old;
 	}
 
 } // namespace zeek
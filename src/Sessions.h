@@ -3,9 +3,9 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
-#include <map>
 #include <utility>
 
+#include "zeek/ConnTable.h"
 #include "zeek/Frag.h"
 #include "zeek/PacketFilter.h"
 #include "zeek/NetVar.h"
@@ -55,6 +55,11 @@ public:
 	void Remove(Connection* c);
 	void Insert(Connection* c);
 
+	// Prefetches the connection table entry for a packet whose flow
+	// hash has been determined ahead of time (see Packet::flow_hash).
+	// Does nothing for other packets.
+	void PrefetchFlow(const Packet* pkt) const;
+
 	// Generating connection_pending events for all connections
 	// that are still active.
 	void Drain();
@@ -80,7 +85,7 @@ public:
 
 	unsigned int CurrentConnections()
 		{
-		return tcp_conns.size() + udp_conns.size() + icmp_conns.size();
+		return tcp_conns.Size() + udp_conns.Size() + icmp_conns.Size();
 		}
 
 	/**
@@ -128,7 +133,7 @@ public:
 protected:
 	friend class ConnCompressor;
 
-	using ConnectionMap = std::map<detail::ConnIDKey, Connection*>;
+	using ConnectionMap = detail::ConnTable;
 
 	Connection* NewConn(const detail::ConnIDKey& k, double t, const ConnID* id,
 	                    const u_char* data, int proto, uint32_t flow_label,
@@ -136,6 +141,10 @@ protected:
 
 	Connection* LookupConn(const ConnectionMap& conns, const detail::ConnIDKey& key);
 
+	// Returns the connection table for the given transport protocol,
+	// or nullptr for protocols we don't track.
+	ConnectionMap* ConnsForTransport(TransportProto proto);
+
 	// Returns true if the port corresonds to an application
 	// for which there's a Bro analyzer (even if it might not
 	// be used by the present policy script), or it's more
@@ -162,8 +171,10 @@ protected:
 	// the same key already exists in the map, it will be overwritten by
 	// the new one.  Connection count stats get updated either way (so most
 	// cases should likely check that the key is not already in the map to
-	// avoid unnecessary incrementing of connecting counts).
-	void InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key, Connection* conn);
+	// avoid unnecessary incrementing of connecting counts).  Returns the
+	// connection previously stored under the key, if any.
+	Connection* InsertConnection(ConnectionMap* m, const detail::ConnIDKey& key,
+	                             detail::hash_t hash, Connection* conn);
 
 	ConnectionMap tcp_conns;
 	ConnectionMap udp_conns;
@@ -2,6 +2,7 @@
 
 #include "zeek/RuleMatcher.h"
 #include "zeek/Conn.h"
+#include "zeek/ConnArena.h"
 #include "zeek/File.h"
 #include "zeek/Event.h"
 #include "zeek/RunState.h"
@@ -12,9 +13,11 @@
 #include "zeek/DNS_Mgr.h"
 #include "zeek/Trigger.h"
 #include "zeek/threading/Manager.h"
+#include "zeek/logging/Manager.h"
 #include "zeek/broker/Manager.h"
 #include "zeek/input.h"
 #include "zeek/Func.h"
+#include "zeek/Frame.h"
 
 uint64_t zeek::detail::killed_by_inactivity = 0;
 uint64_t& killed_by_inactivity = zeek::detail::killed_by_inactivity;
@@ -178,6 +181,18 @@ void ProfileLogger::Log()
 	file->Write(util::fmt("%.06f Total reassembler data: %" PRIu64 "K\n", run_state::network_time,
 	                      Reassembler::TotalMemoryAllocation() / 1024));
 
+	ConnArena::Stats astats;
+	ConnArena::GetStats(&astats);
+
+	file->Write(util::fmt("%.06f Conn-Arena: %s slabs=%" PRIu64 " mem=%" PRIu64 "K free=%" PRIu64 "K heap=%" PRIu64 "K\n",
+	                      run_state::network_time, ConnArena::Enabled() ? "enabled" : "disabled",
+	                      astats.slabs, astats.slab_bytes / 1024, astats.free_bytes / 1024,
+	                      astats.heap_bytes / 1024));
+
+	for ( const auto& p : astats.protocols )
+		file->Write(util::fmt("%.06f   %-25s objects=%" PRIu64 " mem=%" PRIu64 "K\n",
+		                      run_state::network_time, p.name.c_str(), p.objects, p.bytes / 1024));
+
 	// Signature engine.
 	if ( expensive && rule_matcher )
 		{
@@ -185,8 +200,10 @@ void ProfileLogger::Log()
 		rule_matcher->GetStats(&stats);
 
 		file->Write(util::fmt("%06f RuleMatcher: matchers=%d nfa_states=%d dfa_states=%d "
-		                      "ncomputed=%d mem=%dK\n", run_state::network_time, stats.matchers,
-		                      stats.nfa_states, stats.dfa_states, stats.computed, stats.mem / 1024));
+		                      "precompiled=%d ncomputed=%d mem=%dK hits=%d misses=%d evicted=%d\n",
+		                      run_state::network_time, stats.matchers, stats.nfa_states,
+		                      stats.dfa_states, stats.precompiled, stats.computed,
+		                      stats.mem / 1024, stats.hits, stats.misses, stats.evicted));
 		}
 
 	file->Write(util::fmt("%.06f Timers: current=%d max=%d lag=%.2fs\n",
@@ -207,6 +224,10 @@ void ProfileLogger::Log()
 
 	file->Write(util::fmt("%.06f Triggers: total=%lu pending=%lu\n", run_state::network_time, tstats.total, tstats.pending));
 
+	file->Write(util::fmt("%.06f Frames: allocated=%" PRIu64 " reused=%" PRIu64 "\n",
+	                      run_state::network_time, Frame::TotalAllocated(),
+	                      Frame::TotalReused()));
+
 	unsigned int* current_timers = TimerMgr::CurrentTimers();
 	for ( int i = 0; i < NUM_TIMER_TYPES; ++i )
 		{
@@ -225,16 +246,30 @@ void ProfileLogger::Log()
 		threading::MsgThread::Stats s = i->second;
 		file->Write(util::fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
 				" (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+				" (#queue full/max: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
 			        "\n",
 			    run_state::network_time,
 			    i->first.c_str(),
 			    s.sent_in, s.sent_out,
 			    s.pending_in, s.pending_out,
 			    s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
-			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes
+			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes,
+			    s.queue_in_stats.num_full, s.queue_in_stats.max_pending,
+			    s.queue_out_stats.num_full, s.queue_out_stats.max_pending
 			    ));
 		}
 
+	if ( auto pool = log_mgr->GetCompressionPool() )
+		{
+		logging::CompressionPool::Stats ps;
+		pool->GetStats(&ps);
+		file->Write(util::fmt("%0.6f Log-Compression: threads=%d pending=%" PRIu64 " pending_bytes=%" PRIu64 "K"
+		                      " blocks=%" PRIu64 " in=%" PRIu64 "K out=%" PRIu64 "K\n",
+		                      run_state::network_time, ps.num_threads, ps.pending_jobs,
+		                      ps.pending_bytes / 1024, ps.blocks, ps.bytes_in / 1024,
+		                      ps.bytes_out / 1024));
+		}
+
 	auto cs = broker_mgr->GetStatistics();
 
 	file->Write(util::fmt("%0.6f Comm: peers=%zu stores=%zu "
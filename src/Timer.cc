@@ -3,6 +3,8 @@
 #include "zeek/zeek-config.h"
 #include "zeek/Timer.h"
 
+#include <algorithm>
+
 #include "zeek/util.h"
 #include "zeek/Desc.h"
 #include "zeek/RunState.h"
@@ -192,4 +194,337 @@ double PQ_TimerMgr::GetNextTimeout()
 	return -1;
 	}
 
+Wheel_TimerMgr::Wheel_TimerMgr(double arg_resolution) : TimerMgr()
+	{
+	resolution = arg_resolution > 0 ? arg_resolution : DEFAULT_RESOLUTION;
+	due = new PriorityQueue;
+
+	std::fill(std::begin(buckets), std::end(buckets), NO_NODE);
+	std::fill(std::begin(occupied), std::end(occupied), 0);
+	std::fill(std::begin(level_count), std::end(level_count), 0);
+	}
+
+Wheel_TimerMgr::~Wheel_TimerMgr()
+	{
+	for ( auto idx : buckets )
+		{
+		while ( idx != NO_NODE )
+			{
+			delete nodes[idx].timer;
+			idx = nodes[idx].next;
+			}
+		}
+
+	delete due;
+	}
+
+uint64_t Wheel_TimerMgr::TickOf(double t) const
+	{
+	// Also catches NaN.
+	if ( ! (t > 0) )
+		return 0;
+
+	// Keep far-out timers (e.g., HUGE_VAL) representable.
+	double tick = t / resolution;
+	if ( tick >= 1e18 )
+		return uint64_t(1e18);
+
+	return uint64_t(tick);
+	}
+
+void Wheel_TimerMgr::Link(Timer* timer, int slot)
+	{
+	uint32_t idx = free_nodes;
+
+	if ( idx != NO_NODE )
+		free_nodes = nodes[idx].next;
+	else
+		{
+		idx = nodes.size();
+		nodes.emplace_back();
+		}
+
+	Node& n = nodes[idx];
+	n.timer = timer;
+	n.slot = slot;
+	n.prev = NO_NODE;
+	n.next = buckets[slot];
+
+	if ( n.next != NO_NODE )
+		nodes[n.next].prev = idx;
+
+	buckets[slot] = idx;
+	timer->SetOffset(NodeOffset(idx));
+
+	if ( slot < NUM_SLOTS )
+		occupied[slot / 64] |= uint64_t(1) << (slot % 64);
+
+	++level_count[slot / NUM_SLOTS];
+	++num_in_wheel;
+	}
+
+Timer* Wheel_TimerMgr::Unlink(uint32_t idx)
+	{
+	Node& n = nodes[idx];
+	int slot = n.slot;
+
+	if ( n.prev != NO_NODE )
+		nodes[n.prev].next = n.next;
+	else
+		buckets[slot] = n.next;
+
+	if ( n.next != NO_NODE )
+		nodes[n.next].prev = n.prev;
+
+	if ( slot < NUM_SLOTS && buckets[slot] == NO_NODE )
+		occupied[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+
+	--level_count[slot / NUM_SLOTS];
+	--num_in_wheel;
+
+	Timer* timer = n.timer;
+	timer->SetOffset(-1);
+
+	n.timer = nullptr;
+	n.next = free_nodes;
+	free_nodes = idx;
+
+	return timer;
+	}
+
+void Wheel_TimerMgr::Place(Timer* timer)
+	{
+	uint64_t tick = TickOf(timer->Time());
+
+	if ( tick <= now_tick )
+		{
+		if ( ! due->Add(timer) )
+			reporter->InternalError("out of memory");
+
+		return;
+		}
+
+	uint64_t diff = tick - now_tick;
+
+	for ( int level = 0; level < NUM_LEVELS; ++level )
+		{
+		if ( diff < (uint64_t(1) << (SLOT_BITS * (level + 1))) )
+			{
+			int slot = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+			Link(timer, level * NUM_SLOTS + slot);
+			return;
+			}
+		}
+
+	overflow_min_tick = std::min(overflow_min_tick, tick);
+	Link(timer, OVERFLOW_SLOT);
+	}
+
+void Wheel_TimerMgr::Cascade(int slot)
+	{
+	uint32_t idx = buckets[slot];
+
+	if ( slot == OVERFLOW_SLOT )
+		overflow_min_tick = UINT64_MAX;
+
+	while ( idx != NO_NODE )
+		{
+		uint32_t next = nodes[idx].next;
+		Place(Unlink(idx));
+		idx = next;
+		}
+	}
+
+int Wheel_TimerMgr::NextOccupied(int from, int to) const
+	{
+	for ( int word = from / 64; word <= to / 64; ++word )
+		{
+		uint64_t bits = occupied[word];
+
+		if ( word == from / 64 )
+			bits &= ~uint64_t(0) << (from % 64);
+
+		if ( word == to / 64 && to % 64 != 63 )
+			bits &= (uint64_t(1) << (to % 64 + 1)) - 1;
+
+		if ( bits )
+			return word * 64 + __builtin_ctzll(bits);
+		}
+
+	return -1;
+	}
+
+uint64_t Wheel_TimerMgr::NextEventTick() const
+	{
+	// A wheel needs attention whenever the position of the next
+	// inner one wraps around. For the innermost wheel, we can
+	// directly look for the next occupied slot of the current
+	// rotation. Each level's candidate is no later than the next
+	// one's, so the first non-empty level determines the result.
+	if ( level_count[0] > 0 )
+		{
+		int cur = now_tick & SLOT_MASK;
+
+		if ( cur < int(SLOT_MASK) )
+			{
+			int s = NextOccupied(cur + 1, SLOT_MASK);
+
+			if ( s >= 0 )
+				return (now_tick & ~SLOT_MASK) + s;
+			}
+
+		return (now_tick | SLOT_MASK) + 1;
+		}
+
+	for ( int level = 1; level < NUM_LEVELS; ++level )
+		{
+		if ( level_count[level] > 0 )
+			{
+			int shift = SLOT_BITS * level;
+			return ((now_tick >> shift) + 1) << shift;
+			}
+		}
+
+	if ( level_count[NUM_LEVELS] > 0 )
+		{
+		// Skip ahead to the last wrap-around of the outermost wheel
+		// before the earliest overflow timer, rather than visiting
+		// every wrap-around in between.
+		int shift = SLOT_BITS * NUM_LEVELS;
+		uint64_t next_wrap = ((now_tick >> shift) + 1) << shift;
+		uint64_t min_wrap = (overflow_min_tick >> shift) << shift;
+		return std::max(next_wrap, min_wrap);
+		}
+
+	return 0;
+	}
+
+void Wheel_TimerMgr::AdvanceTo(uint64_t tick)
+	{
+	while ( now_tick < tick )
+		{
+		uint64_t next = num_in_wheel > 0 ? NextEventTick() : 0;
+
+		if ( next == 0 || next > tick )
+			{
+			now_tick = tick;
+			break;
+			}
+
+		now_tick = next;
+
+		// Refill inner wheels from the outer ones that wrapped,
+		// outermost first, then collect everything that's due now.
+		if ( (now_tick & ((uint64_t(1) << (SLOT_BITS * NUM_LEVELS)) - 1)) == 0 )
+			Cascade(OVERFLOW_SLOT);
+
+		for ( int level = NUM_LEVELS - 1; level > 0; --level )
+			{
+			int shift = SLOT_BITS * level;
+
+			if ( (now_tick & ((uint64_t(1) << shift) - 1)) == 0 )
+				Cascade(level * NUM_SLOTS + ((now_tick >> shift) & SLOT_MASK));
+			}
+
+		Cascade(now_tick & SLOT_MASK);
+		}
+	}
+
+void Wheel_TimerMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s (%p) at %.6f",
+	        timer_type_to_string(timer->Type()), timer, timer->Time());
+
+	// As with PQ_TimerMgr, already expired timers get added as well
+	// and will be dispatched with the next advance, in sorted order.
+	Place(timer);
+
+	++current_timers[timer->Type()];
+	++cumulative_num;
+
+	if ( Size() > peak_size )
+		peak_size = Size();
+	}
+
+void Wheel_TimerMgr::Expire()
+	{
+	// Dispatching may add new timers, so keep going until the
+	// wheel has been drained completely.
+	while ( num_in_wheel > 0 || due->Size() > 0 )
+		{
+		for ( auto& idx : buckets )
+			{
+			while ( idx != NO_NODE )
+				{
+				if ( ! due->Add(Unlink(idx)) )
+					reporter->InternalError("out of memory");
+				}
+			}
+
+		overflow_min_tick = UINT64_MAX;
+
+		Timer* timer;
+		while ( (timer = (Timer*) due->Remove()) )
+			{
+			DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+			        timer_type_to_string(timer->Type()), timer);
+			timer->Dispatch(t, true);
+			--current_timers[timer->Type()];
+			delete timer;
+			}
+		}
+	}
+
+int Wheel_TimerMgr::DoAdvance(double new_t, int max_expire)
+	{
+	AdvanceTo(TickOf(new_t));
+
+	Timer* timer = (Timer*) due->Top();
+	for ( num_expired = 0; (num_expired < max_expire || max_expire == 0) &&
+		     timer && timer->Time() <= new_t; ++num_expired )
+		{
+		last_timestamp = timer->Time();
+		--current_timers[timer->Type()];
+
+		// Remove it before dispatching, since the dispatch
+		// can otherwise delete it, and then we won't know
+		// whether we should delete it too.
+		(void) due->Remove();
+
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(new_t, false);
+		delete timer;
+
+		timer = (Timer*) due->Top();
+		}
+
+	return num_expired;
+	}
+
+void Wheel_TimerMgr::Remove(Timer* timer)
+	{
+	if ( uint32_t idx = NodeOf(timer); idx != NO_NODE )
+		Unlink(idx);
+
+	else if ( ! due->Remove(timer) )
+		reporter->InternalError("asked to remove a missing timer");
+
+	--current_timers[timer->Type()];
+	delete timer;
+	}
+
+double Wheel_TimerMgr::GetNextTimeout()
+	{
+	if ( Timer* top = (Timer*) due->Top() )
+		return std::max(0.0, top->Time() - run_state::network_time);
+
+	if ( num_in_wheel == 0 )
+		return -1;
+
+	// The start of the next slot that needs attention is a lower
+	// bound for the earliest timer in the wheel.
+	return std::max(0.0, NextEventTick() * resolution - run_state::network_time);
+	}
+
 } // namespace zeek::detail
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 
 #include "zeek/PriorityQueue.h"
 #include "zeek/iosource/IOSource.h"
@@ -171,6 +172,112 @@ protected:
 	PriorityQueue* q;
 };
 
+/**
+ * A timer manager based on a hierarchical timing wheel. Adding and
+ * canceling a timer is O(1); timers become due in batches of one wheel
+ * slot (of the configured resolution) at a time. Due timers are kept in a
+ * small heap so that they are still dispatched in exact time order and
+ * with the same semantics as with PQ_TimerMgr.
+ */
+class Wheel_TimerMgr : public TimerMgr {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param resolution the width of the innermost wheel's slots, in
+	 * seconds.
+	 */
+	explicit Wheel_TimerMgr(double resolution = DEFAULT_RESOLUTION);
+	~Wheel_TimerMgr() override;
+
+	void Add(Timer* timer) override;
+	void Expire() override;
+
+	int Size() const override { return num_in_wheel + due->Size(); }
+	int PeakSize() const override { return peak_size; }
+	uint64_t CumulativeNum() const override { return cumulative_num; }
+	double GetNextTimeout() override;
+
+	double Resolution() const	{ return resolution; }
+
+	static constexpr double DEFAULT_RESOLUTION = 0.001;
+
+protected:
+	int DoAdvance(double t, int max_expire) override;
+	void Remove(Timer* timer) override;
+
+	static constexpr int SLOT_BITS = 8;
+	static constexpr int NUM_SLOTS = 1 << SLOT_BITS;
+	static constexpr uint64_t SLOT_MASK = NUM_SLOTS - 1;
+	static constexpr int NUM_LEVELS = 4;
+
+	// Timers further out than the outermost wheel reaches are kept
+	// in a separate list that is revisited each time it wraps.
+	static constexpr int OVERFLOW_SLOT = NUM_LEVELS * NUM_SLOTS;
+	static constexpr int NUM_BUCKETS = OVERFLOW_SLOT + 1;
+
+	uint64_t TickOf(double t) const;
+
+	// The wheel's slots chain their timers through nodes kept on the
+	// side, so that timers themselves don't need to carry the links.
+	// A timer in the wheel refers to its node through its heap offset,
+	// which is otherwise only used while the timer is in the heap of
+	// due timers and stays negative outside of it.
+	static constexpr uint32_t NO_NODE = UINT32_MAX;
+
+	struct Node {
+		Timer* timer;
+		uint32_t prev;
+		uint32_t next;
+		uint16_t slot;
+	};
+
+	static int NodeOffset(uint32_t idx)	{ return -2 - int(idx); }
+	static uint32_t NodeOf(const Timer* timer)
+		{ return timer->Offset() <= -2 ? uint32_t(-2 - timer->Offset()) : NO_NODE; }
+
+	// Puts the timer either into the wheel or, if it's due with the
+	// current tick, into the heap of due timers.
+	void Place(Timer* timer);
+
+	void Link(Timer* timer, int slot);
+
+	// Takes the node's timer out of its slot and returns it.
+	Timer* Unlink(uint32_t idx);
+
+	// Takes all timers out of the given slot and places them again,
+	// relative to the current tick.
+	void Cascade(int slot);
+
+	// Moves the wheel forward to the given tick, collecting
+	// everything due up to and including it into the heap.
+	void AdvanceTo(uint64_t tick);
+
+	// Returns the next tick after the current one at which the wheel
+	// has work to do, or 0 if there's none.
+	uint64_t NextEventTick() const;
+
+	// Returns the first occupied slot of the innermost wheel in the
+	// range [from, to] (both within the same rotation), or -1.
+	int NextOccupied(int from, int to) const;
+
+	double resolution;
+	uint64_t now_tick = 0;
+
+	uint32_t buckets[NUM_BUCKETS];	// first node of each slot's chain
+	std::vector<Node> nodes;
+	uint32_t free_nodes = NO_NODE;	// chained through Node::next
+	uint64_t occupied[NUM_SLOTS / 64];	// bitmap for the innermost wheel
+	int level_count[NUM_LEVELS + 1];	// the last one counts the overflow list
+	uint64_t overflow_min_tick = UINT64_MAX;
+
+	PriorityQueue* due;
+
+	int num_in_wheel = 0;
+	int peak_size = 0;
+	uint64_t cumulative_num = 0;
+};
+
 extern TimerMgr* timer_mgr;
 
 } // namespace zeek::detail
@@ -1698,6 +1698,48 @@ bool TableVal::RemoveFrom(Val* val) const
 	return true;
 	}
 
+// Looks up the keys of all of t0's entries in t1, a batch at a time so that
+// the cache misses of the lookups overlap. Calls f with each key and whether
+// t1 has it. Stops and returns false as soon as f returns false.
+template<typename F>
+static bool lookup_all_keys(const PDict<TableEntryVal>* t0, const PDict<TableEntryVal>* t1, F f)
+	{
+	constexpr int batch_size = 32;
+	std::vector<detail::HashKey> keys;
+	const detail::HashKey* key_ptrs[batch_size];
+	TableEntryVal* vals[batch_size];
+
+	keys.reserve(batch_size);
+
+	auto flush = [&]()
+		{
+		int n = keys.size();
+
+		for ( int i = 0; i < n; ++i )
+			key_ptrs[i] = &keys[i];
+
+		t1->Lookup(n, key_ptrs, vals);
+
+		for ( int i = 0; i < n; ++i )
+			if ( ! f(keys[i], vals[i] != nullptr) )
+				return false;
+
+		keys.clear();
+		return true;
+		};
+
+	for ( const auto& tble : *t0 )
+		{
+		// These keys don't copy the entries' key bytes.
+		keys.emplace_back(tble.GetKey(), tble.key_size, tble.hash, true);
+
+		if ( keys.size() == batch_size && ! flush() )
+			return false;
+		}
+
+	return flush();
+	}
+
 TableValPtr TableVal::Intersection(const TableVal& tv) const
 	{
 	auto result = make_intrusive<TableVal>(table_type);
@@ -1713,16 +1755,15 @@ TableValPtr TableVal::Intersection(const TableVal& tv) const
 		t0 = tmp;
 		}
 
-	const PDict<TableEntryVal>* tbl = AsTable();
-	for ( const auto& tble : *tbl )
+	// Here we leverage the same assumption about consistent
+	// hashes as in TableVal::RemoveFrom above.
+	lookup_all_keys(AsTable(), t0, [&](detail::HashKey& k, bool found)
 		{
-		auto k = tble.GetHashKey();
+		if ( found )
+			result->table_val->Insert(&k, new TableEntryVal(nullptr));
 
-		// Here we leverage the same assumption about consistent
-		// hashes as in TableVal::RemoveFrom above.
-		if ( t0->Lookup(k.get()) )
-			result->table_val->Insert(k.get(), new TableEntryVal(nullptr));
-		}
+		return true;
+		});
 
 	return result;
 	}
@@ -1735,17 +1776,10 @@ bool TableVal::EqualTo(const TableVal& tv) const
 	if ( t0->Length() != t1->Length() )
 		return false;
 
-	for ( const auto& tble : *t0 )
-		{
-		auto k = tble.GetHashKey();
-
-		// Here we leverage the same assumption about consistent
-		// hashes as in TableVal::RemoveFrom above.
-		if ( ! t1->Lookup(k.get()) )
-			return false;
-		}
-
-	return true;
+	// Here we leverage the same assumption about consistent
+	// hashes as in TableVal::RemoveFrom above.
+	return lookup_all_keys(t0, t1, [](const detail::HashKey& k, bool found)
+		{ return found; });
 	}
 
 bool TableVal::IsSubsetOf(const TableVal& tv) const
@@ -1756,17 +1790,10 @@ bool TableVal::IsSubsetOf(const TableVal& tv) const
 	if ( t0->Length() > t1->Length() )
 		return false;
 
-	for ( const auto& tble : *t0 )
-		{
-		auto k = tble.GetHashKey();
-
-		// Here we leverage the same assumption about consistent
-		// hashes as in TableVal::RemoveFrom above.
-		if ( ! t1->Lookup(k.get()) )
-			return false;
-		}
-
-	return true;
+	// Here we leverage the same assumption about consistent
+	// hashes as in TableVal::RemoveFrom above.
+	return lookup_all_keys(t0, t1, [](const detail::HashKey& k, bool found)
+		{ return found; });
 	}
 
 bool TableVal::ExpandAndInit(ValPtr index, ValPtr new_val)
@@ -22,6 +22,8 @@ class VectorVal;
 class Type;
 class Val;
 
+namespace detail { class ZBody; }
+
 // Note that a ZVal by itself is ambiguous: it doesn't track its type.
 // This makes them consume less memory and cheaper to copy.  It does
 // however require a separate way to determine the type.  Generally
@@ -95,6 +97,7 @@ union ZVal {
 private:
 	friend class RecordVal;
 	friend class VectorVal;
+	friend class detail::ZBody;
 
 	// Used for bool, int, enum.
 	bro_int_t int_val;
@@ -12,7 +12,8 @@
 
 namespace zeek::analyzer {
 
-class AnalyzerTimer final : public zeek::detail::Timer {
+class AnalyzerTimer final : public zeek::detail::Timer,
+                            public zeek::detail::ConnArenaObject {
 public:
 	AnalyzerTimer(Analyzer* arg_analyzer, analyzer_timer_func arg_timer,
 	              double arg_t, int arg_do_expire, zeek::detail::TimerType arg_type);
@@ -79,6 +80,7 @@ void Analyzer::SetAnalyzerTag(const Tag& arg_tag)
 	{
 	assert(! tag || tag == arg_tag);
 	tag = arg_tag;
+	SetArenaProtocol();
 	}
 
 bool Analyzer::IsAnalyzer(const char* name)
@@ -124,6 +126,20 @@ void Analyzer::CtorInit(const Tag& arg_tag, Connection* arg_conn)
 	resp_supporters = nullptr;
 	signature = nullptr;
 	output_handler = nullptr;
+	SetArenaProtocol();
+	}
+
+void Analyzer::SetArenaProtocol()
+	{
+	// Analyzers without a tag of their own, like most support
+	// analyzers, are accounted to whoever is creating them.
+	arena_protocol = zeek::detail::ConnArena::CurrentProtocol();
+
+	if ( ! tag || ! zeek::detail::ConnArena::Enabled() )
+		return;
+
+	if ( const Component* c = analyzer_mgr->Lookup(tag) )
+		arena_protocol = c->ArenaProtocol();
 	}
 
 Analyzer::~Analyzer()
@@ -214,6 +230,7 @@ void Analyzer::NextPacket(int len, const u_char* data, bool is_orig, uint64_t se
 	if ( skip )
 		return;
 
+	zeek::detail::ConnArenaScope arena_scope(arena_protocol);
 	SupportAnalyzer* next_sibling = FirstSupportAnalyzer(is_orig);
 
 	if ( next_sibling )
@@ -237,6 +254,7 @@ void Analyzer::NextStream(int len, const u_char* data, bool is_orig)
 	if ( skip )
 		return;
 
+	zeek::detail::ConnArenaScope arena_scope(arena_protocol);
 	SupportAnalyzer* next_sibling = FirstSupportAnalyzer(is_orig);
 
 	if ( next_sibling )
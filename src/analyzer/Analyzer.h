@@ -12,6 +12,7 @@
 #include "zeek/analyzer/Tag.h"
 
 #include "zeek/Obj.h"
+#include "zeek/ConnArena.h"
 #include "zeek/EventHandler.h"
 #include "zeek/Timer.h"
 #include "zeek/IntrusivePtr.h"
@@ -90,8 +91,10 @@ public:
  *
  * When overiding any of the class' methods, always make sure to call the
  * base-class version first.
+ *
+ * Analyzers are allocated from the connection arena, see ConnArena.
  */
-class Analyzer {
+class Analyzer : public zeek::detail::ConnArenaObject {
 public:
 	/**
 	 * Constructor.
@@ -697,8 +700,12 @@ private:
 	// Helper for the ctors.
 	void CtorInit(const Tag& tag, Connection* conn);
 
+	// Sets the protocol that the analyzer's allocations are charged to.
+	void SetArenaProtocol();
+
 	Tag tag;
 	ID id;
+	zeek::detail::ConnArena::Protocol arena_protocol;
 
 	Connection* conn;
 	Analyzer* parent;
@@ -21,6 +21,7 @@ void Component::Initialize()
 	{
 	InitializeTag();
 	analyzer_mgr->RegisterComponent(this, "ANALYZER_");
+	arena_protocol = zeek::detail::ConnArena::RegisterProtocol(CanonicalName());
 	}
 
 Component::~Component()
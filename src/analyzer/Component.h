@@ -4,6 +4,7 @@
 
 #include "zeek/zeek-config.h"
 
+#include "zeek/ConnArena.h"
 #include "zeek/analyzer/Tag.h"
 #include "zeek/plugin/Component.h"
 #include "zeek/plugin/TaggedComponent.h"
@@ -98,6 +99,12 @@ public:
 	 */
 	void SetEnabled(bool arg_enabled)	{ enabled = arg_enabled; }
 
+	/**
+	 * Returns the protocol that the memory of the analyzer's instances
+	 * is accounted to by the connection arena.
+	 */
+	zeek::detail::ConnArena::Protocol ArenaProtocol() const	{ return arena_protocol; }
+
 protected:
 	/**
 	  * Overriden from plugin::Component.
@@ -108,6 +115,7 @@ private:
 	factory_callback factory;	// The analyzer's factory callback.
 	bool partial;	// True if the analyzer supports partial connections.
 	bool enabled;	// True if the analyzer is enabled.
+	zeek::detail::ConnArena::Protocol arena_protocol = zeek::detail::ConnArena::OTHER;
 };
 
 } // namespace analyzer
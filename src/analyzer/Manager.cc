@@ -304,6 +304,9 @@ Analyzer* Manager::InstantiateAnalyzer(const Tag& tag, Connection* conn)
 		return nullptr;
 		}
 
+	// Whatever the analyzer allocates during construction is
+	// accounted to its own protocol.
+	zeek::detail::ConnArenaScope arena_scope(c->ArenaProtocol());
 	Analyzer* a = c->Factory()(conn);
 
 	if ( ! a )
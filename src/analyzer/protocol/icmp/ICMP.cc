@@ -48,7 +48,7 @@ void ICMP_Analyzer::DeliverPacket(int len, const u_char* data,
 	const struct icmp* icmpp = (const struct icmp*) data;
 
 	if ( ! zeek::detail::ignore_checksums &&
-	     ! zeek::id::find_val<TableVal>("ignore_checksums_nets")->Contains(ip->IPHeaderSrcAddr()) &&
+	     ! zeek::detail::ignore_checksums_nets->Contains(ip->IPHeaderSrcAddr()) &&
 	     caplen >= len )
 		{
 		int chksum = 0;
@@ -4,6 +4,7 @@
 
 #include "zeek/IPAddr.h"
 #include "zeek/File.h"
+#include "zeek/ConnArena.h"
 
 namespace zeek {
 
@@ -27,7 +28,7 @@ enum EndpointState {
 };
 
 // One endpoint of a TCP connection.
-class TCP_Endpoint {
+class TCP_Endpoint : public zeek::detail::ConnArenaObject {
 public:
 	TCP_Endpoint(TCP_Analyzer* analyzer, bool is_orig);
 	~TCP_Endpoint();
@@ -136,6 +136,7 @@ Manager::Manager(bool arg_use_real_time)
 	use_real_time = arg_use_real_time;
 	peer_count = 0;
 	log_batch_size = 0;
+	compact_log_batches = false;
 	log_topic_func = nullptr;
 	log_id_type = nullptr;
 	writer_id_type = nullptr;
@@ -150,6 +151,7 @@ void Manager::InitPostScript()
 	DBG_LOG(DBG_BROKER, "Initializing");
 
 	log_batch_size = get_option("Broker::log_batch_size")->AsCount();
+	compact_log_batches = get_option("Broker::compact_log_batches")->AsBool();
 	default_log_topic_prefix =
 	    get_option("Broker::default_log_topic_prefix")->AsString()->CheckString();
 	log_topic_func = get_option("Broker::log_topic")->AsFunc();
@@ -546,7 +548,8 @@ bool Manager::PublishLogCreate(EnumVal* stream, EnumVal* writer,
 	}
 
 bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
-                              int num_fields, const threading::Value* const * vals)
+                              const std::shared_ptr<const threading::ValueBatchSchema>& schema,
+                              const threading::Value* const * vals)
 	{
 	if ( bstate->endpoint.is_shutdown() )
 		return true;
@@ -573,33 +576,6 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
 		return false;
 		}
 
-	zeek::detail::BinarySerializationFormat fmt;
-	char* data;
-	int len;
-
-	fmt.StartWrite();
-
-	bool success = fmt.Write(num_fields, "num_fields");
-
-	if ( ! success )
-		{
-		reporter->Error("Failed to remotely log stream %s: num_fields serialization failed", stream_id);
-		return false;
-		}
-
-	for ( int i = 0; i < num_fields; ++i )
-		{
-		if ( ! vals[i]->Write(&fmt) )
-			{
-			reporter->Error("Failed to remotely log stream %s: field %d serialization failed", stream_id, i);
-			return false;
-			}
-		}
-
-	len = fmt.EndWrite(&data);
-	std::string serial_data(data, len);
-	free(data);
-
 	auto v = log_topic_func->Invoke(IntrusivePtr{NewRef{}, stream},
 	                                make_intrusive<StringVal>(path));
 
@@ -613,20 +589,77 @@ bool Manager::PublishLogWrite(EnumVal* stream, EnumVal* writer, string path,
 
 	std::string topic = v->AsString()->CheckString();
 
-	auto bstream_id = broker::enum_value(move(stream_id));
-	auto bwriter_id = broker::enum_value(move(writer_id));
-	broker::zeek::LogWrite msg(move(bstream_id), move(bwriter_id), move(path),
-	                           move(serial_data));
-
-	DBG_LOG(DBG_BROKER, "Buffering log record: %s", RenderMessage(topic, msg.as_data()).c_str());
+	DBG_LOG(DBG_BROKER, "Buffering log record for stream %s at path %s to topic %s",
+	        stream_id, path.data(), topic.data());
 
 	if ( log_buffers.size() <= (unsigned int)stream_id_num )
 		log_buffers.resize(stream_id_num + 1);
 
 	auto& lb = log_buffers[stream_id_num];
+	lb.stream_id = stream_id;
+
+	if ( ! compact_log_batches )
+		{
+		// One message per record, in the format that all versions
+		// understand.
+		zeek::detail::BinarySerializationFormat fmt;
+		char* data;
+		int len;
+
+		fmt.StartWrite();
+
+		bool success = fmt.Write(schema->NumFields(), "num_fields");
+
+		if ( ! success )
+			{
+			reporter->Error("Failed to remotely log stream %s: num_fields serialization failed", stream_id);
+			return false;
+			}
+
+		for ( int i = 0; i < schema->NumFields(); ++i )
+			{
+			if ( ! vals[i]->Write(&fmt) )
+				{
+				reporter->Error("Failed to remotely log stream %s: field %d serialization failed", stream_id, i);
+				return false;
+				}
+			}
+
+		len = fmt.EndWrite(&data);
+		std::string serial_data(data, len);
+		free(data);
+
+		broker::zeek::LogWrite msg(broker::enum_value(stream_id), broker::enum_value(writer_id),
+		                           move(path), move(serial_data));
+		lb.msgs[topic].emplace_back(msg.move_data());
+		}
+
+	else
+		{
+		std::string key = topic;
+		key.push_back('\0');
+		key.append(writer_id);
+		key.push_back('\0');
+		key.append(path);
+
+		auto w = lb.writes.find(key);
+
+		if ( w == lb.writes.end() )
+			w = lb.writes.try_emplace(key, move(topic), writer_id, move(path), schema).first;
+
+		else if ( w->second.encoder.Schema() != schema &&
+		          w->second.encoder.Schema()->ID() != schema->ID() )
+			{
+			// The path got a writer with different fields. Send
+			// what we have for the previous one, and start over.
+			lb.FinishWrites(w->second);
+			w->second.encoder = threading::ValueBatchEncoder(schema);
+			}
+
+		w->second.encoder.Add(vals);
+		}
+
 	++lb.message_count;
-	auto& pending_batch = lb.msgs[topic];
-	pending_batch.emplace_back(msg.move_data());
 
 	if ( lb.message_count >= log_batch_size )
 		statistics.num_logs_outgoing += lb.Flush(bstate->endpoint, log_batch_size);
@@ -643,6 +676,11 @@ size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_si
 		// No logs buffered for this stream.
 		return 0;
 
+	for ( auto& kv : writes )
+		FinishWrites(kv.second);
+
+	writes.clear();
+
 	for ( auto& kv : msgs )
 		{
 		auto& topic = kv.first;
@@ -659,6 +697,17 @@ size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_si
 	return rval;
 	}
 
+void Manager::LogBuffer::FinishWrites(PendingLogWrites& pending)
+	{
+	if ( ! pending.encoder.NumRows() )
+		return;
+
+	broker::zeek::LogWrite msg(broker::enum_value(stream_id),
+	                           broker::enum_value(pending.writer_id),
+	                           pending.path, pending.encoder.Finish());
+	msgs[pending.topic].emplace_back(msg.move_data());
+	}
+
 size_t Manager::FlushLogBuffers()
 	{
 	DBG_LOG(DBG_BROKER, "Flushing all log buffers");
@@ -1302,7 +1351,6 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
-	++statistics.num_logs_incoming;
 	auto& stream_id_name = lw.stream_id().name;
 
 	// Get stream ID.
@@ -1339,6 +1387,21 @@ bool Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
+	if ( threading::ValueBatchDecoder::IsBatch(serial_data->data(), serial_data->size()) )
+		{
+		int n = log_mgr->WriteBatchFromRemote(stream_id->AsEnumVal(), writer_id->AsEnumVal(),
+		                                      *path, serial_data->data(), serial_data->size());
+
+		if ( n < 0 )
+			return false;
+
+		statistics.num_logs_incoming += n;
+		return true;
+		}
+
+	// A single record, from a node that doesn't batch them.
+	++statistics.num_logs_incoming;
+
 	zeek::detail::BinarySerializationFormat fmt;
 	fmt.StartRead(serial_data->data(), serial_data->size());
 
@@ -21,6 +21,7 @@
 #include "zeek/IntrusivePtr.h"
 #include "zeek/iosource/IOSource.h"
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/threading/ValueBatch.h"
 
 namespace zeek {
 
@@ -194,17 +195,20 @@ public:
 
 	/**
 	 * Send a log entry to any interested peers.  The topic name used is
-	 * implicitly "bro/log/<stream-name>".
+	 * implicitly "bro/log/<stream-name>".  With Broker::compact_log_batches
+	 * set, entries are buffered and encoded into one batch of values per
+	 * topic, writer and path; otherwise each gets a message of its own.
 	 * @param stream the stream to which the log entry belongs.
 	 * @param writer the writer to use for outputting this log entry.
 	 * @param path the log path to output the log entry to.
-	 * @param num_vals the number of fields to log.
-	 * @param vals the log values to log, of size num_vals.
+	 * @param schema the schema of the log's records.
+	 * @param vals the log values to log, of size schema->NumFields().
 	 * See the Broker::SendFlags record type.
 	 * @return true if the message is sent successfully.
 	 */
 	bool PublishLogWrite(EnumVal* stream, EnumVal* writer,
-	                     std::string path, int num_vals,
+	                     std::string path,
+	                     const std::shared_ptr<const threading::ValueBatchSchema>& schema,
 	                     const threading::Value* const * vals);
 
 	/**
@@ -388,12 +392,35 @@ private:
 	const char* Tag() override	{ return "Broker::Manager"; }
 	double GetNextTimeout() override	{ return -1; }
 
+	// Log entries for the same topic, writer and path, not yet turned
+	// into a LogWrite message.
+	struct PendingLogWrites {
+		std::string topic;
+		std::string writer_id;
+		std::string path;
+		threading::ValueBatchEncoder encoder;
+
+		PendingLogWrites(std::string arg_topic, std::string arg_writer_id, std::string arg_path,
+		                 std::shared_ptr<const threading::ValueBatchSchema> schema)
+			: topic(std::move(arg_topic)), writer_id(std::move(arg_writer_id)),
+			  path(std::move(arg_path)), encoder(std::move(schema))
+			{}
+	};
+
 	struct LogBuffer {
+		std::string stream_id;
+
 		// Indexed by topic string.
 		std::unordered_map<std::string, broker::vector> msgs;
+
+		// Indexed by topic, writer and path.
+		std::unordered_map<std::string, PendingLogWrites> writes;
 		size_t message_count;
 
 		size_t Flush(broker::endpoint& endpoint, size_t batch_size);
+
+		// Encodes pending entries into a LogWrite message.
+		void FinishWrites(PendingLogWrites& pending);
 	};
 
 	// Data stores
@@ -425,6 +452,7 @@ private:
 	int peer_count;
 
 	size_t log_batch_size;
+	bool compact_log_batches;
 	Func* log_topic_func;
 	VectorTypePtr vector_of_data_type;
 	EnumType* log_id_type;
@@ -40,102 +40,325 @@
 
 #include "zeek/net_util.h"
 
+#include <string.h>
+#include <random>
+#include <vector>
+
+// The vectorized kernels are compiled for the CPU features they need and
+// picked at runtime, so that they're available without building for a
+// specific CPU.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CKSUM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#include "zeek/3rdparty/doctest.h"
+
 namespace zeek::detail {
 
-#define ADDCARRY(x)  {if ((x) > 65535) (x) -= 65535;}
-#define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
-
-uint16_t in_cksum(const struct checksum_block *vec, int veclen)
-{
-	const uint16_t *w;
-	int sum = 0;
-	int mlen = 0;
-	int byte_swapped = 0;
-
-	union {
-		uint8_t		c[2];
-		uint16_t	s;
-	} s_util;
-	union {
-		uint16_t	s[2];
-		uint32_t	l;
-	} l_util;
-
-	for (; veclen != 0; vec++, veclen--) {
-		if (vec->len == 0)
-			continue;
-		w = (const uint16_t *)(const void *)vec->block;
-		if (mlen == -1) {
-			/*
-			 * The first byte of this chunk is the continuation
-			 * of a word spanning between this chunk and the
-			 * last chunk.
-			 *
-			 * s_util.c[0] is already saved when scanning previous
-			 * chunk.
-			 */
-			s_util.c[1] = *(const uint8_t *)w;
-			sum += s_util.s;
-			w = (const uint16_t *)(const void *)((const uint8_t *)w + 1);
-			mlen = vec->len - 1;
-		} else
-			mlen = vec->len;
-		/*
-		 * Force to even boundary.
-		 */
-		if ((1 & (uintptr_t) w) && (mlen > 0)) {
-			REDUCE;
-			sum <<= 8;
-			s_util.c[0] = *(const uint8_t *)w;
-			w = (const uint16_t *)(const void *)((const uint8_t *)w + 1);
-			mlen--;
-			byte_swapped = 1;
+// Rather than adding up 16-bit words as the original BSD routine does,
+// we add them up in wider accumulators and fold the carries back in at
+// the end, which yields the same ones-complement sum (RFC 1071, section
+// 2).  All words are loaded in host order relative to the start of their
+// block; for blocks that start at an odd offset into the checksummed data,
+// byte-swapping their sum gets it to line up with the rest (RFC 1071,
+// section 2 (B)).
+
+static inline uint16_t fold(uint64_t sum)
+	{
+	// Each step leaves at most a carry of one to fold back in by the
+	// next one.
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+	}
+
+static inline uint16_t swap16(uint16_t x)
+	{
+	return (x >> 8) | (x << 8);
+	}
+
+// Adds up the 16-bit words of an even number of bytes.
+static uint64_t sum_scalar(const uint8_t* p, int len)
+	{
+	uint64_t sum0 = 0, sum1 = 0;
+
+	// A 32-bit chunk is congruent to the sum of its two words modulo
+	// 0xffff, so we add those, four at a time and into two independent
+	// sums.
+	for ( ; len >= 16; p += 16, len -= 16 )
+		{
+		uint64_t x, y;
+		memcpy(&x, p, sizeof(x));
+		memcpy(&y, p + 8, sizeof(y));
+		sum0 += (x & 0xffffffff) + (x >> 32);
+		sum1 += (y & 0xffffffff) + (y >> 32);
 		}
-		/*
-		 * Unroll the loop to make overhead from
-		 * branches &c small.
-		 */
-		while ((mlen -= 32) >= 0) {
-			sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-			sum += w[4]; sum += w[5]; sum += w[6]; sum += w[7];
-			sum += w[8]; sum += w[9]; sum += w[10]; sum += w[11];
-			sum += w[12]; sum += w[13]; sum += w[14]; sum += w[15];
-			w += 16;
+
+	for ( ; len >= 2; p += 2, len -= 2 )
+		{
+		uint16_t w;
+		memcpy(&w, p, sizeof(w));
+		sum0 += w;
 		}
-		mlen += 32;
-		while ((mlen -= 8) >= 0) {
-			sum += w[0]; sum += w[1]; sum += w[2]; sum += w[3];
-			w += 4;
+
+	return sum0 + sum1;
+	}
+
+#ifdef CKSUM_X86_KERNELS
+
+// Each iteration adds four words to each of the 32-bit lanes of the
+// accumulators, so we need to move them into the 64-bit total before 2^14
+// iterations in order to not overflow them.
+static constexpr int VEC_FLUSH_ITERATIONS = 1 << 14;
+
+static uint64_t sum_sse2(const uint8_t* p, int len)
+	{
+	const __m128i zero = _mm_setzero_si128();
+	uint64_t sum = 0;
+
+	while ( len >= 64 )
+		{
+		__m128i acc0 = _mm_setzero_si128();
+		__m128i acc1 = _mm_setzero_si128();
+
+		for ( int i = 0; len >= 64 && i < VEC_FLUSH_ITERATIONS; ++i, p += 64, len -= 64 )
+			{
+			for ( int j = 0; j < 64; j += 32 )
+				{
+				auto q = reinterpret_cast<const __m128i*>(p + j);
+				__m128i v0 = _mm_loadu_si128(q);
+				__m128i v1 = _mm_loadu_si128(q + 1);
+				acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v0, zero));
+				acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v0, zero));
+				acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v1, zero));
+				acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v1, zero));
+				}
+			}
+
+		// Widen the lanes to 64 bits to add up the two accumulators.
+		__m128i acc = _mm_add_epi64(_mm_add_epi64(_mm_unpacklo_epi32(acc0, zero),
+		                                          _mm_unpackhi_epi32(acc0, zero)),
+		                            _mm_add_epi64(_mm_unpacklo_epi32(acc1, zero),
+		                                          _mm_unpackhi_epi32(acc1, zero)));
+
+		alignas(16) uint64_t lanes[2];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+		sum += lanes[0] + lanes[1];
+		}
+
+	return sum + sum_scalar(p, len);
+	}
+
+__attribute__((target("avx2")))
+static uint64_t sum_avx2(const uint8_t* p, int len)
+	{
+	const __m256i zero = _mm256_setzero_si256();
+	uint64_t sum = 0;
+
+	while ( len >= 128 )
+		{
+		__m256i acc0 = _mm256_setzero_si256();
+		__m256i acc1 = _mm256_setzero_si256();
+
+		for ( int i = 0; len >= 128 && i < VEC_FLUSH_ITERATIONS; ++i, p += 128, len -= 128 )
+			{
+			for ( int j = 0; j < 128; j += 64 )
+				{
+				auto q = reinterpret_cast<const __m256i*>(p + j);
+				__m256i v0 = _mm256_loadu_si256(q);
+				__m256i v1 = _mm256_loadu_si256(q + 1);
+				acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v0, zero));
+				acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v0, zero));
+				acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v1, zero));
+				acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v1, zero));
+				}
+			}
+
+		__m256i acc = _mm256_add_epi64(_mm256_add_epi64(_mm256_unpacklo_epi32(acc0, zero),
+		                                                _mm256_unpackhi_epi32(acc0, zero)),
+		                               _mm256_add_epi64(_mm256_unpacklo_epi32(acc1, zero),
+		                                                _mm256_unpackhi_epi32(acc1, zero)));
+
+		alignas(32) uint64_t lanes[4];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+		sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+
+	__m256i acc = _mm256_setzero_si256();
+
+	for ( ; len >= 32; p += 32, len -= 32 )
+		{
+		__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+		acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
 		}
-		mlen += 8;
-		if (mlen == 0 && byte_swapped == 0)
+
+	alignas(32) uint32_t lanes[8];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+
+	for ( auto l : lanes )
+		sum += l;
+
+	// Avoid the penalty of mixing AVX with SSE code further on.
+	_mm256_zeroupper();
+
+	return sum + sum_scalar(p, len);
+	}
+
+#endif
+
+static ChecksumKernel detect_checksum_kernel()
+	{
+#ifdef CKSUM_X86_KERNELS
+	__builtin_cpu_init();
+
+	if ( __builtin_cpu_supports("avx2") )
+		return CKSUM_AVX2;
+
+	// SSE2 is part of x86-64's baseline.
+	return CKSUM_SSE2;
+#else
+	return CKSUM_SCALAR;
+#endif
+	}
+
+static ChecksumKernel checksum_kernel = detect_checksum_kernel();
+
+ChecksumKernel get_checksum_kernel()
+	{
+	return checksum_kernel;
+	}
+
+void set_checksum_kernel(ChecksumKernel k)
+	{
+	checksum_kernel = (k <= detect_checksum_kernel()) ? k : CKSUM_SCALAR;
+	}
+
+const char* checksum_kernel_name(ChecksumKernel k)
+	{
+	switch ( k ) {
+	case CKSUM_SCALAR:	return "scalar";
+	case CKSUM_SSE2:	return "sse2";
+	case CKSUM_AVX2:	return "avx2";
+	}
+
+	return "<unknown>";
+	}
+
+// Below this, setting up the vectorized kernels costs more than they save.
+static constexpr int VEC_MIN_LEN = 128;
+
+static inline uint64_t sum_words(const uint8_t* p, int len)
+	{
+	if ( len < VEC_MIN_LEN )
+		return sum_scalar(p, len);
+
+	switch ( checksum_kernel ) {
+#ifdef CKSUM_X86_KERNELS
+	case CKSUM_AVX2:
+		return sum_avx2(p, len);
+
+	case CKSUM_SSE2:
+		return sum_sse2(p, len);
+#endif
+
+	default:
+		return sum_scalar(p, len);
+	}
+	}
+
+uint16_t in_cksum(const checksum_block* vec, int veclen)
+	{
+	uint64_t sum = 0;
+	bool odd = false;	// Whether we're at an odd offset into the data.
+
+	for ( ; veclen > 0; ++vec, --veclen )
+		{
+		if ( vec->len <= 0 )
 			continue;
-		REDUCE;
-		while ((mlen -= 2) >= 0) {
-			sum += *w++;
+
+		int even_len = vec->len & ~1;
+		uint64_t s = sum_words(vec->block, even_len);
+
+		if ( vec->len & 1 )
+			{
+			// Pad the trailing byte with a zero, in memory order.
+			uint8_t last[2] = { vec->block[even_len], 0 };
+			uint16_t w;
+			memcpy(&w, last, sizeof(w));
+			s += w;
+			}
+
+		uint16_t folded = fold(s);
+		sum += odd ? swap16(folded) : folded;
+
+		if ( vec->len & 1 )
+			odd = ! odd;
 		}
-		if (byte_swapped) {
-			REDUCE;
-			sum <<= 8;
-			byte_swapped = 0;
-			if (mlen == -1) {
-				s_util.c[1] = *(const uint8_t *)w;
-				sum += s_util.s;
-				mlen = 0;
-			} else
-				mlen = -1;
-		} else if (mlen == -1)
-			s_util.c[0] = *(const uint8_t *)w;
+
+	return fold(sum);
 	}
-	if (mlen == -1) {
-		/* The last mbuf has odd # of bytes. Follow the
-		   standard (the odd byte may be shifted left by 8 bits
-		   or not as determined by endian-ness of the machine) */
-		s_util.c[1] = 0;
-		sum += s_util.s;
+
+TEST_CASE("in_cksum kernels")
+	{
+	std::mt19937 rng(4711);
+	std::vector<uint8_t> buf(20000);
+
+	for ( auto& b : buf )
+		b = rng();
+
+	auto k = get_checksum_kernel();
+
+	for ( int round = 0; round < 200; ++round )
+		{
+		// Random, possibly misaligned pieces of the buffer, of random
+		// and possibly odd lengths.
+		std::vector<checksum_block> blocks;
+		std::vector<uint8_t> data;
+		int n = 1 + rng() % 4;
+
+		for ( int i = 0; i < n; ++i )
+			{
+			int len = round < 100 ? rng() % 100 : rng() % 9001;
+			int off = rng() % (buf.size() - len);
+			blocks.push_back({&buf[off], len});
+			data.insert(data.end(), &buf[off], &buf[off] + len);
+			}
+
+		if ( data.size() & 1 )
+			data.push_back(0);
+
+		uint64_t expected = 0;
+
+		for ( size_t i = 0; i < data.size(); i += 2 )
+			{
+			uint16_t w;
+			memcpy(&w, &data[i], sizeof(w));
+			expected += w;
+			}
+
+		for ( auto test_kernel : { CKSUM_SCALAR, CKSUM_SSE2, CKSUM_AVX2 } )
+			{
+			set_checksum_kernel(test_kernel);
+			CHECK(in_cksum(blocks.data(), blocks.size()) == fold(expected));
+			}
+		}
+
+	// Enough data for the vectorized kernels to flush their accumulators.
+	std::vector<uint8_t> ones(1 << 21, 0xff);
+	checksum_block big{ones.data(), static_cast<int>(ones.size())};
+
+	for ( auto test_kernel : { CKSUM_SCALAR, CKSUM_SSE2, CKSUM_AVX2 } )
+		{
+		set_checksum_kernel(test_kernel);
+		CHECK(in_cksum(&big, 1) == 0xffff);
+		}
+
+	set_checksum_kernel(k);
 	}
-	REDUCE;
-	return sum;
-}
 
-} // namespace zeek
+} // namespace zeek::detail
@@ -217,7 +217,7 @@ ReaderBackend* Manager::CreateBackend(ReaderFrontend* frontend, EnumVal* tag)
 	}
 
 // Create a new input reader object to be used at whomevers leisure later on.
-bool Manager::CreateStream(Stream* info, RecordVal* description)
+bool Manager::CreateStream(Stream* info, RecordVal* description, int num_diff_index_fields)
 	{
 	RecordType* rtype = description->GetType()->AsRecordType();
 	if ( ! ( same_type(rtype, BifType::Record::Input::TableDescription, false)
@@ -247,6 +247,7 @@ bool Manager::CreateStream(Stream* info, RecordVal* description)
 	ReaderBackend::ReaderInfo rinfo;
 	rinfo.source = util::copy_string(source.c_str());
 	rinfo.name = util::copy_string(name.c_str());
+	rinfo.num_diff_index_fields = num_diff_index_fields;
 
 	auto mode_val = description->GetFieldOrDefault("mode");
 	auto mode = mode_val->AsEnumVal();
@@ -674,9 +675,18 @@ bool Manager::CreateTableStream(RecordVal* fval)
 		return false;
 		}
 
+	// Without a predicate, which may veto changes, the reader can work out
+	// on its own which rows changed between full reads. It then sends
+	// only those, and the main thread no longer needs to go through all
+	// rows on each reread.
+	int num_diff_index_fields = 0;
+
+	if ( BifConst::Input::incremental_reloads && ! pred )
+		num_diff_index_fields = idxfields;
+
 	TableStream* stream = new TableStream();
 		{
-		bool res = CreateStream(stream, fval);
+		bool res = CreateStream(stream, fval, num_diff_index_fields);
 		if ( ! res )
 			{
 			delete stream;
@@ -121,6 +121,7 @@ protected:
 	friend class DeleteMessage;
 	friend class ClearMessage;
 	friend class SendEntryMessage;
+	friend class EntriesMessage;
 	friend class EndCurrentSendMessage;
 	friend class ReaderClosedMessage;
 	friend class DisableMessage;
@@ -182,7 +183,9 @@ private:
 	// protected definitions are wrappers around this function.
 	bool RemoveStream(Stream* i);
 
-	bool CreateStream(Stream*, RecordVal* description);
+	// If num_diff_index_fields is non-zero, the stream's reader passes
+	// on only rows that changed between full reads; see ReaderInfo.
+	bool CreateStream(Stream*, RecordVal* description, int num_diff_index_fields = 0);
 
 	// Check if the types of the error_ev event are correct. If table is
 	// true, check for tablestream type, otherwhise check for eventstream
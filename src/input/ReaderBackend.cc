@@ -1,8 +1,15 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include "zeek/input/ReaderBackend.h"
+
+#include <algorithm>
+
 #include "zeek/input/ReaderFrontend.h"
 #include "zeek/input/Manager.h"
+#include "zeek/Hash.h"
+#include "zeek/SerializationFormat.h"
+
+#include "zeek/input/input.bif.h"
 
 using zeek::threading::Value;
 using zeek::threading::Field;
@@ -90,6 +97,35 @@ private:
 	Value* *val;
 };
 
+// The maximum number of rows per EntriesMessage. The manager checks
+// Input::max_apply_time between messages only, so they need to be small
+// enough not to overrun it by much.
+static constexpr size_t MAX_ENTRIES_PER_MESSAGE = 16;
+
+class EntriesMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	EntriesMessage(ReaderFrontend* reader, std::vector<Value**> rows, bool put)
+		: threading::OutputMessage<ReaderFrontend>("Entries", reader),
+		rows(std::move(rows)), put(put) { }
+
+	bool Process() override
+		{
+		for ( auto* vals : rows )
+			{
+			if ( put )
+				input_mgr->Put(Object(), vals);
+			else
+				input_mgr->SendEntry(Object(), vals);
+			}
+
+		return true;
+		}
+
+private:
+	std::vector<Value**> rows;
+	bool put;
+};
+
 class EndCurrentSendMessage final : public threading::OutputMessage<ReaderFrontend> {
 public:
 	EndCurrentSendMessage(ReaderFrontend* reader)
@@ -183,6 +219,10 @@ ReaderBackend::ReaderBackend(ReaderFrontend* arg_frontend) : MsgThread()
 	fields = nullptr;
 
 	SetName(frontend->Name());
+	SetOutputTimeSlice(BifConst::Input::max_apply_time);
+
+	if ( info->num_diff_index_fields )
+		diff_fmt = std::make_unique<zeek::detail::BinarySerializationFormat>();
 	}
 
 ReaderBackend::~ReaderBackend()
@@ -207,6 +247,9 @@ void ReaderBackend::Clear()
 
 void ReaderBackend::EndCurrentSend()
 	{
+	if ( info->num_diff_index_fields )
+		DiffRemovals();
+
 	SendOut(new EndCurrentSendMessage(frontend));
 	}
 
@@ -217,9 +260,160 @@ void ReaderBackend::EndOfData()
 
 void ReaderBackend::SendEntry(Value* *vals)
 	{
+	if ( info->num_diff_index_fields )
+		{
+		// The manager just adds or updates these, the same as for
+		// streaming.
+		if ( DiffEntry(vals) )
+			Put(vals);
+		else
+			Value::delete_value_ptr_array(vals, num_fields);
+
+		return;
+		}
+
 	SendOut(new SendEntryMessage(frontend, vals));
 	}
 
+void ReaderBackend::SendEntries(std::vector<Value**> rows)
+	{
+	bool put = false;
+
+	if ( info->num_diff_index_fields )
+		{
+		size_t n = 0;
+
+		for ( auto* vals : rows )
+			{
+			if ( DiffEntry(vals) )
+				rows[n++] = vals;
+			else
+				Value::delete_value_ptr_array(vals, num_fields);
+			}
+
+		rows.resize(n);
+		put = true;
+		}
+
+	if ( rows.size() <= MAX_ENTRIES_PER_MESSAGE )
+		{
+		if ( ! rows.empty() )
+			SendOut(new EntriesMessage(frontend, std::move(rows), put));
+
+		return;
+		}
+
+	for ( size_t i = 0; i < rows.size(); i += MAX_ENTRIES_PER_MESSAGE )
+		{
+		auto end = rows.begin() + std::min(i + MAX_ENTRIES_PER_MESSAGE, rows.size());
+		std::vector<Value**> part(rows.begin() + i, end);
+		SendOut(new EntriesMessage(frontend, std::move(part), put));
+		}
+	}
+
+std::string ReaderBackend::SerializeValues(Value** vals, int first, int last)
+	{
+	diff_fmt->StartWrite();
+
+	for ( int i = first; i < last; ++i )
+		vals[i]->Write(diff_fmt.get());
+
+	char* data;
+	uint32_t len = diff_fmt->EndWrite(&data);
+	std::string s(data, len);
+	free(data);
+
+	return s;
+	}
+
+Value** ReaderBackend::DeserializeIndex(const std::string& key)
+	{
+	Value** vals = new Value*[num_fields];
+	int num_index_fields = info->num_diff_index_fields;
+
+	diff_fmt->StartRead(key.data(), key.size());
+
+	for ( int i = 0; i < num_index_fields; ++i )
+		{
+		vals[i] = new Value();
+		vals[i]->Read(diff_fmt.get());
+		}
+
+	diff_fmt->EndRead();
+
+	// The manager ignores the values when deleting.
+	for ( unsigned int i = num_index_fields; i < num_fields; ++i )
+		vals[i] = new Value(fields[i]->type, fields[i]->subtype, false);
+
+	return vals;
+	}
+
+bool ReaderBackend::DiffEntry(Value** vals)
+	{
+	if ( ! diff_sending )
+		{
+		diff_sending = true;
+		++diff_read;
+		diff_next_order.clear();
+		}
+
+	int num_index_fields = info->num_diff_index_fields;
+	uint64_t valhash = 0;
+
+	if ( num_fields > static_cast<unsigned int>(num_index_fields) )
+		{
+		std::string v = SerializeValues(vals, num_index_fields, num_fields);
+		valhash = zeek::detail::KeyedHash::Hash64(v.data(), v.size());
+		}
+
+	auto [it, added] = diff_rows.try_emplace(SerializeValues(vals, 0, num_index_fields),
+	                                          DiffRow{valhash, diff_read});
+	auto& row = it->second;
+
+	if ( added )
+		{
+		diff_next_order.push_back(&*it);
+		return true;
+		}
+
+	// Rows may show up more than once per read.
+	if ( row.read != diff_read )
+		{
+		row.read = diff_read;
+		diff_next_order.push_back(&*it);
+		}
+
+	if ( row.valhash == valhash )
+		return false;
+
+	row.valhash = valhash;
+	return true;
+	}
+
+void ReaderBackend::DiffRemovals()
+	{
+	// Reads without any rows don't get here through DiffEntry().
+	if ( ! diff_sending )
+		{
+		++diff_read;
+		diff_next_order.clear();
+		}
+
+	// Removing in the order of the previous read keeps it deterministic.
+	for ( auto* row : diff_order )
+		{
+		if ( row->second.read == diff_read )
+			continue;
+
+		Delete(DeserializeIndex(row->first));
+		diff_rows.erase(diff_rows.find(row->first));
+		}
+
+	diff_order.swap(diff_next_order);
+	diff_next_order.clear();
+	diff_sending = false;
+	}
+
 bool ReaderBackend::Init(const int arg_num_fields,
 		         const threading::Field* const* arg_fields)
 	{
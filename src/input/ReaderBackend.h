@@ -2,6 +2,11 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "zeek/ZeekString.h"
 
 #include "zeek/threading/SerialTypes.h"
@@ -102,11 +107,21 @@ public:
 		 */
 		ReaderMode mode;
 
+		/**
+		 * If non-zero, the number of leading fields that form a row's
+		 * index. SendEntry() and EndCurrentSend() then pass on only the
+		 * rows that were added, changed or removed since the last full
+		 * read. The input manager sets this for table streams that
+		 * don't need to see all rows.
+		 */
+		int num_diff_index_fields;
+
 		ReaderInfo()
 			{
 			source = nullptr;
 			name = nullptr;
 			mode = MODE_NONE;
+			num_diff_index_fields = 0;
 			}
 
 		ReaderInfo(const ReaderInfo& other)
@@ -114,6 +129,7 @@ public:
 			source = other.source ? util::copy_string(other.source) : nullptr;
 			name = other.name ? util::copy_string(other.name) : nullptr;
 			mode = other.mode;
+			num_diff_index_fields = other.num_diff_index_fields;
 
 			for ( config_map::const_iterator i = other.config.begin(); i != other.config.end(); i++ )
 				config.insert(std::make_pair(util::copy_string(i->first), util::copy_string(i->second)));
@@ -332,13 +348,27 @@ protected:
 	 * specific stream back to the manager in tracking mode.
 	 *
 	 * If the stream is a table stream, the values are inserted into the
-	 * table; if it is an event stream, the event is raised.
+	 * table; if it is an event stream, the event is raised. If
+	 * ReaderInfo::num_diff_index_fields is set, a row only gets passed on
+	 * if it is new or has changed since the last full read.
 	 *
 	 * @param val Array of threading::Values expected by the stream. The
 	 * array must have exactly NumEntries() elements.
 	 */
 	void SendEntry(threading::Value** vals);
 
+	/**
+	 * Sends a batch of rows in tracking mode, the same as calling
+	 * SendEntry() for each of them but with fewer messages to the
+	 * manager. Each message carries a limited number of rows, so that
+	 * the manager can still spread large batches across main-loop
+	 * iterations according to Input::max_apply_time.
+	 *
+	 * @param rows The rows, each an array of threading::Values as
+	 * SendEntry() takes them. Ownership of the rows passes to the method.
+	 */
+	void SendEntries(std::vector<threading::Value**> rows);
+
 	/**
 	 * Method telling the manager, that the current list of entries sent
 	 * by SendEntry is finished.
@@ -350,6 +380,33 @@ protected:
 	void EndCurrentSend();
 
 private:
+	// Change detection for full reads, see ReaderInfo::num_diff_index_fields.
+	struct DiffRow
+		{
+		uint64_t valhash;	// Hash of the row's values.
+		uint64_t read;		// The full read that has seen the row last.
+		};
+
+	using DiffRows = std::unordered_map<std::string, DiffRow>;
+
+	// Returns true if the row is to be passed on.
+	bool DiffEntry(threading::Value** vals);
+
+	// Deletes the rows that the current read hasn't seen.
+	void DiffRemovals();
+
+	std::string SerializeValues(threading::Value** vals, int first, int last);
+	threading::Value** DeserializeIndex(const std::string& key);
+
+	// Rows by their serialized index.
+	DiffRows diff_rows;
+	// The rows of the last full read and of the current one, in order.
+	std::vector<DiffRows::value_type*> diff_order;
+	std::vector<DiffRows::value_type*> diff_next_order;
+	uint64_t diff_read = 0;
+	bool diff_sending = false;
+	std::unique_ptr<zeek::detail::SerializationFormat> diff_fmt;
+
 	// Frontend that instantiated us. This object must not be accessed
 	// from this class, it's running in a different thread!
 	ReaderFrontend* frontend;
@@ -4,10 +4,16 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
+#include "zeek/Hash.h"
 #include "zeek/threading/SerialTypes.h"
 
 #include "zeek/input/readers/ascii/ascii.bif.h"
@@ -47,10 +53,146 @@ FieldMapping FieldMapping::subType()
 	return FieldMapping(name, subtype, position);
 	}
 
+// Full reads get parsed in chunks of about this size.
+static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+// Files with fewer chunks than this get parsed by the reader thread
+// itself. For them, starting threads on every (re)read costs more than
+// parallel parsing saves.
+static constexpr size_t MIN_PARALLEL_CHUNKS = 4;
+
+struct Ascii::Chunk {
+	// The rows parsed from the chunk, and the problems encountered, in
+	// order. Exactly one of row and msg is set.
+	struct Item {
+		Value** row;
+		std::string msg;
+		bool fatal;
+	};
+
+	const char* begin;
+	const char* end;
+	std::vector<Item> items;
+	bool done = false;
+
+	Chunk(const char* arg_begin, const char* arg_end) : begin(arg_begin), end(arg_end)	{ }
+};
+
+thread_local Ascii::Chunk* Ascii::current_chunk = nullptr;
+
+// A file's content, read into memory. We don't map files, as accessing
+// parts of a mapping that a concurrent writer truncated fails with
+// SIGBUS, and files commonly get rewritten in place.
+class FileContent {
+public:
+	// The size is what we expect, though the file may turn out to be
+	// shorter or longer by the time we read it.
+	bool Load(int fd, size_t size)
+		{
+		// Leave room to notice the end of the file without growing
+		// the buffer.
+		buf.resize(size + 4096);
+		size_t n = 0;
+
+		while ( true )
+			{
+			if ( n == buf.size() )
+				buf.resize(buf.size() * 2);
+
+			ssize_t r = read(fd, &buf[n], buf.size() - n);
+
+			if ( r < 0 )
+				{
+				if ( errno == EINTR )
+					continue;
+
+				return false;
+				}
+
+			if ( r == 0 )
+				break;
+
+			n += r;
+			}
+
+		buf.resize(n);
+		data = buf.data();
+		len = buf.size();
+		return true;
+		}
+
+	const char* data = nullptr;
+	size_t len = 0;
+
+private:
+	std::string buf;
+};
+
+// Returns the next line that isn't a comment, the same way GetLine() does.
+static bool next_line(const char** p, const char* end, char separator, std::string_view* line)
+	{
+	while ( *p < end )
+		{
+		const char* start = *p;
+		auto nl = static_cast<const char*>(memchr(start, '\n', end - start));
+		*p = nl ? nl + 1 : end;
+
+		std::string_view str(start, (nl ? nl : end) - start);
+
+		if ( str.empty() )
+			continue;
+
+		if ( str.back() == '\r' ) // deal with \r\n by removing \r
+			str.remove_suffix(1);
+
+		if ( str.empty() || str[0] != '#' )
+			{
+			*line = str;
+			return true;
+			}
+
+		if ( str.size() > 8 && str.compare(0, 7, "#fields") == 0 && str[7] == separator )
+			{
+			*line = str.substr(8);
+			return true;
+			}
+		}
+
+	return false;
+	}
+
+// Splits a line into its fields, reusing the strings in the vector. Like
+// splitting with getline(), this drops a trailing empty field. Returns the
+// number of fields.
+static int split_fields(std::string_view line, char separator, std::vector<std::string>* fields)
+	{
+	size_t n = 0;
+	size_t start = 0;
+
+	while ( start < line.size() )
+		{
+		size_t stop = line.find(separator, start);
+
+		if ( stop == std::string_view::npos )
+			stop = line.size();
+
+		if ( fields->size() <= n )
+			fields->emplace_back();
+
+		(*fields)[n++].assign(line.data() + start, stop - start);
+		start = stop + 1;
+		}
+
+	return n;
+	}
+
 Ascii::Ascii(ReaderFrontend *frontend) : ReaderBackend(frontend)
 	{
 	mtime = 0;
 	ino = 0;
+	size = 0;
+	fingerprint = 0;
+	parse_threads = 0;
 	fail_on_file_problem = false;
 	fail_on_invalid_lines = false;
 	}
@@ -85,6 +227,8 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	path_prefix.assign((const char*) BifConst::InputAscii::path_prefix->Bytes(),
 	                   BifConst::InputAscii::path_prefix->Len());
 
+	parse_threads = BifConst::InputAscii::parse_threads;
+
 	// Set per-filter configuration options.
 	for ( ReaderInfo::config_map::const_iterator i = info.config.begin(); i != info.config.end(); i++ )
 		{
@@ -105,6 +249,9 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 		else if ( strcmp(i->first, "fail_on_file_problem") == 0 )
 			fail_on_file_problem = (strncmp(i->second, "T", 1) == 0);
+
+		else if ( strcmp(i->first, "parse_threads") == 0 )
+			parse_threads = atoi(i->second);
 		}
 
 	if ( separator.size() != 1 )
@@ -120,11 +267,8 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 	}
 
 
-bool Ascii::OpenFile()
+void Ascii::SetFileName()
 	{
-	if ( file.is_open() )
-		return true;
-
 	// Handle path-prefixing. See similar logic in Binary::DoInit().
 	fname = Info().source;
 
@@ -140,7 +284,14 @@ bool Ascii::OpenFile()
 
 		fname = path + "/" + fname;
 		}
+	}
 
+bool Ascii::OpenFile()
+	{
+	if ( file.is_open() )
+		return true;
+
+	SetFileName();
 	file.open(fname);
 
 	if ( ! file.is_open() )
@@ -267,190 +418,405 @@ bool Ascii::GetLine(string& str)
 	return false;
 	}
 
-// read the entire file and send appropriate thingies back to InputMgr
-bool Ascii::DoUpdate()
+bool Ascii::ReadFile()
 	{
-	if ( ! OpenFile() )
+	SetFileName();
+
+	int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if ( fd < 0 )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Init: cannot open %s", fname.c_str()), true);
 		return ! fail_on_file_problem;
+		}
 
-	switch ( Info().mode ) {
-		case MODE_REREAD:
+	struct stat sb;
+	if ( fstat(fd, &sb) == -1 )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Could not get stat for %s", fname.c_str()), true);
+		close(fd);
+		return ! fail_on_file_problem;
+		}
+
+	bool reread = (Info().mode == MODE_REREAD);
+
+	if ( reread && sb.st_ino == ino && sb.st_mtime == mtime && sb.st_size == size )
+		{
+		// no change
+		close(fd);
+		return true;
+		}
+
+	FileContent content;
+	bool loaded = content.Load(fd, sb.st_size);
+	int err = errno;
+	close(fd);
+
+	if ( ! loaded )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Could not read %s: %s", fname.c_str(), Strerror(err)), true);
+		return ! fail_on_file_problem;
+		}
+
+	if ( reread )
+		{
+		// A file that got touched or rewritten with the same content
+		// doesn't need parsing again.
+		uint64_t fp = zeek::detail::KeyedHash::Hash64(content.data, content.len);
+		bool same = (ino != 0 && sb.st_size == size && fp == fingerprint);
+
+		// Warn again in case of trouble if the file changes. The comparison to 0
+		// is to suppress an extra warning that we'd otherwise get on the initial
+		// inode assignment.
+		if ( ino != 0 && ! same )
+			StopWarningSuppression();
+
+		mtime = sb.st_mtime;
+		ino = sb.st_ino;
+		size = sb.st_size;
+		fingerprint = fp;
+
+		if ( same )
+			return true;
+		}
+
+	const char* p = content.data;
+	const char* end = content.data + content.len;
+	std::string_view line;
+
+	if ( ! next_line(&p, end, separator[0], &line) )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Could not read input data file %s; first line could not be read",
+		                                   fname.c_str()), true);
+		FailWarn(fail_on_file_problem, Fmt("Init: cannot open %s; problem reading file header", fname.c_str()), true);
+		return ! fail_on_file_problem;
+		}
+
+	headerline = line;
+
+	if ( ! ReadHeader(true) )
+		{
+		FailWarn(fail_on_file_problem, Fmt("Init: cannot open %s; problem reading file header", fname.c_str()), true);
+		return ! fail_on_file_problem;
+		}
+
+	StopWarningSuppression();
+
+	// Split the rest at line boundaries.
+	std::vector<Chunk> chunks;
+
+	while ( p < end )
+		{
+		const char* stop = end;
+
+		if ( size_t(end - p) > CHUNK_SIZE )
 			{
-			// check if the file has changed
-			struct stat sb;
-			if ( stat(fname.c_str(), &sb) == -1 )
-				{
-				FailWarn(fail_on_file_problem, Fmt("Could not get stat for %s", fname.c_str()), true);
+			auto nl = static_cast<const char*>(memchr(p + CHUNK_SIZE, '\n', end - p - CHUNK_SIZE));
+			stop = nl ? nl + 1 : end;
+			}
 
-				file.close();
-				return ! fail_on_file_problem;
-				}
+		chunks.emplace_back(p, stop);
+		p = stop;
+		}
 
-			if ( sb.st_ino == ino && sb.st_mtime == mtime )
-				// no change
-				return true;
+	bool ok;
 
-			// Warn again in case of trouble if the file changes. The comparison to 0
-			// is to suppress an extra warning that we'd otherwise get on the initial
-			// inode assignment.
-			if ( ino != 0 )
-				StopWarningSuppression();
+	if ( parse_threads > 1 && chunks.size() >= MIN_PARALLEL_CHUNKS )
+		ok = ParseChunksInParallel(chunks, std::min(size_t(parse_threads), chunks.size()));
+	else
+		ok = ParseChunks(chunks);
 
-			mtime = sb.st_mtime;
-			ino = sb.st_ino;
-			// File changed. Fall through to re-read.
+	for ( auto& c : chunks )
+		{
+		// Left over after a fatal error.
+		for ( auto& item : c.items )
+			{
+			if ( item.row )
+				Value::delete_value_ptr_array(item.row, NumFields());
 			}
+		}
 
-		case MODE_MANUAL:
-		case MODE_STREAM:
+	if ( ! ok )
+		return false;
+
+	EndCurrentSend();
+	return true;
+	}
+
+bool Ascii::ParseChunks(std::vector<Chunk>& chunks)
+	{
+	for ( auto& c : chunks )
+		{
+		ParseChunk(&c);
+
+		if ( ! SendChunk(&c) )
+			return false;
+		}
+
+	return true;
+	}
+
+bool Ascii::ParseChunksInParallel(std::vector<Chunk>& chunks, int num_threads)
+	{
+	std::mutex mutex;
+	std::condition_variable cond;
+	size_t next = 0;
+	size_t sent = 0;
+	bool stop = false;
+
+	// Bounds the memory that parsed rows take up while waiting for us to
+	// pass them on.
+	size_t max_ahead = 4 * num_threads;
+
+	auto work = [&]()
+		{
+		threading::BasicThread::SetHelperThread();
+		std::unique_lock<std::mutex> lock(mutex);
+
+		for ( ;; )
 			{
-			// dirty, fix me. (well, apparently after trying seeking, etc
-			// - this is not that bad)
-			if ( file.is_open() )
-				{
-				if ( Info().mode == MODE_STREAM )
-					{
-					file.clear(); // remove end of file evil bits
-					if ( ! ReadHeader(true) )
-						{
-						return ! fail_on_file_problem; // header reading failed
-						}
-
-					break;
-					}
-
-				file.close();
-				}
+			cond.wait(lock, [&] { return stop || next == chunks.size() || next < sent + max_ahead; });
+
+			if ( stop || next == chunks.size() )
+				return;
+
+			Chunk* c = &chunks[next++];
+
+			lock.unlock();
+			ParseChunk(c);
+			lock.lock();
+
+			c->done = true;
+			cond.notify_all();
+			}
+		};
 
-			OpenFile();
+	std::vector<std::thread> workers;
 
+	for ( int i = 0; i < num_threads; ++i )
+		workers.emplace_back(work);
+
+	bool ok = true;
+
+	// Pass the rows on in order.
+	for ( auto& c : chunks )
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [&c] { return c.done; });
+		lock.unlock();
+
+		if ( ! SendChunk(&c) )
+			{
+			ok = false;
 			break;
 			}
 
-		default:
-			assert(false);
+		lock.lock();
+		++sent;
+		cond.notify_all();
+		}
 
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		stop = true;
+		cond.notify_all();
 		}
 
-	string line;
+	for ( auto& t : workers )
+		t.join();
 
-	file.sync();
+	return ok;
+	}
 
-	while ( GetLine(line) )
+void Ascii::ParseChunk(Chunk* chunk)
+	{
+	current_chunk = chunk;
+
+	const char* p = chunk->begin;
+	std::string_view line;
+	std::vector<std::string> stringfields;
+
+	while ( next_line(&p, chunk->end, separator[0], &line) )
 		{
-		// split on tabs
-		bool error = false;
-		istringstream splitstream(line);
+		Value** vals;
+		LineResult res = ParseLine(line, &stringfields, &vals);
 
-		map<int, string> stringfields;
-		int pos = 0;
-		while ( splitstream )
-			{
-			string s;
-			if ( ! getline(splitstream, s, separator[0]) )
-				break;
+		if ( res == LINE_OK )
+			chunk->items.push_back({vals, {}, false});
 
-			stringfields[pos] = s;
-			pos++;
-			}
+		else if ( res == LINE_FAILED )
+			break;
+		}
 
-		pos--; // for easy comparisons of max element.
+	current_chunk = nullptr;
+	}
 
-		Value** fields = new Value*[NumFields()];
+bool Ascii::SendChunk(Chunk* chunk)
+	{
+	std::vector<Value**> rows;
 
-		int fpos = 0;
-		for ( vector<FieldMapping>::iterator fit = columnMap.begin();
-			fit != columnMap.end();
-			fit++ )
+	for ( auto& item : chunk->items )
+		{
+		if ( item.row )
 			{
+			rows.push_back(item.row);
+			item.row = nullptr;
+			continue;
+			}
 
-			if ( ! fit->present )
-				{
-				// add non-present field
-				fields[fpos] = new Value((*fit).type, false);
-				fpos++;
-				continue;
-				}
+		if ( ! rows.empty() )
+			{
+			SendEntries(std::move(rows));
+			rows.clear();
+			}
 
-			assert(fit->position >= 0 );
+		if ( item.fatal )
+			{
+			FailWarn(true, item.msg.c_str());
+			return false;
+			}
 
-			if ( (*fit).position > pos || (*fit).secondary_position > pos )
-				{
-				FailWarn(fail_on_invalid_lines, Fmt("Not enough fields in line '%s' of %s. Found %d fields, want positions %d and %d",
-				                                    line.c_str(), fname.c_str(), pos, (*fit).position, (*fit).secondary_position));
-
-				if ( fail_on_invalid_lines )
-					{
-					for ( int i = 0; i < fpos; i++ )
-						delete fields[i];
-
-					delete [] fields;
-
-					return false;
-					}
-				else
-					{
-					error = true;
-					break;
-					}
-				}
+		ReaderBackend::Warning(item.msg.c_str());
+		}
 
-			Value* val = formatter->ParseValue(stringfields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+	SendEntries(std::move(rows));
+	chunk->items.clear();
+	return true;
+	}
 
-			if ( ! val )
-				{
-				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.", line.c_str(), fname.c_str()));
-				error = true;
-				break;
-				}
+void Ascii::Warning(const char* msg)
+	{
+	if ( current_chunk )
+		current_chunk->items.push_back({nullptr, msg, false});
+	else
+		ReaderBackend::Warning(msg);
+	}
 
-			if ( (*fit).secondary_position != -1 )
-				{
-				// we have a port definition :)
-				assert(val->type == TYPE_PORT );
-				//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
+void Ascii::ReportLineProblem(const char* msg, bool fatal)
+	{
+	if ( current_chunk )
+		current_chunk->items.push_back({nullptr, msg, fatal});
+	else
+		FailWarn(fatal, msg);
+	}
 
-				val->val.port_val.proto = formatter->ParseProto(stringfields[(*fit).secondary_position]);
-				}
+Ascii::LineResult Ascii::ParseLine(std::string_view line, std::vector<std::string>* stringfields,
+                                   Value*** vals)
+	{
+	// split on tabs
+	int pos = split_fields(line, separator[0], stringfields);
+	pos--; // for easy comparisons of max element.
+
+	Value** fields = new Value*[NumFields()];
 
-			fields[fpos] = val;
+	int fpos = 0;
+	for ( vector<FieldMapping>::iterator fit = columnMap.begin();
+		fit != columnMap.end();
+		fit++ )
+		{
 
+		if ( ! fit->present )
+			{
+			// add non-present field
+			fields[fpos] = new Value((*fit).type, false);
 			fpos++;
+			continue;
 			}
 
-		if ( error )
+		assert(fit->position >= 0 );
+
+		if ( (*fit).position > pos || (*fit).secondary_position > pos )
+			{
+			std::string l(line);
+			ReportLineProblem(Fmt("Not enough fields in line '%s' of %s. Found %d fields, want positions %d and %d",
+			                      l.c_str(), fname.c_str(), pos, (*fit).position, (*fit).secondary_position),
+			                  fail_on_invalid_lines);
+
+			for ( int i = 0; i < fpos; i++ )
+				delete fields[i];
+
+			delete [] fields;
+
+			return fail_on_invalid_lines ? LINE_FAILED : LINE_SKIP;
+			}
+
+		Value* val = formatter->ParseValue((*stringfields)[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+
+		if ( ! val )
 			{
 			// Encountered non-fatal error, ignoring line. But
 			// first, delete all successfully read fields and the
 			// array structure.
+			std::string l(line);
+			Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.", l.c_str(), fname.c_str()));
 
 			for ( int i = 0; i < fpos; i++ )
 				delete fields[i];
 
 			delete [] fields;
-			continue;
+			return LINE_SKIP;
 			}
 
-		//printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
-		assert ( fpos == NumFields() );
+		if ( (*fit).secondary_position != -1 )
+			{
+			// we have a port definition :)
+			assert(val->type == TYPE_PORT );
+			//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
 
-		if ( Info().mode == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+			val->val.port_val.proto = formatter->ParseProto((*stringfields)[(*fit).secondary_position]);
+			}
+
+		fields[fpos] = val;
+
+		fpos++;
 		}
 
-	if ( Info().mode != MODE_STREAM )
-		EndCurrentSend();
+	assert ( fpos == NumFields() );
 
-	return true;
+	*vals = fields;
+	return LINE_OK;
 	}
 
-bool Ascii::DoHeartbeat(double network_time, double current_time)
+// read the entire file and send appropriate thingies back to InputMgr
+bool Ascii::DoUpdate()
 	{
+	if ( Info().mode != MODE_STREAM )
+		return ReadFile();
+
 	if ( ! OpenFile() )
 		return ! fail_on_file_problem;
 
+	file.clear(); // remove end of file evil bits
+	if ( ! ReadHeader(true) )
+		return ! fail_on_file_problem; // header reading failed
+
+	string line;
+	vector<string> stringfields;
+
+	file.sync();
+
+	while ( GetLine(line) )
+		{
+		Value** fields;
+
+		switch ( ParseLine(line, &stringfields, &fields) ) {
+		case LINE_OK:
+			Put(fields);
+			break;
+
+		case LINE_SKIP:
+			break;
+
+		case LINE_FAILED:
+			return false;
+		}
+		}
+
+	return true;
+	}
+
+bool Ascii::DoHeartbeat(double network_time, double current_time)
+	{
 	switch ( Info().mode )
 		{
 		case MODE_MANUAL:
@@ -458,11 +824,17 @@ bool Ascii::DoHeartbeat(double network_time, double current_time)
 			break;
 
 		case MODE_REREAD:
-		case MODE_STREAM:
 			Update(); // Call Update, not DoUpdate, because Update
 				  // checks the "disabled" flag.
 			break;
 
+		case MODE_STREAM:
+			if ( ! OpenFile() )
+				return ! fail_on_file_problem;
+
+			Update();
+			break;
+
 		default:
 			assert(false);
 		}
@@ -7,6 +7,7 @@
 #include <vector>
 #include <fstream>
 #include <memory>
+#include <string_view>
 
 #include "zeek/input/ReaderBackend.h"
 #include "zeek/threading/formatters/Ascii.h"
@@ -53,14 +54,41 @@ protected:
 	bool DoUpdate() override;
 	bool DoHeartbeat(double network_time, double current_time) override;
 
+	// Collects warnings while parsing in parallel.
+	void Warning(const char* msg) override;
+
 private:
+	// A part of the file that gets parsed in one go.
+	struct Chunk;
+
+	enum LineResult { LINE_OK, LINE_SKIP, LINE_FAILED };
+
 	bool ReadHeader(bool useCached);
 	bool GetLine(std::string& str);
+	void SetFileName();
 	bool OpenFile();
 
+	// Reads the whole file at once, for the modes other than streaming.
+	bool ReadFile();
+	bool ParseChunks(std::vector<Chunk>& chunks);
+	bool ParseChunksInParallel(std::vector<Chunk>& chunks, int num_threads);
+	void ParseChunk(Chunk* chunk);
+
+	// Returns false on a fatal error.
+	bool SendChunk(Chunk* chunk);
+
+	LineResult ParseLine(std::string_view line, std::vector<std::string>* stringfields,
+	                     threading::Value*** vals);
+	void ReportLineProblem(const char* msg, bool fatal);
+
+	// The chunk that the calling thread is parsing currently, if any.
+	static thread_local Chunk* current_chunk;
+
 	std::ifstream file;
 	time_t mtime;
 	ino_t ino;
+	off_t size;
+	uint64_t fingerprint;
 
 	// The name using which we actually load the file -- compared
 	// to the input source name, this one may have a path_prefix
@@ -81,6 +109,7 @@ private:
 	bool fail_on_invalid_lines;
 	bool fail_on_file_problem;
 	std::string path_prefix;
+	int parse_threads;
 
 	std::unique_ptr<threading::Formatter> formatter;
 };
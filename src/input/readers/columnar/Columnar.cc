@@ -0,0 +1,380 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/input/readers/columnar/Columnar.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "zeek/threading/SerialTypes.h"
+
+#include "zeek/input/readers/columnar/columnar.bif.h"
+
+using namespace std;
+using zeek::threading::Value;
+using zeek::threading::Field;
+using zeek::threading::formatter::columnar::Block;
+using zeek::threading::formatter::columnar::Decoder;
+using zeek::threading::formatter::columnar::BLOCK_FOOTER;
+
+namespace zeek::input::reader::detail {
+
+// How much to read from the file at a time.
+static constexpr size_t READ_SIZE = 1024 * 1024;
+
+Columnar::Columnar(ReaderFrontend *frontend)
+	: ReaderBackend(frontend), fd(-1), mtime(0), ino(0), firstrun(true),
+	  have_header(false), have_footer(false)
+	{
+	}
+
+Columnar::~Columnar()
+	{
+	DoClose();
+	}
+
+void Columnar::DoClose()
+	{
+	CloseInput();
+	}
+
+bool Columnar::OpenInput()
+	{
+	fd = open(fname.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("Init: cannot open %s: %s", fname.c_str(), Strerror(errno)));
+		return false;
+		}
+
+	decoder = std::make_unique<Decoder>();
+	buffer.clear();
+	have_header = false;
+	have_footer = false;
+	return true;
+	}
+
+void Columnar::CloseInput()
+	{
+	if ( fd < 0 )
+		return;
+
+	util::safe_close(fd);
+	fd = -1;
+	}
+
+bool Columnar::DoInit(const ReaderInfo& info, int num_fields,
+                      const Field* const* fields)
+	{
+	path_prefix.assign((const char*) BifConst::InputColumnar::path_prefix->Bytes(),
+	                   BifConst::InputColumnar::path_prefix->Len());
+
+	if ( ! info.source || strlen(info.source) == 0 )
+		{
+		Error("No source path provided");
+		return false;
+		}
+
+	fname = info.source;
+
+	// Handle path-prefixing. See similar logic in Ascii::OpenFile().
+	if ( fname.front() != '/' && ! path_prefix.empty() )
+		{
+		string path = path_prefix;
+		std::size_t last = path.find_last_not_of('/');
+
+		if ( last == string::npos ) // Nothing but slashes -- weird but ok...
+			path = "/";
+		else
+			path.erase(last + 1);
+
+		fname = path + "/" + fname;
+		}
+
+	if ( ! OpenInput() )
+		return false;
+
+	if ( UpdateModificationTime() == -1 )
+		return false;
+
+	return DoUpdate();
+	}
+
+int Columnar::UpdateModificationTime()
+	{
+	struct stat sb;
+
+	if ( stat(fname.c_str(), &sb) == -1 )
+		{
+		Error(Fmt("Could not get stat for %s", fname.c_str()));
+		return -1;
+		}
+
+	if ( sb.st_ino == ino && sb.st_mtime == mtime )
+		// no change
+		return 0;
+
+	mtime = sb.st_mtime;
+	ino = sb.st_ino;
+	return 1;
+	}
+
+bool Columnar::MapFields()
+	{
+	const Field* const* columns = decoder->Fields();
+
+	field_map.assign(NumFields(), -1);
+	wanted.assign(decoder->NumFields(), false);
+
+	for ( int i = 0; i < NumFields(); ++i )
+		{
+		const Field* field = Fields()[i];
+		int c = 0;
+
+		while ( c < decoder->NumFields() && strcmp(columns[c]->name, field->name) != 0 )
+			++c;
+
+		if ( c == decoder->NumFields() )
+			{
+			if ( field->optional )
+				// Always send an unset value back.
+				continue;
+
+			Error(Fmt("Did not find requested field %s in input data file %s.",
+			          field->name, fname.c_str()));
+			return false;
+			}
+
+		bool is_container = (field->type == TYPE_TABLE || field->type == TYPE_VECTOR);
+
+		if ( columns[c]->type != field->type ||
+		     (is_container && columns[c]->subtype != field->subtype) )
+			{
+			Error(Fmt("Field %s in input data file %s has type %s, but %s was requested.",
+			          field->name, fname.c_str(), type_name(columns[c]->type),
+			          type_name(field->type)));
+			return false;
+			}
+
+		field_map[i] = c;
+		wanted[c] = true;
+		}
+
+	return true;
+	}
+
+void Columnar::SendRow(Value** row)
+	{
+	Value** vals = new Value*[NumFields()];
+
+	for ( int i = 0; i < NumFields(); ++i )
+		{
+		int c = field_map[i];
+
+		if ( c >= 0 )
+			{
+			vals[i] = row[c];
+			row[c] = nullptr;
+			}
+		else
+			vals[i] = new Value(Fields()[i]->type, Fields()[i]->subtype, false);
+		}
+
+	for ( int c = 0; c < decoder->NumFields(); ++c )
+		delete row[c];
+
+	delete [] row;
+
+	if ( Info().mode == MODE_STREAM )
+		Put(vals);
+	else
+		SendEntry(vals);
+	}
+
+bool Columnar::ParseBuffer()
+	{
+	size_t pos = 0;
+	size_t n;
+
+	if ( ! have_header )
+		{
+		switch ( decoder->ParseHeader(buffer.data(), buffer.size(), &n) ) {
+		case Decoder::NEED_MORE:
+			return true;
+
+		case Decoder::FAILED:
+			Error(Fmt("%s: %s", fname.c_str(), decoder->Error().c_str()));
+			return false;
+
+		case Decoder::OK:
+			break;
+		}
+
+		have_header = true;
+		pos = n;
+
+		if ( ! MapFields() )
+			return false;
+		}
+
+	Block block;
+	std::vector<Value**> rows;
+
+	while ( ! have_footer )
+		{
+		auto status = decoder->ParseBlock(buffer.data() + pos, buffer.size() - pos, &n, &block);
+
+		if ( status == Decoder::NEED_MORE )
+			break;
+
+		if ( status == Decoder::FAILED )
+			{
+			Error(Fmt("%s: %s", fname.c_str(), decoder->Error().c_str()));
+			return false;
+			}
+
+		pos += n;
+
+		if ( block.type == BLOCK_FOOTER )
+			{
+			have_footer = true;
+			break;
+			}
+
+		rows.clear();
+
+		if ( ! decoder->DecodeRowGroup(block, wanted, &rows) )
+			{
+			Error(Fmt("%s: %s", fname.c_str(), decoder->Error().c_str()));
+			return false;
+			}
+
+		for ( auto row : rows )
+			SendRow(row);
+		}
+
+	buffer.erase(0, pos);
+	return true;
+	}
+
+bool Columnar::ReadBlocks()
+	{
+	while ( ! have_footer )
+		{
+		size_t old_size = buffer.size();
+		buffer.resize(old_size + READ_SIZE);
+
+		ssize_t n = read(fd, &buffer[old_size], READ_SIZE);
+
+		if ( n < 0 )
+			{
+			buffer.resize(old_size);
+
+			if ( errno == EINTR )
+				continue;
+
+			Error(Fmt("error reading %s: %s", fname.c_str(), Strerror(errno)));
+			return false;
+			}
+
+		buffer.resize(old_size + n);
+
+		if ( ! ParseBuffer() )
+			return false;
+
+		if ( n == 0 )
+			break;
+		}
+
+	return true;
+	}
+
+// read the entire file and send appropriate thingies back to InputMgr
+bool Columnar::DoUpdate()
+	{
+	if ( firstrun )
+		firstrun = false;
+
+	else
+		{
+		switch ( Info().mode  ) {
+		case MODE_REREAD:
+			{
+			switch ( UpdateModificationTime() ) {
+			case -1:
+				return false; // error
+			case 0:
+				return true; // no change
+			case 1:
+				break; // file changed. reread.
+			default:
+				assert(false);
+			}
+			// fallthrough
+			}
+
+		case MODE_MANUAL:
+		case MODE_STREAM:
+			if ( Info().mode == MODE_STREAM && fd >= 0 )
+				{
+				// Continue where we left off, unless the file
+				// has been replaced, e.g. by rotating it.
+				ino_t old_ino = ino;
+
+				if ( UpdateModificationTime() == -1 )
+					return false;
+
+				if ( ino == old_ino )
+					break;
+				}
+
+			CloseInput();
+
+			if ( ! OpenInput() )
+				return false;
+
+			break;
+
+		default:
+			assert(false);
+		}
+		}
+
+	if ( ! ReadBlocks() )
+		return false;
+
+	if ( Info().mode != MODE_STREAM )
+		{
+		if ( ! buffer.empty() )
+			Warning(Fmt("%s ends with an incomplete row group", fname.c_str()));
+
+		EndCurrentSend();
+		}
+
+	return true;
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	switch ( Info().mode ) {
+		case MODE_MANUAL:
+			// yay, we do nothing :)
+			break;
+
+		case MODE_REREAD:
+		case MODE_STREAM:
+			Update();	// call update and not DoUpdate, because update
+					// checks disabled.
+			break;
+
+		default:
+			assert(false);
+	}
+
+	return true;
+	}
+
+} // namespace zeek::input::reader::detail
@@ -0,0 +1,71 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "zeek/input/ReaderBackend.h"
+#include "zeek/threading/formatters/Columnar.h"
+
+namespace zeek::input::reader::detail {
+
+/**
+ * Reader for the files of the Columnar log writer.
+ */
+class Columnar : public ReaderBackend {
+public:
+	explicit Columnar(ReaderFrontend* frontend);
+	~Columnar() override;
+
+	static ReaderBackend* Instantiate(ReaderFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	bool DoInit(const ReaderInfo& info, int arg_num_fields,
+	            const threading::Field* const* fields) override;
+	void DoClose() override;
+	bool DoUpdate() override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	bool OpenInput();
+	void CloseInput();
+	int UpdateModificationTime();
+
+	// Reads whatever data is available, passing on the rows of complete
+	// row groups.
+	bool ReadBlocks();
+
+	// Parses the header and the complete blocks in the buffer.
+	bool ParseBuffer();
+
+	// Maps the requested fields to the file's columns.
+	bool MapFields();
+
+	// Passes on a row, taking ownership of its values.
+	void SendRow(threading::Value** row);
+
+	std::string fname;
+	int fd;
+	time_t mtime;
+	ino_t ino;
+	bool firstrun;
+
+	std::unique_ptr<threading::formatter::columnar::Decoder> decoder;
+	std::string buffer;	// Data read but not parsed yet.
+	bool have_header;
+	bool have_footer;
+
+	// For each requested field, its column, or -1 if the file doesn't
+	// have it.
+	std::vector<int> field_map;
+	std::vector<bool> wanted;	// Per column, whether it's needed.
+
+	// Options set from the script-level.
+	std::string path_prefix;
+};
+
+} // namespace zeek::input::reader::detail
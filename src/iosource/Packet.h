@@ -18,6 +18,8 @@ typedef struct timeval pkt_timeval;
 #include "zeek/NetVar.h" // For BifEnum::Tunnel
 #include "zeek/TunnelEncapsulation.h"
 #include "zeek/IP.h"
+#include "zeek/IPAddr.h"
+#include "zeek/Hash.h"
 
 namespace zeek {
 
@@ -233,6 +235,16 @@ public:
 	 */
 	int gre_link_type = DLT_RAW;
 
+	/**
+	 * The key and hash of the packet's connection, and its transport
+	 * protocol, if these were determined ahead of time by the packet
+	 * pipeline (see :zeek:see:`Pcap::pipeline`). A zero hash means
+	 * they weren't.
+	 */
+	detail::ConnIDKey flow_key;
+	detail::hash_t flow_hash = 0;
+	int flow_proto = -1;
+
 private:
 	// Renders an MAC address into its ASCII representation.
 	ValPtr FmtEUI48(const u_char* mac) const;
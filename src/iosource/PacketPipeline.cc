@@ -0,0 +1,387 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/iosource/PacketPipeline.h"
+
+#include <assert.h>
+#include <signal.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "zeek/3rdparty/doctest.h"
+
+#include "zeek/Conn.h"
+#include "zeek/ConnTable.h"
+#include "zeek/iosource/Packet.h"
+#include "zeek/util.h"
+
+namespace zeek::iosource::detail {
+
+PacketPipeline::PacketPipeline(size_t capacity)
+	: input(capacity), output(capacity)
+	{
+	thread = std::thread(&PacketPipeline::Run, this);
+	util::detail::set_thread_name("zk.pipeline", thread.native_handle());
+	}
+
+PacketPipeline::~PacketPipeline()
+	{
+	stopping = true;
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		input_cond.notify_one();
+		}
+
+	thread.join();
+	}
+
+bool PacketPipeline::Submit(Packet* pkt)
+	{
+	if ( in_flight >= input.Capacity() || ! input.Push(pkt) )
+		return false;
+
+	++in_flight;
+
+	// Pairs with the fence in Run(): either the thread sees the new
+	// packet before going to sleep, or we see that it's sleeping.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( sleeping.load(std::memory_order_relaxed) )
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		input_cond.notify_one();
+		}
+
+	return true;
+	}
+
+Packet* PacketPipeline::Next()
+	{
+	assert(in_flight > 0);
+
+	Packet* pkt;
+
+	if ( ! output.Pop(&pkt) )
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		waiting.store(true, std::memory_order_relaxed);
+
+		// Pairs with the fence in Run(), like for the thread's
+		// sleeping.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		output_cond.wait(lock, [this]() { return ! output.Empty(); });
+		waiting.store(false, std::memory_order_relaxed);
+		lock.unlock();
+
+		output.Pop(&pkt);
+		}
+
+	--in_flight;
+	return pkt;
+	}
+
+Packet* PacketPipeline::TryNext()
+	{
+	Packet* pkt;
+
+	if ( in_flight == 0 || ! output.Pop(&pkt) )
+		return nullptr;
+
+	--in_flight;
+	return pkt;
+	}
+
+void PacketPipeline::Run()
+	{
+	// Signals are handled by the main thread only, like for all other
+	// threads (see BasicThread).
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, nullptr);
+
+	while ( ! stopping.load(std::memory_order_relaxed) )
+		{
+		Packet* pkt;
+
+		if ( input.Pop(&pkt) )
+			{
+			Dissect(pkt);
+
+			// The output ring is as large as the input ring and
+			// Submit() limits the packets in flight accordingly,
+			// so there's always space.
+			output.Push(pkt);
+
+			// Pairs with the fence in Next(): either the main
+			// thread sees the packet before it starts waiting, or
+			// we see that it's waiting.
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if ( waiting.load(std::memory_order_relaxed) )
+				{
+				std::lock_guard<std::mutex> lock(mutex);
+				output_cond.notify_one();
+				}
+
+			continue;
+			}
+
+		// Nothing to do until the next batch, which may be a while;
+		// sleep rather than poll for it.
+		std::unique_lock<std::mutex> lock(mutex);
+		sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		input_cond.wait(lock, [this]()
+			{
+			return stopping.load(std::memory_order_relaxed) || ! input.Empty();
+			});
+
+		sleeping.store(false, std::memory_order_relaxed);
+		}
+	}
+
+static inline uint16_t extract_uint16(const u_char* p)
+	{
+	return (p[0] << 8) | p[1];
+	}
+
+bool PacketPipeline::Dissect(Packet* pkt)
+	{
+	const u_char* data = pkt->data;
+	uint32_t len = pkt->cap_len;
+	uint32_t off = 0;
+	int l3 = 0;
+
+	if ( ! data )
+		return false;
+
+	switch ( pkt->link_type ) {
+	case DLT_EN10MB:
+		{
+		if ( len < 14 )
+			return false;
+
+		uint16_t eth_type = extract_uint16(data + 12);
+		off = 14;
+
+		// 802.1Q and 802.1ad tags, possibly stacked.
+		while ( eth_type == 0x8100 || eth_type == 0x88a8 || eth_type == 0x9100 )
+			{
+			if ( len < off + 4 )
+				return false;
+
+			eth_type = extract_uint16(data + off + 2);
+			off += 4;
+			}
+
+		if ( eth_type == 0x0800 )
+			l3 = 4;
+		else if ( eth_type == 0x86dd )
+			l3 = 6;
+		else
+			return false;
+
+		break;
+		}
+
+	case DLT_RAW:
+		if ( len < 1 )
+			return false;
+
+		l3 = data[0] >> 4;
+		break;
+
+	default:
+		return false;
+	}
+
+	ConnID id;
+	int proto;
+
+	if ( l3 == 4 )
+		{
+		if ( len < off + 20 || (data[off] >> 4) != 4 )
+			return false;
+
+		uint32_t hdr_len = (data[off] & 0x0f) * 4;
+
+		// Fragments get reassembled first, so there's no telling
+		// what the reassembled packet will belong to yet.
+		if ( hdr_len < 20 || (extract_uint16(data + off + 6) & 0x3fff) )
+			return false;
+
+		in4_addr src, dst;
+		memcpy(&src, data + off + 12, sizeof(src));
+		memcpy(&dst, data + off + 16, sizeof(dst));
+		id.src_addr = IPAddr(src);
+		id.dst_addr = IPAddr(dst);
+
+		proto = data[off + 9];
+		off += hdr_len;
+		}
+
+	else if ( l3 == 6 )
+		{
+		if ( len < off + 40 || (data[off] >> 4) != 6 )
+			return false;
+
+		// We don't look into extension headers; the main thread
+		// will take care of those packets.
+		proto = data[off + 6];
+
+		in6_addr src, dst;
+		memcpy(&src, data + off + 8, sizeof(src));
+		memcpy(&dst, data + off + 24, sizeof(dst));
+		id.src_addr = IPAddr(src);
+		id.dst_addr = IPAddr(dst);
+
+		off += 40;
+		}
+
+	else
+		return false;
+
+	if ( proto != IPPROTO_TCP && proto != IPPROTO_UDP )
+		return false;
+
+	if ( len < off + 4 )
+		return false;
+
+	// Ports stay in network order, like in NetSessions.
+	uint16_t src_port, dst_port;
+	memcpy(&src_port, data + off, sizeof(src_port));
+	memcpy(&dst_port, data + off + 2, sizeof(dst_port));
+	id.src_port = src_port;
+	id.dst_port = dst_port;
+	id.is_one_way = false;
+
+	pkt->flow_key = zeek::detail::BuildConnIDKey(id);
+	pkt->flow_hash = zeek::detail::ConnTable::Hash(pkt->flow_key);
+	pkt->flow_proto = proto;
+
+	return true;
+	}
+
+TEST_SUITE_BEGIN("PacketPipeline");
+
+static void make_test_packet(u_char* buf, int proto, uint8_t last_octet, uint16_t port, uint16_t frag)
+	{
+	static const u_char tmpl[] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0x81, 0x00, 0x00, 0x2a, 0x08, 0x00,
+		0x45, 0, 0, 40, 0, 0, 0, 0, 64, 6, 0, 0,
+		10, 0, 0, 1, 10, 0, 0, 2,
+		0x04, 0xd2, 0x00, 0x50, 0, 0, 0, 0, 0, 0, 0, 0, 0x50, 0x02, 0, 0, 0, 0, 0, 0,
+	};
+
+	memcpy(buf, tmpl, sizeof(tmpl));
+	buf[18 + 6] = frag >> 8;
+	buf[18 + 7] = frag & 0xff;
+	buf[18 + 9] = proto;
+	buf[18 + 19] = last_octet;
+	buf[38 + 2] = port >> 8;
+	buf[38 + 3] = port & 0xff;
+	}
+
+TEST_CASE("packet pipeline dissection")
+	{
+	u_char buf[58];
+	pkt_timeval ts = { 0, 0 };
+	Packet pkt;
+
+	make_test_packet(buf, IPPROTO_TCP, 2, 80, 0);
+	pkt.Init(DLT_EN10MB, &ts, sizeof(buf), sizeof(buf), buf);
+	CHECK(PacketPipeline::Dissect(&pkt));
+	CHECK(pkt.flow_proto == IPPROTO_TCP);
+	CHECK(pkt.flow_hash != 0);
+
+	ConnID id;
+	id.src_addr = IPAddr("10.0.0.1");
+	id.dst_addr = IPAddr("10.0.0.2");
+	id.src_port = htons(1234);
+	id.dst_port = htons(80);
+	id.is_one_way = false;
+	CHECK(pkt.flow_key == zeek::detail::BuildConnIDKey(id));
+
+	auto hash = pkt.flow_hash;
+
+	// Re-initializing the packet clears the hint.
+	pkt.Init(DLT_EN10MB, &ts, sizeof(buf), sizeof(buf), buf);
+	CHECK(pkt.flow_hash == 0);
+
+	// Other flows, and fragments.
+	make_test_packet(buf, IPPROTO_TCP, 3, 80, 0);
+	pkt.Init(DLT_EN10MB, &ts, sizeof(buf), sizeof(buf), buf);
+	CHECK(PacketPipeline::Dissect(&pkt));
+	CHECK(pkt.flow_hash != hash);
+
+	make_test_packet(buf, IPPROTO_UDP, 2, 80, 0);
+	pkt.Init(DLT_EN10MB, &ts, sizeof(buf), sizeof(buf), buf);
+	CHECK(PacketPipeline::Dissect(&pkt));
+	CHECK(pkt.flow_proto == IPPROTO_UDP);
+
+	make_test_packet(buf, IPPROTO_TCP, 2, 80, 0x2000);
+	pkt.Init(DLT_EN10MB, &ts, sizeof(buf), sizeof(buf), buf);
+	CHECK_FALSE(PacketPipeline::Dissect(&pkt));
+	CHECK(pkt.flow_hash == 0);
+
+	make_test_packet(buf, IPPROTO_ICMP, 2, 80, 0);
+	pkt.Init(DLT_EN10MB, &ts, sizeof(buf), sizeof(buf), buf);
+	CHECK_FALSE(PacketPipeline::Dissect(&pkt));
+
+	make_test_packet(buf, IPPROTO_TCP, 2, 80, 0);
+	pkt.Init(DLT_EN10MB, &ts, 40, 40, buf);
+	CHECK_FALSE(PacketPipeline::Dissect(&pkt));
+
+	// Without the Ethernet header and VLAN tag.
+	pkt.Init(DLT_RAW, &ts, sizeof(buf) - 18, sizeof(buf) - 18, buf + 18);
+	CHECK(PacketPipeline::Dissect(&pkt));
+	CHECK(pkt.flow_hash == hash);
+	}
+
+TEST_CASE("packet pipeline ordering")
+	{
+	const size_t n = 64;
+	u_char buf[n][58];
+	Packet pkts[n];
+	pkt_timeval ts = { 0, 0 };
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		make_test_packet(buf[i], IPPROTO_UDP, i % 7, 1000 + i, 0);
+		pkts[i].Init(DLT_EN10MB, &ts, sizeof(buf[i]), sizeof(buf[i]), buf[i]);
+		}
+
+	PacketPipeline pipeline(16);
+	size_t submitted = 0;
+	size_t returned = 0;
+
+	while ( returned < n )
+		{
+		while ( submitted < n && pipeline.Submit(&pkts[submitted]) )
+			++submitted;
+
+		CHECK(pipeline.InFlight() <= 16);
+
+		Packet* p = returned % 2 ? pipeline.Next() : pipeline.TryNext();
+
+		if ( ! p )
+			continue;
+
+		CHECK(p == &pkts[returned]);
+		CHECK(p->flow_hash != 0);
+		++returned;
+		}
+
+	CHECK(pipeline.InFlight() == 0);
+	CHECK(pipeline.TryNext() == nullptr);
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::iosource::detail
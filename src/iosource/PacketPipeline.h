@@ -0,0 +1,111 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek/zeek-config.h"
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "zeek/threading/SPSCRing.h"
+
+namespace zeek {
+
+class Packet;
+
+namespace iosource::detail {
+
+/**
+ * A pipeline stage that dissects packets on a separate thread while the
+ * main thread is busy with the analysis of earlier ones.
+ *
+ * For each packet it parses the link layer and the IPv4/IPv6 header, and
+ * for unfragmented TCP and UDP packets computes the key and hash of the
+ * connection. The results are stored with the packet (see
+ * Packet::flow_hash), so that the main thread can prefetch connection
+ * table entries ahead of time and skips hashing the key itself. All other
+ * processing remains with the main thread, which is where the state of
+ * sessions, analyzers, and the script layer lives.
+ *
+ * Packets are passed to the dissection thread, and back, through SPSC
+ * rings. They come back in the order they were submitted.
+ */
+class PacketPipeline {
+public:
+	/**
+	 * Constructor. Starts the dissection thread.
+	 *
+	 * @param capacity The maximum number of packets in flight.
+	 */
+	explicit PacketPipeline(size_t capacity);
+
+	/**
+	 * Destructor. Stops the dissection thread; packets still in flight
+	 * are discarded.
+	 */
+	~PacketPipeline();
+
+	PacketPipeline(const PacketPipeline&) = delete;
+	PacketPipeline& operator=(const PacketPipeline&) = delete;
+
+	/**
+	 * Hands a packet over to the dissection thread. The packet must not
+	 * be touched until it's returned by Next() or TryNext().
+	 *
+	 * @return False if the maximum number of packets is in flight
+	 * already.
+	 */
+	bool Submit(Packet* pkt);
+
+	/**
+	 * Returns the oldest packet submitted, waiting for its dissection
+	 * to finish if necessary. Must not be called with no packets in
+	 * flight.
+	 */
+	Packet* Next();
+
+	/**
+	 * Returns the oldest packet submitted if its dissection has
+	 * finished already, and nullptr otherwise.
+	 */
+	Packet* TryNext();
+
+	/**
+	 * Returns the number of packets submitted but not returned yet.
+	 */
+	size_t InFlight() const	{ return in_flight; }
+
+	/**
+	 * Determines the key and hash of a packet's connection and stores
+	 * them with the packet. This is the dissection thread's work, but
+	 * it may be called on any thread.
+	 *
+	 * @return True if the packet is a TCP or UDP packet that the flow
+	 * key could be determined for.
+	 */
+	static bool Dissect(Packet* pkt);
+
+private:
+	void Run();
+
+	threading::SPSCRing<Packet*> input;
+	threading::SPSCRing<Packet*> output;
+	size_t in_flight = 0;
+
+	// For putting the thread to sleep when there's nothing to do, and
+	// the main thread when it has to wait for a packet.
+	std::mutex mutex;
+	std::condition_variable input_cond;
+	std::condition_variable output_cond;
+	std::atomic<bool> sleeping{false};
+	std::atomic<bool> waiting{false};
+	std::atomic<bool> stopping{false};
+
+	std::thread thread;
+};
+
+} // namespace iosource::detail
+} // namespace zeek
@@ -13,11 +13,16 @@
 #include "zeek/iosource/Manager.h"
 #include "zeek/packet_analysis/Manager.h"
 #include "zeek/iosource/BPF_Program.h"
+#include "zeek/iosource/PacketPipeline.h"
 
 #include "zeek/iosource/pcap/pcap.bif.h"
 
 namespace zeek::iosource {
 
+// Number of packets of a batch whose connections' state gets brought
+// into the cache ahead of their processing.
+static constexpr size_t PREFETCH_AHEAD = 8;
+
 PktSrc::Properties::Properties()
 	{
 	selectable_fd = -1;
@@ -149,6 +154,12 @@ void PktSrc::Process()
 	if ( ! IsOpen() )
 		return;
 
+	if ( batch_len > 0 || UseBatches() )
+		{
+		ProcessBatch();
+		return;
+		}
+
 	if ( ! ExtractNextPacketInternal() )
 		return;
 
@@ -163,6 +174,137 @@ const char* PktSrc::Tag()
 	return "PktSrc";
 	}
 
+bool PktSrc::UseBatches() const
+	{
+	// In pseudo-realtime mode each packet needs to wait for its time
+	// individually, see GetNextTimeout().
+	return BifConst::Pcap::batch_size > 1 && ! run_state::pseudo_realtime;
+	}
+
+size_t PktSrc::ExtractNextBatch(Packet* pkts, size_t max)
+	{
+	return ExtractNextPacket(&pkts[0]) ? 1 : 0;
+	}
+
+void PktSrc::DoneWithBatch()
+	{
+	DoneWithPacket();
+	}
+
+void PktSrc::ProcessBatch()
+	{
+	// Don't return any packets if processing is suspended (except for the
+	// very first packet which we need to set up times).
+	auto suspended = []()
+		{
+		return run_state::is_processing_suspended() && run_state::detail::first_timestamp;
+		};
+
+	if ( batch_len == 0 )
+		{
+		if ( suspended() )
+			return;
+
+		if ( ! batch )
+			{
+			batch_capacity = std::max(bro_uint_t(1), BifConst::Pcap::batch_size);
+			batch = std::make_unique<Packet[]>(batch_capacity);
+			}
+
+		batch_len = ExtractNextBatch(batch.get(), batch_capacity);
+		batch_pos = 0;
+		batch_piped = batch_ready = 0;
+
+		if ( batch_len == 0 )
+			return;
+
+		if ( BifConst::Pcap::pipeline )
+			{
+			if ( ! pipeline )
+				pipeline = std::make_unique<detail::PacketPipeline>(batch_capacity);
+
+			// The pipeline takes up to a whole batch, so this
+			// shouldn't fail. If it does nevertheless, we take care
+			// of the remainder ourselves, like without the pipeline.
+			while ( batch_piped < batch_len && pipeline->Submit(&batch[batch_piped]) )
+				++batch_piped;
+			}
+
+		batch_prefetched = batch_piped;
+		}
+
+	// The whole batch gets processed before we return to the main loop,
+	// unless something happening during processing asks us to hold off.
+	while ( batch_pos < batch_len && ! suspended() && ! run_state::terminating )
+		{
+		Packet* pkt = &batch[batch_pos++];
+
+		if ( batch_pos > batch_piped )
+			PrefetchAhead();
+		else if ( batch_ready < batch_pos )
+			AwaitPipeline(batch_pos);
+
+		if ( pkt->time < 0 )
+			{
+			Weird("negative_packet_timestamp", pkt);
+			continue;
+			}
+
+		if ( ! run_state::detail::first_timestamp )
+			run_state::detail::first_timestamp = pkt->time;
+
+		current_batch_packet = pkt;
+		run_state::detail::dispatch_packet(pkt, this);
+		current_batch_packet = nullptr;
+		}
+
+	if ( batch_pos == batch_len )
+		{
+		batch_len = batch_pos = 0;
+		DoneWithBatch();
+		}
+	}
+
+void PktSrc::AwaitPipeline(size_t n)
+	{
+	// Packets come back in order. Beyond the ones we need right away,
+	// we take a few more if they are ready already, so that their
+	// connections' state is in the cache by the time we get to them.
+	while ( batch_ready < n )
+		{
+		sessions->PrefetchFlow(pipeline->Next());
+		++batch_ready;
+		}
+
+	while ( batch_ready < n + PREFETCH_AHEAD )
+		{
+		Packet* pkt = pipeline->TryNext();
+
+		if ( ! pkt )
+			break;
+
+		sessions->PrefetchFlow(pkt);
+		++batch_ready;
+		}
+	}
+
+void PktSrc::PrefetchAhead()
+	{
+	// For packets not going through the pipeline, we dissect the
+	// upcoming ones ourselves. That's cheap compared to the cache misses it saves,
+	// and NetSessions reuses the hashes instead of computing them
+	// again.
+	size_t end = std::min(batch_pos + PREFETCH_AHEAD, batch_len);
+
+	for ( ; batch_prefetched < end; ++batch_prefetched )
+		{
+		Packet* pkt = &batch[batch_prefetched];
+
+		if ( detail::PacketPipeline::Dissect(pkt) )
+			sessions->PrefetchFlow(pkt);
+		}
+	}
+
 bool PktSrc::ExtractNextPacketInternal()
 	{
 	if ( have_packet )
@@ -264,6 +406,12 @@ bool PktSrc::ApplyBPFFilter(int index, const struct pcap_pkthdr *hdr, const u_ch
 
 bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	{
+	if ( current_batch_packet )
+		{
+		*pkt = current_batch_packet;
+		return true;
+		}
+
 	if ( ! have_packet )
 		return false;
 
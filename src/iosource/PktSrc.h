@@ -3,6 +3,7 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <memory>
 #include <vector>
 
 #include "zeek/iosource/IOSource.h"
@@ -12,7 +13,12 @@ struct pcap_pkthdr;
 
 namespace zeek::iosource {
 
-namespace detail { class BPF_Program; }
+namespace detail {
+
+class BPF_Program;
+class PacketPipeline;
+
+}
 
 /**
  * Base class for packet sources.
@@ -46,7 +52,19 @@ public:
 		*/
 		uint64_t bytes_received;
 
-		Stats()	{ received = dropped = link = bytes_received = 0; }
+		/**
+		 * Number of times the source's capture buffer ran full.
+		 * Optional, can be left unset if not available.
+		 */
+		uint64_t buffer_full;
+
+		/**
+		 * Current fill level of the source's capture buffer, in
+		 * percent. Optional, can be left unset if not available.
+		 */
+		uint64_t buffer_fill;
+
+		Stats()	{ received = dropped = link = bytes_received = buffer_full = buffer_fill = 0; }
 	};
 
 	/**
@@ -329,11 +347,58 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Provides a batch of packets from the source. This is used instead
+	 * of \a ExtractNextPacket() if the script-level
+	 * :zeek:see:`Pcap::batch_size` is larger than one.
+	 *
+	 * Derived classes may override this to hand over many packets at
+	 * once, ideally pointing directly into their capture buffers. The
+	 * default implementation provides a single packet via \a
+	 * ExtractNextPacket().
+	 *
+	 * @param pkts An array of packet structures to fill in. The callee
+	 * keeps ownership of the packets' data but must guarantee that it
+	 * stays available at least until \a DoneWithBatch() is called. It
+	 * is guaranteed that no two calls to this method will happen
+	 * without \a DoneWithBatch() in between.
+	 *
+	 * @param max The number of elements in *pkts*.
+	 *
+	 * @return The number of packets filled in, which may be zero if
+	 * none are available or an error occurred (which must be flagged
+	 * via Error()).
+	 */
+	virtual size_t ExtractNextBatch(Packet* pkts, size_t max);
+
+	/**
+	 * Signals that the data of all packets of the previously extracted
+	 * batch will no longer be needed. The default implementation calls
+	 * \a DoneWithPacket().
+	 */
+	virtual void DoneWithBatch();
+
 private:
 
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Returns true if packets are to be processed in batches.
+	bool UseBatches() const;
+
+	// Processes (the remainder of) the current batch, extracting a
+	// new one first if needed.
+	void ProcessBatch();
+
+	// Retrieves packets of the current batch from the pipeline until
+	// the first n are through, prefetching their connections' state.
+	void AwaitPipeline(size_t n);
+
+	// For packets not submitted to the pipeline, dissects the ones of
+	// the current batch just ahead of the one about to be processed,
+	// prefetching their connections' state.
+	void PrefetchAhead();
+
 	// IOSource interface implementation.
 	void InitSource() override;
 	void Done() override;
@@ -345,6 +410,24 @@ private:
 	bool have_packet;
 	Packet current_packet;
 
+	// For batch processing. Only allocated once batching is used.
+	std::unique_ptr<Packet[]> batch;
+	size_t batch_capacity = 0;
+	size_t batch_len = 0;
+	size_t batch_pos = 0;
+	Packet* current_batch_packet = nullptr;
+
+	// Dissects the packets of each batch ahead of their processing if
+	// Pcap::pipeline is set. The ones below batch_piped have been
+	// submitted to it, and of those, the ones below batch_ready are
+	// through.
+	std::unique_ptr<detail::PacketPipeline> pipeline;
+	size_t batch_piped = 0;
+	size_t batch_ready = 0;
+
+	// Packets below this one have been prefetched by PrefetchAhead().
+	size_t batch_prefetched = 0;
+
 	// For BPF filtering support.
 	std::vector<detail::BPF_Program *> filters;
 
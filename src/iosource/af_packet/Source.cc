@@ -0,0 +1,437 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/zeek-config.h"
+#include "zeek/iosource/af_packet/Source.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+
+#include "zeek/iosource/Packet.h"
+#include "zeek/iosource/BPF_Program.h"
+
+#include "zeek/ID.h"
+#include "zeek/Val.h"
+
+// Older kernel headers lack the checksum status bits.
+#ifndef TP_STATUS_CSUMNOTREADY
+#define TP_STATUS_CSUMNOTREADY (1 << 3)
+#endif
+
+#ifndef TP_STATUS_CSUM_VALID
+#define TP_STATUS_CSUM_VALID (1 << 7)
+#endif
+
+namespace zeek::iosource::af_packet {
+
+AF_PacketSource::~AF_PacketSource()
+	{
+	Close();
+	}
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+	}
+
+PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new AF_PacketSource(path, is_live);
+	}
+
+void AF_PacketSource::Open()
+	{
+	if ( ! props.is_live )
+		{
+		Error("AF_PACKET sources can only read from live interfaces");
+		return;
+		}
+
+	if ( ! SetupSocket() || ! SetupRing() )
+		{
+		Close();
+		return;
+		}
+
+	if ( id::find_val("AF_Packet::enable_fanout")->AsBool() && ! JoinFanout() )
+		{
+		Close();
+		return;
+		}
+
+	use_csum_status = id::find_val("AF_Packet::checksum_offload_status")->AsBool();
+
+	props.selectable_fd = fd;
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	Opened(props);
+	}
+
+void AF_PacketSource::Close()
+	{
+	if ( fd < 0 )
+		return;
+
+	if ( ring )
+		munmap(ring, ring_size);
+
+	close(fd);
+
+	fd = -1;
+	ring = nullptr;
+	ring_size = 0;
+	release_pos = held = 0;
+	pkts_left = 0;
+	next_hdr = nullptr;
+
+	if ( IsOpen() )
+		Closed();
+	}
+
+void AF_PacketSource::SysError(const char* where)
+	{
+	Error(util::fmt("%s: %s (%s)", props.path.c_str(), strerror(errno), where));
+	}
+
+bool AF_PacketSource::SetupSocket()
+	{
+	if ( props.path.empty() )
+		{
+		Error("no interface given for AF_PACKET source");
+		return false;
+		}
+
+	fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( fd < 0 )
+		{
+		SysError("socket");
+		return false;
+		}
+
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+
+	if ( props.path.size() >= sizeof(ifr.ifr_name) )
+		{
+		Error(util::fmt("interface name too long: %s", props.path.c_str()));
+		return false;
+		}
+
+	strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name) - 1);
+
+	if ( ioctl(fd, SIOCGIFINDEX, &ifr) < 0 )
+		{
+		SysError("SIOCGIFINDEX");
+		return false;
+		}
+
+	int ifindex = ifr.ifr_ifindex;
+
+	if ( ioctl(fd, SIOCGIFHWADDR, &ifr) < 0 )
+		{
+		SysError("SIOCGIFHWADDR");
+		return false;
+		}
+
+	// The loopback device comes with (zeroed) Ethernet headers as well.
+	switch ( ifr.ifr_hwaddr.sa_family ) {
+	case ARPHRD_ETHER:
+	case ARPHRD_LOOPBACK:
+		props.link_type = DLT_EN10MB;
+		break;
+	default:
+		Error(util::fmt("%s: unsupported link type %d", props.path.c_str(),
+		                ifr.ifr_hwaddr.sa_family));
+		return false;
+	}
+
+	int version = TPACKET_V3;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 )
+		{
+		SysError("PACKET_VERSION");
+		return false;
+		}
+
+	struct sockaddr_ll sll;
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+
+	if ( bind(fd, reinterpret_cast<struct sockaddr*>(&sll), sizeof(sll)) < 0 )
+		{
+		SysError("bind");
+		return false;
+		}
+
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = ifindex;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+		{
+		SysError("PACKET_ADD_MEMBERSHIP");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::SetupRing()
+	{
+	block_size = id::find_val("AF_Packet::block_size")->AsCount();
+	num_blocks = id::find_val("AF_Packet::block_count")->AsCount();
+	double timeout = id::find_val("AF_Packet::block_timeout")->AsInterval();
+
+	if ( block_size == 0 || block_size % getpagesize() != 0 )
+		{
+		Error(util::fmt("AF_Packet::block_size must be a multiple of the page size (%d)",
+		                getpagesize()));
+		return false;
+		}
+
+	if ( num_blocks == 0 )
+		{
+		Error("AF_Packet::block_count must be positive");
+		return false;
+		}
+
+	// With TPACKET_V3, packets are stored back-to-back within a block;
+	// the frame size only matters for the kernel's sanity checks.
+	const unsigned int frame_size = TPACKET_ALIGNMENT << 7;
+
+	struct tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = block_size;
+	req.tp_block_nr = num_blocks;
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = (block_size / frame_size) * num_blocks;
+	req.tp_retire_blk_tov = static_cast<unsigned int>(timeout * 1000);
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+		{
+		SysError("PACKET_RX_RING");
+		return false;
+		}
+
+	ring_size = block_size * num_blocks;
+	void* m = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if ( m == MAP_FAILED )
+		{
+		SysError("mmap");
+		ring_size = 0;
+		return false;
+		}
+
+	ring = static_cast<u_char*>(m);
+	release_pos = held = 0;
+	pkts_left = 0;
+	next_hdr = nullptr;
+
+	return true;
+	}
+
+bool AF_PacketSource::JoinFanout()
+	{
+	int mode = PACKET_FANOUT_HASH;
+
+	if ( id::find_val("AF_Packet::fanout_defrag")->AsBool() )
+		mode |= PACKET_FANOUT_FLAG_DEFRAG;
+
+	int group = id::find_val("AF_Packet::fanout_id")->AsCount();
+	int arg = (group & 0xffff) | (mode << 16);
+
+	if ( setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0 )
+		{
+		SysError("PACKET_FANOUT");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::NextPacket(Packet* pkt)
+	{
+	while ( pkts_left == 0 )
+		{
+		// All blocks may still be owned by us if the caller hasn't
+		// released previous packets yet.
+		if ( held == num_blocks )
+			return false;
+
+		tpacket_block_desc* block = Block((release_pos + held) % num_blocks);
+
+		if ( (__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0 )
+			return false;
+
+		++held;
+		pkts_left = block->hdr.bh1.num_pkts;
+		next_hdr = reinterpret_cast<tpacket3_hdr*>(
+			reinterpret_cast<u_char*>(block) + block->hdr.bh1.offset_to_first_pkt);
+
+		// Should the kernel ever hand over an empty block, we just
+		// move on; it gets released along with the next ones.
+		}
+
+	tpacket3_hdr* hdr = next_hdr;
+	pkt_timeval ts = { static_cast<time_t>(hdr->tp_sec),
+	                   static_cast<suseconds_t>(hdr->tp_nsec / 1000) };
+
+	pkt->Init(props.link_type, &ts, hdr->tp_snaplen, hdr->tp_len,
+	          reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac);
+
+	// The kernel strips the outermost VLAN tag and reports it
+	// separately.
+	if ( hdr->tp_status & TP_STATUS_VLAN_VALID )
+		pkt->vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+	// The kernel flags packets whose transport checksum the NIC has
+	// already verified, as well as outgoing ones that it has yet to
+	// compute it for. Either way, there's no point in checking it.
+	if ( use_csum_status &&
+	     (hdr->tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)) )
+		pkt->l3_checksummed = true;
+
+	if ( --pkts_left > 0 )
+		next_hdr = reinterpret_cast<tpacket3_hdr*>(
+			reinterpret_cast<u_char*>(hdr) + hdr->tp_next_offset);
+	else
+		next_hdr = nullptr;
+
+	++stats.received;
+	stats.bytes_received += hdr->tp_len;
+
+	return true;
+	}
+
+void AF_PacketSource::ReleaseBlocks()
+	{
+	// The block being read stays ours as long as it has packets left.
+	size_t done = pkts_left > 0 ? held - 1 : held;
+
+	for ( size_t i = 0; i < done; ++i )
+		{
+		tpacket_block_desc* block = Block(release_pos);
+		__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		release_pos = (release_pos + 1) % num_blocks;
+		}
+
+	held -= done;
+	}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( ! ring )
+		return false;
+
+	return NextPacket(pkt);
+	}
+
+void AF_PacketSource::DoneWithPacket()
+	{
+	ReleaseBlocks();
+	}
+
+size_t AF_PacketSource::ExtractNextBatch(Packet* pkts, size_t max)
+	{
+	if ( ! ring )
+		return 0;
+
+	size_t n = 0;
+
+	while ( n < max && NextPacket(&pkts[n]) )
+		++n;
+
+	return n;
+	}
+
+void AF_PacketSource::DoneWithBatch()
+	{
+	ReleaseBlocks();
+	}
+
+bool AF_PacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool AF_PacketSource::SetFilter(int index)
+	{
+	if ( fd < 0 )
+		return true; // Prevent error message
+
+	iosource::detail::BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(util::fmt("No precompiled pcap filter for index %d", index));
+		return false;
+		}
+
+	// The kernel runs the filter before packets even enter the ring.
+	// Classic BPF instructions share their layout with sock_filter.
+	bpf_program* prog = code->GetProgram();
+
+	struct sock_fprog fprog;
+	fprog.len = prog->bf_len;
+	fprog.filter = reinterpret_cast<struct sock_filter*>(prog->bf_insns);
+
+	if ( setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		SysError("SO_ATTACH_FILTER");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Statistics(Stats* s)
+	{
+	if ( fd >= 0 )
+		{
+		struct tpacket_stats_v3 tp_stats;
+		socklen_t len = sizeof(tp_stats);
+
+		if ( getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) == 0 )
+			{
+			kernel_drops += tp_stats.tp_drops;
+			kernel_freezes += tp_stats.tp_freeze_q_cnt;
+			}
+		else
+			SysError("PACKET_STATISTICS");
+		}
+
+	size_t filled = 0;
+
+	if ( ring )
+		{
+		for ( size_t i = 0; i < num_blocks; ++i )
+			{
+			if ( __atomic_load_n(&Block(i)->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER )
+				++filled;
+			}
+		}
+
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->dropped = kernel_drops;
+	s->link = stats.received + kernel_drops;
+	s->buffer_full = kernel_freezes;
+	s->buffer_fill = num_blocks ? filled * 100 / num_blocks : 0;
+	}
+
+} // namespace zeek::iosource::af_packet
@@ -0,0 +1,85 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <sys/types.h> // for u_char
+
+#include <linux/if_packet.h>
+
+#include "zeek/iosource/PktSrc.h"
+
+namespace zeek::iosource::af_packet {
+
+/**
+ * A live packet source reading from a memory-mapped TPACKET_V3 ring of a
+ * Linux AF_PACKET socket. Packets are handed to Zeek straight out of the
+ * ring: the kernel fills blocks of many packets at a time, and a block
+ * goes back to the kernel once all of its packets have been processed.
+ *
+ * If fanout is enabled, all Zeek processes reading from the same interface
+ * with the same AF_Packet::fanout_id join one fanout group, in which the
+ * kernel balances flows across them by hashing their addresses and ports.
+ */
+class AF_PacketSource : public PktSrc {
+public:
+	AF_PacketSource(const std::string& path, bool is_live);
+	~AF_PacketSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	size_t ExtractNextBatch(Packet* pkts, size_t max) override;
+	void DoneWithBatch() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	bool SetupSocket();
+	bool SetupRing();
+	bool JoinFanout();
+	void SysError(const char* where);
+
+	tpacket_block_desc* Block(size_t i) const
+		{ return reinterpret_cast<tpacket_block_desc*>(ring + i * block_size); }
+
+	// Fills in the next packet from the ring, taking ownership of
+	// another block if the current one has been read completely.
+	// Returns false if no packet is ready.
+	bool NextPacket(Packet* pkt);
+
+	// Hands all blocks that have been read completely back to the
+	// kernel.
+	void ReleaseBlocks();
+
+	Properties props;
+	Stats stats;
+
+	int fd = -1;
+	u_char* ring = nullptr;
+	size_t ring_size = 0;
+	size_t block_size = 0;
+	size_t num_blocks = 0;
+
+	// Blocks we currently own start at release_pos; the last of them
+	// is the one being read, with pkts_left packets remaining and
+	// next_hdr pointing to the next one.
+	size_t release_pos = 0;
+	size_t held = 0;
+	uint32_t pkts_left = 0;
+	tpacket3_hdr* next_hdr = nullptr;
+
+	// Whether to trust the kernel's checksum status bits.
+	bool use_csum_status = true;
+
+	// The kernel resets its counters whenever they are read.
+	uint64_t kernel_drops = 0;
+	uint64_t kernel_freezes = 0;
+};
+
+} // namespace zeek::iosource::af_packet
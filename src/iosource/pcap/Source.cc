@@ -245,6 +245,77 @@ void PcapSource::DoneWithPacket()
 	// Nothing to do.
 	}
 
+void PcapSource::BatchCallback(u_char* user, const pcap_pkthdr* hdr,
+                               const u_char* data)
+	{
+	auto src = reinterpret_cast<PcapSource*>(user);
+
+	src->batch_hdrs.push_back(*hdr);
+	src->batch_offsets.push_back(src->batch_data.size());
+	src->batch_data.insert(src->batch_data.end(), data, data + hdr->caplen);
+	}
+
+size_t PcapSource::ExtractNextBatch(Packet* pkts, size_t max)
+	{
+	if ( ! pd )
+		return 0;
+
+	batch_hdrs.clear();
+	batch_offsets.clear();
+	batch_data.clear();
+
+	int res = pcap_dispatch(pd, max, BatchCallback, reinterpret_cast<u_char*>(this));
+
+	if ( res == PCAP_ERROR )
+		{
+		if ( props.is_live )
+			reporter->Error("failed to read a packet from %s: %s",
+			                props.path.data(), pcap_geterr(pd));
+		else
+			reporter->FatalError("failed to read a packet from %s: %s",
+			                     props.path.data(), pcap_geterr(pd));
+		return 0;
+		}
+
+	// The packets are handed over even if reading stopped early, a
+	// potential EOF gets noticed with the next batch.
+	if ( batch_hdrs.empty() && ! props.is_live &&
+	     (res == 0 || res == PCAP_ERROR_BREAK) )
+		{
+		// Exhausted pcap file, no more packets to read.
+		Close();
+		return 0;
+		}
+
+	size_t n = 0;
+
+	for ( size_t i = 0; i < batch_hdrs.size(); ++i )
+		{
+		pcap_pkthdr& hdr = batch_hdrs[i];
+		Packet* pkt = &pkts[n];
+
+		pkt->Init(props.link_type, &hdr.ts, hdr.caplen, hdr.len,
+		          batch_data.data() + batch_offsets[i]);
+
+		if ( hdr.len == 0 || hdr.caplen == 0 )
+			{
+			Weird("empty_pcap_header", pkt);
+			continue;
+			}
+
+		++stats.received;
+		stats.bytes_received += hdr.len;
+		++n;
+		}
+
+	return n;
+	}
+
+void PcapSource::DoneWithBatch()
+	{
+	// Nothing to do, the buffer gets reused with the next batch.
+	}
+
 bool PcapSource::PrecompileFilter(int index, const std::string& filter)
 	{
 	return PktSrc::PrecompileBPFFilter(index, filter);
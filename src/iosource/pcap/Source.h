@@ -3,6 +3,7 @@
 #pragma once
 
 #include <sys/types.h> // for u_char
+#include <vector>
 
 extern "C" {
 #include <pcap.h>
@@ -25,6 +26,8 @@ protected:
 	void Close() override;
 	bool ExtractNextPacket(Packet* pkt) override;
 	void DoneWithPacket() override;
+	size_t ExtractNextBatch(Packet* pkts, size_t max) override;
+	void DoneWithBatch() override;
 	bool PrecompileFilter(int index, const std::string& filter) override;
 	bool SetFilter(int index) override;
 	void Statistics(Stats* stats) override;
@@ -34,10 +37,20 @@ private:
 	void OpenOffline();
 	void PcapError(const char* where = nullptr);
 
+	static void BatchCallback(u_char* user, const pcap_pkthdr* hdr,
+	                          const u_char* data);
+
 	Properties props;
 	Stats stats;
 
 	pcap_t *pd;
+
+	// libpcap guarantees a packet's data only while its callback runs,
+	// so batched packets are copied into a buffer that gets reused from
+	// batch to batch.
+	std::vector<pcap_pkthdr> batch_hdrs;
+	std::vector<size_t> batch_offsets;
+	std::vector<u_char> batch_data;
 };
 
 } // namespace zeek::iosource::pcap
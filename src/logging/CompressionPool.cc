@@ -0,0 +1,456 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/CompressionPool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "zeek/3rdparty/doctest.h"
+
+#include "zeek/util.h"
+
+namespace zeek::logging {
+
+CompressionPool::CompressionPool(int num_threads)
+	{
+	for ( int i = 0; i < num_threads; ++i )
+		{
+		threads.emplace_back(&CompressionPool::Run, this);
+		util::detail::set_thread_name("zk.compress", threads.back().native_handle());
+		}
+	}
+
+CompressionPool::~CompressionPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	cond.notify_all();
+
+	for ( auto& t : threads )
+		t.join();
+	}
+
+void CompressionPool::Submit(std::function<void()> job, size_t bytes)
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.emplace_back(std::move(job), bytes);
+		++pending_jobs;
+		pending_bytes += bytes;
+		}
+
+	cond.notify_one();
+	}
+
+void CompressionPool::Compressed(size_t arg_bytes_in, size_t arg_bytes_out)
+	{
+	++blocks;
+	bytes_in += arg_bytes_in;
+	bytes_out += arg_bytes_out;
+	}
+
+void CompressionPool::GetStats(Stats* stats)
+	{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats->num_threads = threads.size();
+	stats->pending_jobs = pending_jobs;
+	stats->pending_bytes = pending_bytes;
+	stats->blocks = blocks;
+	stats->bytes_in = bytes_in;
+	stats->bytes_out = bytes_out;
+	}
+
+void CompressionPool::Run()
+	{
+	// Signals are handled by the main thread only, like for all other
+	// threads (see BasicThread).
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, nullptr);
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while ( true )
+		{
+		cond.wait(lock, [this]() { return stopping || ! jobs.empty(); });
+
+		// Jobs still queued when stopping get done first.
+		if ( jobs.empty() )
+			return;
+
+		auto job = std::move(jobs.front());
+		jobs.pop_front();
+		lock.unlock();
+
+		job.first();
+
+		lock.lock();
+		--pending_jobs;
+		pending_bytes -= job.second;
+		}
+	}
+
+// A block of a file's data, which gets replaced by its compressed version.
+struct CompressedFile::Block {
+	std::string data;
+	bool done = false;
+	bool ok = true;
+};
+
+// The part of a file shared with the pool's threads.
+struct CompressedFile::State {
+	explicit State(int arg_fd) : fd(arg_fd)	{ }
+
+	// Writes out the leading blocks that are compressed, and closes the
+	// file once all are. Must be called with the lock held.
+	void WriteOut(std::unique_lock<std::mutex>& lock);
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::shared_ptr<Block>> blocks;	// In file order.
+	int fd;
+	bool writing = false;	// True while a thread is writing blocks out.
+	bool closing = false;
+	bool completed = false;
+	std::function<void(const std::string& error)> done;
+	std::string error;
+	std::atomic<bool> failed{false};
+};
+
+// Like util::safe_write(), but returns the errno on failure instead of
+// aborting, so that the error can be reported through the file.
+static int write_all(int fd, const char* data, size_t len)
+	{
+	while ( len > 0 )
+		{
+		ssize_t n = write(fd, data, len);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			return errno;
+			}
+
+		data += n;
+		len -= n;
+		}
+
+	return 0;
+	}
+
+void CompressedFile::State::WriteOut(std::unique_lock<std::mutex>& lock)
+	{
+	// Whoever is at it already will see our block, too.
+	if ( writing )
+		return;
+
+	writing = true;
+
+	while ( ! blocks.empty() && blocks.front()->done )
+		{
+		auto b = std::move(blocks.front());
+		blocks.pop_front();
+
+		if ( ! b->ok && error.empty() )
+			{
+			error = "compression failed";
+			failed = true;
+			}
+
+		if ( ! failed )
+			{
+			lock.unlock();
+			int err = write_all(fd, b->data.data(), b->data.size());
+			lock.lock();
+
+			if ( err && error.empty() )
+				{
+				error = util::fmt("write failed: %s", strerror(err));
+				failed = true;
+				}
+			}
+
+		// There's room for another block now.
+		cond.notify_all();
+		}
+
+	writing = false;
+
+	if ( ! closing || ! blocks.empty() || completed )
+		return;
+
+	auto cb = std::move(done);
+	std::string err = error;
+	lock.unlock();
+
+	util::safe_close(fd);
+
+	if ( cb )
+		cb(err);
+
+	lock.lock();
+	completed = true;
+	cond.notify_all();
+	}
+
+CompressedFile::CompressedFile(CompressionPool* arg_pool, int fd, int arg_level,
+                               size_t arg_block_size)
+	: state(std::make_shared<State>(fd)), pool(arg_pool), level(arg_level),
+	  block_size(arg_block_size)
+	{
+	}
+
+CompressedFile::~CompressedFile()
+	{
+	if ( ! closed )
+		Finish();
+	}
+
+bool CompressedFile::Write(const char* data, size_t len)
+	{
+	buffer.append(data, len);
+
+	if ( buffer.size() >= block_size )
+		SubmitBlock();
+
+	return ! state->failed;
+	}
+
+bool CompressedFile::Flush()
+	{
+	if ( ! buffer.empty() )
+		SubmitBlock();
+
+	return ! state->failed;
+	}
+
+void CompressedFile::SubmitBlock()
+	{
+	auto b = std::make_shared<Block>();
+	b->data.swap(buffer);
+	buffer.reserve(block_size);
+
+		{
+		// Don't let the data pile up if the pool can't keep up.
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->cond.wait(lock, [this]() { return state->blocks.size() < MAX_PENDING_BLOCKS; });
+		state->blocks.push_back(b);
+		}
+
+	size_t len = b->data.size();
+
+	pool->Submit([s = state, b, pool = pool, level = level]()
+		{
+		std::string out;
+		bool ok = CompressMember(b->data.data(), b->data.size(), level, &out);
+
+		if ( ok )
+			pool->Compressed(b->data.size(), out.size());
+
+		std::unique_lock<std::mutex> lock(s->mutex);
+		b->data.swap(out);
+		b->ok = ok;
+		b->done = true;
+		s->WriteOut(lock);
+		}, len);
+	}
+
+void CompressedFile::Close(std::function<void(const std::string& error)> done)
+	{
+	if ( closed )
+		return;
+
+	closed = true;
+	Flush();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->closing = true;
+	state->done = std::move(done);
+	state->WriteOut(lock);
+	}
+
+bool CompressedFile::Finish()
+	{
+	Close(nullptr);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->cond.wait(lock, [this]() { return state->completed; });
+	return state->error.empty();
+	}
+
+std::string CompressedFile::Error() const
+	{
+	std::lock_guard<std::mutex> lock(state->mutex);
+	return state->error;
+	}
+
+static void put_le32(unsigned char* p, uint32_t v)
+	{
+	for ( int i = 0; i < 4; ++i )
+		p[i] = (v >> (8 * i)) & 0xff;
+	}
+
+bool CompressedFile::CompressMember(const char* data, size_t len, int level, std::string* out)
+	{
+	// The gzip header with the extra field giving the member's size,
+	// which we fill in last.
+	static const unsigned char header[] = {
+		0x1f, 0x8b,	// Magic.
+		8,	// Deflate.
+		4,	// FEXTRA.
+		0, 0, 0, 0,	// No modification time.
+		0,	// Extra flags.
+		3,	// Unix.
+		8, 0,	// Length of the extra field.
+		'Z', 'K', 4, 0,	// Subfield ID and length.
+		0, 0, 0, 0,	// Member size.
+	};
+	const size_t header_len = sizeof(header);
+	const size_t trailer_len = 8;
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	// Raw deflate, as we write header and trailer ourselves.
+	if ( deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+		return false;
+
+	size_t bound = deflateBound(&zs, len);
+	out->resize(header_len + bound + trailer_len);
+	auto p = reinterpret_cast<unsigned char*>(&(*out)[0]);
+
+	zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	zs.avail_in = len;
+	zs.next_out = p + header_len;
+	zs.avail_out = bound;
+
+	int rc = deflate(&zs, Z_FINISH);
+	size_t compressed_len = zs.total_out;
+	deflateEnd(&zs);
+
+	if ( rc != Z_STREAM_END )
+		return false;
+
+	size_t total = header_len + compressed_len + trailer_len;
+	memcpy(p, header, header_len);
+	put_le32(p + header_len - 4, total);
+	put_le32(p + header_len + compressed_len,
+	         crc32(0, reinterpret_cast<const Bytef*>(data), len));
+	put_le32(p + header_len + compressed_len + 4, len);
+	out->resize(total);
+	return true;
+	}
+
+TEST_SUITE_BEGIN("CompressionPool");
+
+TEST_CASE("compressed file")
+	{
+	char path[] = "/tmp/zeek-compressed-file-XXXXXX";
+	int fd = mkstemp(path);
+	REQUIRE(fd >= 0);
+
+	std::string expected;
+
+		{
+		CompressionPool pool(3);
+		CompressedFile f(&pool, fd, 6, 1000);
+
+		for ( int i = 0; i < 1000; ++i )
+			{
+			std::string line = util::fmt("line %d of the log\n", i);
+			expected += line;
+			CHECK(f.Write(line.data(), line.size()));
+
+			if ( i == 500 )
+				CHECK(f.Flush());
+			}
+
+		std::string error = "unset";
+		f.Close([&error](const std::string& e) { error = e; });
+		CHECK(f.Finish());
+		CHECK(error.empty());
+
+		CompressionPool::Stats stats;
+		pool.GetStats(&stats);
+		CHECK(stats.bytes_in == expected.size());
+		}
+
+	// The members' extra fields lead from one to the next, and the whole
+	// file decompresses into what's been written.
+	gzFile gz = gzopen(path, "rb");
+	REQUIRE(gz);
+	std::string contents;
+	char buf[4096];
+	int n;
+
+	while ( (n = gzread(gz, buf, sizeof(buf))) > 0 )
+		contents.append(buf, n);
+
+	gzclose(gz);
+	CHECK(contents == expected);
+
+	FILE* raw = fopen(path, "rb");
+	REQUIRE(raw);
+	std::string file;
+
+	while ( (n = fread(buf, 1, sizeof(buf), raw)) > 0 )
+		file.append(buf, n);
+
+	fclose(raw);
+	unlink(path);
+
+	size_t pos = 0;
+	int members = 0;
+
+	while ( pos + 20 <= file.size() && file[pos + 12] == 'Z' && file[pos + 13] == 'K' )
+		{
+		uint32_t size = 0;
+
+		for ( int i = 0; i < 4; ++i )
+			size |= uint32_t(static_cast<unsigned char>(file[pos + 16 + i])) << (8 * i);
+
+		pos += size;
+		++members;
+		}
+
+	CHECK(pos == file.size());
+	CHECK(members > 10);
+	}
+
+TEST_CASE("compressed file write error")
+	{
+	// Every write to /dev/full fails with ENOSPC.
+	int fd = open("/dev/full", O_WRONLY);
+
+	if ( fd < 0 )
+		return;
+
+	CompressionPool pool(1);
+	CompressedFile f(&pool, fd, 6, 100);
+	std::string line(1000, 'x');
+
+	f.Write(line.data(), line.size());
+	std::string error;
+	f.Close([&error](const std::string& e) { error = e; });
+	CHECK_FALSE(f.Finish());
+	CHECK(error.find("write failed") == 0);
+	CHECK(f.Error() == error);
+	CHECK_FALSE(f.Write(line.data(), line.size()));
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::logging
@@ -0,0 +1,190 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zeek::logging {
+
+/**
+ * A pool of threads compressing log data on behalf of all writers.
+ */
+class CompressionPool {
+public:
+	/**
+	 * Constructor. Starts the threads.
+	 *
+	 * @param num_threads The number of threads.
+	 */
+	explicit CompressionPool(int num_threads);
+
+	/**
+	 * Destructor. Completes the jobs queued, then stops the threads.
+	 */
+	~CompressionPool();
+
+	CompressionPool(const CompressionPool&) = delete;
+	CompressionPool& operator=(const CompressionPool&) = delete;
+
+	/**
+	 * Queues a job for one of the threads. Thread-safe.
+	 *
+	 * @param job The job.
+	 *
+	 * @param bytes The amount of data the job works on, for the
+	 * statistics.
+	 */
+	void Submit(std::function<void()> job, size_t bytes);
+
+	/**
+	 * Records a block's compression for the statistics. Thread-safe.
+	 */
+	void Compressed(size_t bytes_in, size_t bytes_out);
+
+	struct Stats {
+		int num_threads;
+		uint64_t pending_jobs;	//! Jobs queued or running.
+		uint64_t pending_bytes;	//! The data they work on.
+		uint64_t blocks;	//! Blocks compressed so far.
+		uint64_t bytes_in;	//! Their size before compression.
+		uint64_t bytes_out;	//! And after.
+	};
+
+	/**
+	 * Returns statistics about the pool's work. Thread-safe.
+	 */
+	void GetStats(Stats* stats);
+
+private:
+	void Run();
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::pair<std::function<void()>, size_t>> jobs;
+	bool stopping = false;
+	std::vector<std::thread> threads;
+
+	// Statistics. The first two are protected by the mutex.
+	uint64_t pending_jobs = 0;
+	uint64_t pending_bytes = 0;
+	std::atomic<uint64_t> blocks{0};
+	std::atomic<uint64_t> bytes_in{0};
+	std::atomic<uint64_t> bytes_out{0};
+};
+
+/**
+ * A gzip-compressed file whose data gets compressed by a CompressionPool.
+ *
+ * The data is cut into blocks of a fixed size, which the pool's threads
+ * compress in parallel into separate gzip members. The members are
+ * written out in order, so the result is a regular gzip file. Each
+ * member's header carries an extra field (subfield ID "ZK", see RFC 1952)
+ * with the member's total size, so that readers can skip from member to
+ * member without decompressing, e.g. to build an index for seeking.
+ *
+ * Write() and Flush() must be called from a single thread, the owner's.
+ * Once closed, the file completes in the background, independent of the
+ * CompressedFile instance.
+ */
+class CompressedFile {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param pool The pool to compress with. It must outlive the file's
+	 * completion.
+	 *
+	 * @param fd The file to write to. It gets closed along with this.
+	 *
+	 * @param level The zlib compression level.
+	 *
+	 * @param block_size The amount of data per gzip member.
+	 */
+	CompressedFile(CompressionPool* pool, int fd, int level,
+	               size_t block_size = DEFAULT_BLOCK_SIZE);
+
+	/**
+	 * Destructor. Closes the file if that hasn't happened yet, waiting
+	 * for it to complete.
+	 */
+	~CompressedFile();
+
+	CompressedFile(const CompressedFile&) = delete;
+	CompressedFile& operator=(const CompressedFile&) = delete;
+
+	/**
+	 * Appends data. This may wait for the pool if a lot of data from
+	 * this file is pending already.
+	 *
+	 * @return False if writing to the file has failed; see Error().
+	 */
+	bool Write(const char* data, size_t len);
+
+	/**
+	 * Hands the data buffered so far to the pool, even if it doesn't
+	 * fill a block.
+	 *
+	 * @return False if writing to the file has failed; see Error().
+	 */
+	bool Flush();
+
+	/**
+	 * Closes the file once all data has been written, without waiting
+	 * for that.
+	 *
+	 * @param done Called once the file has been closed, with an error
+	 * message, or an empty string on success. It may run on one of the
+	 * pool's threads, or right away.
+	 */
+	void Close(std::function<void(const std::string& error)> done);
+
+	/**
+	 * Closes the file and waits for that to complete.
+	 *
+	 * @return False if writing to the file has failed; see Error().
+	 */
+	bool Finish();
+
+	/**
+	 * Returns a description of the first error writing to the file.
+	 */
+	std::string Error() const;
+
+	/**
+	 * Compresses data into a gzip member carrying its size, as
+	 * described above. Thread-safe.
+	 *
+	 * @return False if zlib failed.
+	 */
+	static bool CompressMember(const char* data, size_t len, int level, std::string* out);
+
+	static constexpr size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+	// Maximum number of blocks of one file in the pool at a time.
+	static constexpr size_t MAX_PENDING_BLOCKS = 16;
+
+private:
+	struct Block;
+	struct State;
+
+	void SubmitBlock();
+
+	std::shared_ptr<State> state;
+	CompressionPool* pool;
+	int level;
+	size_t block_size;
+	std::string buffer;
+	bool closed = false;
+};
+
+} // namespace zeek::logging
@@ -148,6 +148,11 @@ Manager::~Manager()
 void Manager::InitPostScript()
 	{
 	rotation_format_func = id::find_func("Log::rotation_format_func");
+
+	auto compression_threads = id::find_val("Log::compression_threads")->AsCount();
+
+	if ( compression_threads > 0 )
+		compression_pool = std::make_unique<CompressionPool>(compression_threads);
 	}
 
 WriterBackend* Manager::CreateBackend(WriterFrontend* frontend, EnumVal* tag)
@@ -896,6 +901,30 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			}
 
 		// Alright, can do the write now.
+		assert(writer);
+
+		if ( ! plugin_mgr->HavePluginForHook(plugin::HOOK_LOG_WRITE) &&
+		     filter->num_fields == writer->NumFields() )
+			{
+			// Nobody gets to see (or modify) the values before the
+			// writer, so we fill them in right where it buffers
+			// them. Script code needs to run before that, as it
+			// may write to the same writer.
+			auto ext_rec = FilterExtensions(filter);
+
+			if ( threading::Value** vals = writer->StartWrite() )
+				{
+				RecordToFilterVals(filter, columns.get(), ext_rec.get(),
+				                   vals, writer->WriteBatch());
+				writer->FinishWrite();
+				}
+
+#ifdef DEBUG
+			DBG_LOG(DBG_LOGGING, "Wrote record to filter '%s' on stream '%s'",
+				filter->name.c_str(), stream->name.c_str());
+#endif
+			continue;
+			}
 
 		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
 
@@ -916,7 +945,6 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 			}
 
 		// Write takes ownership of vals.
-		assert(writer);
 		writer->Write(filter->num_fields, vals);
 
 #ifdef DEBUG
@@ -928,15 +956,37 @@ bool Manager::Write(EnumVal* id, RecordVal* columns_arg)
 	return true;
 	}
 
-threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
+// Copies a string for a log value, from the batch if given.
+static char* copy_log_string(const char* s, size_t len, RecordBatch* batch)
 	{
-	if ( ! ty )
-		ty = val->GetType().get();
+	char* buf = batch ? batch->AllocBytes(len + 1) : new char[len + 1];
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	return buf;
+	}
 
-	if ( ! val )
-		return new threading::Value(ty->Tag(), false);
+// Allocates the elements of a set or vector log value, from the batch if given.
+static threading::Value** new_log_vals(bro_int_t n, RecordBatch* batch)
+	{
+	if ( batch )
+		return batch->AllocValues(n);
+
+	threading::Value** vals = new threading::Value*[n];
 
-	threading::Value* lval = new threading::Value(ty->Tag());
+	for ( bro_int_t i = 0; i < n; i++ )
+		vals[i] = new threading::Value();
+
+	return vals;
+	}
+
+void Manager::ValToLogVal(threading::Value* lval, Val* val, TypeTag type, RecordBatch* batch)
+	{
+	lval->type = type;
+	lval->subtype = TYPE_VOID;
+	lval->present = (val != nullptr);
+
+	if ( ! val )
+		return;
 
 	switch ( lval->type ) {
 	case TYPE_BOOL:
@@ -951,14 +1001,14 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 
 		if ( s )
 			{
-			lval->val.string_val.data = util::copy_string(s);
 			lval->val.string_val.length = strlen(s);
+			lval->val.string_val.data = copy_log_string(s, lval->val.string_val.length, batch);
 			}
 
 		else
 			{
 			val->GetType()->Error("enum type does not contain value", val);
-			lval->val.string_val.data = util::copy_string("");
+			lval->val.string_val.data = copy_log_string("", 0, batch);
 			lval->val.string_val.length = 0;
 			}
 		break;
@@ -990,10 +1040,8 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 	case TYPE_STRING:
 		{
 		const String* s = val->AsString();
-		char* buf = new char[s->Len()];
-		memcpy(buf, s->Bytes(), s->Len());
-
-		lval->val.string_val.data = buf;
+		lval->val.string_val.data =
+			copy_log_string(reinterpret_cast<const char*>(s->Bytes()), s->Len(), batch);
 		lval->val.string_val.length = s->Len();
 		break;
 		}
@@ -1002,7 +1050,7 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		{
 		const File* f = val->AsFile();
 		string s = f->Name();
-		lval->val.string_val.data = util::copy_string(s.c_str());
+		lval->val.string_val.data = copy_log_string(s.c_str(), s.size(), batch);
 		lval->val.string_val.length = s.size();
 		break;
 		}
@@ -1013,8 +1061,8 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		const Func* f = val->AsFunc();
 		f->Describe(&d);
 		const char* s = d.Description();
-		lval->val.string_val.data = util::copy_string(s);
 		lval->val.string_val.length = strlen(s);
+		lval->val.string_val.data = copy_log_string(s, lval->val.string_val.length, batch);
 		break;
 		}
 
@@ -1027,10 +1075,13 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 			set = make_intrusive<ListVal>(TYPE_INT);
 
 		lval->val.set_val.size = set->Length();
-		lval->val.set_val.vals = new threading::Value* [lval->val.set_val.size];
+		lval->val.set_val.vals = new_log_vals(lval->val.set_val.size, batch);
 
 		for ( bro_int_t i = 0; i < lval->val.set_val.size; i++ )
-			lval->val.set_val.vals[i] = ValToLogVal(set->Idx(i).get());
+			{
+			Val* elem = set->Idx(i).get();
+			ValToLogVal(lval->val.set_val.vals[i], elem, elem->GetType()->Tag(), batch);
+			}
 
 		break;
 		}
@@ -1039,14 +1090,13 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 		{
 		VectorVal* vec = val->AsVectorVal();
 		lval->val.vector_val.size = vec->Size();
-		lval->val.vector_val.vals =
-			new threading::Value* [lval->val.vector_val.size];
+		lval->val.vector_val.vals = new_log_vals(lval->val.vector_val.size, batch);
 
 		for ( bro_int_t i = 0; i < lval->val.vector_val.size; i++ )
 			{
-			lval->val.vector_val.vals[i] =
-				ValToLogVal(vec->ValAt(i).get(),
-					    vec->GetType()->Yield().get());
+			ValToLogVal(lval->val.vector_val.vals[i],
+				    vec->ValAt(i).get(),
+				    vec->GetType()->Yield()->Tag(), batch);
 			}
 
 		break;
@@ -1055,25 +1105,38 @@ threading::Value* Manager::ValToLogVal(Val* val, Type* ty)
 	default:
 		reporter->InternalError("unsupported type %s for log_write", type_name(lval->type));
 	}
+	}
 
-	return lval;
+RecordValPtr Manager::FilterExtensions(Filter* filter)
+	{
+	if ( filter->num_ext_fields == 0 )
+		return nullptr;
+
+	auto res = filter->ext_func->Invoke(IntrusivePtr{NewRef{}, filter->path_val});
+
+	if ( ! res )
+		return nullptr;
+
+	return {AdoptRef{}, res.release()->AsRecordVal()};
 	}
 
 threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
                                                RecordVal* columns)
 	{
-	RecordValPtr ext_rec;
+	auto ext_rec = FilterExtensions(filter);
 
-	if ( filter->num_ext_fields > 0 )
-		{
-		auto res = filter->ext_func->Invoke(IntrusivePtr{NewRef{}, filter->path_val});
+	threading::Value** vals = new threading::Value*[filter->num_fields];
 
-		if ( res )
-			ext_rec = {AdoptRef{}, res.release()->AsRecordVal()};
-		}
+	for ( int i = 0; i < filter->num_fields; ++i )
+		vals[i] = new threading::Value();
 
-	threading::Value** vals = new threading::Value*[filter->num_fields];
+	RecordToFilterVals(filter, columns, ext_rec.get(), vals, nullptr);
+	return vals;
+	}
 
+void Manager::RecordToFilterVals(Filter* filter, RecordVal* columns, RecordVal* ext_rec,
+                                 threading::Value** vals, RecordBatch* batch)
+	{
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
 		Val* val;
@@ -1082,11 +1145,11 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			if ( ! ext_rec )
 				{
 				// executing function did not return record. Send empty for all vals.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				ValToLogVal(vals[i], nullptr, filter->fields[i]->type, batch);
 				continue;
 				}
 
-			val = ext_rec.get();
+			val = ext_rec;
 			}
 		else
 			val = columns;
@@ -1105,16 +1168,14 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			if ( ! val )
 				{
 				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				ValToLogVal(vals[i], nullptr, filter->fields[i]->type, batch);
 				break;
 				}
 			}
 
 		if ( val )
-			vals[i] = ValToLogVal(val);
+			ValToLogVal(vals[i], val, val->GetType()->Tag(), batch);
 		}
-
-	return vals;
 	}
 
 bool Manager::CreateWriterForRemoteLog(EnumVal* id, EnumVal* writer, WriterBackend::WriterInfo* info,
@@ -1302,6 +1363,79 @@ bool Manager::WriteFromRemote(EnumVal* id, EnumVal* writer, const string& path,
 	return true;
 	}
 
+int Manager::WriteBatchFromRemote(EnumVal* id, EnumVal* writer, const string& path,
+                                  const char* data, size_t len)
+	{
+	Stream* stream = FindStream(id);
+
+	if ( ! stream )
+		{
+		// Don't know this stream.
+#ifdef DEBUG
+		ODesc desc;
+		id->Describe(&desc);
+		DBG_LOG(DBG_LOGGING, "unknown stream %s in Manager::WriteBatchFromRemote()",
+			desc.Description());
+#endif
+		return 0;
+		}
+
+	if ( ! stream->enabled )
+		return 0;
+
+	Stream::WriterMap::iterator w =
+		stream->writers.find(Stream::WriterPathPair(writer->AsEnum(), path));
+
+	if ( w == stream->writers.end() || ! w->second->writer->Schema() )
+		{
+		// Don't know this writer, or it's not initialized yet.
+#ifdef DEBUG
+		ODesc desc;
+		id->Describe(&desc);
+		DBG_LOG(DBG_LOGGING, "unknown writer %s in Manager::WriteBatchFromRemote()",
+			desc.Description());
+#endif
+		return 0;
+		}
+
+	WriterFrontend* frontend = w->second->writer;
+	threading::ValueBatchDecoder decoder(*frontend->Schema());
+
+	if ( ! decoder.Start(data, len) )
+		{
+		reporter->Warning("failed to unpack remote log batch for stream %s at path %s: %s",
+		                  stream->name.c_str(), path.c_str(), decoder.Error().c_str());
+		return -1;
+		}
+
+	int n = 0;
+
+	for ( ; n < static_cast<int>(decoder.NumRows()); ++n )
+		{
+		threading::Value** vals = frontend->StartWrite();
+
+		if ( ! vals )
+			// Not getting written anywhere.
+			break;
+
+		if ( ! decoder.Next(vals, frontend->WriteBatch()) )
+			{
+			frontend->WriteBatch()->RemoveLastRecord();
+			reporter->Warning("failed to unpack remote log record %d for stream %s at path %s: %s",
+			                  n, stream->name.c_str(), path.c_str(), decoder.Error().c_str());
+			return -1;
+			}
+
+		frontend->FinishWrite();
+		}
+
+	DBG_LOG(DBG_LOGGING,
+		"Wrote %d pre-filtered records to path '%s' on stream '%s'",
+		n, path.c_str(), stream->name.c_str());
+
+	return n;
+	}
+
 void Manager::SendAllWritersTo(const broker::endpoint_info& ei)
 	{
 	auto et = id::find_type("Log::Writer")->AsEnumType();
@@ -1362,6 +1496,21 @@ bool Manager::Flush(EnumVal* id)
 	return true;
 	}
 
+uint64_t Manager::PendingMessages(EnumVal* id)
+	{
+	Stream* stream = FindStream(id);
+
+	if ( ! stream )
+		return 0;
+
+	uint64_t pending = 0;
+
+	for ( const auto& w : stream->writers )
+		pending += w.second->writer->PendingMessages();
+
+	return pending;
+	}
+
 void Manager::Terminate()
 	{
 	for ( vector<Stream *>::iterator s = streams.begin(); s != streams.end(); ++s )
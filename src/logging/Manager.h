@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <memory>
 #include <string_view>
 
 #include "zeek/Val.h"
@@ -12,6 +13,7 @@
 #include "zeek/plugin/ComponentManager.h"
 
 #include "zeek/logging/Component.h"
+#include "zeek/logging/CompressionPool.h"
 #include "zeek/logging/WriterBackend.h"
 
 namespace broker { struct endpoint_info; }
@@ -192,6 +194,27 @@ public:
 	bool WriteFromRemote(EnumVal* stream, EnumVal* writer, const std::string& path,
 	                     int num_fields, threading::Value** vals);
 
+	/**
+	 * Writes a batch of log records received from a remote node, as
+	 * encoded by a threading::ValueBatchEncoder. The values get decoded
+	 * right into the writer's buffer.
+	 *
+	 * @param stream The enum value corresponding to the log stream.
+	 *
+	 * @param writer The enum value corresponding to the desired log writer.
+	 *
+	 * @param path The path of the target log stream to write to.
+	 *
+	 * @param data The encoded batch.
+	 *
+	 * @param len The length of *data*.
+	 *
+	 * @return The number of records written, or -1 if the batch could
+	 * not be decoded.
+	 */
+	int WriteBatchFromRemote(EnumVal* stream, EnumVal* writer, const std::string& path,
+	                         const char* data, size_t len);
+
 	/**
 	 * Announces all instantiated writers to a given Broker peer.
 	 */
@@ -220,6 +243,14 @@ public:
 	 */
 	bool Flush(EnumVal* id);
 
+	/**
+	 * Returns the number of messages that the local writers of a log
+	 * stream have yet to process.
+	 *
+	 * @param id  The enum value corresponding the log stream.
+	 */
+	uint64_t PendingMessages(EnumVal* id);
+
 	/**
 	 * Signals the manager to shutdown at Bro's termination.
 	 */
@@ -250,6 +281,15 @@ public:
 	 */
 	RecordType* StreamColumns(EnumVal* stream_id);
 
+	/**
+	 * Returns the threads compressing log files on behalf of the
+	 * writers, or null if they compress their files themselves. The
+	 * pool gets set up by InitPostScript() according to
+	 * Log::compression_threads, and is accessible from all threads.
+	 */
+	CompressionPool* GetCompressionPool() const
+		{ return compression_pool.get(); }
+
 protected:
 	friend class WriterFrontend;
 	friend class RotationFinishedMessage;
@@ -287,7 +327,17 @@ private:
 	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
 	                                      RecordVal* columns);
 
-	threading::Value* ValToLogVal(Val* val, Type* ty = nullptr);
+	// Fills in the values of a record for a filter. If a batch is
+	// given, their data gets allocated from there.
+	void RecordToFilterVals(Filter* filter, RecordVal* columns, RecordVal* ext_rec,
+	                        threading::Value** vals, RecordBatch* batch);
+
+	// Returns the record of a filter's extension fields, if any.
+	RecordValPtr FilterExtensions(Filter* filter);
+
+	// Fills in a log value. If a batch is given, its data gets
+	// allocated from there, otherwise from the heap.
+	void ValToLogVal(threading::Value* lval, Val* val, TypeTag type, RecordBatch* batch);
 	Stream* FindStream(EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
@@ -299,6 +349,7 @@ private:
 	std::vector<Stream *> streams;	// Indexed by stream enum.
 	int rotations_pending;	// Number of rotations not yet finished.
 	FuncPtr rotation_format_func;
+	std::unique_ptr<CompressionPool> compression_pool;
 };
 
 } // namespace logging;
@@ -0,0 +1,374 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/RecordBatch.h"
+
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+#include "zeek/3rdparty/doctest.h"
+
+using zeek::threading::Value;
+
+namespace zeek::logging {
+
+RecordBatch::RecordBatch(int arg_num_fields, int arg_capacity)
+	: num_fields(arg_num_fields), capacity(arg_capacity)
+	{
+	Grow(std::min(capacity, INITIAL_RECORDS));
+	}
+
+RecordBatch::~RecordBatch()
+	{
+	// The values' data belongs to the arena, so we must keep their
+	// destructors from releasing it.
+	for ( size_t i = 0; i < static_cast<size_t>(num_fields) * allocated; ++i )
+		values[i].present = false;
+	}
+
+void RecordBatch::Grow(int n)
+	{
+	size_t total = static_cast<size_t>(num_fields) * n;
+	auto new_values = std::make_unique<Value[]>(total);
+
+	// The values' data stays where it is in the arena, so it's enough
+	// to move the values themselves over.
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		for ( int j = 0; j < size; ++j )
+			{
+			Value* dst = &new_values[i * n + j];
+			Value* src = &values[i * allocated + j];
+			dst->type = src->type;
+			dst->subtype = src->subtype;
+			dst->present = src->present;
+			memcpy(&dst->val, &src->val, sizeof(dst->val));
+			}
+		}
+
+	for ( size_t i = 0; i < static_cast<size_t>(num_fields) * allocated; ++i )
+		values[i].present = false;
+
+	values = std::move(new_values);
+	value_ptrs = std::make_unique<Value*[]>(total);
+	records = std::make_unique<Value**[]>(n);
+	allocated = n;
+
+	for ( int j = 0; j < allocated; ++j )
+		{
+		records[j] = value_ptrs.get() + j * num_fields;
+
+		for ( int i = 0; i < num_fields; ++i )
+			records[j][i] = values.get() + i * allocated + j;
+		}
+	}
+
+Value** RecordBatch::AddRecord()
+	{
+	assert(size < capacity);
+
+	if ( size == allocated )
+		Grow(std::min(capacity, std::max(1, allocated * 2)));
+
+	return records[size++];
+	}
+
+size_t RecordBatch::MemoryAllocation() const
+	{
+	size_t n = static_cast<size_t>(num_fields) * allocated;
+	return n * (sizeof(Value) + sizeof(Value*)) + allocated * sizeof(Value**) + arena_size;
+	}
+
+void RecordBatch::RemoveLastRecord()
+	{
+	assert(size > 0);
+
+	if ( --size == 0 )
+		Clear();
+	}
+
+char* RecordBatch::AllocBytes(size_t n)
+	{
+	// Keep everything aligned for the Values allocated from here.
+	n = (n + alignof(Value) - 1) & ~(alignof(Value) - 1);
+
+	if ( n > CHUNK_SIZE / 4 )
+		{
+		large_chunks.emplace_back(new char[n]);
+		arena_size += n;
+		return large_chunks.back().get();
+		}
+
+	if ( cur_chunk < chunks.size() && chunk_pos + n > CHUNK_SIZE )
+		{
+		++cur_chunk;
+		chunk_pos = 0;
+		}
+
+	if ( cur_chunk == chunks.size() )
+		{
+		chunks.emplace_back(new char[CHUNK_SIZE]);
+		arena_size += CHUNK_SIZE;
+		}
+
+	char* p = chunks[cur_chunk].get() + chunk_pos;
+	chunk_pos += n;
+	return p;
+	}
+
+Value** RecordBatch::AllocValues(size_t n)
+	{
+	if ( n == 0 )
+		return nullptr;
+
+	char* mem = AllocBytes(n * sizeof(Value) + n * sizeof(Value*));
+	Value* vals = reinterpret_cast<Value*>(mem);
+	Value** ptrs = reinterpret_cast<Value**>(mem + n * sizeof(Value));
+
+	for ( size_t i = 0; i < n; ++i )
+		ptrs[i] = new (&vals[i]) Value();
+
+	return ptrs;
+	}
+
+void RecordBatch::CopyValue(Value* dst, const Value* src)
+	{
+	dst->type = src->type;
+	dst->subtype = src->subtype;
+	dst->present = src->present;
+	memcpy(&dst->val, &src->val, sizeof(dst->val));
+
+	if ( ! src->present )
+		return;
+
+	switch ( src->type ) {
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		{
+		int len = src->val.string_val.length;
+		dst->val.string_val.data = AllocBytes(len);
+		memcpy(dst->val.string_val.data, src->val.string_val.data, len);
+		break;
+		}
+
+	case TYPE_PATTERN:
+		{
+		size_t len = strlen(src->val.pattern_text_val) + 1;
+		char* text = AllocBytes(len);
+		memcpy(text, src->val.pattern_text_val, len);
+		dst->val.pattern_text_val = text;
+		break;
+		}
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		{
+		// Sets and vectors share the same layout.
+		bro_int_t n = src->val.set_val.size;
+		dst->val.set_val.vals = AllocValues(n);
+
+		for ( bro_int_t i = 0; i < n; ++i )
+			CopyValue(dst->val.set_val.vals[i], src->val.set_val.vals[i]);
+
+		break;
+		}
+
+	default:
+		break;
+	}
+	}
+
+void RecordBatch::Clear()
+	{
+	size = 0;
+	cur_chunk = 0;
+	chunk_pos = 0;
+	arena_size = chunks.size() * CHUNK_SIZE;
+	large_chunks.clear();
+	}
+
+RecordBatchPool::RecordBatchPool(int arg_num_fields, int arg_capacity, size_t arg_max_idle_bytes)
+	: num_fields(arg_num_fields), capacity(arg_capacity), max_idle_bytes(arg_max_idle_bytes)
+	{
+	}
+
+RecordBatchPool::~RecordBatchPool()
+	{
+	for ( auto b : idle )
+		delete b;
+	}
+
+RecordBatch* RecordBatchPool::Get()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if ( ! idle.empty() )
+			{
+			RecordBatch* b = idle.back();
+			idle.pop_back();
+			idle_bytes -= b->MemoryAllocation();
+			return b;
+			}
+		}
+
+	return new RecordBatch(num_fields, capacity);
+	}
+
+void RecordBatchPool::Put(RecordBatch* batch)
+	{
+	batch->Clear();
+	size_t bytes = batch->MemoryAllocation();
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if ( idle_bytes + bytes <= max_idle_bytes )
+			{
+			idle.push_back(batch);
+			idle_bytes += bytes;
+			return;
+			}
+		}
+
+	delete batch;
+	}
+
+TEST_SUITE_BEGIN("RecordBatch");
+
+TEST_CASE("record batch layout")
+	{
+	RecordBatch batch(3, 4);
+
+	for ( int j = 0; j < 4; ++j )
+		{
+		CHECK(! batch.Full());
+		Value** rec = batch.AddRecord();
+
+		for ( int i = 0; i < 3; ++i )
+			{
+			rec[i]->type = TYPE_COUNT;
+			rec[i]->present = true;
+			rec[i]->val.uint_val = j * 10 + i;
+			}
+		}
+
+	CHECK(batch.Full());
+	CHECK(batch.Size() == 4);
+
+	for ( int i = 0; i < 3; ++i )
+		{
+		const Value* col = batch.Column(i);
+
+		for ( int j = 0; j < 4; ++j )
+			{
+			CHECK(col[j].val.uint_val == static_cast<bro_uint_t>(j * 10 + i));
+			CHECK(batch.Record(j)[i] == &col[j]);
+			}
+		}
+
+	batch.RemoveLastRecord();
+	CHECK(batch.Size() == 3);
+	CHECK(batch.AddRecord() == batch.Record(3));
+	}
+
+TEST_CASE("record batch growth")
+	{
+	const int n = RecordBatch::INITIAL_RECORDS * 4 + 1;
+	RecordBatch batch(2, n);
+	size_t initial = batch.MemoryAllocation();
+
+	for ( int j = 0; j < n; ++j )
+		{
+		Value** rec = batch.AddRecord();
+		rec[0]->type = TYPE_COUNT;
+		rec[0]->present = true;
+		rec[0]->val.uint_val = j;
+
+		rec[1]->type = TYPE_STRING;
+		rec[1]->present = true;
+		rec[1]->val.string_val.data = batch.AllocBytes(8);
+		rec[1]->val.string_val.length = snprintf(rec[1]->val.string_val.data, 8, "%d", j);
+		}
+
+	CHECK(batch.Full());
+	CHECK(batch.MemoryAllocation() > initial);
+
+	// Everything moved along while growing.
+	for ( int j = 0; j < n; ++j )
+		{
+		CHECK(batch.Column(0)[j].val.uint_val == static_cast<bro_uint_t>(j));
+		CHECK(batch.Record(j)[1] == &batch.Column(1)[j]);
+		CHECK(std::string(batch.Record(j)[1]->val.string_val.data,
+		                  batch.Record(j)[1]->val.string_val.length) == std::to_string(j));
+		}
+
+	// The storage stays around for reuse.
+	size_t grown = batch.MemoryAllocation();
+	batch.Clear();
+	CHECK(batch.MemoryAllocation() == grown);
+	}
+
+TEST_CASE("record batch copy")
+	{
+	Value src(TYPE_VECTOR, TYPE_STRING);
+	src.val.vector_val.size = 2;
+	src.val.vector_val.vals = new Value*[2];
+
+	for ( int i = 0; i < 2; ++i )
+		{
+		auto v = new Value(TYPE_STRING);
+		v->val.string_val.data = new char[3];
+		memcpy(v->val.string_val.data, i ? "def" : "abc", 3);
+		v->val.string_val.length = 3;
+		src.val.vector_val.vals[i] = v;
+		}
+
+	RecordBatch batch(1, 1);
+	Value** rec = batch.AddRecord();
+	batch.CopyValue(rec[0], &src);
+
+	CHECK(rec[0]->type == TYPE_VECTOR);
+	CHECK(rec[0]->subtype == TYPE_STRING);
+	CHECK(rec[0]->val.vector_val.size == 2);
+	CHECK(rec[0]->val.vector_val.vals != src.val.vector_val.vals);
+	CHECK(memcmp(rec[0]->val.vector_val.vals[1]->val.string_val.data, "def", 3) == 0);
+	CHECK(rec[0]->val.vector_val.vals[1]->val.string_val.data !=
+	      src.val.vector_val.vals[1]->val.string_val.data);
+
+	// Large allocations get their own chunk and go away when clearing.
+	batch.AllocBytes(RecordBatch::CHUNK_SIZE);
+	CHECK(batch.ArenaSize() >= 2 * RecordBatch::CHUNK_SIZE);
+	batch.Clear();
+	CHECK(batch.ArenaSize() == RecordBatch::CHUNK_SIZE);
+	CHECK(batch.Size() == 0);
+	}
+
+TEST_CASE("record batch pool")
+	{
+	RecordBatch probe(2, 8);
+	probe.AllocBytes(1);
+	RecordBatchPool pool(2, 8, probe.MemoryAllocation());
+
+	auto b1 = pool.Get();
+	auto b2 = pool.Get();
+	CHECK(b1 != b2);
+	b1->AddRecord();
+	b1->AllocBytes(1);
+	b2->AllocBytes(1);
+
+	pool.Put(b1);
+	pool.Put(b2); // Deleted, exceeds max_idle_bytes.
+
+	auto b3 = pool.Get();
+	CHECK(b3 == b1);
+	CHECK(b3->Size() == 0);
+	pool.Put(b3);
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::logging
@@ -0,0 +1,180 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+#include "zeek/threading/ValueBatch.h"
+
+namespace zeek::logging {
+
+/**
+ * A batch of log records on their way from a WriterFrontend to its
+ * WriterBackend.
+ *
+ * The values are stored by column: all values of a field are adjacent in
+ * memory, in the order of the records. Each record also has an array of
+ * pointers to its values, which is what WriterBackend::DoWrite() receives.
+ * Variable-length data (strings and the elements of sets and vectors)
+ * comes from an arena owned by the batch. Storage for the values grows
+ * with the number of records added, up to the capacity. Once written, a
+ * batch is cleared and reused with the storage it has, so that in the
+ * steady state filling it in doesn't allocate any memory.
+ *
+ * As the values don't own their data, they must not be deleted, nor
+ * handed to anything that takes ownership of them.
+ */
+class RecordBatch : public threading::ValueAllocator {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of fields of each record.
+	 *
+	 * @param capacity The maximum number of records.
+	 */
+	RecordBatch(int num_fields, int capacity);
+	~RecordBatch() override;
+
+	RecordBatch(const RecordBatch&) = delete;
+	RecordBatch& operator=(const RecordBatch&) = delete;
+
+	int NumFields() const	{ return num_fields; }
+	int Capacity() const	{ return capacity; }
+	int Size() const	{ return size; }
+	bool Full() const	{ return size == capacity; }
+
+	/**
+	 * Appends a record, and returns the values for the caller to fill
+	 * in. Their previous content is undefined. Must not be called if the
+	 * batch is full. May move the values of the records added before,
+	 * so pointers to them must not be held across calls.
+	 */
+	threading::Value** AddRecord();
+
+	/**
+	 * Removes the record added last.
+	 */
+	void RemoveLastRecord();
+
+	/**
+	 * Returns the values of a record.
+	 */
+	threading::Value** Record(int i) const	{ return records[i]; }
+
+	/**
+	 * Returns all values of a field, one per record.
+	 */
+	const threading::Value* Column(int field) const
+		{ return values.get() + field * allocated; }
+
+	/**
+	 * Allocates memory for a value's data. It remains valid until the
+	 * batch gets cleared.
+	 */
+	char* AllocBytes(size_t n) override;
+
+	/**
+	 * Allocates elements for a set or vector value, returning an array
+	 * of pointers to them. They remain valid until the batch gets
+	 * cleared.
+	 */
+	threading::Value** AllocValues(size_t n) override;
+
+	/**
+	 * Copies a value into one of the batch's values. Data is copied into
+	 * the batch's arena.
+	 */
+	void CopyValue(threading::Value* dst, const threading::Value* src);
+
+	/**
+	 * Removes all records and releases the arena's content.
+	 */
+	void Clear();
+
+	/**
+	 * Returns the number of bytes the arena has allocated.
+	 */
+	size_t ArenaSize() const	{ return arena_size; }
+
+	/**
+	 * Returns the number of bytes the batch has allocated in total,
+	 * including the arena.
+	 */
+	size_t MemoryAllocation() const;
+
+	// Size of the arena's chunks. Larger allocations get a chunk of
+	// their own, which is released when the batch is cleared.
+	static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+	// Number of records the batch has room for initially.
+	static constexpr int INITIAL_RECORDS = 8;
+
+private:
+	// Makes room for at least n records, rearranging the values.
+	void Grow(int n);
+
+	// Values in the batch, stored by column.
+	std::unique_ptr<threading::Value[]> values;
+
+	// For each record, pointers to its values.
+	std::unique_ptr<threading::Value*[]> value_ptrs;
+	std::unique_ptr<threading::Value**[]> records;
+
+	int num_fields;
+	int capacity;
+	int allocated = 0;	// Records there's room for.
+	int size = 0;
+
+	// The arena. Chunks before cur_chunk are full.
+	std::vector<std::unique_ptr<char[]>> chunks;
+	std::vector<std::unique_ptr<char[]>> large_chunks;
+	size_t cur_chunk = 0;
+	size_t chunk_pos = 0;
+	size_t arena_size = 0;
+};
+
+/**
+ * Recycles the batches passed between a WriterFrontend and its
+ * WriterBackend. It's shared by both, and thread-safe.
+ */
+class RecordBatchPool {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of fields of the records.
+	 *
+	 * @param capacity The capacity of the batches.
+	 *
+	 * @param max_idle_bytes The maximum amount of memory to keep
+	 * allocated by empty batches.
+	 */
+	RecordBatchPool(int num_fields, int capacity, size_t max_idle_bytes);
+	~RecordBatchPool();
+
+	/**
+	 * Returns an empty batch.
+	 */
+	RecordBatch* Get();
+
+	/**
+	 * Takes a batch back once it's been written.
+	 */
+	void Put(RecordBatch* batch);
+
+private:
+	int num_fields;
+	int capacity;
+	size_t max_idle_bytes;
+
+	std::mutex mutex;
+	std::vector<RecordBatch*> idle;
+	size_t idle_bytes = 0;
+};
+
+} // namespace zeek::logging
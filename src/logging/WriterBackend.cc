@@ -126,6 +126,7 @@ WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread()
 	frontend = arg_frontend;
 	info = new WriterInfo(frontend->Info());
 	rotation_counter = 0;
+	deferred_rotations = 0;
 
 	SetName(frontend->Name());
 	}
@@ -143,20 +144,6 @@ WriterBackend::~WriterBackend()
 	delete info;
 	}
 
-void WriterBackend::DeleteVals(int num_writes, Value*** vals)
-	{
-	for ( int j = 0; j < num_writes; ++j )
-		{
-		// Note this code is duplicated in Manager::DeleteVals().
-		for ( int i = 0; i < num_fields; i++ )
-			delete vals[j][i];
-
-		delete [] vals[j];
-		}
-
-	delete [] vals;
-	}
-
 bool WriterBackend::FinishedRotation(const char* new_name, const char* old_name,
 				     double open, double close, bool terminating)
 	{
@@ -172,6 +159,27 @@ bool WriterBackend::FinishedRotation()
 	return true;
 	}
 
+void WriterBackend::DeferRotation()
+	{
+	--rotation_counter;
+	++deferred_rotations;
+	}
+
+bool WriterBackend::FinishedDeferredRotation(const char* new_name, const char* old_name,
+                                             double open, double close, bool terminating)
+	{
+	--deferred_rotations;
+	SendOut(new RotationFinishedMessage(frontend, new_name, old_name, open, close, true, terminating));
+	return true;
+	}
+
+bool WriterBackend::FinishedDeferredRotation()
+	{
+	--deferred_rotations;
+	SendOut(new RotationFinishedMessage(frontend, nullptr, nullptr, 0, 0, false, false));
+	return true;
+	}
+
 void WriterBackend::DisableFrontend()
 	{
 	SendOut(new DisableMessage(frontend));
@@ -195,38 +203,38 @@ bool WriterBackend::Init(int arg_num_fields, const Field* const* arg_fields)
 	return true;
 	}
 
-bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
+bool WriterBackend::Write(const RecordBatch& batch)
 	{
 	// Double-check that the arguments match. If we get this from remote,
 	// something might be mixed up.
-	if ( num_fields != arg_num_fields )
+	if ( num_fields != batch.NumFields() )
 		{
 
 #ifdef DEBUG
 		const char* msg = Fmt("Number of fields don't match in WriterBackend::Write() (%d vs. %d)",
-				      arg_num_fields, num_fields);
+				      batch.NumFields(), num_fields);
 		Debug(DBG_LOGGING, msg);
 #endif
 
-		DeleteVals(num_writes, vals);
 		DisableFrontend();
 		return false;
 		}
 
 	// Double-check all the types match.
-	for ( int j = 0; j < num_writes; j++ )
+	for ( int i = 0; i < num_fields; ++i )
 		{
-		for ( int i = 0; i < num_fields; ++i )
+		const Value* column = batch.Column(i);
+
+		for ( int j = 0; j < batch.Size(); j++ )
 			{
-			if ( vals[j][i]->type != fields[i]->type )
+			if ( column[j].type != fields[i]->type )
 				{
 #ifdef DEBUG
 				const char* msg = Fmt("Field #%d type doesn't match in WriterBackend::Write() (%d vs. %d)",
-						      i, vals[j][i]->type, fields[i]->type);
+						      i, column[j].type, fields[i]->type);
 				Debug(DBG_LOGGING, msg);
 #endif
 				DisableFrontend();
-				DeleteVals(num_writes, vals);
 				return false;
 				}
 			}
@@ -236,17 +244,15 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 
 	if ( ! Failed() )
 		{
-		for ( int j = 0; j < num_writes; j++ )
+		for ( int j = 0; j < batch.Size(); j++ )
 			{
-			success = DoWrite(num_fields, fields, vals[j]);
+			success = DoWrite(num_fields, fields, batch.Record(j));
 
 			if ( ! success )
 				break;
 			}
 		}
 
-	DeleteVals(num_writes, vals);
-
 	if ( ! success )
 		DisableFrontend();
 
@@ -316,7 +322,13 @@ bool WriterBackend::OnFinish(double network_time)
 	if ( Failed() )
 		return true;
 
-	return DoFinish(network_time);
+	bool result = DoFinish(network_time);
+
+	// Insurance against broken writers.
+	if ( deferred_rotations != 0 )
+		InternalError(Fmt("writer %s did not finish all deferred rotations", Name()));
+
+	return result;
 	}
 
 bool WriterBackend::OnHeartbeat(double network_time, double current_time)
@@ -6,6 +6,7 @@
 
 #include "zeek/threading/MsgThread.h"
 #include "zeek/logging/Component.h"
+#include "zeek/logging/RecordBatch.h"
 
 namespace broker { class data; }
 
@@ -144,21 +145,18 @@ public:
 	bool Init(int num_fields, const threading::Field* const* fields);
 
 	/**
-	 * Writes one log entry.
+	 * Writes a batch of log entries.
 	 *
-	 * @param num_fields: The number of log fields for this stream. The
-	 * value must match what was passed to Init().
-	 *
-	 * @param An array of size \a num_fields with the log values. Their
-	 * types musst match with the field passed to Init(). The method
-	 * takes ownership of \a vals..
+	 * @param batch The entries. Its number of fields must match what
+	 * was passed to Init(), as must the types of the values. The caller
+	 * retains ownership of the batch.
 	 *
 	 * Returns false if an error occured, in which case the writer must
 	 * not be used any further.
 	 *
 	 * @return False if an error occured.
 	 */
-	bool Write(int num_fields, int num_writes, threading::Value*** vals);
+	bool Write(const RecordBatch& batch);
 
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
@@ -255,6 +253,34 @@ public:
 	 */
 	bool FinishedRotation();
 
+	/**
+	 * Signals that a writer's implementation of DoRotate() will finish
+	 * the rotation later, e.g. once the original file has been written
+	 * out in the background. It then takes the place of the
+	 * FinishedRotation() call, and one of the two
+	 * FinishedDeferredRotation() methods must follow eventually, from
+	 * the writer's thread.
+	 */
+	void DeferRotation();
+
+	/**
+	 * Signals that a deferred rotation has finished successfully. The
+	 * parameters are the same as for FinishedRotation().
+	 */
+	bool FinishedDeferredRotation(const char* new_name, const char* old_name,
+	                              double open, double close, bool terminating);
+
+	/**
+	 * Signals that a deferred rotation has finished without anything for
+	 * the post-processor to do.
+	 */
+	bool FinishedDeferredRotation();
+
+	/**
+	 * Returns the number of deferred rotations not finished yet.
+	 */
+	int DeferredRotations() const	{ return deferred_rotations; }
+
 	// Overridden from MsgThread.
 	bool OnHeartbeat(double network_time, double current_time) override;
 	bool OnFinish(double network_time) override;
@@ -381,11 +407,6 @@ protected:
 	virtual bool DoHeartbeat(double network_time, double current_time) = 0;
 
 private:
-	/**
-	 * Deletes the values as passed into Write().
-	 */
-	void DeleteVals(int num_writes, threading::Value*** vals);
-
 	// Frontend that instantiated us. This object must not be access from
 	// this class, it's running in a different thread!
 	WriterFrontend* frontend;
@@ -396,6 +417,7 @@ private:
 	bool buffering;	// True if buffering is enabled.
 
 	int rotation_counter; // Tracks FinishedRotation() calls.
+	int deferred_rotations; // Rotations to be finished later.
 };
 
 } // namespace zeek::logging
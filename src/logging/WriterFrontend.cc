@@ -53,16 +53,17 @@ private:
 class WriteMessage final : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
+	WriteMessage(WriterBackend* backend, std::shared_ptr<RecordBatchPool> pool, RecordBatch* batch)
 		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+		pool(std::move(pool)), batch(batch)	{}
 
-	bool Process() override { return Object()->Write(num_fields, num_writes, vals); }
+	~WriteMessage() override	{ pool->Put(batch); }
+
+	bool Process() override { return Object()->Write(*batch); }
 
 private:
-	int num_fields;
-	int num_writes;
-	Value ***vals;
+	std::shared_ptr<RecordBatchPool> pool;
+	RecordBatch* batch;
 };
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend>
@@ -104,8 +105,7 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 	buf = true;
 	local = arg_local;
 	remote = arg_remote;
-	write_buffer = nullptr;
-	write_buffer_pos = 0;
+	write_batch = nullptr;
 	info = new WriterBackend::WriterInfo(arg_info);
 
 	num_fields = 0;
@@ -128,6 +128,9 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, EnumVa
 
 WriterFrontend::~WriterFrontend()
 	{
+	if ( write_batch )
+		batch_pool->Put(write_batch);
+
 	for ( auto i = 0; i < num_fields; ++i )
 		delete fields[i];
 
@@ -161,8 +164,11 @@ void WriterFrontend::Init(int arg_num_fields, const Field* const * arg_fields)
 
 	num_fields = arg_num_fields;
 	fields = arg_fields;
+	schema = std::make_shared<const threading::ValueBatchSchema>(num_fields, fields);
 
 	initialized = true;
+	batch_pool = std::make_shared<RecordBatchPool>(num_fields, WRITER_BUFFER_SIZE,
+	                                               WRITER_MAX_IDLE_BYTES);
 
 	if ( backend )
 		{
@@ -206,43 +212,88 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 		broker_mgr->PublishLogWrite(stream,
 				writer,
 				info->path,
-				num_fields,
+				schema,
 				vals);
 		}
 
-	if ( ! backend )
+	if ( ! backend || ! initialized )
 		{
 		DeleteVals(arg_num_fields, vals);
 		return;
 		}
 
-	if ( ! write_buffer )
+	if ( ! write_batch )
+		write_batch = batch_pool->Get();
+
+	Value** batch_vals = write_batch->AddRecord();
+
+	for ( int i = 0; i < num_fields; i++ )
+		write_batch->CopyValue(batch_vals[i], vals[i]);
+
+	DeleteVals(arg_num_fields, vals);
+
+	if ( write_batch->Full() || ! buf || run_state::terminating )
+		// Buffer full (or no bufferin desired or termiating).
+		FlushWriteBuffer();
+	}
+
+Value** WriterFrontend::StartWrite()
+	{
+	if ( disabled || ! initialized || ! (backend || remote) )
+		return nullptr;
+
+	if ( ! write_batch )
+		write_batch = batch_pool->Get();
+
+	return write_batch->AddRecord();
+	}
+
+void WriterFrontend::FinishWrite()
+	{
+	Value** vals = write_batch->Record(write_batch->Size() - 1);
+
+	if ( remote )
 		{
-		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
-		write_buffer_pos = 0;
+		broker_mgr->PublishLogWrite(stream,
+				writer,
+				info->path,
+				schema,
+				vals);
 		}
 
-	write_buffer[write_buffer_pos++] = vals;
+	if ( ! backend )
+		{
+		write_batch->RemoveLastRecord();
+		return;
+		}
 
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || run_state::terminating )
-		// Buffer full (or no bufferin desired or termiating).
+	if ( write_batch->Full() || ! buf || run_state::terminating )
 		FlushWriteBuffer();
+	}
+
+uint64_t WriterFrontend::PendingMessages()
+	{
+	if ( ! backend || disabled )
+		return 0;
 
+	threading::MsgThread::Stats stats;
+	backend->GetStats(&stats);
+	return stats.pending_in;
 	}
 
 void WriterFrontend::FlushWriteBuffer()
 	{
-	if ( ! write_buffer_pos )
+	if ( ! write_batch || ! write_batch->Size() )
 		// Nothing to do.
 		return;
 
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		// The message returns the batch to the pool once written.
+		backend->SendIn(new WriteMessage(backend, batch_pool, write_batch));
+	else
+		batch_pool->Put(write_batch);
 
-	// Clear buffer (no delete, we pass ownership to child thread.)
-	write_buffer = nullptr;
-	write_buffer_pos = 0;
+	write_batch = nullptr;
 	}
 
 void WriterFrontend::SetBuf(bool enabled)
@@ -2,7 +2,10 @@
 
 #pragma once
 
+#include <memory>
+
 #include "zeek/logging/WriterBackend.h"
+#include "zeek/logging/RecordBatch.h"
 
 namespace zeek::logging  {
 
@@ -93,6 +96,34 @@ public:
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Starts writing out a record by returning values to fill in. This
+	 * avoids the copying that Write() needs to do. Once filled in, the
+	 * record must be passed on with FinishWrite() before calling any
+	 * other method. The values remain owned by the frontend, and their
+	 * data must be allocated with the methods of the batch returned by
+	 * WriteBatch().
+	 *
+	 * This method must only be called from the main thread.
+	 *
+	 * @return The values, NumFields() of them, or null if the record
+	 * would not be written anywhere.
+	 */
+	threading::Value** StartWrite();
+
+	/**
+	 * Writes out the record started with StartWrite(). See Write() for
+	 * details.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void FinishWrite();
+
+	/**
+	 * Returns the batch that StartWrite() adds records to.
+	 */
+	RecordBatch* WriteBatch() const	{ return write_batch; }
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -141,6 +172,16 @@ public:
 	 */
 	void FlushWriteBuffer();
 
+	/**
+	 * Returns the number of messages that the backend has yet to
+	 * process. That's zero for frontends without a local backend, and
+	 * for disabled ones, as their backend may not process anything
+	 * anymore.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	uint64_t PendingMessages();
+
 	/**
 	 * Disables the writer frontend. From now on, all method calls that
 	 * would normally send message over to the backend, turn into no-ops.
@@ -183,6 +224,13 @@ public:
 	 */
 	const threading::Field* const * Fields() const	{ return fields; }
 
+	/**
+	 * Returns the schema for encoding the records into batches of
+	 * values, once initialized.
+	 */
+	const std::shared_ptr<const threading::ValueBatchSchema>& Schema() const
+		{ return schema; }
+
 protected:
 	friend class Manager;
 
@@ -202,11 +250,15 @@ protected:
 	WriterBackend::WriterInfo* info;	// The writer information.
 	int num_fields;	// The number of log fields.
 	const threading::Field* const*  fields;	// The log fields.
+	std::shared_ptr<const threading::ValueBatchSchema> schema;
 
-	// Buffer for bulk writes.
+	// Buffer for bulk writes. Batches are recycled by the backend once
+	// it has written them, keeping up to WRITER_MAX_IDLE_BYTES of them
+	// around.
 	static const int WRITER_BUFFER_SIZE = 1000;
-	int write_buffer_pos;	// Position of next write in buffer.
-	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	static const size_t WRITER_MAX_IDLE_BYTES = 2 * 1024 * 1024;
+	std::shared_ptr<RecordBatchPool> batch_pool;
+	RecordBatch* write_batch;	// Batch of up to WRITER_BUFFER_SIZE records.
 };
 
 } // namespace zeek::logging
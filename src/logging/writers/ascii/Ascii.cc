@@ -14,6 +14,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <optional>
 
 #include "zeek/Func.h"
@@ -191,6 +193,24 @@ static std::optional<LeftoverLog> parse_shadow_log(const std::string& fname)
 	return rval;
 	}
 
+// Rotations waiting for their files to be written out by the compression
+// pool. Shared with the pool's threads.
+struct Ascii::DeferredRotations {
+	struct Rotation {
+		std::string new_name;
+		std::string old_name;
+		double open;
+		double close;
+		bool terminating;
+		std::string error;
+	};
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	int outstanding = 0;
+	std::vector<Rotation> completed;
+};
+
 Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	{
 	fd = 0;
@@ -203,6 +223,7 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	formatter = nullptr;
 	gzip_level = 0;
 	gzfile = nullptr;
+	deferred_rotations = std::make_shared<DeferredRotations>();
 
 	InitConfigOptions();
 	init_options = InitFilterOptions();
@@ -507,16 +528,21 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const threading::Fiel
 			return false;
 			}
 
-		char mode[4];
-		snprintf(mode, sizeof(mode), "wb%d", gzip_level);
-		errno = 0; // errno will only be set under certain circumstances by gzdopen.
-		gzfile = gzdopen(fd, mode);
-
-		if ( gzfile == nullptr )
+		if ( auto pool = log_mgr->GetCompressionPool() )
+			cfile = std::make_unique<logging::CompressedFile>(pool, fd, gzip_level);
+		else
 			{
-			Error(Fmt("cannot gzip %s: %s", fname.c_str(),
-			                                Strerror(errno)));
-			return false;
+			char mode[4];
+			snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+			errno = 0; // errno will only be set under certain circumstances by gzdopen.
+			gzfile = gzdopen(fd, mode);
+
+			if ( gzfile == nullptr )
+				{
+				Error(Fmt("cannot gzip %s: %s", fname.c_str(),
+				                                Strerror(errno)));
+				return false;
+				}
 			}
 		}
 	else
@@ -587,6 +613,10 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	if ( cfile )
+		cfile->Flush();
+
+	FinishDeferredRotations(false);
 	fsync(fd);
 	return true;
 	}
@@ -604,6 +634,7 @@ bool Ascii::DoFinish(double network_time)
 	ascii_done = true;
 
 	CloseFile(network_time);
+	FinishDeferredRotations(true);
 
 	return true;
 	}
@@ -659,7 +690,13 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		return true;
 		}
 
-	CloseFile(close);
+	// With a compression pool, we rename the file while its remaining
+	// data is still being compressed, and finish the rotation once the
+	// file is complete. That keeps the thread from waiting for it.
+	bool defer = (cfile != nullptr);
+
+	if ( ! defer )
+		CloseFile(close);
 
 	string nname = string(rotated_path) + "." + LogExt();
 
@@ -675,6 +712,7 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		util::zeek_strerror_r(errno, buf, sizeof(buf));
 		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
 		          nname.c_str(), buf));
+		CloseFile(close);
 		FinishedRotation();
 		return false;
 		}
@@ -688,11 +726,19 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 		if ( unlink(sfname.data()) != 0 )
 			{
 			Error(Fmt("cannot unlink %s: %s", sfname.data(), Strerror(errno)));
+			CloseFile(close);
 			FinishedRotation();
 			return false;
 			}
 		}
 
+	if ( defer )
+		{
+		CloseFileInBackground(nname, open, close, terminating);
+		DeferRotation();
+		return true;
+		}
+
 	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
 		{
 		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
@@ -710,10 +756,67 @@ bool Ascii::DoSetBuf(bool enabled)
 
 bool Ascii::DoHeartbeat(double network_time, double current_time)
 	{
-	// Nothing to do.
+	FinishDeferredRotations(false);
 	return true;
 	}
 
+void Ascii::CloseFileInBackground(const std::string& new_name, double open,
+                                  double close, bool terminating)
+	{
+	if ( include_meta && ! tsv )
+		WriteHeaderField("close", Timestamp(0));
+
+	auto rotations = deferred_rotations;
+	DeferredRotations::Rotation r{new_name, fname, open, close, terminating, ""};
+
+		{
+		std::lock_guard<std::mutex> lock(rotations->mutex);
+		++rotations->outstanding;
+		}
+
+	// This may run on one of the pool's threads.
+	cfile->Close([rotations, r](const std::string& error) mutable
+		{
+		r.error = error;
+
+		std::lock_guard<std::mutex> lock(rotations->mutex);
+		rotations->completed.push_back(std::move(r));
+		--rotations->outstanding;
+		rotations->cond.notify_all();
+		});
+
+	cfile.reset();
+	fd = 0;
+	}
+
+void Ascii::FinishDeferredRotations(bool wait)
+	{
+	std::vector<DeferredRotations::Rotation> completed;
+
+		{
+		std::unique_lock<std::mutex> lock(deferred_rotations->mutex);
+
+		if ( wait )
+			deferred_rotations->cond.wait(lock, [this]()
+				{ return deferred_rotations->outstanding == 0; });
+
+		completed.swap(deferred_rotations->completed);
+		}
+
+	for ( const auto& r : completed )
+		{
+		if ( ! r.error.empty() )
+			{
+			Error(Fmt("error writing %s: %s", r.new_name.c_str(), r.error.c_str()));
+			FinishedDeferredRotation();
+			continue;
+			}
+
+		FinishedDeferredRotation(r.new_name.c_str(), r.old_name.c_str(),
+		                         r.open, r.close, r.terminating);
+		}
+	}
+
 static std::vector<LeftoverLog> find_leftover_logs()
 	{
 	std::vector<LeftoverLog> rval;
@@ -884,6 +987,15 @@ string Ascii::Timestamp(double t)
 
 bool Ascii::InternalWrite(int fd, const char* data, int len)
 	{
+	if ( cfile )
+		{
+		if ( cfile->Write(data, len) )
+			return true;
+
+		Error(Fmt("Ascii::InternalWrite error: %s\n", cfile->Error().c_str()));
+		return false;
+		}
+
 	if ( ! gzfile )
 		return util::safe_write(fd, data, len);
 
@@ -907,6 +1019,17 @@ bool Ascii::InternalWrite(int fd, const char* data, int len)
 
 bool Ascii::InternalClose(int fd)
 	{
+	if ( cfile )
+		{
+		bool ok = cfile->Finish();
+
+		if ( ! ok )
+			Error(Fmt("Ascii::InternalClose error: %s\n", cfile->Error().c_str()));
+
+		cfile.reset();
+		return ok;
+		}
+
 	if ( ! gzfile )
 		{
 		util::safe_close(fd);
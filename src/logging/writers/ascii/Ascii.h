@@ -5,7 +5,9 @@
 #pragma once
 
 #include <zlib.h>
+#include <memory>
 
+#include "zeek/logging/CompressionPool.h"
 #include "zeek/logging/WriterBackend.h"
 #include "zeek/threading/formatters/Ascii.h"
 #include "zeek/threading/formatters/JSON.h"
@@ -53,8 +55,21 @@ private:
 	bool InternalWrite(int fd, const char* data, int len);
 	bool InternalClose(int fd);
 
+	// Closes a file renamed by a rotation without waiting for its data
+	// to be written, finishing the rotation once that's done.
+	void CloseFileInBackground(const std::string& new_name, double open,
+	                           double close, bool terminating);
+
+	// Finishes the rotations whose files have been closed, optionally
+	// waiting for all of them.
+	void FinishDeferredRotations(bool wait);
+
+	struct DeferredRotations;
+
 	int fd;
 	gzFile gzfile;
+	std::unique_ptr<logging::CompressedFile> cfile; // Used instead of gzfile with a compression pool.
+	std::shared_ptr<DeferredRotations> deferred_rotations;
 	std::string fname;
 	ODesc desc;
 	bool ascii_done;
@@ -0,0 +1,230 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/logging/writers/columnar/Columnar.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "zeek/threading/SerialTypes.h"
+
+#include "zeek/logging/writers/columnar/columnar.bif.h"
+
+using namespace std;
+using zeek::threading::Value;
+using zeek::threading::Field;
+using zeek::threading::formatter::columnar::Encoder;
+
+namespace zeek::logging::writer::detail {
+
+Columnar::Columnar(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	fd = 0;
+	num_row_groups = 0;
+	num_rows = 0;
+
+	compression_level = BifConst::LogColumnar::compression_level;
+	row_group_size = BifConst::LogColumnar::row_group_size;
+	file_extension.assign(
+		(const char*) BifConst::LogColumnar::file_extension->Bytes(),
+		BifConst::LogColumnar::file_extension->Len()
+		);
+	}
+
+Columnar::~Columnar()
+	{
+	// In case of errors aborting the logging altogether, DoFinish() may
+	// not have been called.
+	CloseFile();
+	}
+
+bool Columnar::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	// Set per-filter configuration options.
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "compression_level") == 0 )
+			compression_level = atoi(i->second);
+
+		else if ( strcmp(i->first, "row_group_size") == 0 )
+			row_group_size = strtoull(i->second, nullptr, 10);
+
+		else if ( strcmp(i->first, "file_extension") == 0 )
+			file_extension.assign(i->second);
+		}
+
+	if ( compression_level < 0 || compression_level > 9 )
+		{
+		Error("invalid value for 'compression_level', must be a number between 0 and 9.");
+		return false;
+		}
+
+	if ( row_group_size == 0 )
+		{
+		Error("invalid value for 'row_group_size', must be positive.");
+		return false;
+		}
+
+	return true;
+	}
+
+bool Columnar::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( ! InitFilterOptions() )
+		return false;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( ! Encoder::IsSupportedType(fields[i]->type, fields[i]->subtype) )
+			{
+			Error(Fmt("unsupported type for field %s", fields[i]->name));
+			return false;
+			}
+		}
+
+	encoder = std::make_unique<Encoder>(num_fields, fields);
+	return OpenFile();
+	}
+
+bool Columnar::OpenFile()
+	{
+	fname = string(Info().path) + "." + file_extension;
+
+	fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+	if ( fd < 0 )
+		{
+		Error(Fmt("cannot open %s: %s", fname.c_str(), Strerror(errno)));
+		fd = 0;
+		return false;
+		}
+
+	num_row_groups = 0;
+	num_rows = 0;
+
+	threading::formatter::columnar::MetaData meta = {
+		{"path", Info().path},
+		{"open", Fmt("%.6f", util::current_time())},
+	};
+
+	return WriteOut(encoder->Header(meta));
+	}
+
+bool Columnar::CloseFile()
+	{
+	if ( ! fd )
+		return true;
+
+	bool ok = WriteRowGroup() && WriteOut(encoder->Footer(num_row_groups, num_rows));
+
+	util::safe_close(fd);
+	fd = 0;
+	return ok;
+	}
+
+bool Columnar::WriteOut(const std::string& data)
+	{
+	if ( util::safe_write(fd, data.data(), data.size()) )
+		return true;
+
+	Error(Fmt("error writing to %s: %s", fname.c_str(), Strerror(errno)));
+	return false;
+	}
+
+bool Columnar::WriteRowGroup()
+	{
+	uint64_t n = encoder->NumRows();
+
+	if ( n == 0 )
+		return true;
+
+	if ( ! WriteOut(encoder->FinishRowGroup(compression_level)) )
+		return false;
+
+	++num_row_groups;
+	num_rows += n;
+	return true;
+	}
+
+bool Columnar::DoWrite(int num_fields, const Field* const* fields, Value** vals)
+	{
+	if ( ! fd && ! OpenFile() )
+		return false;
+
+	encoder->Add(vals);
+
+	if ( encoder->NumRows() >= row_group_size || ! IsBuf() ||
+	     encoder->BufferedBytes() >= MAX_ROW_GROUP_BYTES )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Columnar::DoSetBuf(bool enabled)
+	{
+	if ( ! enabled && fd )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Columnar::DoFlush(double network_time)
+	{
+	if ( ! fd )
+		return true;
+
+	return WriteRowGroup();
+	}
+
+bool Columnar::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// Don't rotate if there's not a file currently open.
+	if ( ! fd )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	// Row groups never cross a rotation, as the file gets its footer
+	// here. The next write opens a new one.
+	CloseFile();
+
+	string nname = string(rotated_path) + "." + file_extension;
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		char buf[256];
+		util::zeek_strerror_r(errno, buf, sizeof(buf));
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), buf));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Columnar::DoFinish(double network_time)
+	{
+	return CloseFile();
+	}
+
+bool Columnar::DoHeartbeat(double network_time, double current_time)
+	{
+	// Nothing to do.
+	return true;
+	}
+
+} // namespace zeek::logging::writer::detail
@@ -0,0 +1,57 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for a columnar binary format.
+
+#pragma once
+
+#include <memory>
+
+#include "zeek/logging/WriterBackend.h"
+#include "zeek/threading/formatters/Columnar.h"
+
+namespace zeek::logging::writer::detail {
+
+class Columnar : public WriterBackend {
+public:
+	explicit Columnar(WriterFrontend* frontend);
+	~Columnar() override;
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Columnar(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+	            const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+	             threading::Value** vals) override;
+	bool DoSetBuf(bool enabled) override;
+	bool DoRotate(const char* rotated_path, double open,
+	              double close, bool terminating) override;
+	bool DoFlush(double network_time) override;
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	bool InitFilterOptions();
+	bool OpenFile();
+	bool CloseFile();
+	bool WriteRowGroup();
+	bool WriteOut(const std::string& data);
+
+	// Upper bound for a row group's size in memory, independent of its
+	// number of rows.
+	static constexpr size_t MAX_ROW_GROUP_BYTES = 64 * 1024 * 1024;
+
+	int fd;
+	std::string fname;
+	std::unique_ptr<threading::formatter::columnar::Encoder> encoder;
+	uint64_t num_row_groups;
+	uint64_t num_rows;
+
+	// Options set from the script-level.
+	int compression_level;
+	uint64_t row_group_size;
+	std::string file_extension;
+};
+
+} // namespace zeek::logging::writer::detail
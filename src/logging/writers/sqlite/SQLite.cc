@@ -4,10 +4,13 @@
 #include "zeek/logging/writers/sqlite/SQLite.h"
 
 #include <errno.h>
+#include <string.h>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "zeek/threading/SerialTypes.h"
+#include "zeek/util.h"
 
 #include "zeek/logging/writers/sqlite/sqlite.bif.h"
 
@@ -19,8 +22,14 @@ namespace zeek::logging::writer::detail {
 
 SQLite::SQLite(WriterFrontend* frontend)
 	: WriterBackend(frontend),
-	  fields(), num_fields(), db(), st()
+	  fields(), num_fields(), db(), st(), begin_st(), commit_st(), rollback_st(),
+	  in_transaction(false), batch_rows(0), batch_start(0),
+	  total_rows(0), commits(0), write_time(0), commit_time(0), max_commit_time(0)
 	{
+	batch_size = BifConst::LogSQLite::batch_size;
+	batch_interval = BifConst::LogSQLite::batch_interval;
+	wal = BifConst::LogSQLite::wal;
+
 	set_separator.assign(
 			(const char*) BifConst::LogSQLite::set_separator->Bytes(),
 			BifConst::LogSQLite::set_separator->Len()
@@ -45,6 +54,9 @@ SQLite::~SQLite()
 	if ( db != 0 )
 		{
 		sqlite3_finalize(st);
+		sqlite3_finalize(begin_st);
+		sqlite3_finalize(commit_st);
+		sqlite3_finalize(rollback_st);
 		if ( ! sqlite3_close(db) )
 			Error("Sqlite could not close connection");
 
@@ -111,9 +123,49 @@ bool SQLite::checkError(int code)
 	return false;
 	}
 
+bool SQLite::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	// Set per-filter configuration options.
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "batch_size") == 0 )
+			batch_size = strtoull(i->second, nullptr, 10);
+
+		else if ( strcmp(i->first, "batch_interval") == 0 )
+			batch_interval = atof(i->second);
+
+		else if ( strcmp(i->first, "wal") == 0 )
+			{
+			if ( strcmp(i->second, "T") == 0 )
+				wal = true;
+			else if ( strcmp(i->second, "F") == 0 )
+				wal = false;
+			else
+				{
+				Error("invalid value for 'wal', must be a string and either \"T\" or \"F\"");
+				return false;
+				}
+			}
+		}
+
+	if ( batch_interval <= 0 )
+		{
+		Error("invalid value for 'batch_interval', must be positive.");
+		return false;
+		}
+
+	return true;
+	}
+
 bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
                     const Field* const * arg_fields)
 	{
+	if ( ! InitFilterOptions() )
+		return false;
+
 	if ( sqlite3_threadsafe() == 0 )
 		{
 		Error("SQLite reports that it is not threadsafe. Zeek needs a threadsafe version of SQLite. Aborting");
@@ -150,6 +202,22 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 					NULL)) )
 		return false;
 
+	if ( wal )
+		{
+		// With a write-ahead log, commits don't need to sync the
+		// database itself, and NORMAL syncs only at checkpoints. That
+		// can lose the last transactions on power loss, but doesn't
+		// corrupt the database.
+		char* errorMsg = 0;
+		if ( sqlite3_exec(db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;",
+		                  NULL, NULL, &errorMsg) != SQLITE_OK )
+			{
+			Error(Fmt("Error enabling WAL mode: %s", errorMsg));
+			sqlite3_free(errorMsg);
+			return false;
+			}
+		}
+
 	string create = "CREATE TABLE IF NOT EXISTS " + tablename + " (\n";
 		//"id SERIAL UNIQUE NOT NULL"; // SQLite has rowids, we do not need a counter here.
 
@@ -233,9 +301,60 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 	if ( checkError(sqlite3_prepare_v2(db, insert.c_str(), insert.size()+1, &st, NULL)) )
 		return false;
 
+	if ( checkError(sqlite3_prepare_v2(db, "BEGIN", -1, &begin_st, NULL)) ||
+	     checkError(sqlite3_prepare_v2(db, "COMMIT", -1, &commit_st, NULL)) ||
+	     checkError(sqlite3_prepare_v2(db, "ROLLBACK", -1, &rollback_st, NULL)) )
+		return false;
+
+	rendered.resize(num_fields);
 	return true;
 	}
 
+bool SQLite::Exec(sqlite3_stmt* stmt)
+	{
+	int res = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	return ! checkError(res);
+	}
+
+bool SQLite::Commit()
+	{
+	if ( ! in_transaction )
+		return true;
+
+	double start = util::current_time(true);
+
+	if ( ! Exec(commit_st) )
+		{
+		// A failed COMMIT may leave the transaction open, which would
+		// make the next BEGIN fail as well.
+		Rollback();
+		return false;
+		}
+
+	in_transaction = false;
+	batch_rows = 0;
+
+	double took = util::current_time(true) - start;
+	++commits;
+	commit_time += took;
+	max_commit_time = std::max(max_commit_time, took);
+	return true;
+	}
+
+void SQLite::Rollback()
+	{
+	if ( ! in_transaction )
+		return;
+
+	// The transaction is gone even if this fails, as SQLite rolls back
+	// by itself on errors that leave it unable to continue.
+	sqlite3_step(rollback_st);
+	sqlite3_reset(rollback_st);
+	in_transaction = false;
+	batch_rows = 0;
+	}
+
 int SQLite::AddParams(Value* val, int pos)
 	{
 	if ( ! val->present )
@@ -254,16 +373,21 @@ int SQLite::AddParams(Value* val, int pos)
 	case TYPE_PORT:
 		return sqlite3_bind_int(st, pos, val->val.port_val.port);
 
+	// The bound data must stay around until the insert has run. That's
+	// the case for the values themselves and for the renderings of the
+	// current row, so nothing needs copying.
 	case TYPE_SUBNET:
 		{
-		string out = io->Render(val->val.subnet_val);
-		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_TRANSIENT);
+		string& out = rendered[pos-1];
+		out = io->Render(val->val.subnet_val);
+		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_STATIC);
 		}
 
 	case TYPE_ADDR:
 		{
-		string out = io->Render(val->val.addr_val);
-		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_TRANSIENT);
+		string& out = rendered[pos-1];
+		out = io->Render(val->val.addr_val);
+		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_STATIC);
 		}
 
 	case TYPE_TIME:
@@ -279,7 +403,7 @@ int SQLite::AddParams(Value* val, int pos)
 		if ( ! val->val.string_val.length || val->val.string_val.length == 0 )
 			return sqlite3_bind_null(st, pos);
 
-		return sqlite3_bind_text(st, pos, val->val.string_val.data, val->val.string_val.length, SQLITE_TRANSIENT);
+		return sqlite3_bind_text(st, pos, val->val.string_val.data, val->val.string_val.length, SQLITE_STATIC);
 		}
 
 	case TYPE_TABLE:
@@ -301,7 +425,9 @@ int SQLite::AddParams(Value* val, int pos)
 				}
 
 		desc.RemoveEscapeSequence(set_separator);
-		return sqlite3_bind_text(st, pos, (const char*) desc.Bytes(), desc.Len(), SQLITE_TRANSIENT);
+		string& out = rendered[pos-1];
+		out.assign((const char*) desc.Bytes(), desc.Len());
+		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_STATIC);
 		}
 
 	case TYPE_VECTOR:
@@ -323,7 +449,9 @@ int SQLite::AddParams(Value* val, int pos)
 				}
 
 		desc.RemoveEscapeSequence(set_separator);
-		return sqlite3_bind_text(st, pos, (const char*) desc.Bytes(), desc.Len(), SQLITE_TRANSIENT);
+		string& out = rendered[pos-1];
+		out.assign((const char*) desc.Bytes(), desc.Len());
+		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_STATIC);
 		}
 
 	default:
@@ -334,29 +462,92 @@ int SQLite::AddParams(Value* val, int pos)
 
 bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
 	{
+	double start = batch_size ? util::current_time(true) : 0;
+
+	if ( batch_size && ! in_transaction )
+		{
+		if ( ! Exec(begin_st) )
+			return false;
+
+		in_transaction = true;
+		batch_start = start;
+		}
+
 	// bind parameters
 	for ( int i = 0; i < num_fields; i++ )
 		{
 		if ( checkError(AddParams(vals[i], i+1)) )
-			return false;
+			return WriteFailed();
 		}
 
 	// execute query
 	if ( checkError(sqlite3_step(st)) )
-		return false;
+		return WriteFailed();
 
 	// clean up and make ready for next query execution
 	if ( checkError(sqlite3_clear_bindings(st)) )
-		return false;
+		return WriteFailed();
 
 	if ( checkError(sqlite3_reset(st)) )
+		return WriteFailed();
+
+	++total_rows;
+
+	if ( ! batch_size )
+		return true;
+
+	write_time += util::current_time(true) - start;
+
+	if ( ++batch_rows >= batch_size || start - batch_start >= batch_interval )
+		return Commit();
+
+	return true;
+	}
+
+bool SQLite::WriteFailed()
+	{
+	sqlite3_clear_bindings(st);
+	sqlite3_reset(st);
+	Rollback();
+	return false;
+	}
+
+bool SQLite::DoFlush(double network_time)
+	{
+	return Commit();
+	}
+
+bool SQLite::DoHeartbeat(double network_time, double current_time)
+	{
+	if ( in_transaction && util::current_time(true) - batch_start >= batch_interval )
+		return Commit();
+
+	return true;
+	}
+
+bool SQLite::DoFinish(double network_time)
+	{
+	if ( ! Commit() )
 		return false;
 
+	if ( batch_size && total_rows )
+		{
+		double busy = write_time + commit_time;
+		MsgThread::Info(Fmt("%" PRIu64 " rows in %" PRIu64 " transactions, %.0f rows/sec, "
+		                    "commit latency avg %.3fms max %.3fms",
+		                    total_rows, commits, busy > 0 ? total_rows / busy : 0.0,
+		                    commits ? commit_time / commits * 1e3 : 0.0,
+		                    max_commit_time * 1e3));
+		}
+
 	return true;
 	}
 
 bool SQLite::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
+	if ( ! Commit() )
+		return false;
+
 	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating))
 		{
 		Error(Fmt("error rotating %s", Info().path));
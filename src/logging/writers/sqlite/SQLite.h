@@ -6,6 +6,9 @@
 
 #include "zeek/zeek-config.h"
 
+#include <string>
+#include <vector>
+
 #include "zeek/logging/WriterBackend.h"
 #include "zeek/threading/formatters/Ascii.h"
 #include "zeek/3rdparty/sqlite3.h"
@@ -29,12 +32,26 @@ protected:
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
-	bool DoFlush(double network_time) override { return true; }
-	bool DoFinish(double network_time) override { return true; }
-	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+	bool DoFlush(double network_time) override;
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
 	bool checkError(int code);
+	bool InitFilterOptions();
+
+	// Runs a statement that doesn't take parameters.
+	bool Exec(sqlite3_stmt* stmt);
+
+	// Commits the current batch's transaction, if any. Rolls it back if
+	// that fails.
+	bool Commit();
+
+	// Rolls back the current batch's transaction, if any.
+	void Rollback();
+
+	// Cleans up after a failed insert, dropping the current batch.
+	bool WriteFailed();
 
 	int AddParams(threading::Value* val, int pos);
 	std::string GetTableType(int, int);
@@ -44,6 +61,30 @@ private:
 
 	sqlite3 *db;
 	sqlite3_stmt *st;
+	sqlite3_stmt *begin_st;
+	sqlite3_stmt *commit_st;
+	sqlite3_stmt *rollback_st;
+
+	// Rows per transaction, or zero to commit each on its own.
+	bro_uint_t batch_size;
+	// Maximum age of a transaction, in seconds.
+	double batch_interval;
+	bool wal;
+
+	bool in_transaction;
+	bro_uint_t batch_rows;
+	double batch_start;
+
+	// Renderings of the current row's fields that aren't stored in the
+	// values themselves. The insert statement binds them without copying.
+	std::vector<std::string> rendered;
+
+	// Statistics, reported at the end when batching.
+	uint64_t total_rows;
+	uint64_t commits;
+	double write_time;
+	double commit_time;
+	double max_commit_time;
 
 	std::string set_separator;
 	std::string unset_field;
@@ -144,8 +144,22 @@ struct ipv6_pseudo_hdr {
 	uint8_t  next_proto;
 };
 
+// Returns the ones-complement sum of the concatenated blocks, without
+// complementing it.
 extern uint16_t in_cksum(const checksum_block* blocks, int num_blocks);
 
+// The implementations that in_cksum() can use for adding up the data.
+// By default it uses the best one that the CPU supports.
+enum ChecksumKernel { CKSUM_SCALAR, CKSUM_SSE2, CKSUM_AVX2 };
+
+extern ChecksumKernel get_checksum_kernel();
+
+// Falls back to CKSUM_SCALAR if the CPU lacks support for the given
+// kernel.  For testing and benchmarking.
+extern void set_checksum_kernel(ChecksumKernel k);
+
+extern const char* checksum_kernel_name(ChecksumKernel k);
+
 inline uint16_t in_cksum(const uint8_t* data, int len)
 	{
 	checksum_block cb{data, len};
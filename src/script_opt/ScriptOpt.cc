@@ -9,6 +9,7 @@
 #include "zeek/script_opt/Reduce.h"
 #include "zeek/script_opt/GenRDs.h"
 #include "zeek/script_opt/UseDefs.h"
+#include "zeek/script_opt/ZAM.h"
 
 
 namespace zeek::detail {
@@ -133,6 +134,18 @@ void optimize_func(ScriptFunc* f, std::shared_ptr<ProfileFunc> pf,
 	if ( new_frame_size > f->FrameSize() )
 		f->SetFrameSize(new_frame_size);
 
+	if ( analysis_options.gen_ZAM_code )
+		{
+		ZAMCompiler zc(f, body, reduced_rds.GetDefSetsMgr());
+		auto zbody = zc.Compile();
+
+		if ( analysis_options.only_func || analysis_options.dump_xform )
+			zbody->Dump();
+
+		f->ReplaceBody(body, zbody);
+		body = zbody;
+		}
+
 	pop_scope();
 	}
 
@@ -170,6 +183,7 @@ void analyze_scripts()
 		check_env_opt("ZEEK_INLINE", analysis_options.inliner);
 		check_env_opt("ZEEK_OPT", analysis_options.optimize_AST);
 		check_env_opt("ZEEK_XFORM", analysis_options.activate);
+		check_env_opt("ZEEK_ZAM", analysis_options.gen_ZAM_code);
 
 		auto usage = getenv("ZEEK_USAGE_ISSUES");
 
@@ -185,6 +199,7 @@ void analyze_scripts()
 
 		if ( analysis_options.only_func ||
 		     analysis_options.optimize_AST ||
+		     analysis_options.gen_ZAM_code ||
 		     analysis_options.usage_issues > 0 )
 			analysis_options.activate = true;
 
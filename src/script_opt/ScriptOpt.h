@@ -39,6 +39,10 @@ struct AnalyOpt {
 	// If true, do global inlining.
 	bool inliner = false;
 
+	// If true, compile function bodies to ZAM instructions for
+	// execution by its register machine.
+	bool gen_ZAM_code = false;
+
 	// If true, report which functions are directly and indirectly
 	// recursive, and exit.  Only germane if running the inliner.
 	bool report_recursive = false;
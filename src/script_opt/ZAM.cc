@@ -0,0 +1,787 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZAM.h"
+
+#include <unordered_set>
+
+#include "zeek/Expr.h"
+#include "zeek/Reporter.h"
+#include "zeek/Stmt.h"
+#include "zeek/Traverse.h"
+
+namespace zeek::detail {
+
+// The typed operations come in groups of three forms (VVV, VVC, VCV),
+// for signed, unsigned and double operands, in that order.
+static_assert(OP_ADD_U_VVV == OP_ADD_I_VVV + 3);
+static_assert(OP_ADD_D_VCV == OP_ADD_I_VVV + 8);
+static_assert(OP_MOD_U_VCV == OP_MOD_I_VVV + 5);
+static_assert(OP_NE_D_VCV == OP_NE_I_VVV + 8);
+
+// Gathers the locals an AST refers to, telling apart the ones whose
+// values it uses from the ones it only assigns.
+class LocalsCollector : public TraversalCallback {
+public:
+	TraversalCode PreStmt(const Stmt* s) override
+		{
+		switch ( s->Tag() ) {
+		case STMT_FOR:
+			{
+			auto fs = s->AsForStmt();
+
+			for ( const auto& id : *fs->LoopVars() )
+				AddDef(id);
+
+			if ( auto vv = fs->ValueVar() )
+				AddDef(vv.get());
+			break;
+			}
+
+		case STMT_INIT:
+			for ( const auto& id : s->AsInitStmt()->Inits() )
+				AddDef(id.get());
+			break;
+
+		case STMT_SWITCH:
+			for ( const auto& c : *s->AsSwitchStmt()->Cases() )
+				if ( auto tc = c->TypeCases() )
+					for ( const auto& id : *tc )
+						AddDef(id);
+			break;
+
+		default:
+			break;
+		}
+
+		return TC_CONTINUE;
+		}
+
+	TraversalCode PreExpr(const Expr* e) override
+		{
+		if ( e->Tag() == EXPR_ASSIGN )
+			{
+			auto lhs = e->GetOp1().get();
+
+			if ( lhs->Tag() == EXPR_REF )
+				lhs = lhs->GetOp1().get();
+
+			if ( lhs->Tag() == EXPR_NAME )
+				{
+				AddDef(lhs->AsNameExpr()->Id());
+				assigned.insert(lhs);
+				}
+			}
+
+		else if ( e->Tag() == EXPR_NAME && ! assigned.count(e) )
+			{
+			auto id = e->AsNameExpr()->Id();
+
+			if ( ! id->IsGlobal() )
+				{
+				locals.insert(id);
+				uses.insert(id);
+				use_exprs.push_back(e->AsNameExpr());
+				}
+			}
+
+		return TC_CONTINUE;
+		}
+
+	// All locals, those whose values get used, and those that get
+	// assigned.
+	std::unordered_set<const ID*> locals;
+	std::unordered_set<const ID*> uses;
+	std::unordered_set<const ID*> defs;
+
+	// Where values of locals get used.
+	std::vector<const NameExpr*> use_exprs;
+
+private:
+	void AddDef(const ID* id)
+		{
+		if ( ! id->IsGlobal() )
+			{
+			locals.insert(id);
+			defs.insert(id);
+			}
+		}
+
+	// The targets of assignments, which aren't uses.
+	std::unordered_set<const Expr*> assigned;
+};
+
+// Locals of these types get slots.
+static bool is_slot_type(const TypePtr& t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_ENUM:
+	case TYPE_COUNT:
+	case TYPE_PORT:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+// Returns the offset of the typed operations' group for the given
+// operand type, or -1 if there's none.
+static int typed_op_group(const TypePtr& t)
+	{
+	switch ( t->InternalType() ) {
+	case TYPE_INTERNAL_INT:		return 0;
+	case TYPE_INTERNAL_UNSIGNED:	return 3;
+	case TYPE_INTERNAL_DOUBLE:	return 6;
+	default:			return -1;
+	}
+	}
+
+ZAMCompiler::ZAMCompiler(ScriptFunc* f, StmtPtr _body, const DefSetsMgr* _mgr)
+	: func(f), body(std::move(_body)), mgr(_mgr)
+	{
+	frame_size = f->FrameSize();
+	}
+
+IntrusivePtr<ZBody> ZAMCompiler::Compile()
+	{
+	FindSlots();
+
+	CompileStmt(body.get());
+	Emit(ZInst(OP_END));
+
+	std::vector<std::pair<int, TypePtr>> params;
+	int num_params = func->GetType()->Params()->NumFields();
+
+	for ( int i = 0; i < num_params; ++i )
+		{
+		auto s = slots.find(i);
+		if ( s != slots.end() )
+			params.emplace_back(i, s->second);
+		}
+
+	return make_intrusive<ZBody>(func->Name(), body, std::move(insts),
+	                             std::move(auxes), std::move(params),
+	                             frame_size + num_scratch);
+	}
+
+void ZAMCompiler::FindSlots()
+	{
+	LocalsCollector lc;
+	body->Traverse(&lc);
+
+	// Distinct locals shouldn't share frame offsets, but if they do
+	// with different types, we leave them in the frame.
+	std::unordered_set<int> excluded;
+
+	// The same goes for locals that may get used before they're
+	// assigned. The interpreter reports that as an error, while a
+	// slot would just hold zero.
+	int num_params = func->GetType()->Params()->NumFields();
+
+	for ( auto e : lc.use_exprs )
+		{
+		auto id = e->Id();
+
+		if ( id->Offset() < num_params || id->GetAttr(ATTR_IS_ASSIGNED) )
+			continue;
+
+		if ( ! mgr->HasPreMinRDs(e) || ! mgr->HasPreMinRD(e, id) )
+			excluded.insert(id->Offset());
+		}
+
+	for ( auto id : lc.locals )
+		{
+		int offset = id->Offset();
+		const auto& t = id->GetType();
+
+		if ( offset < 0 || offset >= frame_size || ! is_slot_type(t) )
+			{
+			excluded.insert(offset);
+			continue;
+			}
+
+		auto s = slots.find(offset);
+
+		if ( s == slots.end() )
+			slots[offset] = t;
+		else if ( s->second->Tag() != t->Tag() )
+			excluded.insert(offset);
+		}
+
+	for ( auto offset : excluded )
+		slots.erase(offset);
+	}
+
+void ZAMCompiler::CompileStmt(const Stmt* s)
+	{
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+		CompileStmtList(s->AsStmtList());
+		break;
+
+	case STMT_EXPR:
+		CompileExprStmt(s->AsExprStmt());
+		break;
+
+	case STMT_IF:
+		CompileIf(s->AsIfStmt());
+		break;
+
+	case STMT_WHILE:
+		CompileWhile(s->AsWhileStmt());
+		break;
+
+	case STMT_NEXT:
+		CompileNext(s);
+		break;
+
+	case STMT_BREAK:
+		CompileBreak(s);
+		break;
+
+	case STMT_RETURN:
+		CompileReturn(s->AsReturnStmt());
+		break;
+
+	case STMT_CATCH_RETURN:
+		CompileCatchReturn(s->AsCatchReturnStmt());
+		break;
+
+	case STMT_INIT:
+		CompileInit(s->AsInitStmt());
+		break;
+
+	case STMT_NULL:
+		break;
+
+	default:
+		CompileFallback(s);
+		break;
+	}
+	}
+
+void ZAMCompiler::CompileStmtList(const StmtList* sl)
+	{
+	for ( const auto& s : sl->Stmts() )
+		CompileStmt(s);
+	}
+
+void ZAMCompiler::CompileExprStmt(const ExprStmt* s)
+	{
+	auto e = s->StmtExpr();
+
+	if ( e->Tag() == EXPR_ASSIGN )
+		{
+		auto lhs = e->GetOp1();
+
+		if ( lhs->Tag() == EXPR_REF )
+			lhs = lhs->GetOp1();
+
+		if ( lhs->Tag() == EXPR_NAME &&
+		     CompileAssign(lhs->AsNameExpr()->Id(), e->GetOp2().get()) )
+			return;
+		}
+
+	CompileFallback(s);
+	}
+
+void ZAMCompiler::CompileIf(const IfStmt* s)
+	{
+	auto cond = s->StmtExpr();
+	auto s1 = s->TrueBranch();
+	auto s2 = s->FalseBranch();
+
+	if ( cond->IsConst() )
+		{
+		auto branch = cond->AsConstExpr()->Value()->IsZero() ? s2 : s1;
+
+		if ( branch )
+			CompileStmt(branch);
+
+		return;
+		}
+
+	int test = Emit(ZInst(OP_IF_FALSE_VJ, CondSlot(cond)));
+
+	if ( s1 )
+		CompileStmt(s1);
+
+	if ( s2 && s2->Tag() != STMT_NULL )
+		{
+		int skip = Emit(ZInst(OP_GOTO_J));
+		insts[test].v2 = insts.size();
+		CompileStmt(s2);
+		insts[skip].v1 = insts.size();
+		}
+	else
+		insts[test].v2 = insts.size();
+	}
+
+void ZAMCompiler::CompileWhile(const WhileStmt* s)
+	{
+	LoopInfo loop;
+	loop.top = insts.size();
+
+	if ( auto pred = s->CondPredStmt() )
+		CompileStmt(pred.get());
+
+	auto cond = s->Condition().get();
+
+	if ( cond->IsConst() )
+		{
+		if ( cond->AsConstExpr()->Value()->IsZero() )
+			// The body never executes.
+			return;
+		}
+	else
+		{
+		int test = Emit(ZInst(OP_IF_FALSE_VJ, CondSlot(cond)));
+		loop.breaks.emplace_back(test, &ZInst::v2);
+		}
+
+	loops.push_back(std::move(loop));
+
+	CompileStmt(s->Body().get());
+	Emit(ZInst(OP_GOTO_J, loops.back().top));
+
+	int end = insts.size();
+
+	for ( const auto& [i, target] : loops.back().breaks )
+		insts[i].*target = end;
+
+	loops.pop_back();
+	}
+
+void ZAMCompiler::CompileNext(const Stmt* s)
+	{
+	auto loop = CurrentLoop();
+
+	if ( loop )
+		Emit(ZInst(OP_GOTO_J, loop->top));
+	else
+		CompileFallback(s);
+	}
+
+void ZAMCompiler::CompileBreak(const Stmt* s)
+	{
+	auto loop = CurrentLoop();
+
+	if ( loop )
+		{
+		int i = Emit(ZInst(OP_GOTO_J));
+		loop->breaks.emplace_back(i, &ZInst::v1);
+		}
+
+	else if ( loops.empty() )
+		// Outside of any loop, this ends a hook handler.
+		Emit(ZInst(OP_HOOK_BREAK));
+
+	else
+		CompileFallback(s);
+	}
+
+void ZAMCompiler::CompileReturn(const ReturnStmt* s)
+	{
+	auto e = s->StmtExpr();
+
+	if ( ! catches.empty() )
+		{
+		// Returning from an inlined function body amounts to
+		// assigning its return variable and leaving the body.
+		auto ret_var = catches.back().ret_var;
+
+		if ( e && ret_var && ! CompileAssign(ret_var, e) )
+			{
+			CompileFallback(s);
+			return;
+			}
+
+		int i = Emit(ZInst(OP_GOTO_J));
+		catches.back().exits.emplace_back(i, &ZInst::v1);
+		return;
+		}
+
+	if ( ! e )
+		{
+		Emit(ZInst(OP_RETURN_VOID));
+		return;
+		}
+
+	if ( HasSlot(e) )
+		{
+		ZInst inst(OP_RETURN_V, Slot(e));
+		inst.t = e->GetType();
+		Emit(std::move(inst));
+		return;
+		}
+
+	ZInst inst(OP_RETURN_EVAL);
+	inst.e = e;
+	inst.aux = SyncFor(e);
+	Emit(std::move(inst));
+	}
+
+void ZAMCompiler::CompileCatchReturn(const CatchReturnStmt* s)
+	{
+	CatchInfo c;
+
+	if ( s->RetVar() )
+		c.ret_var = s->RetVar()->Id();
+
+	catches.push_back(std::move(c));
+
+	LoopInfo barrier;
+	barrier.barrier = true;
+	loops.push_back(std::move(barrier));
+
+	CompileStmt(s->Block().get());
+
+	loops.pop_back();
+
+	int end = insts.size();
+
+	for ( const auto& [i, target] : catches.back().exits )
+		insts[i].*target = end;
+
+	catches.pop_back();
+	}
+
+void ZAMCompiler::CompileInit(const InitStmt* s)
+	{
+	bool all_slots = true;
+
+	for ( const auto& id : s->Inits() )
+		if ( ! HasSlot(id.get()) )
+			all_slots = false;
+
+	if ( ! all_slots )
+		// Aggregates get initialized by the interpreter.
+		CompileFallback(s);
+
+	// Locals in slots start out as zero.
+	for ( const auto& id : s->Inits() )
+		if ( HasSlot(id.get()) )
+			Emit(ZInst(OP_ASSIGN_VC, id->Offset()));
+	}
+
+void ZAMCompiler::CompileFallback(const Stmt* s)
+	{
+	ZInst inst(OP_EXEC_STMT, -1, -1, -1);
+	inst.s = const_cast<Stmt*>(s);
+	inst.aux = SyncFor(s);
+
+	auto loop = CurrentLoop();
+
+	if ( loop )
+		inst.v1 = loop->top;
+
+	if ( ! catches.empty() )
+		{
+		if ( auto ret_var = catches.back().ret_var )
+			{
+			if ( HasSlot(ret_var) )
+				inst.aux->ret_slot = ret_var->Offset();
+			else
+				inst.aux->ret_frame = ret_var->Offset();
+
+			inst.aux->ret_type = ret_var->GetType();
+			}
+		}
+
+	int i = Emit(std::move(inst));
+
+	if ( loop )
+		loop->breaks.emplace_back(i, &ZInst::v2);
+
+	if ( ! catches.empty() )
+		catches.back().exits.emplace_back(i, &ZInst::v3);
+	}
+
+bool ZAMCompiler::CompileAssign(const ID* lhs, const Expr* rhs)
+	{
+	if ( lhs->IsGlobal() )
+		return false;
+
+	if ( ! HasSlot(lhs) )
+		{
+		ZInst inst(OP_EVAL_TO_FRAME, lhs->Offset());
+		inst.e = rhs;
+		inst.aux = SyncFor(rhs);
+		Emit(std::move(inst));
+		return true;
+		}
+
+	int slot = lhs->Offset();
+	const auto& t = lhs->GetType();
+
+	if ( rhs->GetType()->InternalType() != t->InternalType() )
+		return false;
+
+	if ( HasSlot(rhs) )
+		{
+		Emit(ZInst(OP_ASSIGN_VV, slot, Slot(rhs)));
+		return true;
+		}
+
+	if ( rhs->IsConst() )
+		{
+		ZInst inst(OP_ASSIGN_VC, slot);
+		inst.c = ZVal(rhs->AsConstExpr()->ValuePtr(), rhs->GetType());
+		Emit(std::move(inst));
+		return true;
+		}
+
+	if ( CompileBinary(slot, rhs) || CompileUnary(slot, rhs) ||
+	     CompileField(slot, rhs) )
+		return true;
+
+	ZInst inst(OP_EVAL_TO_SLOT_V, slot);
+	inst.e = rhs;
+	inst.t = t;
+	inst.aux = SyncFor(rhs);
+	Emit(std::move(inst));
+
+	return true;
+	}
+
+bool ZAMCompiler::CompileBinary(int lhs, const Expr* e)
+	{
+	ZOp base;
+	bool is_comparison = false;
+	bool swap = false;
+
+	switch ( e->Tag() ) {
+	case EXPR_ADD:		base = OP_ADD_I_VVV; break;
+	case EXPR_SUB:		base = OP_SUB_I_VVV; break;
+	case EXPR_TIMES:	base = OP_MUL_I_VVV; break;
+	case EXPR_DIVIDE:	base = OP_DIV_I_VVV; break;
+	case EXPR_MOD:		base = OP_MOD_I_VVV; break;
+
+	case EXPR_LT:	base = OP_LT_I_VVV; is_comparison = true; break;
+	case EXPR_LE:	base = OP_LE_I_VVV; is_comparison = true; break;
+	case EXPR_EQ:	base = OP_EQ_I_VVV; is_comparison = true; break;
+	case EXPR_NE:	base = OP_NE_I_VVV; is_comparison = true; break;
+
+	// a > b is b < a, and a >= b is b <= a.
+	case EXPR_GT:	base = OP_LT_I_VVV; is_comparison = swap = true; break;
+	case EXPR_GE:	base = OP_LE_I_VVV; is_comparison = swap = true; break;
+
+	default:
+		return false;
+	}
+
+	auto op1 = e->GetOp1();
+	auto op2 = e->GetOp2();
+
+	if ( swap )
+		std::swap(op1, op2);
+
+	const auto& t = op1->GetType();
+	int group = typed_op_group(t);
+
+	if ( group < 0 || op2->GetType()->InternalType() != t->InternalType() )
+		return false;
+
+	if ( ! is_comparison &&
+	     e->GetType()->InternalType() != t->InternalType() )
+		return false;
+
+	if ( base == OP_MOD_I_VVV && t->InternalType() == TYPE_INTERNAL_DOUBLE )
+		return false;
+
+	ZInst inst(OP_END, lhs);
+
+	if ( HasSlot(op1.get()) && HasSlot(op2.get()) )
+		{
+		inst.op = ZOp(base + group);
+		inst.v2 = Slot(op1.get());
+		inst.v3 = Slot(op2.get());
+		}
+
+	else if ( HasSlot(op1.get()) && op2->IsConst() )
+		{
+		inst.op = ZOp(base + group + 1);
+		inst.v2 = Slot(op1.get());
+		inst.c = ZVal(op2->AsConstExpr()->ValuePtr(), op2->GetType());
+		}
+
+	else if ( op1->IsConst() && HasSlot(op2.get()) )
+		{
+		inst.op = ZOp(base + group + 2);
+		inst.v2 = Slot(op2.get());
+		inst.c = ZVal(op1->AsConstExpr()->ValuePtr(), t);
+		}
+
+	else
+		return false;
+
+	inst.e = e;
+	Emit(std::move(inst));
+
+	return true;
+	}
+
+bool ZAMCompiler::CompileUnary(int lhs, const Expr* e)
+	{
+	if ( e->Tag() != EXPR_NOT && e->Tag() != EXPR_NEGATE )
+		return false;
+
+	auto op = e->GetOp1();
+
+	if ( ! HasSlot(op.get()) ||
+	     op->GetType()->InternalType() != e->GetType()->InternalType() )
+		return false;
+
+	ZOp zop;
+
+	if ( e->Tag() == EXPR_NOT )
+		zop = OP_NOT_VV;
+	else if ( op->GetType()->InternalType() == TYPE_INTERNAL_INT )
+		zop = OP_NEGATE_I_VV;
+	else if ( op->GetType()->InternalType() == TYPE_INTERNAL_DOUBLE )
+		zop = OP_NEGATE_D_VV;
+	else
+		return false;
+
+	Emit(ZInst(zop, lhs, Slot(op.get())));
+
+	return true;
+	}
+
+bool ZAMCompiler::CompileField(int lhs, const Expr* e)
+	{
+	if ( e->Tag() != EXPR_FIELD )
+		return false;
+
+	auto rec = e->GetOp1();
+
+	if ( rec->Tag() != EXPR_NAME || HasSlot(rec.get()) )
+		return false;
+
+	auto id = rec->AsNameExpr()->Id();
+
+	if ( id->IsGlobal() )
+		return false;
+
+	ZOp zop;
+
+	switch ( typed_op_group(e->GetType()) ) {
+	case 0:	zop = OP_FIELD_I_VV; break;
+	case 3:	zop = OP_FIELD_U_VV; break;
+	case 6:	zop = OP_FIELD_D_VV; break;
+	default:
+		return false;
+	}
+
+	ZInst inst(zop, lhs, id->Offset(), e->AsFieldExpr()->Field());
+	inst.e = e;
+	inst.t = e->GetType();
+	inst.aux = SyncFor(e);
+	Emit(std::move(inst));
+
+	return true;
+	}
+
+int ZAMCompiler::CondSlot(const Expr* cond)
+	{
+	if ( HasSlot(cond) )
+		return Slot(cond);
+
+	int slot = NewScratch();
+
+	ZInst inst(OP_EVAL_TO_SLOT_V, slot);
+	inst.e = cond;
+	inst.t = cond->GetType();
+	inst.aux = SyncFor(cond);
+	Emit(std::move(inst));
+
+	return slot;
+	}
+
+bool ZAMCompiler::HasSlot(const ID* id) const
+	{
+	return ! id->IsGlobal() && slots.count(id->Offset()) > 0;
+	}
+
+bool ZAMCompiler::HasSlot(const Expr* e) const
+	{
+	return e->Tag() == EXPR_NAME && HasSlot(e->AsNameExpr()->Id());
+	}
+
+int ZAMCompiler::Slot(const Expr* e) const
+	{
+	return e->AsNameExpr()->Id()->Offset();
+	}
+
+ZInstAux* ZAMCompiler::SyncFor(const Stmt* s)
+	{
+	LocalsCollector lc;
+	s->Traverse(&lc);
+
+	std::set<int> used;
+	std::set<int> assigned;
+
+	for ( auto id : lc.uses )
+		if ( HasSlot(id) )
+			used.insert(id->Offset());
+
+	for ( auto id : lc.defs )
+		if ( HasSlot(id) && ! used.count(id->Offset()) )
+			assigned.insert(id->Offset());
+
+	return NewAux(used, assigned);
+	}
+
+ZInstAux* ZAMCompiler::SyncFor(const Expr* e)
+	{
+	LocalsCollector lc;
+	e->Traverse(&lc);
+
+	std::set<int> used;
+
+	for ( auto id : lc.uses )
+		if ( HasSlot(id) )
+			used.insert(id->Offset());
+
+	return NewAux(used, {});
+	}
+
+ZInstAux* ZAMCompiler::NewAux(const std::set<int>& used, const std::set<int>& assigned)
+	{
+	auto aux = std::make_unique<ZInstAux>();
+
+	for ( auto slot : used )
+		aux->sync.emplace_back(slot, slots[slot]);
+
+	for ( auto slot : assigned )
+		aux->defs.emplace_back(slot, slots[slot]);
+
+	auxes.push_back(std::move(aux));
+	return auxes.back().get();
+	}
+
+int ZAMCompiler::Emit(ZInst inst)
+	{
+	insts.push_back(std::move(inst));
+	return insts.size() - 1;
+	}
+
+int ZAMCompiler::NewScratch()
+	{
+	return frame_size + num_scratch++;
+	}
+
+ZAMCompiler::LoopInfo* ZAMCompiler::CurrentLoop()
+	{
+	if ( loops.empty() || loops.back().barrier )
+		return nullptr;
+
+	return &loops.back();
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,118 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Compiles reduced function bodies into ZAM instructions.
+//
+// Locals of types with a plain low-level representation - bool, int,
+// enum, count, port, double, time and interval - live in slots indexed
+// by their frame offset, and the compiler generates type-specialized
+// instructions for assignments to them, arithmetic on them, comparisons,
+// conditionals and loops.  All other values remain in the frame, and
+// statements and expressions the compiler doesn't handle natively get
+// executed by the AST interpreter, with the locals they use copied
+// between slots and frame around them.
+
+#pragma once
+
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "zeek/Func.h"
+#include "zeek/script_opt/DefSetsMgr.h"
+#include "zeek/script_opt/ZBody.h"
+
+namespace zeek::detail {
+
+class ZAMCompiler {
+public:
+	// The body needs to be in reduced form, and the function's frame
+	// size needs to reflect it. The reaching definitions tell which
+	// locals may get used before they're assigned.
+	ZAMCompiler(ScriptFunc* f, StmtPtr body, const DefSetsMgr* mgr);
+
+	IntrusivePtr<ZBody> Compile();
+
+protected:
+	// Determines which locals get a slot.
+	void FindSlots();
+
+	void CompileStmt(const Stmt* s);
+	void CompileStmtList(const StmtList* sl);
+	void CompileExprStmt(const ExprStmt* s);
+	void CompileIf(const IfStmt* s);
+	void CompileWhile(const WhileStmt* s);
+	void CompileNext(const Stmt* s);
+	void CompileBreak(const Stmt* s);
+	void CompileReturn(const ReturnStmt* s);
+	void CompileCatchReturn(const CatchReturnStmt* s);
+	void CompileInit(const InitStmt* s);
+
+	// Has the AST interpreter execute the statement.
+	void CompileFallback(const Stmt* s);
+
+	// Generates code for assigning the given expression to the given
+	// local.  Returns false if the assignment needs to be left to
+	// the AST interpreter.
+	bool CompileAssign(const ID* lhs, const Expr* rhs);
+
+	// Helpers for CompileAssign() for the various sorts of expressions
+	// we compile natively, returning false if the expression isn't one
+	// of those after all.
+	bool CompileBinary(int lhs, const Expr* e);
+	bool CompileUnary(int lhs, const Expr* e);
+	bool CompileField(int lhs, const Expr* e);
+
+	// Returns a slot holding the value of the given condition,
+	// evaluating it if needed.
+	int CondSlot(const Expr* cond);
+
+	// Whether the given local/expression lives in a slot.
+	bool HasSlot(const ID* id) const;
+	bool HasSlot(const Expr* e) const;
+	int Slot(const Expr* e) const;
+
+	// Returns the auxiliary information an instruction needs for the
+	// AST interpreter to run the given statement or expression.
+	ZInstAux* SyncFor(const Stmt* s);
+	ZInstAux* SyncFor(const Expr* e);
+	ZInstAux* NewAux(const std::set<int>& used, const std::set<int>& assigned);
+
+	int Emit(ZInst inst);
+	int NewScratch();
+
+	// Where next/break in the innermost loop go.  Loops inside
+	// inlined function bodies are separate from the loops around the
+	// body, so those start out with a barrier.
+	struct LoopInfo {
+		bool barrier = false;
+		int top = -1;
+		std::vector<std::pair<int, int ZInst::*>> breaks;
+	};
+
+	// Where returns within an inlined function body go.
+	struct CatchInfo {
+		const ID* ret_var = nullptr;
+		std::vector<std::pair<int, int ZInst::*>> exits;
+	};
+
+	LoopInfo* CurrentLoop();
+
+	ScriptFunc* func;
+	StmtPtr body;
+	const DefSetsMgr* mgr;
+
+	std::vector<ZInst> insts;
+	std::vector<std::unique_ptr<ZInstAux>> auxes;
+
+	// The types of the locals that get slots, indexed by frame offset.
+	std::unordered_map<int, TypePtr> slots;
+
+	int frame_size;
+	int num_scratch = 0;
+
+	std::vector<LoopInfo> loops;
+	std::vector<CatchInfo> catches;
+};
+
+} // namespace zeek::detail
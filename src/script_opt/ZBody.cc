@@ -0,0 +1,420 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/script_opt/ZBody.h"
+
+#include "zeek/Desc.h"
+#include "zeek/Expr.h"
+#include "zeek/Frame.h"
+#include "zeek/Reporter.h"
+#include "zeek/Traverse.h"
+
+// With GCC and clang, each operation jumps straight to the next one
+// through a table of label addresses ("threaded" dispatch), which keeps
+// the branch predictor far better informed than a single switch does.
+#ifdef __GNUC__
+#define ZAM_THREADED_DISPATCH
+#endif
+
+namespace zeek::detail {
+
+const char* ZOpName(ZOp op)
+	{
+	static const char* names[] = {
+#define ZAM_OP_NAME(name) #name,
+		ZAM_OPS(ZAM_OP_NAME)
+#undef ZAM_OP_NAME
+	};
+
+	if ( op < 0 || op >= NUM_ZOPS )
+		return "<bad op>";
+
+	return names[op];
+	}
+
+// Copies the locals held in slots that the AST interpreter is going to
+// use into the frame.  The compiler only puts locals into slots that are
+// assigned before any use, so these all hold proper values, and locals
+// that may get used beforehand remain unset in the frame.  Locals that
+// are only getting assigned are cleared, to tell whether they were.
+static void sync_to_frame(const ZInstAux* aux, const ZVal* slots, Frame* f)
+	{
+	for ( const auto& [slot, t] : aux->sync )
+		f->SetElement(slot, slots[slot].ToVal(t));
+
+	for ( const auto& [slot, t] : aux->defs )
+		f->SetElement(slot, nullptr);
+	}
+
+// The reverse, for after the interpreter ran.  Locals it left unset
+// keep their previous values.
+static void sync_from_frame(const ZInstAux* aux, ZVal* slots, Frame* f)
+	{
+	for ( const auto& [slot, t] : aux->sync )
+		if ( const auto& v = f->GetElement(slot) )
+			slots[slot] = ZVal(v, t);
+
+	for ( const auto& [slot, t] : aux->defs )
+		if ( const auto& v = f->GetElement(slot) )
+			slots[slot] = ZVal(v, t);
+	}
+
+static void eval_to_slot(const ZInst* pc, ZVal* slots, Frame* f)
+	{
+	sync_to_frame(pc->aux, slots, f);
+
+	// As for AssignExpr, a missing value leaves the target unchanged.
+	if ( auto v = pc->e->Eval(f) )
+		slots[pc->v1] = ZVal(std::move(v), pc->t);
+	}
+
+// Executes a statement using the AST interpreter, and maps the resulting
+// control flow onto the compiled code.  Returns the instruction to
+// continue with, or -1 if the body is done, with *flow* and *result*
+// set accordingly.
+static int exec_stmt(const ZInst* pc, int next, ZVal* slots, Frame* f,
+                     StmtFlowType& flow, ValPtr& result)
+	{
+	sync_to_frame(pc->aux, slots, f);
+
+	StmtFlowType s_flow = FLOW_NEXT;
+	result = pc->s->Exec(f, s_flow);
+
+	sync_from_frame(pc->aux, slots, f);
+
+	if ( f->HasDelayed() )
+		{
+		flow = s_flow;
+		return -1;
+		}
+
+	switch ( s_flow ) {
+	case FLOW_RETURN:
+		if ( pc->v3 < 0 )
+			break;
+
+		// A return from an inlined function body.
+		if ( pc->aux->ret_slot >= 0 )
+			{
+			if ( result )
+				slots[pc->aux->ret_slot] = ZVal(result, pc->aux->ret_type);
+			}
+
+		else if ( pc->aux->ret_frame >= 0 )
+			f->SetElement(pc->aux->ret_frame, result);
+
+		result = nullptr;
+		return pc->v3;
+
+	case FLOW_LOOP:
+		if ( pc->v1 < 0 )
+			break;
+
+		return pc->v1;
+
+	case FLOW_BREAK:
+		if ( pc->v2 < 0 )
+			break;
+
+		return pc->v2;
+
+	default:
+		return next;
+	}
+
+	// Control flow that leaves the body: a return, or a "break"
+	// ending a hook handler.
+	flow = s_flow;
+	return -1;
+	}
+
+ZBody::ZBody(std::string _func_name, StmtPtr _orig_body,
+             std::vector<ZInst> _insts,
+             std::vector<std::unique_ptr<ZInstAux>> _auxes,
+             std::vector<std::pair<int, TypePtr>> _params, int _num_slots)
+	: Stmt(STMT_ZAM), func_name(std::move(_func_name)),
+	  orig_body(std::move(_orig_body)), insts(std::move(_insts)),
+	  auxes(std::move(_auxes)), params(std::move(_params)),
+	  num_slots(_num_slots)
+	{
+	SetOriginal(orig_body);
+	}
+
+ValPtr ZBody::Exec(Frame* f, StmtFlowType& flow)
+	{
+	RegisterAccess();
+	flow = FLOW_NEXT;
+
+	// Most bodies get by with few enough slots to keep them on the stack.
+	constexpr int NUM_STACK_SLOTS = 64;
+	ZVal stack_slots[NUM_STACK_SLOTS];
+	std::unique_ptr<ZVal[]> heap_slots;
+	ZVal* slots = stack_slots;
+
+	if ( num_slots > NUM_STACK_SLOTS )
+		{
+		heap_slots = std::make_unique<ZVal[]>(num_slots);
+		slots = heap_slots.get();
+		}
+
+	for ( const auto& [slot, t] : params )
+		if ( const auto& v = f->GetElement(slot) )
+			slots[slot] = ZVal(v, t);
+
+	const ZInst* start = insts.data();
+	const ZInst* pc = start;
+
+	// The operations don't keep objects with destructors around
+	// themselves, so the jumps between them don't skip any cleanup.
+	// What they need to pass back goes here.
+	ValPtr result;
+
+#ifdef ZAM_THREADED_DISPATCH
+	static const void* const labels[] = {
+#define ZAM_OP_LABEL(name) &&L_OP_##name,
+		ZAM_OPS(ZAM_OP_LABEL)
+#undef ZAM_OP_LABEL
+	};
+
+#define OP(name) L_##name:
+#define DISPATCH() goto *labels[pc->op]
+#else
+#define OP(name) case name:
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT() do { ++pc; DISPATCH(); } while ( 0 )
+#define JUMP(target) do { pc = start + (target); DISPATCH(); } while ( 0 )
+
+#define ZAM_BINARY_OP(name, T, field, rfield, op, check) \
+	OP(OP_##name##_##T##_VVV) \
+		{ \
+		auto b = slots[pc->v3].field; \
+		check; \
+		slots[pc->v1].rfield = slots[pc->v2].field op b; \
+		NEXT(); \
+		} \
+	OP(OP_##name##_##T##_VVC) \
+		{ \
+		auto b = pc->c.field; \
+		check; \
+		slots[pc->v1].rfield = slots[pc->v2].field op b; \
+		NEXT(); \
+		} \
+	OP(OP_##name##_##T##_VCV) \
+		{ \
+		auto b = slots[pc->v2].field; \
+		check; \
+		slots[pc->v1].rfield = pc->c.field op b; \
+		NEXT(); \
+		}
+
+#define ZAM_ARITH_OP(name, op, check) \
+	ZAM_BINARY_OP(name, I, int_val, int_val, op, check) \
+	ZAM_BINARY_OP(name, U, uint_val, uint_val, op, check) \
+	ZAM_BINARY_OP(name, D, double_val, double_val, op, check)
+
+#define ZAM_COMPARISON_OP(name, op) \
+	ZAM_BINARY_OP(name, I, int_val, int_val, op, ) \
+	ZAM_BINARY_OP(name, U, uint_val, int_val, op, ) \
+	ZAM_BINARY_OP(name, D, double_val, int_val, op, )
+
+#define ZAM_ZERO_CHECK(msg) \
+	if ( b == 0 ) \
+		reporter->ExprRuntimeError(pc->e, "%s", msg)
+
+#define ZAM_FIELD_OP(T, field, val_type) \
+	OP(OP_FIELD_##T##_VV) \
+		{ \
+		const auto& rv = f->GetElement(pc->v2); \
+		if ( rv && rv->AsRecordVal()->HasField(pc->v3) ) \
+			slots[pc->v1].field = rv->AsRecordVal()->GetFieldAs<val_type>(pc->v3); \
+		else \
+			/* Let the interpreter deal with &default or the error. */ \
+			eval_to_slot(pc, slots, f); \
+		NEXT(); \
+		}
+
+#ifdef ZAM_THREADED_DISPATCH
+	DISPATCH();
+#else
+dispatch:
+	switch ( pc->op ) {
+#endif
+
+	OP(OP_ASSIGN_VV)
+		{
+		slots[pc->v1] = slots[pc->v2];
+		NEXT();
+		}
+
+	OP(OP_ASSIGN_VC)
+		{
+		slots[pc->v1] = pc->c;
+		NEXT();
+		}
+
+	ZAM_ARITH_OP(ADD, +, )
+	ZAM_ARITH_OP(SUB, -, )
+	ZAM_ARITH_OP(MUL, *, )
+	ZAM_ARITH_OP(DIV, /, ZAM_ZERO_CHECK("division by zero"))
+
+	ZAM_BINARY_OP(MOD, I, int_val, int_val, %, ZAM_ZERO_CHECK("modulo by zero"))
+	ZAM_BINARY_OP(MOD, U, uint_val, uint_val, %, ZAM_ZERO_CHECK("modulo by zero"))
+
+	ZAM_COMPARISON_OP(LT, <)
+	ZAM_COMPARISON_OP(LE, <=)
+	ZAM_COMPARISON_OP(EQ, ==)
+	ZAM_COMPARISON_OP(NE, !=)
+
+	OP(OP_NOT_VV)
+		{
+		slots[pc->v1].int_val = ! slots[pc->v2].int_val;
+		NEXT();
+		}
+
+	OP(OP_NEGATE_I_VV)
+		{
+		slots[pc->v1].int_val = - slots[pc->v2].int_val;
+		NEXT();
+		}
+
+	OP(OP_NEGATE_D_VV)
+		{
+		slots[pc->v1].double_val = - slots[pc->v2].double_val;
+		NEXT();
+		}
+
+	ZAM_FIELD_OP(I, int_val, IntVal)
+	ZAM_FIELD_OP(U, uint_val, CountVal)
+	ZAM_FIELD_OP(D, double_val, DoubleVal)
+
+	OP(OP_EVAL_TO_SLOT_V)
+		{
+		eval_to_slot(pc, slots, f);
+		NEXT();
+		}
+
+	OP(OP_EVAL_TO_FRAME)
+		{
+		sync_to_frame(pc->aux, slots, f);
+
+		if ( (result = pc->e->Eval(f)) )
+			f->SetElement(pc->v1, std::move(result));
+
+		NEXT();
+		}
+
+	OP(OP_IF_FALSE_VJ)
+		{
+		if ( ! slots[pc->v1].int_val )
+			JUMP(pc->v2);
+
+		NEXT();
+		}
+
+	OP(OP_GOTO_J)
+		{
+		JUMP(pc->v1);
+		}
+
+	OP(OP_EXEC_STMT)
+		{
+		int target = exec_stmt(pc, pc - start + 1, slots, f, flow, result);
+
+		if ( target < 0 )
+			return result;
+
+		JUMP(target);
+		}
+
+	OP(OP_HOOK_BREAK)
+		{
+		flow = FLOW_BREAK;
+		return nullptr;
+		}
+
+	OP(OP_RETURN_V)
+		{
+		flow = FLOW_RETURN;
+		return slots[pc->v1].ToVal(pc->t);
+		}
+
+	OP(OP_RETURN_EVAL)
+		{
+		sync_to_frame(pc->aux, slots, f);
+		flow = FLOW_RETURN;
+		return pc->e->Eval(f);
+		}
+
+	OP(OP_RETURN_VOID)
+		{
+		flow = FLOW_RETURN;
+		return nullptr;
+		}
+
+	OP(OP_END)
+		{
+		return nullptr;
+		}
+
+#ifndef ZAM_THREADED_DISPATCH
+	default:
+		reporter->InternalError("bad ZAM operation %d", int(pc->op));
+	}
+#endif
+
+#undef ZAM_FIELD_OP
+#undef ZAM_ZERO_CHECK
+#undef ZAM_COMPARISON_OP
+#undef ZAM_ARITH_OP
+#undef ZAM_BINARY_OP
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#undef OP
+	}
+
+StmtPtr ZBody::Duplicate()
+	{
+	return orig_body->Duplicate();
+	}
+
+void ZBody::Dump() const
+	{
+	printf("ZAM code for %s (%d slots):\n", func_name.c_str(), num_slots);
+
+	for ( size_t i = 0; i < insts.size(); ++i )
+		{
+		const auto& inst = insts[i];
+
+		printf("%zu: %s %d %d %d", i, ZOpName(inst.op),
+		       inst.v1, inst.v2, inst.v3);
+
+		if ( inst.e )
+			printf(" (%s)", obj_desc(inst.e).c_str());
+		else if ( inst.s )
+			printf(" (%s)", obj_desc(inst.s).c_str());
+
+		printf("\n");
+		}
+	}
+
+void ZBody::StmtDescribe(ODesc* d) const
+	{
+	// Describe what the body does, rather than how.
+	orig_body->Describe(d);
+	}
+
+TraversalCode ZBody::Traverse(TraversalCallback* cb) const
+	{
+	TraversalCode tc = cb->PreStmt(this);
+	HANDLE_TC_STMT_PRE(tc);
+
+	tc = orig_body->Traverse(cb);
+	HANDLE_TC_STMT_PRE(tc);
+
+	tc = cb->PostStmt(this);
+	HANDLE_TC_STMT_POST(tc);
+	}
+
+} // namespace zeek::detail
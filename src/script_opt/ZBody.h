@@ -0,0 +1,59 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// A function body compiled to ZAM instructions.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zeek/Stmt.h"
+#include "zeek/script_opt/ZInst.h"
+
+namespace zeek::detail {
+
+class ZBody : public Stmt {
+public:
+	// The original body is what the instructions refer to for
+	// statements and expressions they hand off to the AST interpreter,
+	// and what we describe and traverse.
+	ZBody(std::string func_name, StmtPtr orig_body,
+	      std::vector<ZInst> insts,
+	      std::vector<std::unique_ptr<ZInstAux>> auxes,
+	      std::vector<std::pair<int, TypePtr>> params, int num_slots);
+
+	ValPtr Exec(Frame* f, StmtFlowType& flow) override;
+
+	const StmtPtr& OrigBody() const	{ return orig_body; }
+
+	// Compiled bodies are only created after inlining, so there's
+	// no need to duplicate them; this returns a copy of the original
+	// body instead.
+	StmtPtr Duplicate() override;
+
+	// Prints the instructions to stdout.
+	void Dump() const;
+
+	void StmtDescribe(ODesc* d) const override;
+
+	TraversalCode Traverse(TraversalCallback* cb) const override;
+
+protected:
+	std::string func_name;
+	StmtPtr orig_body;
+
+	std::vector<ZInst> insts;
+	std::vector<std::unique_ptr<ZInstAux>> auxes;
+
+	// The parameters held in slots, which get loaded from the frame
+	// upon entry.
+	std::vector<std::pair<int, TypePtr>> params;
+
+	// Slots are the function's frame offsets plus any scratch slots
+	// the compiler needed.
+	int num_slots;
+};
+
+} // namespace zeek::detail
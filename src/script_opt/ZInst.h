@@ -0,0 +1,112 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Instructions for the ZAM ("Zeek Abstract Machine") register machine that
+// executes compiled function bodies.
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "zeek/Val.h"
+
+namespace zeek::detail {
+
+class Expr;
+class Stmt;
+
+// The operations.  Their operands are given by a suffix: "V" for a slot
+// (register), "C" for a constant, and "J" for a jump target, in the order
+// v1, v2, v3 (skipping over the constant, which lives separately).  The
+// first V of an operation that has a result is where the result goes.
+// The type-specialized operations have an infix of "I" for signed
+// integers (bool, int, enum), "U" for unsigned ones (count, port) and "D"
+// for doubles (double, time, interval).
+
+#define ZAM_TYPED_OPS(X, name, T) \
+	X(name##_##T##_VVV) X(name##_##T##_VVC) X(name##_##T##_VCV)
+
+#define ZAM_NUMERIC_OPS(X, name) \
+	ZAM_TYPED_OPS(X, name, I) ZAM_TYPED_OPS(X, name, U) ZAM_TYPED_OPS(X, name, D)
+
+#define ZAM_OPS(X) \
+	X(ASSIGN_VV) X(ASSIGN_VC) \
+	ZAM_NUMERIC_OPS(X, ADD) \
+	ZAM_NUMERIC_OPS(X, SUB) \
+	ZAM_NUMERIC_OPS(X, MUL) \
+	ZAM_NUMERIC_OPS(X, DIV) \
+	ZAM_TYPED_OPS(X, MOD, I) ZAM_TYPED_OPS(X, MOD, U) \
+	ZAM_NUMERIC_OPS(X, LT) \
+	ZAM_NUMERIC_OPS(X, LE) \
+	ZAM_NUMERIC_OPS(X, EQ) \
+	ZAM_NUMERIC_OPS(X, NE) \
+	X(NOT_VV) X(NEGATE_I_VV) X(NEGATE_D_VV) \
+	X(FIELD_I_VV) X(FIELD_U_VV) X(FIELD_D_VV) \
+	X(EVAL_TO_SLOT_V) X(EVAL_TO_FRAME) \
+	X(IF_FALSE_VJ) X(GOTO_J) \
+	X(EXEC_STMT) \
+	X(HOOK_BREAK) \
+	X(RETURN_V) X(RETURN_EVAL) X(RETURN_VOID) \
+	X(END)
+
+enum ZOp {
+#define ZAM_OP_ENUM(name) OP_##name,
+	ZAM_OPS(ZAM_OP_ENUM)
+#undef ZAM_OP_ENUM
+	NUM_ZOPS
+};
+
+extern const char* ZOpName(ZOp op);
+
+// Auxiliary information for the operations that hand off to the AST
+// interpreter, which needs to see the values of the locals held in slots.
+struct ZInstAux {
+	// The slots of the locals whose values the AST uses, along with
+	// their types, which are copied into the frame beforehand and back
+	// out of it afterwards.
+	std::vector<std::pair<int, TypePtr>> sync;
+
+	// The same for locals that a statement only assigns. These get
+	// cleared in the frame beforehand, and copied back out of it
+	// afterwards if the statement did assign them.
+	std::vector<std::pair<int, TypePtr>> defs;
+
+	// If the statement is within an inlined function body, where the
+	// value of a "return" goes: a slot if ret_slot is set, otherwise
+	// the frame element ret_frame (if that's set).
+	int ret_slot = -1;
+	int ret_frame = -1;
+	TypePtr ret_type;
+};
+
+struct ZInst {
+	ZInst(ZOp _op, int _v1 = 0, int _v2 = 0, int _v3 = 0)
+		: op(_op), v1(_v1), v2(_v2), v3(_v3)
+		{}
+
+	ZOp op;
+
+	// Slots, jump targets, or (for EXEC_STMT) -1 for absent jump
+	// targets.  For the FIELD operations, v2 is a frame element
+	// and v3 the field's offset.  For EVAL_TO_FRAME, v1 is a
+	// frame element.
+	int v1, v2, v3;
+
+	// The constant operand, if any.
+	ZVal c;
+
+	// The type of the value in v1, for operations that need to
+	// convert it to a Val.
+	TypePtr t;
+
+	// The expression the operation stems from, for run-time errors,
+	// or that it evaluates.
+	const Expr* e = nullptr;
+
+	// For EXEC_STMT, the statement to execute.
+	Stmt* s = nullptr;
+
+	ZInstAux* aux = nullptr;
+};
+
+} // namespace zeek::detail
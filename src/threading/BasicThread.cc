@@ -13,6 +13,21 @@ static const int STD_FMT_BUF_LEN = 2048;
 
 uint64_t BasicThread::thread_counter = 0;
 
+namespace {
+
+struct FmtBuffer {
+	char* buf = nullptr;
+	unsigned int len = 0;
+
+	~FmtBuffer()	{ free(buf); }
+};
+
+// Fmt()'s buffer for helper threads.
+thread_local FmtBuffer helper_fmt_buffer;
+thread_local bool is_helper_thread = false;
+
+}
+
 BasicThread::BasicThread()
 	{
 	started = false;
@@ -50,32 +65,40 @@ void BasicThread::SetOSName(const char* arg_name)
 	util::detail::set_thread_name(arg_name, thread.native_handle());
 	}
 
+void BasicThread::SetHelperThread()
+	{
+	is_helper_thread = true;
+	}
+
 const char* BasicThread::Fmt(const char* format, ...)
 	{
-	if ( buf_len > 10 * STD_FMT_BUF_LEN )
+	char*& b = is_helper_thread ? helper_fmt_buffer.buf : buf;
+	unsigned int& b_len = is_helper_thread ? helper_fmt_buffer.len : buf_len;
+
+	if ( ! b || b_len > 10 * STD_FMT_BUF_LEN )
 		{
 		// Shrink back to normal.
-		buf = (char*) util::safe_realloc(buf, STD_FMT_BUF_LEN);
-		buf_len = STD_FMT_BUF_LEN;
+		b = (char*) util::safe_realloc(b, STD_FMT_BUF_LEN);
+		b_len = STD_FMT_BUF_LEN;
 		}
 
 	va_list al;
 	va_start(al, format);
-	int n = vsnprintf(buf, buf_len, format, al);
+	int n = vsnprintf(b, b_len, format, al);
 	va_end(al);
 
-	if ( (unsigned int) n >= buf_len )
+	if ( (unsigned int) n >= b_len )
 		{ // Not enough room, grow the buffer.
-		buf_len = n + 32;
-		buf = (char*) util::safe_realloc(buf, buf_len);
+		b_len = n + 32;
+		b = (char*) util::safe_realloc(b, b_len);
 
 		// Is it portable to restart?
 		va_start(al, format);
-		n = vsnprintf(buf, buf_len, format, al);
+		n = vsnprintf(b, b_len, format, al);
 		va_end(al);
 		}
 
-	return buf;
+	return b;
 	}
 
 const char* BasicThread::Strerror(int err)
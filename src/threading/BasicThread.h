@@ -116,10 +116,19 @@ public:
 	 * A version of zeek::util::fmt() that the thread can safely use.
 	 *
 	 * This is safe to call from Run() but must not be used from any
-	 * other thread than the current one.
+	 * other thread than the current one, except for helper threads
+	 * that have called SetHelperThread().
 	 */
 	const char* Fmt(const char* format, ...)  __attribute__((format(printf, 2, 3)));;
 
+	/**
+	 * Marks the calling OS thread as a helper that works on behalf of a
+	 * thread, e.g., to parallelize parsing its input. Fmt() then formats
+	 * into a buffer of the helper's own when called from it, so that it
+	 * can be used concurrently with the thread.
+	 */
+	static void SetHelperThread();
+
 	/**
 	 * A version of strerror() that the thread can safely use. This is
 	 * essentially a wrapper around strerror_r(). Note that it keeps a
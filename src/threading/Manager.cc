@@ -2,6 +2,7 @@
 
 #include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
 
 #include "zeek/NetVar.h"
 #include "zeek/iosource/Manager.h"
@@ -275,4 +276,25 @@ const threading::Manager::msg_stats_list& threading::Manager::GetMsgThreadStats(
 	return stats;
 	}
 
+threading::Manager::QueueStats threading::Manager::GetQueueStats()
+	{
+	QueueStats qs = {};
+
+	for ( msg_thread_list::iterator i = msg_threads.begin(); i != msg_threads.end(); i++ )
+		{
+		MsgThread::Stats s;
+		(*i)->GetStats(&s);
+
+		qs.pending += s.pending_in + s.pending_out;
+
+		qs.num_full += s.queue_in_stats.num_full + s.queue_out_stats.num_full;
+		qs.num_wakeups += s.queue_in_stats.num_wakeups + s.queue_out_stats.num_wakeups;
+		qs.max_pending = std::max({qs.max_pending,
+		                            s.queue_in_stats.max_pending,
+		                            s.queue_out_stats.max_pending});
+		}
+
+	return qs;
+	}
+
 } // namespace zeek::threading
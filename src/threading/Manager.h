@@ -74,6 +74,25 @@ public:
 	 */
 	const msg_stats_list& GetMsgThreadStats();
 
+	/**
+	 * Statistics about the message queues of all MsgThread instances,
+	 * in both directions.
+	 */
+	struct QueueStats
+		{
+		uint64_t pending;	//! Number of messages not yet processed.
+		uint64_t num_full;	//! Number of times a queue's ring buffer was full.
+		uint64_t max_pending;	//! Maximum number of messages queued in a queue when it was full.
+		uint64_t num_wakeups;	//! Number of times a blocked thread had to be woken up.
+		};
+
+	/**
+	 * Returns statistics about the message queues, summed up over all
+	 * current MsgThread instances. Frequently full queues mean that
+	 * threads can't keep up with their input.
+	 */
+	QueueStats GetQueueStats();
+
 	/**
 	 * Returns the number of currently active threads. This counts all
 	 * threads that are not yet joined, includingt any potentially in
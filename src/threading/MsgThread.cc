@@ -3,12 +3,15 @@
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <thread>
 
 #include "zeek/DebugLogger.h"
 #include "zeek/threading/Manager.h"
 #include "zeek/iosource/Manager.h"
 #include "zeek/RunState.h"
 
+#include "zeek/3rdparty/doctest.h"
+
 // Set by Zeek's main signal handler.
 extern int signal_val;
 
@@ -207,6 +210,7 @@ MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullp
 	child_finished = false;
 	child_sent_finish = false;
 	failed = false;
+	output_time_slice = 0;
 	thread_mgr->AddMsgThread(this);
 
 	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
@@ -381,11 +385,14 @@ void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
 		return;
 		}
 
-	queue_out.Put(msg);
+	bool signal = queue_out.Put(msg);
 
 	++cnt_sent_out;
 
-	flare.Fire();
+	// The main thread asks for the next signal only once it has
+	// processed the messages of the previous one.
+	if ( signal )
+		flare.Fire();
 	}
 
 void MsgThread::SendEvent(const char* name, const int num_vals, Value* *vals)
@@ -469,6 +476,9 @@ void MsgThread::Process()
 	{
 	flare.Extinguish();
 
+	double deadline = output_time_slice > 0 ? util::current_time(true) + output_time_slice : 0;
+	uint64_t processed = 0;
+
 	while ( HasOut() )
 		{
 		Message* msg = RetrieveOut();
@@ -481,7 +491,57 @@ void MsgThread::Process()
 			}
 
 		delete msg;
+
+		// Most messages take less time than checking the clock. The
+		// queue signals us again for the ones left.
+		if ( deadline && ++processed % 64 == 0 && util::current_time(true) > deadline )
+			break;
 		}
+
+	if ( queue_out.RequestSignal() )
+		flare.Fire();
+	}
+
+TEST_CASE("threading queue")
+	{
+	// A small ring, so that the writer outpaces the reader.
+	Queue<int*> q(nullptr, nullptr, 8);
+	const uintptr_t n = 100000;
+
+	std::thread reader([&q, n]()
+		{
+		for ( uintptr_t i = 1; i <= n; )
+			{
+			if ( int* p = q.Get() )
+				{
+				if ( reinterpret_cast<uintptr_t>(p) != i )
+					break;
+
+				++i;
+				}
+			}
+		});
+
+	for ( uintptr_t i = 1; i <= n; ++i )
+		q.Put(reinterpret_cast<int*>(i));
+
+	reader.join();
+
+	Queue<int*>::Stats stats;
+	q.GetStats(&stats);
+	CHECK(stats.num_writes == n);
+	CHECK(stats.num_reads == n);
+	CHECK(q.Size() == 0);
+	CHECK(! q.Ready());
+
+	// The writer signals once per request, and the reader needs to
+	// signal itself if there's been input before its request.
+	CHECK(! q.RequestSignal());
+	CHECK(q.Put(reinterpret_cast<int*>(1)));
+	CHECK(! q.Put(reinterpret_cast<int*>(2)));
+	CHECK(q.RequestSignal());
+	CHECK(! q.Put(reinterpret_cast<int*>(3)));
+	CHECK(q.Size() == 3);
 	}
 
 } // namespace zeek::threading
@@ -203,6 +203,15 @@ public:
 	 */
 	void GetStats(Stats* stats);
 
+	/**
+	 * Limits the time the main thread spends on processing the thread's
+	 * messages in one go. Any messages left wait for the next round of
+	 * the main loop. By default, all queued messages get processed.
+	 *
+	 * @param secs The limit in seconds, or zero for none.
+	 */
+	void SetOutputTimeSlice(double secs)	{ output_time_slice = secs; }
+
 	/**
 	 * Overridden from iosource::IOSource.
 	 */
@@ -343,6 +352,8 @@ private:
 	bool child_sent_finish; // Child thread asked to be finished.
 	bool failed;	// Set to true when a command failed.
 
+	double output_time_slice;	// Limit for processing output in one go, or zero.
+
 	zeek::detail::Flare flare;
 };
 
@@ -2,13 +2,14 @@
 
 #include <mutex>
 #include <condition_variable>
-#include <queue>
-#include <deque>
+#include <atomic>
+#include <thread>
 #include <stdint.h>
 #include <sys/time.h>
 
 #include "zeek/Reporter.h"
 #include "zeek/threading/BasicThread.h"
+#include "zeek/threading/SPSCRing.h"
 
 #undef Queue // Defined elsewhere unfortunately.
 
@@ -17,13 +18,17 @@ namespace zeek::threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * Elements pass through a lock-free ring buffer. If the reader falls so
+ * far behind that the ring fills up, the writer chains another ring to
+ * it and continues there, so it never blocks; the reader releases rings
+ * it has drained. The reader only sleeps, and the writer only wakes it,
+ * once the queue has run empty, so that a busy reader doesn't cost the
+ * writer any system calls.
  *
- * All Queue instances must be instantiated by Bro's main thread.
+ * The element type must be a pointer, with null indicating that there
+ * was nothing to retrieve.
  *
- * TODO: Unclear how critical performance is for this qeueue. We could likely
- * optimize it further if helpful.
+ * All Queue instances must be instantiated by Bro's main thread.
  */
 template<typename T>
 class Queue
@@ -35,8 +40,11 @@ public:
 	 * reader, writer: The corresponding threads. This is for checking
 	 * whether they have terminated so that we can abort I/O opeations.
 	 * Can be left null for the main thread.
+	 *
+	 * capacity: The size of each ring buffer.
 	 */
-	Queue(BasicThread* arg_reader, BasicThread* arg_writer);
+	Queue(BasicThread* arg_reader, BasicThread* arg_writer,
+	      size_t capacity = DEFAULT_CAPACITY);
 
 	/**
 	 * Destructor.
@@ -52,24 +60,24 @@ public:
 
 	/**
 	 * Queues one element.
+	 *
+	 * @return True if the reader has asked to be signaled through
+	 * RequestSignal(). The caller then needs to do so, by whatever means
+	 * the reader waits with.
 	 */
-	void Put(T data);
+	bool Put(T data);
 
 	/**
-	 * Returns true if the next Get() operation will succeed.
+	 * Returns true if the next Get() operation will succeed. Must only
+	 * be called by the reader.
 	 */
 	bool Ready();
 
 	/**
-	 * Returns true if the next Get() operation might succeed. This
-	 * function may occasionally return a value not indicating the actual
-	 * state, but won't do so very often. Note that this means that it can
-	 * consistently return false even if there is something in the Queue.
-	 * You have to check real queue status from time to time to be sure that
-	 * it is empty. In other words, this method helps to avoid locking the queue
-	 * frequently, but doesn't allow you to forgo it completely.
+	 * Returns true if the next Get() operation might succeed. As checking
+	 * doesn't need locking anymore, this is the same as Ready().
 	 */
-	bool MaybeReady() { return (num_reads != num_writes); }
+	bool MaybeReady() { return Ready(); }
 
 	/**
 	 * Wake up the reader if it's currently blocked for input. This is
@@ -77,6 +85,19 @@ public:
 	 */
 	void WakeUp();
 
+	/**
+	 * For readers that wait for input by other means than Get(), asks
+	 * for the next Put() to return true, so that the writer signals the
+	 * reader. It does so only once per request, which batches up the
+	 * signals while the reader is busy. Must only be called by the
+	 * reader.
+	 *
+	 * @return True if elements have been queued meanwhile whose Put()
+	 * may have missed the request. The reader then needs to signal
+	 * itself.
+	 */
+	bool RequestSignal();
+
 	/**
 	 * Returns the number of queued items not yet retrieved.
 	 */
@@ -89,6 +110,9 @@ public:
 		{
 		uint64_t num_reads;	//! Number of messages read from the queue.
 		uint64_t num_writes;	//! Number of messages written to the queue.
+		uint64_t num_full;	//! Number of times the writer found the ring buffer full.
+		uint64_t max_pending;	//! Maximum number of queued messages when it did.
+		uint64_t num_wakeups;	//! Number of times the writer woke up a blocked reader.
 		};
 
 	/**
@@ -99,24 +123,43 @@ public:
 	 */
 	void GetStats(Stats* stats);
 
+	static const size_t DEFAULT_CAPACITY = 4096;
+
 private:
-	static const int NUM_QUEUES = 8;
+	// How often Get() checks for input before blocking.
+	static const int SPIN_ROUNDS = 64;
+
+	struct Segment {
+		explicit Segment(size_t capacity) : ring(capacity)	{ }
+
+		SPSCRing<T> ring;
+		std::atomic<Segment*> next{nullptr};	// Set once the writer has moved on.
+	};
+
+	// Retrieves the next element, or null if there's none.
+	T Pop();
 
-	std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+	size_t capacity;
 
-	std::mutex mutex[NUM_QUEUES];	// Mutex protected shared accesses.
-	std::condition_variable has_data[NUM_QUEUES];	// Signals when data becomes available
-	std::queue<T> messages[NUM_QUEUES];	// Actually holds the queued messages
+	Segment* read_seg;	// Owned by the reader.
+	Segment* write_seg;	// Owned by the writer.
 
-	int read_ptr;	// Where the next operation will read from
-	int write_ptr;	// Where the next operation will write to
+	std::mutex mutex;	// For blocking in Get().
+	std::condition_variable has_data;	// Signals when data becomes available.
+	std::atomic<bool> reader_waiting{false};	// True while blocking in Get().
+	bool wakeup = false;	// Set by WakeUp(), protected by mutex.
+
+	std::atomic<bool> signal_requested{true};
 
 	BasicThread* reader;
 	BasicThread* writer;
 
 	// Statistics.
-	uint64_t num_reads;
-	uint64_t num_writes;
+	std::atomic<uint64_t> num_reads{0};
+	std::atomic<uint64_t> num_writes{0};
+	std::atomic<uint64_t> num_full{0};
+	std::atomic<uint64_t> max_pending{0};
+	std::atomic<uint64_t> num_wakeups{0};
 };
 
 inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
@@ -133,12 +176,18 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
 		}
 	}
 
+// Counters are only ever updated by one thread, so they don't need an
+// atomic read-modify-write.
+inline static void bump_counter(std::atomic<uint64_t>& c)
+	{
+	c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
 template<typename T>
-inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer, size_t arg_capacity)
 	{
-	read_ptr = 0;
-	write_ptr = 0;
-	num_reads = num_writes = 0;
+	capacity = arg_capacity;
+	read_seg = write_seg = new Segment(capacity);
 	reader = arg_reader;
 	writer = arg_writer;
 	}
@@ -146,119 +195,151 @@ inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
 template<typename T>
 inline Queue<T>::~Queue()
 	{
+	while ( read_seg )
+		{
+		Segment* next = read_seg->next.load(std::memory_order_relaxed);
+		delete read_seg;
+		read_seg = next;
+		}
 	}
 
 template<typename T>
-inline T Queue<T>::Get()
+inline T Queue<T>::Pop()
 	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	T data = nullptr;
 
-	int old_read_ptr = read_ptr;
-
-	if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+	while ( ! read_seg->ring.Pop(&data) )
 		{
-		if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-			return nullptr;
-		}
+		Segment* next = read_seg->next.load(std::memory_order_acquire);
 
-	if ( messages[read_ptr].empty() )
-		return nullptr;
+		if ( ! next )
+			return nullptr;
 
-	T data = messages[read_ptr].front();
-	messages[read_ptr].pop();
+		// The writer doesn't touch the segment anymore once it has
+		// linked the next one, but it may have filled it up right
+		// before.
+		if ( read_seg->ring.Pop(&data) )
+			break;
 
-	read_ptr = (read_ptr + 1) % NUM_QUEUES;
-	++num_reads;
+		delete read_seg;
+		read_seg = next;
+		}
 
+	bump_counter(num_reads);
 	return data;
 	}
 
 template<typename T>
-inline void Queue<T>::Put(T data)
+inline bool Queue<T>::Ready()
 	{
-	auto lock = acquire_lock(mutex[write_ptr]);
+	return ! read_seg->ring.Empty() || read_seg->next.load(std::memory_order_acquire);
+	}
 
-	int old_write_ptr = write_ptr;
+template<typename T>
+inline T Queue<T>::Get()
+	{
+	// Before going to sleep, give the writer a moment: when messages
+	// arrive in quick succession, that's much cheaper than having it
+	// wake us up for each of them.
+	for ( int i = 0; i < SPIN_ROUNDS; i++ )
+		{
+		if ( T data = Pop() )
+			return data;
 
-	bool need_signal = messages[write_ptr].empty();
+		std::this_thread::yield();
+		}
 
-	messages[write_ptr].push(data);
+	if ( (reader && reader->Killed()) || (writer && writer->Killed()) )
+		return nullptr;
 
-	write_ptr = (write_ptr + 1) % NUM_QUEUES;
-	++num_writes;
+	auto lock = acquire_lock(mutex);
 
-	if ( need_signal )
-		{
-		lock.unlock();
-		has_data[old_write_ptr].notify_one();
-		}
-	}
+	// Pairs with the fence in Put(): either the writer sees us waiting,
+	// or we see its data.
+	reader_waiting.store(true);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
 
+	bool ready = has_data.wait_for(lock, std::chrono::seconds(5),
+	                               [this]() { return wakeup || Ready(); });
 
-template<typename T>
-inline bool Queue<T>::Ready()
-	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	reader_waiting.store(false, std::memory_order_relaxed);
+	wakeup = false;
+	lock.unlock();
 
-	bool ret = (messages[read_ptr].size());
+	if ( ! ready )
+		return nullptr;
 
-	return ret;
+	return Pop();
 	}
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues()
+inline bool Queue<T>::Put(T data)
 	{
-	std::vector<std::unique_lock<std::mutex>> locks;
+	// Count before queueing, so that Size() can't see the read first.
+	bump_counter(num_writes);
 
-	try
+	if ( ! write_seg->ring.Push(std::move(data)) )
 		{
-		for ( int i = 0; i < NUM_QUEUES; i++ )
-			locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
+		// The reader is falling behind. Rather than waiting for it,
+		// continue in a new segment.
+		Segment* seg = new Segment(capacity);
+		seg->ring.Push(std::move(data));
+		write_seg->next.store(seg, std::memory_order_release);
+		write_seg = seg;
+
+		bump_counter(num_full);
+
+		uint64_t pending = Size();
+
+		if ( pending > max_pending.load(std::memory_order_relaxed) )
+			max_pending.store(pending, std::memory_order_relaxed);
 		}
 
-	catch ( const std::system_error& e )
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( reader_waiting.load(std::memory_order_relaxed) )
 		{
-		reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-		// Never gets here.
-		throw std::exception();
+		auto lock = acquire_lock(mutex);
+		has_data.notify_one();
+		bump_counter(num_wakeups);
 		}
 
-	return locks;
+	return signal_requested.load(std::memory_order_relaxed) && signal_requested.exchange(false);
 	}
 
 template<typename T>
-inline uint64_t Queue<T>::Size()
+inline bool Queue<T>::RequestSignal()
 	{
-	// Need to lock all queues.
-	auto locks = LocksForAllQueues();
-
-	uint64_t size = 0;
+	signal_requested.store(true);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
 
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		size += messages[i].size();
+	return Ready() && signal_requested.exchange(false);
+	}
 
-	return size;
+template<typename T>
+inline uint64_t Queue<T>::Size()
+	{
+	// Read the reads first, so that we can't end up with more of them.
+	uint64_t reads = num_reads.load(std::memory_order_acquire);
+	return num_writes.load(std::memory_order_acquire) - reads;
 	}
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats)
 	{
-	// To be safe, we look all queues. That's probably unneccessary, but
-	// doesn't really hurt.
-	auto locks = LocksForAllQueues();
-
-	stats->num_reads = num_reads;
-	stats->num_writes = num_writes;
+	stats->num_reads = num_reads.load(std::memory_order_relaxed);
+	stats->num_writes = num_writes.load(std::memory_order_relaxed);
+	stats->num_full = num_full.load(std::memory_order_relaxed);
+	stats->max_pending = max_pending.load(std::memory_order_relaxed);
+	stats->num_wakeups = num_wakeups.load(std::memory_order_relaxed);
 	}
 
 template<typename T>
 inline void Queue<T>::WakeUp()
 	{
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		{
-		auto lock = acquire_lock(mutex[i]);
-		has_data[i].notify_all();
-		}
+	auto lock = acquire_lock(mutex);
+	wakeup = true;
+	has_data.notify_all();
 	}
 
 } // namespace zeek::threading
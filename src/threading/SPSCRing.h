@@ -0,0 +1,117 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace zeek::threading {
+
+/**
+ * A bounded, lock-free queue connecting exactly one producer thread with
+ * exactly one consumer thread.
+ *
+ * The capacity is rounded up to a power of two. Each side keeps a private
+ * copy of the other side's position and only reloads the shared one once
+ * the ring looks full (or empty, respectively), so that in the common case
+ * the two threads don't contend for the same cache lines.
+ */
+template<typename T>
+class SPSCRing {
+public:
+	explicit SPSCRing(size_t capacity)
+		{
+		size_t n = 1;
+
+		while ( n < capacity )
+			n <<= 1;
+
+		slots = std::make_unique<T[]>(n);
+		mask = n - 1;
+		}
+
+	SPSCRing(const SPSCRing&) = delete;
+	SPSCRing& operator=(const SPSCRing&) = delete;
+
+	/**
+	 * Appends an element. Must only be called by the producer.
+	 *
+	 * @return False if the ring is full, in which case the element is
+	 * left alone.
+	 */
+	bool Push(T&& v)
+		{
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		if ( t - cached_head > mask )
+			{
+			cached_head = head.load(std::memory_order_acquire);
+
+			if ( t - cached_head > mask )
+				return false;
+			}
+
+		slots[t & mask] = std::move(v);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+		}
+
+	bool Push(const T& v)
+		{
+		T tmp(v);
+		return Push(std::move(tmp));
+		}
+
+	/**
+	 * Removes the oldest element. Must only be called by the consumer.
+	 *
+	 * @return False if the ring is empty.
+	 */
+	bool Pop(T* v)
+		{
+		size_t h = head.load(std::memory_order_relaxed);
+
+		if ( h == cached_tail )
+			{
+			cached_tail = tail.load(std::memory_order_acquire);
+
+			if ( h == cached_tail )
+				return false;
+			}
+
+		*v = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+		}
+
+	/**
+	 * Returns the number of elements currently queued. When called by
+	 * either side while the other one is active, the result is only a
+	 * snapshot.
+	 */
+	size_t Size() const
+		{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+	bool Empty() const	{ return Size() == 0; }
+	size_t Capacity() const	{ return mask + 1; }
+
+private:
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+
+	std::unique_ptr<T[]> slots;
+	size_t mask;
+
+	// Consumer side.
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};
+	size_t cached_tail = 0;
+
+	// Producer side.
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+	size_t cached_head = 0;
+};
+
+} // namespace zeek::threading
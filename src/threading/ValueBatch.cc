@@ -0,0 +1,655 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/ValueBatch.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::threading {
+
+using namespace value_batch;
+
+static void put_varint(std::string* out, uint64_t v)
+	{
+	while ( v >= 0x80 )
+		{
+		out->push_back(static_cast<char>((v & 0x7f) | 0x80));
+		v >>= 7;
+		}
+
+	out->push_back(static_cast<char>(v));
+	}
+
+static void put_fixed(std::string* out, uint64_t v, int n)
+	{
+	for ( int i = 0; i < n; ++i )
+		out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+	}
+
+static uint64_t get_fixed(const char* p, int n)
+	{
+	uint64_t v = 0;
+
+	for ( int i = 0; i < n; ++i )
+		v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+
+	return v;
+	}
+
+static void put_string(std::string* out, const char* data, size_t len)
+	{
+	put_varint(out, len);
+	out->append(data, len);
+	}
+
+static void put_addr(std::string* out, const Value::addr_t& a)
+	{
+	if ( a.family == IPv4 )
+		{
+		out->push_back(4);
+		out->append(reinterpret_cast<const char*>(&a.in.in4), sizeof(a.in.in4));
+		}
+	else
+		{
+		out->push_back(6);
+		out->append(reinterpret_cast<const char*>(&a.in.in6), sizeof(a.in.in6));
+		}
+	}
+
+static void put_value(std::string* out, const Value* v, TypeTag type, TypeTag subtype)
+	{
+	if ( ! v->present )
+		{
+		out->push_back(0);
+		return;
+		}
+
+	out->push_back(1);
+
+	switch ( type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		put_varint(out, (static_cast<uint64_t>(v->val.int_val) << 1) ^
+		                static_cast<uint64_t>(v->val.int_val >> 63));
+		break;
+
+	case TYPE_COUNT:
+		put_varint(out, v->val.uint_val);
+		break;
+
+	case TYPE_PORT:
+		put_varint(out, v->val.port_val.port);
+		out->push_back(static_cast<char>(v->val.port_val.proto));
+		break;
+
+	case TYPE_ADDR:
+		put_addr(out, v->val.addr_val);
+		break;
+
+	case TYPE_SUBNET:
+		put_addr(out, v->val.subnet_val.prefix);
+		out->push_back(static_cast<char>(v->val.subnet_val.length));
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		{
+		uint64_t d;
+		memcpy(&d, &v->val.double_val, sizeof(d));
+		put_fixed(out, d, 8);
+		break;
+		}
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		put_string(out, v->val.string_val.data, v->val.string_val.length);
+		break;
+
+	case TYPE_PATTERN:
+		put_string(out, v->val.pattern_text_val, strlen(v->val.pattern_text_val));
+		break;
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		// Sets and vectors share the same layout.
+		put_varint(out, v->val.set_val.size);
+
+		for ( bro_int_t i = 0; i < v->val.set_val.size; ++i )
+			put_value(out, v->val.set_val.vals[i], subtype, TYPE_VOID);
+
+		break;
+
+	default:
+		// Not loggable.
+		break;
+	}
+	}
+
+ValueBatchSchema::ValueBatchSchema(int num_fields, const Field* const* fields)
+	{
+	// FNV-1a, as the ID needs to be the same across processes.
+	id = 0xcbf29ce484222325;
+
+	auto add = [this](const char* p, size_t n)
+		{
+		for ( size_t i = 0; i < n; ++i )
+			{
+			id ^= static_cast<uint8_t>(p[i]);
+			id *= 0x100000001b3;
+			}
+		};
+
+	types.reserve(num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		const Field* f = fields[i];
+		char t[2] = {static_cast<char>(f->type), static_cast<char>(f->subtype)};
+
+		add(f->name, strlen(f->name) + 1);
+		add(t, sizeof(t));
+		types.emplace_back(f->type, f->subtype);
+		}
+	}
+
+ValueBatchEncoder::ValueBatchEncoder(std::shared_ptr<const ValueBatchSchema> arg_schema)
+	: schema(std::move(arg_schema))
+	{
+	Reset();
+	}
+
+void ValueBatchEncoder::Reset()
+	{
+	buf.clear();
+	buf.push_back(static_cast<char>(MAGIC));
+	buf.push_back(static_cast<char>(FORMAT_VERSION));
+	put_fixed(&buf, schema->ID(), 8);
+	put_varint(&buf, schema->NumFields());
+
+	// The row count gets filled in at the end.
+	rows_offset = buf.size();
+	put_fixed(&buf, 0, 4);
+	num_rows = 0;
+	}
+
+void ValueBatchEncoder::Add(const Value* const* vals)
+	{
+	for ( int i = 0; i < schema->NumFields(); ++i )
+		put_value(&buf, vals[i], schema->Type(i), schema->Subtype(i));
+
+	++num_rows;
+	}
+
+std::string ValueBatchEncoder::Finish()
+	{
+	for ( int i = 0; i < 4; ++i )
+		buf[rows_offset + i] = static_cast<char>((num_rows >> (8 * i)) & 0xff);
+
+	std::string rval = std::move(buf);
+	Reset();
+	return rval;
+	}
+
+namespace {
+
+// Bounds-checked access to a batch.
+class Input {
+public:
+	Input(const char* arg_data, size_t arg_len, size_t arg_pos)
+		: data(arg_data), len(arg_len), pos(arg_pos)	{ }
+
+	size_t Pos() const	{ return pos; }
+	size_t Left() const	{ return len - pos; }
+
+	bool Byte(uint8_t* b)
+		{
+		if ( pos >= len )
+			return false;
+
+		*b = static_cast<uint8_t>(data[pos++]);
+		return true;
+		}
+
+	bool Varint(uint64_t* v)
+		{
+		*v = 0;
+
+		for ( int shift = 0; shift < 64; shift += 7 )
+			{
+			uint8_t b;
+
+			if ( ! Byte(&b) )
+				return false;
+
+			*v |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+			if ( ! (b & 0x80) )
+				return true;
+			}
+
+		return false;
+		}
+
+	bool Raw(size_t n, const char** p)
+		{
+		if ( n > Left() )
+			return false;
+
+		*p = data + pos;
+		pos += n;
+		return true;
+		}
+
+	bool Fixed(int n, uint64_t* v)
+		{
+		const char* p;
+
+		if ( ! Raw(n, &p) )
+			return false;
+
+		*v = get_fixed(p, n);
+		return true;
+		}
+
+	bool String(const char** p, size_t* n)
+		{
+		uint64_t l;
+
+		if ( ! Varint(&l) || ! Raw(l, p) )
+			return false;
+
+		*n = l;
+		return true;
+		}
+
+private:
+	const char* data;
+	size_t len;
+	size_t pos;
+};
+
+} // namespace
+
+static bool get_addr(Input* in, Value::addr_t* a)
+	{
+	uint8_t family;
+	const char* p;
+
+	if ( ! in->Byte(&family) )
+		return false;
+
+	if ( family == 4 )
+		{
+		if ( ! in->Raw(sizeof(a->in.in4), &p) )
+			return false;
+
+		a->family = IPv4;
+		memcpy(&a->in.in4, p, sizeof(a->in.in4));
+		return true;
+		}
+
+	if ( family == 6 )
+		{
+		if ( ! in->Raw(sizeof(a->in.in6), &p) )
+			return false;
+
+		a->family = IPv6;
+		memcpy(&a->in.in6, p, sizeof(a->in.in6));
+		return true;
+		}
+
+	return false;
+	}
+
+static char* alloc_bytes(size_t n, ValueAllocator* alloc)
+	{
+	return alloc ? alloc->AllocBytes(n) : new char[n];
+	}
+
+// Decodes a value. It's marked present only once its data is in place,
+// so that it's safe to delete even on failure.
+static bool get_value(Input* in, Value* v, TypeTag type, TypeTag subtype, ValueAllocator* alloc)
+	{
+	uint8_t present;
+
+	v->type = type;
+	v->subtype = subtype;
+	v->present = false;
+
+	if ( ! in->Byte(&present) )
+		return false;
+
+	if ( ! present )
+		return true;
+
+	switch ( type ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+		{
+		uint64_t u;
+
+		if ( ! in->Varint(&u) )
+			return false;
+
+		v->val.int_val = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+		break;
+		}
+
+	case TYPE_COUNT:
+		if ( ! in->Varint(&v->val.uint_val) )
+			return false;
+
+		break;
+
+	case TYPE_PORT:
+		{
+		uint64_t port;
+		uint8_t proto;
+
+		if ( ! (in->Varint(&port) && in->Byte(&proto)) || proto > TRANSPORT_ICMP )
+			return false;
+
+		v->val.port_val.port = port;
+		v->val.port_val.proto = static_cast<TransportProto>(proto);
+		break;
+		}
+
+	case TYPE_ADDR:
+		if ( ! get_addr(in, &v->val.addr_val) )
+			return false;
+
+		break;
+
+	case TYPE_SUBNET:
+		if ( ! (get_addr(in, &v->val.subnet_val.prefix) &&
+		        in->Byte(&v->val.subnet_val.length)) )
+			return false;
+
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		{
+		uint64_t d;
+
+		if ( ! in->Fixed(8, &d) )
+			return false;
+
+		memcpy(&v->val.double_val, &d, sizeof(d));
+		break;
+		}
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		{
+		const char* p;
+		size_t n;
+
+		if ( ! in->String(&p, &n) || n > INT_MAX )
+			return false;
+
+		v->val.string_val.data = alloc_bytes(n, alloc);
+		v->val.string_val.length = n;
+		memcpy(v->val.string_val.data, p, n);
+		break;
+		}
+
+	case TYPE_PATTERN:
+		{
+		const char* p;
+		size_t n;
+
+		if ( ! in->String(&p, &n) )
+			return false;
+
+		char* text = alloc_bytes(n + 1, alloc);
+		memcpy(text, p, n);
+		text[n] = '\0';
+		v->val.pattern_text_val = text;
+		break;
+		}
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		{
+		uint64_t n;
+
+		// Each element takes at least one byte.
+		if ( ! in->Varint(&n) || n > in->Left() )
+			return false;
+
+		Value** elems;
+
+		if ( alloc )
+			elems = alloc->AllocValues(n);
+		else
+			{
+			elems = new Value*[n];
+
+			for ( uint64_t i = 0; i < n; ++i )
+				elems[i] = new Value();
+			}
+
+		v->val.set_val.vals = elems;
+		v->val.set_val.size = n;
+		v->present = true;
+
+		for ( uint64_t i = 0; i < n; ++i )
+			{
+			if ( ! get_value(in, elems[i], subtype, TYPE_VOID, alloc) )
+				return false;
+			}
+
+		return true;
+		}
+
+	default:
+		return false;
+	}
+
+	v->present = true;
+	return true;
+	}
+
+bool ValueBatchDecoder::Start(const char* arg_data, size_t arg_len)
+	{
+	data = arg_data;
+	len = arg_len;
+	num_rows = next_row = 0;
+
+	Input in(data, len, 0);
+	uint8_t magic;
+	uint8_t version;
+	uint64_t id;
+	uint64_t num_fields;
+	uint64_t rows;
+
+	if ( ! (in.Byte(&magic) && in.Byte(&version)) || magic != MAGIC )
+		return Fail("not a value batch");
+
+	if ( version != FORMAT_VERSION )
+		return Fail(util::fmt("unsupported value batch version %d", version));
+
+	if ( ! (in.Fixed(8, &id) && in.Varint(&num_fields) && in.Fixed(4, &rows)) )
+		return Fail("truncated value batch header");
+
+	if ( id != schema.ID() || num_fields != static_cast<uint64_t>(schema.NumFields()) )
+		return Fail("value batch has a different schema");
+
+	pos = in.Pos();
+	num_rows = rows;
+	return true;
+	}
+
+bool ValueBatchDecoder::Next(Value** vals, ValueAllocator* alloc)
+	{
+	if ( next_row >= num_rows )
+		return false;
+
+	Input in(data, len, pos);
+
+	for ( int i = 0; i < schema.NumFields(); ++i )
+		{
+		if ( ! get_value(&in, vals[i], schema.Type(i), schema.Subtype(i), alloc) )
+			{
+			// Don't leave uninitialized values behind.
+			for ( int j = i + 1; j < schema.NumFields(); ++j )
+				{
+				vals[j]->type = schema.Type(j);
+				vals[j]->present = false;
+				}
+
+			num_rows = next_row;
+			return Fail(util::fmt("invalid value for field %d", i));
+			}
+		}
+
+	pos = in.Pos();
+	++next_row;
+	return true;
+	}
+
+bool ValueBatchDecoder::Fail(const std::string& msg)
+	{
+	error = msg;
+	return false;
+	}
+
+TEST_SUITE_BEGIN("ValueBatch");
+
+TEST_CASE("value batch round trip")
+	{
+	Field f_ts("ts", nullptr, TYPE_TIME, TYPE_VOID, false);
+	Field f_host("host", nullptr, TYPE_ADDR, TYPE_VOID, false);
+	Field f_name("name", nullptr, TYPE_STRING, TYPE_VOID, true);
+	Field f_num("num", nullptr, TYPE_INT, TYPE_VOID, false);
+	Field f_tags("tags", nullptr, TYPE_TABLE, TYPE_STRING, false);
+	const Field* fields[] = {&f_ts, &f_host, &f_name, &f_num, &f_tags};
+
+	auto schema = std::make_shared<ValueBatchSchema>(5, fields);
+	ValueBatchEncoder enc(schema);
+
+	char tag[] = "x";
+	const int num_rows = 200;
+
+	for ( int i = 0; i < num_rows; ++i )
+		{
+		Value ts(TYPE_TIME);
+		ts.val.double_val = 1300475167 + double(i) / 3;
+
+		Value host(TYPE_ADDR);
+		host.val.addr_val.family = IPv4;
+		host.val.addr_val.in.in4.s_addr = htonl(0x0a000000 + i);
+
+		Value name(TYPE_STRING, i % 10 != 0);
+		name.val.string_val.data = tag;
+		name.val.string_val.length = 1;
+
+		Value num(TYPE_INT);
+		num.val.int_val = -i * 1000;
+
+		Value elem(TYPE_STRING);
+		elem.val.string_val.data = tag;
+		elem.val.string_val.length = 1;
+		Value* elems[] = {&elem};
+
+		Value tags(TYPE_TABLE, TYPE_STRING);
+		tags.val.set_val.size = i % 2;
+		tags.val.set_val.vals = elems;
+
+		const Value* vals[] = {&ts, &host, &name, &num, &tags};
+		enc.Add(vals);
+
+		// The values don't own their data.
+		name.present = elem.present = tags.present = false;
+		}
+
+	CHECK(enc.NumRows() == num_rows);
+	std::string data = enc.Finish();
+	CHECK(enc.NumRows() == 0);
+	CHECK(ValueBatchDecoder::IsBatch(data.data(), data.size()));
+
+	ValueBatchDecoder dec(*schema);
+	REQUIRE(dec.Start(data.data(), data.size()));
+	REQUIRE(dec.NumRows() == num_rows);
+
+	for ( int i = 0; i < num_rows; ++i )
+		{
+		Value* row[5];
+
+		for ( auto& v : row )
+			v = new Value();
+
+		REQUIRE(dec.Next(row));
+		CHECK(row[0]->val.double_val == 1300475167 + double(i) / 3);
+		CHECK(ntohl(row[1]->val.addr_val.in.in4.s_addr) == uint32_t(0x0a000000 + i));
+		CHECK(row[2]->present == (i % 10 != 0));
+		CHECK(row[3]->val.int_val == -i * 1000);
+		CHECK(row[4]->type == TYPE_TABLE);
+		CHECK(row[4]->val.set_val.size == i % 2);
+
+		if ( row[2]->present )
+			CHECK(std::string(row[2]->val.string_val.data, row[2]->val.string_val.length) == "x");
+
+		for ( auto& v : row )
+			delete v;
+		}
+
+	Value* extra = new Value();
+	Value* row[] = {extra, extra, extra, extra, extra};
+	CHECK_FALSE(dec.Next(row));
+	delete extra;
+	}
+
+TEST_CASE("value batch errors")
+	{
+	Field f_a("a", nullptr, TYPE_STRING, TYPE_VOID, false);
+	Field f_b("b", nullptr, TYPE_STRING, TYPE_VOID, false);
+	const Field* fields_a[] = {&f_a};
+	const Field* fields_b[] = {&f_b};
+
+	auto schema_a = std::make_shared<ValueBatchSchema>(1, fields_a);
+	ValueBatchSchema schema_b(1, fields_b);
+	CHECK(schema_a->ID() != schema_b.ID());
+	CHECK(schema_a->ID() == ValueBatchSchema(1, fields_a).ID());
+
+	ValueBatchEncoder enc(schema_a);
+	char text[] = "some text";
+	Value v(TYPE_STRING);
+	v.val.string_val.data = text;
+	v.val.string_val.length = strlen(text);
+	const Value* vals[] = {&v};
+	enc.Add(vals);
+	enc.Add(vals);
+	v.present = false;
+
+	std::string data = enc.Finish();
+
+	ValueBatchDecoder dec_b(schema_b);
+	CHECK_FALSE(dec_b.Start(data.data(), data.size()));
+
+	// Truncated in the middle of the second record.
+	ValueBatchDecoder dec(*schema_a);
+	REQUIRE(dec.Start(data.data(), data.size() - 3));
+
+	Value* row[] = {new Value()};
+	CHECK(dec.Next(row));
+	delete row[0];
+
+	row[0] = new Value();
+	CHECK_FALSE(dec.Next(row));
+	CHECK_FALSE(row[0]->present);
+	delete row[0];
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::threading
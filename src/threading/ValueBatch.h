@@ -0,0 +1,190 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::threading {
+
+/**
+ * A compact binary encoding of a batch of records, for passing them
+ * between threads and nodes.
+ *
+ * The records' schema isn't part of a batch. Both sides need to know it
+ * already, and a batch carries only a hash identifying it:
+ *
+ *     batch = byte(MAGIC) byte(FORMAT_VERSION) u64(schema id)
+ *             varint(#fields) u32(#rows) row*
+ *     row   = value*	(one per field)
+ *     value = byte(present) [plain encoding, if present]
+ *
+ * Fixed-size integers are little-endian. The plain encodings are
+ * integers as varints (zig-zag for signed ones), doubles as their 8
+ * bytes, strings with a varint length, addresses as a byte 4 or 6 and
+ * the address in network order, subnets as their prefix and a byte with
+ * their length (unchanged, i.e., as the logging framework provides it),
+ * ports as a varint and a byte for the protocol, and sets and vectors as
+ * an element count followed by a value per element.
+ *
+ * The magic byte differs from the first byte of a Value::Write()
+ * serialization of a record, so that both can be told apart.
+ */
+namespace value_batch {
+
+constexpr uint8_t MAGIC = 0xfe;
+constexpr uint8_t FORMAT_VERSION = 1;
+
+}
+
+/**
+ * The schema of the records in a batch: their fields' types, along with
+ * an ID that's the same on all nodes for the same field names and types.
+ */
+class ValueBatchSchema {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of fields.
+	 *
+	 * @param fields The fields. The schema doesn't keep a reference to
+	 * them.
+	 */
+	ValueBatchSchema(int num_fields, const Field* const* fields);
+
+	uint64_t ID() const	{ return id; }
+	int NumFields() const	{ return types.size(); }
+	TypeTag Type(int i) const	{ return types[i].first; }
+	TypeTag Subtype(int i) const	{ return types[i].second; }
+
+private:
+	uint64_t id;
+	std::vector<std::pair<TypeTag, TypeTag>> types;
+};
+
+/**
+ * Where a decoder puts the data of the values it decodes. Without one,
+ * the data is allocated on the heap, so that deleting the values
+ * releases it.
+ */
+class ValueAllocator {
+public:
+	virtual ~ValueAllocator() = default;
+
+	/**
+	 * Allocates memory for a value's data.
+	 */
+	virtual char* AllocBytes(size_t n) = 0;
+
+	/**
+	 * Allocates elements for a set or vector value, returning an array
+	 * of pointers to them.
+	 */
+	virtual Value** AllocValues(size_t n) = 0;
+};
+
+/**
+ * Encodes records into a batch. Values are encoded as they're added, so
+ * the encoder doesn't keep references to them.
+ */
+class ValueBatchEncoder {
+public:
+	explicit ValueBatchEncoder(std::shared_ptr<const ValueBatchSchema> schema);
+
+	const std::shared_ptr<const ValueBatchSchema>& Schema() const	{ return schema; }
+
+	/**
+	 * Adds a record, with a value per field of the schema.
+	 */
+	void Add(const Value* const* vals);
+
+	/**
+	 * Returns the number of records added since the last Finish().
+	 */
+	uint32_t NumRows() const	{ return num_rows; }
+
+	/**
+	 * Returns the batch's current size in bytes.
+	 */
+	size_t Size() const	{ return buf.size(); }
+
+	/**
+	 * Returns the batch, and starts a new one.
+	 */
+	std::string Finish();
+
+private:
+	void Reset();
+
+	std::shared_ptr<const ValueBatchSchema> schema;
+	std::string buf;
+	size_t rows_offset = 0;
+	uint32_t num_rows = 0;
+};
+
+/**
+ * Decodes the records of a batch, one by one.
+ */
+class ValueBatchDecoder {
+public:
+	explicit ValueBatchDecoder(const ValueBatchSchema& schema) : schema(schema)	{ }
+
+	/**
+	 * Returns true if the data starts out like a batch.
+	 */
+	static bool IsBatch(const char* data, size_t len)
+		{ return len > 0 && static_cast<uint8_t>(data[0]) == value_batch::MAGIC; }
+
+	/**
+	 * Starts decoding a batch. Fails if it's for a different schema.
+	 *
+	 * @param data The batch, which must remain valid while decoding.
+	 *
+	 * @param len The length of *data*.
+	 */
+	bool Start(const char* data, size_t len);
+
+	/**
+	 * Returns the number of records in the batch being decoded.
+	 */
+	uint32_t NumRows() const	{ return num_rows; }
+
+	/**
+	 * Decodes the next record.
+	 *
+	 * @param vals Values to fill in, one per field of the schema. Their
+	 * previous content gets overwritten without releasing it. On
+	 * failure they may be partially filled in, but it's still safe to
+	 * delete them if the data has been allocated on the heap.
+	 *
+	 * @param alloc Where to allocate the values' data, or null for the
+	 * heap.
+	 *
+	 * @return False if there's no further record, or on error.
+	 */
+	bool Next(Value** vals, ValueAllocator* alloc = nullptr);
+
+	/**
+	 * Returns a description of the most recent failure.
+	 */
+	const std::string& Error() const	{ return error; }
+
+private:
+	bool Fail(const std::string& msg);
+
+	const ValueBatchSchema& schema;
+	const char* data = nullptr;
+	size_t len = 0;
+	size_t pos = 0;
+	uint32_t num_rows = 0;
+	uint32_t next_row = 0;
+	std::string error;
+};
+
+} // namespace zeek::threading
@@ -0,0 +1,1393 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek/threading/formatters/Columnar.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <zlib.h>
+#include <algorithm>
+
+#include "zeek/3rdparty/doctest.h"
+
+namespace zeek::threading::formatter::columnar {
+
+// Upper bound for a row group's decompressed size, as a sanity check
+// when reading.
+static constexpr uint64_t MAX_PAYLOAD = uint64_t(1) << 32;
+
+static void put_varint(std::string* out, uint64_t v)
+	{
+	while ( v >= 0x80 )
+		{
+		out->push_back(static_cast<char>((v & 0x7f) | 0x80));
+		v >>= 7;
+		}
+
+	out->push_back(static_cast<char>(v));
+	}
+
+static size_t varint_len(uint64_t v)
+	{
+	size_t n = 1;
+
+	for ( ; v >= 0x80; v >>= 7 )
+		++n;
+
+	return n;
+	}
+
+static uint64_t zigzag(int64_t v)
+	{
+	return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+	}
+
+static int64_t unzigzag(uint64_t v)
+	{
+	return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+
+static void put_u32(std::string* out, uint32_t v)
+	{
+	for ( int i = 0; i < 4; ++i )
+		out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+	}
+
+static void put_double(std::string* out, double d)
+	{
+	uint64_t v;
+	memcpy(&v, &d, sizeof(v));
+
+	for ( int i = 0; i < 8; ++i )
+		out->push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+	}
+
+static void put_string(std::string* out, const char* data, size_t len)
+	{
+	put_varint(out, len);
+	out->append(data, len);
+	}
+
+// Converts microseconds since the epoch back into a time the same way
+// packet timestamps are computed, so that those come out unchanged.
+static double ticks_to_time(int64_t ticks)
+	{
+	int64_t secs = ticks / 1000000;
+	int64_t usecs = ticks % 1000000;
+
+	if ( usecs < 0 )
+		{
+		usecs += 1000000;
+		--secs;
+		}
+
+	return secs + double(usecs) / 1e6;
+	}
+
+static bool time_to_ticks(double t, int64_t* ticks)
+	{
+	if ( ! (fabs(t) < 1e12) )
+		return false;
+
+	*ticks = llround(t * 1e6);
+	return ticks_to_time(*ticks) == t;
+	}
+
+// Returns true for the types we encode into a dictionary if that's
+// smaller.
+static bool is_dict_type(TypeTag t)
+	{
+	switch ( t ) {
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+	case TYPE_PORT:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+static bool is_scalar_type(TypeTag t)
+	{
+	switch ( t ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_COUNT:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+	case TYPE_PATTERN:
+		return true;
+
+	default:
+		return is_dict_type(t);
+	}
+	}
+
+static void put_addr(std::string* out, const Value::addr_t& a)
+	{
+	if ( a.family == IPv4 )
+		{
+		out->push_back(4);
+		out->append(reinterpret_cast<const char*>(&a.in.in4), sizeof(a.in.in4));
+		}
+	else
+		{
+		out->push_back(6);
+		out->append(reinterpret_cast<const char*>(&a.in.in6), sizeof(a.in.in6));
+		}
+	}
+
+// Appends the plain encoding of a value that's present.
+static void put_plain(std::string* out, const Value* v, TypeTag type)
+	{
+	switch ( type ) {
+	case TYPE_BOOL:
+		out->push_back(v->val.int_val ? 1 : 0);
+		break;
+
+	case TYPE_INT:
+		put_varint(out, zigzag(v->val.int_val));
+		break;
+
+	case TYPE_COUNT:
+		put_varint(out, v->val.uint_val);
+		break;
+
+	case TYPE_PORT:
+		put_varint(out, v->val.port_val.port);
+		out->push_back(static_cast<char>(v->val.port_val.proto));
+		break;
+
+	case TYPE_ADDR:
+		put_addr(out, v->val.addr_val);
+		break;
+
+	case TYPE_SUBNET:
+		{
+		// The logging framework gives IPv4 prefix lengths as for IPv6,
+		// while the input framework expects them as usual. We store the
+		// latter.
+		uint8_t length = v->val.subnet_val.length;
+
+		if ( v->val.subnet_val.prefix.family == IPv4 && length >= 96 )
+			length -= 96;
+
+		put_addr(out, v->val.subnet_val.prefix);
+		out->push_back(static_cast<char>(length));
+		break;
+		}
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		put_double(out, v->val.double_val);
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		put_string(out, v->val.string_val.data, v->val.string_val.length);
+		break;
+
+	case TYPE_PATTERN:
+		put_string(out, v->val.pattern_text_val, strlen(v->val.pattern_text_val));
+		break;
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		{
+		// Sets and vectors share the same layout.
+		put_varint(out, v->val.set_val.size);
+
+		for ( bro_int_t i = 0; i < v->val.set_val.size; ++i )
+			{
+			const Value* elem = v->val.set_val.vals[i];
+			out->push_back(elem->present ? 1 : 0);
+
+			if ( elem->present )
+				put_plain(out, elem, v->subtype);
+			}
+
+		break;
+		}
+
+	default:
+		// Rejected by the Encoder's constructor.
+		assert(false);
+	}
+	}
+
+class Encoder::Column {
+public:
+	explicit Column(const Field* f) : type(f->type), subtype(f->subtype)	{ }
+
+	void Add(const Value* v, uint64_t row);
+	void Finish(std::string* out);
+	size_t Size() const;
+
+private:
+	void Clear();
+
+	TypeTag type;
+	TypeTag subtype;
+
+	// Bitmap of the rows with a value.
+	std::string present;
+	bool has_nulls = false;
+	uint64_t num_values = 0;
+
+	// Plain encodings, or for bools, a bitmap of their values.
+	std::string plain;
+
+	// For the types that may use a dictionary, the distinct plain
+	// encodings and, for each value, its index.
+	std::unordered_map<std::string, uint64_t> dict;
+	std::vector<const std::string*> dict_entries;
+	std::vector<uint64_t> indices;
+	size_t dict_bytes = 0;	// Size of the encoded dictionary.
+	size_t index_bytes = 0;	// Size of the encoded indices.
+	size_t plain_bytes = 0;	// Size of the values if not using the dictionary.
+
+	std::vector<double> times;
+
+	std::string scratch;
+};
+
+void Encoder::Column::Add(const Value* v, uint64_t row)
+	{
+	if ( row % 8 == 0 )
+		present.push_back(0);
+
+	if ( ! v->present )
+		{
+		has_nulls = true;
+		return;
+		}
+
+	present.back() |= (1 << (row % 8));
+
+	if ( type == TYPE_BOOL )
+		{
+		if ( num_values % 8 == 0 )
+			plain.push_back(0);
+
+		if ( v->val.int_val )
+			plain.back() |= (1 << (num_values % 8));
+		}
+
+	else if ( type == TYPE_TIME )
+		times.push_back(v->val.double_val);
+
+	else if ( is_dict_type(type) )
+		{
+		scratch.clear();
+		put_plain(&scratch, v, type);
+
+		auto [it, inserted] = dict.emplace(scratch, dict_entries.size());
+
+		if ( inserted )
+			{
+			dict_entries.push_back(&it->first);
+			dict_bytes += scratch.size();
+			}
+
+		indices.push_back(it->second);
+		index_bytes += varint_len(it->second);
+		plain_bytes += scratch.size();
+		}
+
+	else
+		put_plain(&plain, v, type);
+
+	++num_values;
+	}
+
+size_t Encoder::Column::Size() const
+	{
+	return present.size() + plain.size() + dict_bytes + index_bytes + times.size() * 8;
+	}
+
+void Encoder::Column::Finish(std::string* out)
+	{
+	out->push_back(has_nulls ? CHUNK_HAS_NULLS : 0);
+
+	if ( has_nulls )
+		out->append(present);
+
+	if ( type == TYPE_TIME )
+		{
+		std::vector<int64_t> ticks(times.size());
+		bool exact = true;
+
+		for ( size_t i = 0; i < times.size() && exact; ++i )
+			exact = time_to_ticks(times[i], &ticks[i]);
+
+		if ( exact )
+			{
+			out->push_back(ENCODING_DELTA);
+			int64_t last = 0;
+
+			for ( auto t : ticks )
+				{
+				put_varint(out, zigzag(t - last));
+				last = t;
+				}
+			}
+		else
+			{
+			out->push_back(ENCODING_PLAIN);
+
+			for ( auto t : times )
+				put_double(out, t);
+			}
+		}
+
+	else if ( is_dict_type(type) )
+		{
+		size_t dict_size = varint_len(dict_entries.size()) + dict_bytes + index_bytes;
+
+		if ( dict_size < plain_bytes )
+			{
+			out->push_back(ENCODING_DICT);
+			put_varint(out, dict_entries.size());
+
+			for ( auto e : dict_entries )
+				out->append(*e);
+
+			for ( auto i : indices )
+				put_varint(out, i);
+			}
+		else
+			{
+			out->push_back(ENCODING_PLAIN);
+
+			for ( auto i : indices )
+				out->append(*dict_entries[i]);
+			}
+		}
+
+	else
+		{
+		out->push_back(ENCODING_PLAIN);
+		out->append(plain);
+		}
+
+	Clear();
+	}
+
+void Encoder::Column::Clear()
+	{
+	present.clear();
+	has_nulls = false;
+	num_values = 0;
+	plain.clear();
+	dict_entries.clear();
+	dict.clear();
+	indices.clear();
+	dict_bytes = index_bytes = plain_bytes = 0;
+	times.clear();
+	}
+
+Encoder::Encoder(int arg_num_fields, const Field* const* arg_fields)
+	: num_fields(arg_num_fields), fields(arg_fields)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		assert(IsSupportedType(fields[i]->type, fields[i]->subtype));
+		columns.emplace_back(new Column(fields[i]));
+		}
+	}
+
+bool Encoder::IsSupportedType(TypeTag type, TypeTag subtype)
+	{
+	if ( type == TYPE_TABLE || type == TYPE_VECTOR )
+		return is_scalar_type(subtype);
+
+	return is_scalar_type(type);
+	}
+
+Encoder::~Encoder()
+	{
+	}
+
+std::string Encoder::Header(const MetaData& meta) const
+	{
+	std::string out(MAGIC, MAGIC_LEN);
+	put_varint(&out, FORMAT_VERSION);
+	put_varint(&out, num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		put_string(&out, fields[i]->name, strlen(fields[i]->name));
+		out.push_back(static_cast<char>(fields[i]->type));
+		out.push_back(static_cast<char>(fields[i]->subtype));
+		out.push_back(fields[i]->optional ? 1 : 0);
+		}
+
+	put_varint(&out, meta.size());
+
+	for ( const auto& [key, value] : meta )
+		{
+		put_string(&out, key.data(), key.size());
+		put_string(&out, value.data(), value.size());
+		}
+
+	return out;
+	}
+
+void Encoder::Add(const Value* const* vals)
+	{
+	for ( int i = 0; i < num_fields; ++i )
+		columns[i]->Add(vals[i], num_rows);
+
+	++num_rows;
+	}
+
+size_t Encoder::BufferedBytes() const
+	{
+	size_t n = 0;
+
+	for ( const auto& c : columns )
+		n += c->Size();
+
+	return n;
+	}
+
+std::string Encoder::FinishRowGroup(int compression_level)
+	{
+	std::string raw;
+	std::string chunk;
+
+	for ( auto& c : columns )
+		{
+		chunk.clear();
+		c->Finish(&chunk);
+		put_string(&raw, chunk.data(), chunk.size());
+		}
+
+	std::string out;
+	out.push_back(BLOCK_ROW_GROUP);
+	put_varint(&out, num_rows);
+	num_rows = 0;
+
+	uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(raw.data()), raw.size());
+
+	if ( compression_level > 0 )
+		{
+		uLongf len = compressBound(raw.size());
+		std::string compressed(len, '\0');
+
+		if ( compress2(reinterpret_cast<Bytef*>(&compressed[0]), &len,
+		               reinterpret_cast<const Bytef*>(raw.data()), raw.size(),
+		               compression_level) == Z_OK &&
+		     len < raw.size() )
+			{
+			out.push_back(COMPRESSION_ZLIB);
+			put_varint(&out, raw.size());
+			put_varint(&out, len);
+			put_u32(&out, crc);
+			out.append(compressed.data(), len);
+			return out;
+			}
+		}
+
+	out.push_back(COMPRESSION_NONE);
+	put_varint(&out, raw.size());
+	put_varint(&out, raw.size());
+	put_u32(&out, crc);
+	out.append(raw);
+	return out;
+	}
+
+std::string Encoder::Footer(uint64_t num_row_groups, uint64_t num_total_rows) const
+	{
+	std::string out;
+	out.push_back(BLOCK_FOOTER);
+	put_varint(&out, num_row_groups);
+	put_varint(&out, num_total_rows);
+	return out;
+	}
+
+namespace {
+
+// Bounds-checked access to encoded data.
+class Input {
+public:
+	Input(const char* arg_data, size_t arg_len) : data(arg_data), len(arg_len)	{ }
+
+	size_t Pos() const	{ return pos; }
+	size_t Left() const	{ return len - pos; }
+	const char* Cur() const	{ return data + pos; }
+
+	bool Byte(uint8_t* b)
+		{
+		if ( pos >= len )
+			return false;
+
+		*b = static_cast<uint8_t>(data[pos++]);
+		return true;
+		}
+
+	bool Varint(uint64_t* v)
+		{
+		*v = 0;
+
+		for ( int shift = 0; shift < 64; shift += 7 )
+			{
+			uint8_t b;
+
+			if ( ! Byte(&b) )
+				return false;
+
+			*v |= static_cast<uint64_t>(b & 0x7f) << shift;
+
+			if ( ! (b & 0x80) )
+				return true;
+			}
+
+		return false;
+		}
+
+	bool Raw(size_t n, const char** p)
+		{
+		if ( n > Left() )
+			return false;
+
+		*p = data + pos;
+		pos += n;
+		return true;
+		}
+
+	bool U32(uint32_t* v)
+		{
+		const char* p;
+
+		if ( ! Raw(4, &p) )
+			return false;
+
+		*v = 0;
+
+		for ( int i = 0; i < 4; ++i )
+			*v |= static_cast<uint32_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+
+		return true;
+		}
+
+	bool Double(double* d)
+		{
+		const char* p;
+
+		if ( ! Raw(8, &p) )
+			return false;
+
+		uint64_t v = 0;
+
+		for ( int i = 0; i < 8; ++i )
+			v |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+
+		memcpy(d, &v, sizeof(*d));
+		return true;
+		}
+
+	bool String(const char** p, size_t* n)
+		{
+		uint64_t l;
+
+		if ( ! Varint(&l) || ! Raw(l, p) )
+			return false;
+
+		*n = l;
+		return true;
+		}
+
+	bool String(std::string* s)
+		{
+		const char* p;
+		size_t n;
+
+		if ( ! String(&p, &n) )
+			return false;
+
+		s->assign(p, n);
+		return true;
+		}
+
+private:
+	const char* data;
+	size_t len;
+	size_t pos = 0;
+};
+
+} // namespace
+
+static bool get_addr(Input* in, Value::addr_t* a)
+	{
+	uint8_t family;
+	const char* p;
+
+	if ( ! in->Byte(&family) )
+		return false;
+
+	if ( family == 4 )
+		{
+		if ( ! in->Raw(sizeof(a->in.in4), &p) )
+			return false;
+
+		a->family = IPv4;
+		memcpy(&a->in.in4, p, sizeof(a->in.in4));
+		return true;
+		}
+
+	if ( family == 6 )
+		{
+		if ( ! in->Raw(sizeof(a->in.in6), &p) )
+			return false;
+
+		a->family = IPv6;
+		memcpy(&a->in.in6, p, sizeof(a->in.in6));
+		return true;
+		}
+
+	return false;
+	}
+
+// Decodes the plain encoding of a value that's present into one that's
+// marked as absent. It's marked present only once its data is in place,
+// so that it's safe to delete even on failure.
+static bool get_plain(Input* in, Value* v)
+	{
+	switch ( v->type ) {
+	case TYPE_BOOL:
+		{
+		uint8_t b;
+
+		if ( ! in->Byte(&b) )
+			return false;
+
+		v->val.int_val = (b != 0);
+		break;
+		}
+
+	case TYPE_INT:
+		{
+		uint64_t u;
+
+		if ( ! in->Varint(&u) )
+			return false;
+
+		v->val.int_val = unzigzag(u);
+		break;
+		}
+
+	case TYPE_COUNT:
+		{
+		uint64_t u;
+
+		if ( ! in->Varint(&u) )
+			return false;
+
+		v->val.uint_val = u;
+		break;
+		}
+
+	case TYPE_PORT:
+		{
+		uint64_t port;
+		uint8_t proto;
+
+		if ( ! (in->Varint(&port) && in->Byte(&proto)) || proto > TRANSPORT_ICMP )
+			return false;
+
+		v->val.port_val.port = port;
+		v->val.port_val.proto = static_cast<TransportProto>(proto);
+		break;
+		}
+
+	case TYPE_ADDR:
+		if ( ! get_addr(in, &v->val.addr_val) )
+			return false;
+
+		break;
+
+	case TYPE_SUBNET:
+		if ( ! (get_addr(in, &v->val.subnet_val.prefix) &&
+		        in->Byte(&v->val.subnet_val.length)) )
+			return false;
+
+		break;
+
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+		if ( ! in->Double(&v->val.double_val) )
+			return false;
+
+		break;
+
+	case TYPE_ENUM:
+	case TYPE_STRING:
+	case TYPE_FILE:
+	case TYPE_FUNC:
+		{
+		const char* p;
+		size_t n;
+
+		if ( ! in->String(&p, &n) || n > INT_MAX )
+			return false;
+
+		v->val.string_val.data = new char[n];
+		v->val.string_val.length = n;
+		memcpy(v->val.string_val.data, p, n);
+		break;
+		}
+
+	case TYPE_PATTERN:
+		{
+		const char* p;
+		size_t n;
+
+		if ( ! in->String(&p, &n) )
+			return false;
+
+		char* text = new char[n + 1];
+		memcpy(text, p, n);
+		text[n] = '\0';
+		v->val.pattern_text_val = text;
+		break;
+		}
+
+	case TYPE_TABLE:
+	case TYPE_VECTOR:
+		{
+		uint64_t n;
+
+		// Each element takes at least one byte.
+		if ( ! in->Varint(&n) || n > in->Left() )
+			return false;
+
+		v->val.set_val.vals = new Value*[n];
+		v->val.set_val.size = n;
+
+		for ( uint64_t i = 0; i < n; ++i )
+			v->val.set_val.vals[i] = new Value(v->subtype, false);
+
+		v->present = true;
+
+		for ( uint64_t i = 0; i < n; ++i )
+			{
+			uint8_t present;
+
+			if ( ! in->Byte(&present) )
+				return false;
+
+			if ( present && ! get_plain(in, v->val.set_val.vals[i]) )
+				return false;
+			}
+
+		return true;
+		}
+
+	default:
+		return false;
+	}
+
+	v->present = true;
+	return true;
+	}
+
+static bool get_bit(const char* bits, uint64_t i)
+	{
+	return bits[i / 8] & (1 << (i % 8));
+	}
+
+// Decodes a column chunk into the values of a row group's rows.
+static bool decode_column(Input* in, const Field* f, Value*** rows, uint64_t num_rows, int col)
+	{
+	uint8_t flags;
+	uint8_t encoding;
+	const char* present = nullptr;
+	uint64_t num_values = num_rows;
+
+	if ( ! in->Byte(&flags) )
+		return false;
+
+	if ( flags & CHUNK_HAS_NULLS )
+		{
+		if ( ! in->Raw((num_rows + 7) / 8, &present) )
+			return false;
+
+		num_values = 0;
+
+		for ( uint64_t i = 0; i < num_rows; ++i )
+			num_values += get_bit(present, i);
+		}
+
+	if ( ! in->Byte(&encoding) )
+		return false;
+
+	const char* bools = nullptr;
+	std::vector<std::pair<const char*, size_t>> dict;
+	int64_t ticks = 0;
+
+	switch ( encoding ) {
+	case ENCODING_PLAIN:
+		if ( f->type == TYPE_BOOL && ! in->Raw((num_values + 7) / 8, &bools) )
+			return false;
+
+		break;
+
+	case ENCODING_DICT:
+		{
+		uint64_t n;
+
+		if ( ! is_dict_type(f->type) || ! in->Varint(&n) || n > in->Left() )
+			return false;
+
+		for ( uint64_t i = 0; i < n; ++i )
+			{
+			// Decode the entries once to find their lengths.
+			const char* start = in->Cur();
+			Value tmp(f->type, f->subtype, false);
+
+			if ( ! get_plain(in, &tmp) )
+				return false;
+
+			dict.emplace_back(start, in->Cur() - start);
+			}
+
+		break;
+		}
+
+	case ENCODING_DELTA:
+		if ( f->type != TYPE_TIME )
+			return false;
+
+		break;
+
+	default:
+		return false;
+	}
+
+	uint64_t j = 0;	// Index of the current value among those present.
+
+	for ( uint64_t i = 0; i < num_rows; ++i )
+		{
+		// Values get marked present once decoded.
+		Value* v = new Value(f->type, f->subtype, false);
+		rows[i][col] = v;
+
+		if ( present && ! get_bit(present, i) )
+			continue;
+
+		switch ( encoding ) {
+		case ENCODING_PLAIN:
+			if ( bools )
+				{
+				v->val.int_val = get_bit(bools, j);
+				v->present = true;
+				}
+
+			else if ( ! get_plain(in, v) )
+				return false;
+
+			break;
+
+		case ENCODING_DICT:
+			{
+			uint64_t idx;
+
+			if ( ! in->Varint(&idx) || idx >= dict.size() )
+				return false;
+
+			Input entry(dict[idx].first, dict[idx].second);
+
+			if ( ! get_plain(&entry, v) )
+				return false;
+
+			break;
+			}
+
+		case ENCODING_DELTA:
+			{
+			uint64_t delta;
+
+			if ( ! in->Varint(&delta) )
+				return false;
+
+			ticks += unzigzag(delta);
+			v->val.double_val = ticks_to_time(ticks);
+			v->present = true;
+			break;
+			}
+		}
+
+		++j;
+		}
+
+	return in->Left() == 0;
+	}
+
+Decoder::~Decoder()
+	{
+	for ( auto f : fields )
+		delete f;
+	}
+
+bool Decoder::Fail(const std::string& msg)
+	{
+	error = msg;
+	return false;
+	}
+
+Decoder::Status Decoder::Failed(const std::string& msg)
+	{
+	error = msg;
+	return FAILED;
+	}
+
+Decoder::Status Decoder::ParseHeader(const char* data, size_t len, size_t* consumed)
+	{
+	for ( auto f : fields )
+		delete f;
+
+	fields.clear();
+	meta.clear();
+
+	Input in(data, len);
+	const char* magic;
+	uint64_t version;
+	uint64_t num_fields;
+
+	if ( ! in.Raw(MAGIC_LEN, &magic) )
+		return NEED_MORE;
+
+	if ( memcmp(magic, MAGIC, MAGIC_LEN) != 0 )
+		return Failed("not a columnar log file");
+
+	if ( ! in.Varint(&version) )
+		return NEED_MORE;
+
+	if ( version != FORMAT_VERSION )
+		return Failed("unsupported format version " + std::to_string(version));
+
+	if ( ! in.Varint(&num_fields) )
+		return NEED_MORE;
+
+	for ( uint64_t i = 0; i < num_fields; ++i )
+		{
+		std::string name;
+		uint8_t type;
+		uint8_t subtype;
+		uint8_t optional;
+
+		if ( ! (in.String(&name) && in.Byte(&type) && in.Byte(&subtype) && in.Byte(&optional)) )
+			return NEED_MORE;
+
+		auto t = static_cast<TypeTag>(type);
+		auto st = static_cast<TypeTag>(subtype);
+
+		if ( ! Encoder::IsSupportedType(t, st) )
+			return Failed("unsupported type for column " + name);
+
+		fields.push_back(new Field(name.c_str(), nullptr, t, st, optional != 0));
+		}
+
+	uint64_t num_meta;
+
+	if ( ! in.Varint(&num_meta) )
+		return NEED_MORE;
+
+	for ( uint64_t i = 0; i < num_meta; ++i )
+		{
+		std::string key;
+		std::string value;
+
+		if ( ! (in.String(&key) && in.String(&value)) )
+			return NEED_MORE;
+
+		meta.emplace_back(std::move(key), std::move(value));
+		}
+
+	*consumed = in.Pos();
+	return OK;
+	}
+
+Decoder::Status Decoder::ParseBlock(const char* data, size_t len, size_t* consumed, Block* block)
+	{
+	Input in(data, len);
+	uint8_t type;
+
+	if ( ! in.Byte(&type) )
+		return NEED_MORE;
+
+	block->type = static_cast<BlockType>(type);
+	block->payload.clear();
+
+	if ( type == BLOCK_FOOTER )
+		{
+		if ( ! (in.Varint(&block->num_row_groups) && in.Varint(&block->num_rows)) )
+			return NEED_MORE;
+
+		*consumed = in.Pos();
+		return OK;
+		}
+
+	if ( type != BLOCK_ROW_GROUP )
+		return Failed("invalid block type");
+
+	uint8_t compression;
+	uint64_t raw_size;
+	uint64_t stored_size;
+	uint32_t crc;
+	const char* stored;
+
+	if ( ! (in.Varint(&block->num_rows) && in.Byte(&compression) &&
+	        in.Varint(&raw_size) && in.Varint(&stored_size) && in.U32(&crc)) )
+		return NEED_MORE;
+
+	if ( raw_size > MAX_PAYLOAD || stored_size > MAX_PAYLOAD )
+		return Failed("row group too large");
+
+	if ( ! in.Raw(stored_size, &stored) )
+		return NEED_MORE;
+
+	if ( compression == COMPRESSION_NONE )
+		{
+		if ( stored_size != raw_size )
+			return Failed("row group size mismatch");
+
+		block->payload.assign(stored, stored_size);
+		}
+
+	else if ( compression == COMPRESSION_ZLIB )
+		{
+		block->payload.resize(raw_size);
+		uLongf n = raw_size;
+
+		if ( uncompress(reinterpret_cast<Bytef*>(&block->payload[0]), &n,
+		                reinterpret_cast<const Bytef*>(stored), stored_size) != Z_OK ||
+		     n != raw_size )
+			return Failed("cannot decompress row group");
+		}
+
+	else
+		return Failed("unknown compression");
+
+	if ( crc32(0, reinterpret_cast<const Bytef*>(block->payload.data()),
+	           block->payload.size()) != crc )
+		return Failed("row group checksum mismatch");
+
+	*consumed = in.Pos();
+	return OK;
+	}
+
+bool Decoder::DecodeRowGroup(const Block& block, const std::vector<bool>& wanted,
+                             std::vector<Value**>* rows)
+	{
+	// Every row takes at least one bit per column.
+	if ( block.type != BLOCK_ROW_GROUP || block.num_rows > block.payload.size() * 8 + 8 )
+		return Fail("invalid row group");
+
+	size_t first = rows->size();
+
+	for ( uint64_t i = 0; i < block.num_rows; ++i )
+		{
+		Value** row = new Value*[fields.size()];
+		std::fill(row, row + fields.size(), nullptr);
+		rows->push_back(row);
+		}
+
+	Input in(block.payload.data(), block.payload.size());
+	bool ok = true;
+
+	for ( size_t c = 0; c < fields.size() && ok; ++c )
+		{
+		const char* chunk;
+		size_t len;
+
+		if ( ! in.String(&chunk, &len) )
+			ok = false;
+
+		else if ( c < wanted.size() && wanted[c] )
+			{
+			Input cin(chunk, len);
+			ok = decode_column(&cin, fields[c], rows->data() + first, block.num_rows, c);
+			}
+		}
+
+	if ( ok && in.Left() == 0 )
+		return true;
+
+	for ( size_t i = first; i < rows->size(); ++i )
+		{
+		for ( size_t c = 0; c < fields.size(); ++c )
+			delete (*rows)[i][c];
+
+		delete [] (*rows)[i];
+		}
+
+	rows->resize(first);
+	return Fail("malformed row group");
+	}
+
+TEST_SUITE_BEGIN("Columnar");
+
+TEST_CASE("columnar round trip")
+	{
+	Field f_ts("ts", nullptr, TYPE_TIME, TYPE_VOID, false);
+	Field f_host("host", nullptr, TYPE_ADDR, TYPE_VOID, false);
+	Field f_name("name", nullptr, TYPE_STRING, TYPE_VOID, true);
+	Field f_flag("flag", nullptr, TYPE_BOOL, TYPE_VOID, false);
+	Field f_num("num", nullptr, TYPE_INT, TYPE_VOID, false);
+	Field f_tags("tags", nullptr, TYPE_TABLE, TYPE_STRING, false);
+	const Field* fields[] = {&f_ts, &f_host, &f_name, &f_flag, &f_num, &f_tags};
+
+	Encoder enc(6, fields);
+	std::string data = enc.Header({{"path", "test"}});
+
+	char tag[] = "x";
+	const int num_rows = 100;
+
+	for ( int i = 0; i < num_rows; ++i )
+		{
+		Value ts(TYPE_TIME);
+		ts.val.double_val = 1300475167 + double(i * 1013) / 1e6;
+
+		Value host(TYPE_ADDR);
+		host.val.addr_val.family = IPv4;
+		host.val.addr_val.in.in4.s_addr = htonl(0x0a000000 + i % 3);
+
+		Value name(TYPE_STRING, i % 10 != 0);
+		name.val.string_val.data = tag;
+		name.val.string_val.length = 1;
+
+		Value flag(TYPE_BOOL);
+		flag.val.int_val = (i % 3 == 0);
+
+		Value num(TYPE_INT);
+		num.val.int_val = -i;
+
+		Value elem(TYPE_STRING);
+		elem.val.string_val.data = tag;
+		elem.val.string_val.length = 1;
+		Value* elems[] = {&elem};
+
+		Value tags(TYPE_TABLE, TYPE_STRING);
+		tags.val.set_val.size = i % 2;
+		tags.val.set_val.vals = elems;
+
+		const Value* vals[] = {&ts, &host, &name, &flag, &num, &tags};
+		enc.Add(vals);
+
+		if ( i == num_rows / 2 )
+			data += enc.FinishRowGroup(0);
+
+		// The values don't own their data.
+		name.present = elem.present = tags.present = false;
+		}
+
+	data += enc.FinishRowGroup(6);
+	data += enc.Footer(2, num_rows);
+
+	Decoder dec;
+	size_t n;
+	REQUIRE(dec.ParseHeader(data.data(), data.size(), &n) == Decoder::OK);
+	CHECK(dec.NumFields() == 6);
+	CHECK(dec.Fields()[5]->subtype == TYPE_STRING);
+	CHECK(dec.Fields()[2]->optional);
+	CHECK(dec.Meta()[0].second == "test");
+
+	std::vector<Value**> rows;
+	std::vector<bool> wanted = {true, true, true, true, false, true};
+	Block block;
+	size_t pos = n;
+
+	for ( int groups = 0; groups < 2; ++groups )
+		{
+		// A truncated block isn't an error, there's just more to come.
+		CHECK(dec.ParseBlock(data.data() + pos, 20, &n, &block) == Decoder::NEED_MORE);
+		REQUIRE(dec.ParseBlock(data.data() + pos, data.size() - pos, &n, &block) == Decoder::OK);
+		REQUIRE(dec.DecodeRowGroup(block, wanted, &rows));
+		pos += n;
+		}
+
+	REQUIRE(dec.ParseBlock(data.data() + pos, data.size() - pos, &n, &block) == Decoder::OK);
+	CHECK(block.type == BLOCK_FOOTER);
+	CHECK(block.num_rows == num_rows);
+	CHECK(pos + n == data.size());
+
+	REQUIRE(rows.size() == num_rows);
+
+	for ( int i = 0; i < num_rows; ++i )
+		{
+		Value** row = rows[i];
+		CHECK(row[0]->val.double_val == 1300475167 + double(i * 1013) / 1e6);
+		CHECK(ntohl(row[1]->val.addr_val.in.in4.s_addr) == uint32_t(0x0a000000 + i % 3));
+		CHECK(row[2]->present == (i % 10 != 0));
+		CHECK(row[3]->val.int_val == (i % 3 == 0));
+		CHECK(row[4] == nullptr);
+		CHECK(row[5]->val.set_val.size == i % 2);
+
+		if ( row[2]->present )
+			CHECK(std::string(row[2]->val.string_val.data, row[2]->val.string_val.length) == "x");
+
+		for ( int c = 0; c < 6; ++c )
+			delete row[c];
+
+		delete [] row;
+		}
+	}
+
+TEST_CASE("columnar encodings")
+	{
+	Field f("t", nullptr, TYPE_TIME, TYPE_VOID, false);
+	const Field* fields[] = {&f};
+	Encoder enc(1, fields);
+
+	auto encode = [&enc](double t)
+		{
+		Value v(TYPE_TIME);
+		v.val.double_val = t;
+		const Value* vals[] = {&v};
+		enc.Add(vals);
+		enc.Add(vals);
+		return enc.FinishRowGroup(0);
+		};
+
+	// Whole microseconds get delta-encoded, and anything else stored as is.
+	std::string delta = encode(1300475167.096535);
+	std::string plain = encode(1300475167.0965351);
+	CHECK(delta.size() < plain.size());
+
+	Decoder dec;
+	size_t n;
+	std::string data = enc.Header({}) + plain;
+	REQUIRE(dec.ParseHeader(data.data(), data.size(), &n) == Decoder::OK);
+
+	Block block;
+	std::vector<Value**> rows;
+	REQUIRE(dec.ParseBlock(data.data() + n, data.size() - n, &n, &block) == Decoder::OK);
+	REQUIRE(dec.DecodeRowGroup(block, {true}, &rows));
+	CHECK(rows[1][0]->val.double_val == 1300475167.0965351);
+
+	for ( auto row : rows )
+		{
+		delete row[0];
+		delete [] row;
+		}
+
+	// Corruption gets noticed.
+	data.back() ^= 1;
+	REQUIRE(dec.ParseHeader(data.data(), data.size(), &n) == Decoder::OK);
+	CHECK(dec.ParseBlock(data.data() + n, data.size() - n, &n, &block) == Decoder::FAILED);
+	CHECK(dec.Error() == "row group checksum mismatch");
+	CHECK(dec.ParseHeader("ZEEKCOX", 8, &n) == Decoder::FAILED);
+	}
+
+TEST_CASE("columnar damaged row group")
+	{
+	Field f_name("name", nullptr, TYPE_STRING, TYPE_VOID, true);
+	Field f_re("re", nullptr, TYPE_PATTERN, TYPE_VOID, false);
+	Field f_tags("tags", nullptr, TYPE_VECTOR, TYPE_STRING, false);
+	const Field* fields[] = {&f_name, &f_re, &f_tags};
+	Encoder enc(3, fields);
+
+	char name_a[] = "a";
+	char name_b[] = "some longer name";
+	char re_text[] = "^foo$";
+
+	for ( int i = 0; i < 10; ++i )
+		{
+		Value name(TYPE_STRING, i % 4 != 0);
+		name.val.string_val.data = i % 2 ? name_a : name_b;
+		name.val.string_val.length = strlen(name.val.string_val.data);
+
+		Value re(TYPE_PATTERN);
+		re.val.pattern_text_val = re_text;
+
+		Value elem(TYPE_STRING);
+		elem.val.string_val.data = name_b;
+		elem.val.string_val.length = strlen(name_b);
+		Value* elems[] = {&elem, &elem};
+
+		Value tags(TYPE_VECTOR, TYPE_STRING);
+		tags.val.vector_val.size = i % 3;
+		tags.val.vector_val.vals = elems;
+
+		const Value* vals[] = {&name, &re, &tags};
+		enc.Add(vals);
+
+		// The values don't own their data.
+		name.present = re.present = elem.present = tags.present = false;
+		}
+
+	Decoder dec;
+	size_t n;
+	std::string data = enc.Header({}) + enc.FinishRowGroup(0);
+	REQUIRE(dec.ParseHeader(data.data(), data.size(), &n) == Decoder::OK);
+
+	Block block;
+	REQUIRE(dec.ParseBlock(data.data() + n, data.size() - n, &n, &block) == Decoder::OK);
+
+	std::vector<bool> wanted = {true, true, true};
+	std::vector<Value**> rows;
+
+	// Decoding fails cleanly wherever the data ends, deleting the values
+	// decoded so far.
+	for ( size_t len = 0; len < block.payload.size(); ++len )
+		{
+		Block truncated = block;
+		truncated.payload.resize(len);
+		CHECK_FALSE(dec.DecodeRowGroup(truncated, wanted, &rows));
+		CHECK(rows.empty());
+		}
+
+	// Damaged bytes may or may not get noticed, but must not leave
+	// values behind that cannot be deleted.
+	for ( size_t pos = 0; pos < block.payload.size(); ++pos )
+		{
+		for ( int bits : {0x01, 0x80, 0xff} )
+			{
+			Block damaged = block;
+			damaged.payload[pos] ^= bits;
+
+			if ( ! dec.DecodeRowGroup(damaged, wanted, &rows) )
+				continue;
+
+			for ( auto row : rows )
+				{
+				for ( int c = 0; c < 3; ++c )
+					delete row[c];
+
+				delete [] row;
+				}
+
+			rows.clear();
+			}
+		}
+
+	REQUIRE(dec.DecodeRowGroup(block, wanted, &rows));
+	REQUIRE(rows.size() == 10);
+	CHECK(rows[0][2]->val.vector_val.size == 0);
+	CHECK(rows[2][2]->val.vector_val.size == 2);
+	CHECK(std::string(rows[3][1]->val.pattern_text_val) == "^foo$");
+
+	for ( auto row : rows )
+		{
+		for ( int c = 0; c < 3; ++c )
+			delete row[c];
+
+		delete [] row;
+		}
+	}
+
+TEST_SUITE_END();
+
+} // namespace zeek::threading::formatter::columnar
@@ -0,0 +1,211 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "zeek/threading/SerialTypes.h"
+
+namespace zeek::threading::formatter::columnar {
+
+/**
+ * Encoding and decoding of Zeek's columnar binary log format, shared by
+ * the Columnar log writer and input reader.
+ *
+ * A file starts with a header describing its schema, followed by a
+ * sequence of blocks:
+ *
+ *     file      = MAGIC header block* footer
+ *     header    = varint(FORMAT_VERSION) varint(#fields) field*
+ *                 varint(#meta) (string string)*
+ *     field     = string(name) byte(type) byte(subtype) byte(optional)
+ *     block     = byte(BLOCK_ROW_GROUP) varint(#rows) byte(compression)
+ *                 varint(raw size) varint(stored size) u32(crc32 of raw)
+ *                 payload
+ *     footer    = byte(BLOCK_FOOTER) varint(#row groups) varint(#rows)
+ *
+ * A row group's payload holds one chunk per column, each prefixed by its
+ * length so that readers can skip the columns they don't need. A chunk
+ * starts with a byte of flags (CHUNK_HAS_NULLS, followed by a bitmap of
+ * the rows that have a value) and a byte giving the encoding of the
+ * values present:
+ *
+ * - ENCODING_PLAIN: one after the other, with integers as varints
+ *   (zig-zag for signed ones), doubles as 8 little-endian bytes, strings
+ *   with a varint length, addresses as a byte 4 or 6 and the address in
+ *   network order, subnets as their prefix and a byte with their length
+ *   (as for the input framework, i.e., not offset for IPv4), bools packed
+ *   into a bitmap, and sets and vectors as an element count followed by,
+ *   per element, a presence byte and the element.
+ *
+ * - ENCODING_DICT: a dictionary of the distinct plain encodings, then per
+ *   value its varint index into it. Used for strings, enums, addresses,
+ *   subnets and ports whenever that's smaller.
+ *
+ * - ENCODING_DELTA: for times that are whole microseconds, the zig-zag
+ *   varint of the first one, then the differences to the previous one.
+ */
+
+constexpr char MAGIC[] = "ZEEKCOL";	// Including the terminating null.
+constexpr size_t MAGIC_LEN = sizeof(MAGIC);
+constexpr uint64_t FORMAT_VERSION = 1;
+
+enum BlockType : uint8_t { BLOCK_ROW_GROUP = 'R', BLOCK_FOOTER = 'E' };
+enum Compression : uint8_t { COMPRESSION_NONE = 0, COMPRESSION_ZLIB = 1 };
+enum Encoding : uint8_t { ENCODING_PLAIN = 0, ENCODING_DICT = 1, ENCODING_DELTA = 2 };
+enum ChunkFlags : uint8_t { CHUNK_HAS_NULLS = 0x01 };
+
+using MetaData = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * Turns rows of values into the columnar format. Values are encoded as
+ * they are added, so the encoder doesn't keep references to them.
+ */
+class Encoder {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param num_fields The number of columns.
+	 *
+	 * @param fields The columns' descriptions. The encoder keeps a
+	 * reference to them. Their types must be supported.
+	 */
+	Encoder(int num_fields, const Field* const* fields);
+	~Encoder();
+
+	/**
+	 * Returns true if columns of the given type can be stored.
+	 */
+	static bool IsSupportedType(TypeTag type, TypeTag subtype);
+
+	/**
+	 * Returns the file's magic and header.
+	 *
+	 * @param meta Key/value pairs to record along with the schema.
+	 */
+	std::string Header(const MetaData& meta) const;
+
+	/**
+	 * Adds a row to the current row group.
+	 */
+	void Add(const Value* const* vals);
+
+	/**
+	 * Returns the number of rows in the current row group.
+	 */
+	uint64_t NumRows() const	{ return num_rows; }
+
+	/**
+	 * Returns an estimate of the current row group's encoded size before
+	 * compression.
+	 */
+	size_t BufferedBytes() const;
+
+	/**
+	 * Returns the block for the current row group, and starts a new one.
+	 *
+	 * @param compression_level The zlib compression level, with 0
+	 * disabling compression.
+	 */
+	std::string FinishRowGroup(int compression_level);
+
+	/**
+	 * Returns the footer of a file.
+	 */
+	std::string Footer(uint64_t num_row_groups, uint64_t num_total_rows) const;
+
+private:
+	class Column;
+
+	int num_fields;
+	const Field* const* fields;
+	std::vector<std::unique_ptr<Column>> columns;
+	uint64_t num_rows = 0;
+};
+
+/**
+ * A block read from a file.
+ */
+struct Block {
+	BlockType type;
+	uint64_t num_rows;	//! For a footer, the total number of rows.
+	uint64_t num_row_groups;	//! Only set for a footer.
+	std::string payload;	//! Decompressed, only set for row groups.
+};
+
+/**
+ * Parses the columnar format back into values.
+ */
+class Decoder {
+public:
+	enum Status { OK, NEED_MORE, FAILED };
+
+	Decoder() = default;
+	~Decoder();
+
+	/**
+	 * Parses the file's magic and header.
+	 *
+	 * @param data The data, which may cover more than the header.
+	 *
+	 * @param len The length of *data*.
+	 *
+	 * @param consumed Set to the header's length on success.
+	 *
+	 * @return NEED_MORE if *data* doesn't contain the full header yet.
+	 */
+	Status ParseHeader(const char* data, size_t len, size_t* consumed);
+
+	/**
+	 * Parses the next block, decompressing and verifying its payload.
+	 * Arguments and return value are as for ParseHeader().
+	 */
+	Status ParseBlock(const char* data, size_t len, size_t* consumed, Block* block);
+
+	/**
+	 * Decodes the rows of a row group, appending them to a vector. Each
+	 * row has an element per column, to be deleted by the caller, and
+	 * the array itself must be deleted with delete[].
+	 *
+	 * @param wanted Per column, whether to decode it. The rows get nulls
+	 * for the columns skipped.
+	 */
+	bool DecodeRowGroup(const Block& block, const std::vector<bool>& wanted,
+	                    std::vector<Value**>* rows);
+
+	/**
+	 * Returns the number of columns, once the header's been parsed.
+	 */
+	int NumFields() const	{ return fields.size(); }
+
+	/**
+	 * Returns the columns' description, once the header's been parsed.
+	 */
+	const Field* const* Fields() const	{ return fields.data(); }
+
+	/**
+	 * Returns the header's meta data.
+	 */
+	const MetaData& Meta() const	{ return meta; }
+
+	/**
+	 * Returns a description of the most recent failure.
+	 */
+	const std::string& Error() const	{ return error; }
+
+private:
+	bool Fail(const std::string& msg);
+	Status Failed(const std::string& msg);
+
+	std::vector<Field*> fields;
+	MetaData meta;
+	std::string error;
+};
+
+} // namespace zeek::threading::formatter::columnar
@@ -10,11 +10,21 @@
 #include <errno.h>
 #include <math.h>
 #include <stdint.h>
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <rapidjson/internal/dtoa.h>
 #include <rapidjson/internal/ieee754.h>
 
+#include "zeek/3rdparty/doctest.h"
+
 #include "zeek/Desc.h"
+#include "zeek/modp_numtoa.h"
 #include "zeek/threading/MsgThread.h"
 
 namespace zeek::threading::formatter {
@@ -39,19 +49,27 @@ JSON::~JSON()
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
                     Value** vals) const
 	{
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	const auto& field_keys = Keys(num_fields, fields);
+	bool first = true;
 
-	writer.StartObject();
+	buffer.clear();
+	buffer.push_back('{');
 
 	for ( int i = 0; i < num_fields; i++ )
 		{
-		if ( vals[i]->present )
-			BuildJSON(writer, vals[i], fields[i]->name);
+		if ( ! vals[i]->present )
+			continue;
+
+		if ( ! first )
+			buffer.push_back(',');
+
+		buffer.append(field_keys[i]);
+		AppendValue(&buffer, vals[i]);
+		first = false;
 		}
 
-	writer.EndObject();
-	desc->Add(buffer.GetString());
+	buffer.push_back('}');
+	desc->Add(buffer.c_str());
 
 	return true;
 	}
@@ -67,15 +85,14 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const
 	if ( ! val->present || name.empty() )
 		return true;
 
-	rapidjson::Document doc;
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	buffer.clear();
+	buffer.push_back('{');
+	AppendString(&buffer, name.data(), name.size());
+	buffer.push_back(':');
+	AppendValue(&buffer, val);
+	buffer.push_back('}');
 
-	writer.StartObject();
-	BuildJSON(writer, val, name);
-	writer.EndObject();
-
-	desc->Add(buffer.GetString());
+	desc->Add(buffer.c_str());
 	return true;
 	}
 
@@ -86,85 +103,88 @@ Value* JSON::ParseValue(const std::string& s, const std::string& name,
 	return nullptr;
 	}
 
-void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name) const
+const std::vector<std::string>& JSON::Keys(int num_fields, const Field* const* fields) const
+	{
+	// A writer passes the same fields array for all of its writes.
+	if ( fields == key_fields && keys.size() == static_cast<size_t>(num_fields) )
+		return keys;
+
+	keys.clear();
+
+	for ( int i = 0; i < num_fields; i++ )
+		{
+		std::string key;
+		AppendString(&key, fields[i]->name, strlen(fields[i]->name));
+		key.push_back(':');
+		keys.push_back(std::move(key));
+		}
+
+	key_fields = fields;
+	return keys;
+	}
+
+void JSON::AppendValue(std::string* buf, const Value* val) const
 	{
 	if ( ! val->present )
 		{
-		writer.Null();
+		buf->append("null");
 		return;
 		}
 
-	if ( ! name.empty() )
-		writer.Key(name);
+	char tmp[32];
 
 	switch ( val->type )
 		{
 		case TYPE_BOOL:
-			writer.Bool(val->val.int_val != 0);
+			buf->append(val->val.int_val != 0 ? "true" : "false");
 			break;
 
 		case TYPE_INT:
-			writer.Int64(val->val.int_val);
+			modp_litoa10(val->val.int_val, tmp);
+			buf->append(tmp);
 			break;
 
 		case TYPE_COUNT:
-			writer.Uint64(val->val.uint_val);
+			modp_ulitoa10(val->val.uint_val, tmp);
+			buf->append(tmp);
 			break;
 
 		case TYPE_PORT:
-			writer.Uint64(val->val.port_val.port);
+			modp_ulitoa10(val->val.port_val.port, tmp);
+			buf->append(tmp);
 			break;
 
+		// Rendered addresses and subnets need no escaping.
 		case TYPE_SUBNET:
-			writer.String(Formatter::Render(val->val.subnet_val));
+			buf->push_back('"');
+			buf->append(Formatter::Render(val->val.subnet_val));
+			buf->push_back('"');
 			break;
 
 		case TYPE_ADDR:
-			writer.String(Formatter::Render(val->val.addr_val));
+			buf->push_back('"');
+			buf->append(Formatter::Render(val->val.addr_val));
+			buf->push_back('"');
 			break;
 
 		case TYPE_DOUBLE:
 		case TYPE_INTERVAL:
-			writer.Double(val->val.double_val);
+			AppendDouble(buf, val->val.double_val);
 			break;
 
 		case TYPE_TIME:
 			{
 			if ( timestamps == TS_ISO8601 )
-				{
-				char buffer[40];
-				char buffer2[48];
-				time_t the_time = time_t(floor(val->val.double_val));
-				struct tm t;
-
-				if ( ! gmtime_r(&the_time, &t) ||
-				     ! strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &t) )
-					{
-					GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
-					// This was a failure, doesn't really matter what gets put here
-					// but it should probably stand out...
-					writer.String("2000-01-01T00:00:00.000000");
-					}
-				else
-					{
-					double integ;
-					double frac = modf(val->val.double_val, &integ);
-
-					if ( frac < 0 )
-						frac += 1;
-
-					snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-					writer.String(buffer2, strlen(buffer2));
-					}
-				}
+				AppendTime(buf, val->val.double_val);
 
 			else if ( timestamps == TS_EPOCH )
-				writer.Double(val->val.double_val);
+				AppendDouble(buf, val->val.double_val);
 
 			else if ( timestamps == TS_MILLIS )
 				{
 				// ElasticSearch uses milliseconds for timestamps
-				writer.Uint64((uint64_t) (val->val.double_val * 1000));
+				modp_ulitoa10((uint64_t) (val->val.double_val * 1000), tmp);
+				buf->append(tmp);
 				}
 
 			break;
@@ -174,38 +194,321 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 		case TYPE_STRING:
 		case TYPE_FILE:
 		case TYPE_FUNC:
-			{
-			writer.String(util::json_escape_utf8(
-				              std::string(val->val.string_val.data, val->val.string_val.length)));
+			AppendString(buf, val->val.string_val.data, val->val.string_val.length);
 			break;
-			}
 
 		case TYPE_TABLE:
 			{
-			writer.StartArray();
+			buf->push_back('[');
 
 			for ( bro_int_t idx = 0; idx < val->val.set_val.size; idx++ )
-				BuildJSON(writer, val->val.set_val.vals[idx]);
+				{
+				if ( idx > 0 )
+					buf->push_back(',');
+
+				AppendValue(buf, val->val.set_val.vals[idx]);
+				}
 
-			writer.EndArray();
+			buf->push_back(']');
 			break;
 			}
 
 		case TYPE_VECTOR:
 			{
-			writer.StartArray();
+			buf->push_back('[');
 
 			for ( bro_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
-				BuildJSON(writer, val->val.vector_val.vals[idx]);
+				{
+				if ( idx > 0 )
+					buf->push_back(',');
 
-			writer.EndArray();
+				AppendValue(buf, val->val.vector_val.vals[idx]);
+				}
+
+			buf->push_back(']');
 			break;
 			}
 
 		default:
-			reporter->Warning("Unhandled type in JSON::BuildJSON");
+			reporter->Warning("Unhandled type in JSON::AppendValue");
+			buf->append("null");
 			break;
 		}
 	}
 
+void JSON::AppendTime(std::string* buf, double t) const
+	{
+	time_t the_time = time_t(floor(t));
+
+	// Consecutive log entries tend to fall into the same second.
+	if ( ! have_iso_second || the_time != iso_second )
+		{
+		char tmp[40];
+		struct tm tm;
+
+		if ( ! gmtime_r(&the_time, &tm) ||
+		     ! strftime(tmp, sizeof(tmp), "%Y-%m-%dT%H:%M:%S", &tm) )
+			{
+			GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", t));
+			// This was a failure, doesn't really matter what gets put here
+			// but it should probably stand out...
+			buf->append("\"2000-01-01T00:00:00.000000\"");
+			return;
+			}
+
+		iso_prefix = tmp;
+		iso_second = the_time;
+		have_iso_second = true;
+		}
+
+	double integ;
+	double frac = modf(t, &integ);
+
+	if ( frac < 0 )
+		frac += 1;
+
+	// Rounds like printf's "%06.0f", which may yield 1000000.
+	char usecs[32];
+	modp_ulitoa10((uint64_t) nearbyint(fabs(frac) * 1000000), usecs);
+
+	buf->push_back('"');
+	buf->append(iso_prefix);
+	buf->push_back('.');
+	buf->append(6 - std::min<size_t>(6, strlen(usecs)), '0');
+	buf->append(usecs);
+	buf->append("Z\"");
+	}
+
+void JSON::AppendDouble(std::string* buf, double d)
+	{
+	if ( ! std::isfinite(d) )
+		{
+		buf->append("null");
+		return;
+		}
+
+	// The same shortest round-trip representation the writer uses.
+	char tmp[32];
+	char* end = rapidjson::internal::dtoa(d, tmp);
+	buf->append(tmp, end - tmp);
+	}
+
+// Returns the number of leading bytes of a string that go into a JSON
+// string as they are: printable ASCII other than quote and backslash.
+static size_t plain_prefix_length(const char* data, size_t len)
+	{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// Bytes from 0x80 on are negative, so the signed comparison catches
+	// them along with the control characters.
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i special = _mm_or_si128(_mm_cmplt_epi8(v, space),
+		                               _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+		                                            _mm_cmpeq_epi8(v, backslash)));
+
+		if ( int mask = _mm_movemask_epi8(special) )
+			return i + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		{
+		auto c = static_cast<unsigned char>(data[i]);
+
+		if ( c < 0x20 || c >= 0x80 || c == '"' || c == '\\' )
+			break;
+		}
+
+	return i;
+	}
+
+void JSON::AppendString(std::string* buf, const char* data, size_t len)
+	{
+	size_t n = plain_prefix_length(data, len);
+
+	buf->push_back('"');
+	buf->append(data, n);
+
+	if ( n < len )
+		{
+		// Byte-escape what isn't valid UTF-8, then escape for JSON like
+		// rapidjson does.
+		static const char hex_digits[] = "0123456789ABCDEF";
+		std::string rest = util::json_escape_utf8(std::string(data + n, len - n));
+
+		for ( char ch : rest )
+			{
+			auto c = static_cast<unsigned char>(ch);
+
+			switch ( c ) {
+			case '"': buf->append("\\\""); break;
+			case '\\': buf->append("\\\\"); break;
+			case '\b': buf->append("\\b"); break;
+			case '\f': buf->append("\\f"); break;
+			case '\n': buf->append("\\n"); break;
+			case '\r': buf->append("\\r"); break;
+			case '\t': buf->append("\\t"); break;
+			default:
+				if ( c < 0x20 )
+					{
+					char u[] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0xf]};
+					buf->append(u, sizeof(u));
+					}
+				else
+					buf->push_back(ch);
+			}
+			}
+		}
+
+	buf->push_back('"');
+	}
+
+TEST_SUITE_BEGIN("JSON formatter");
+
+// Renders a value through rapidjson's writer, as the formatter used to.
+static void reference_json(JSON::NullDoubleWriter& writer, const Value* val)
+	{
+	if ( ! val->present )
+		{
+		writer.Null();
+		return;
+		}
+
+	switch ( val->type ) {
+	case TYPE_BOOL:
+		writer.Bool(val->val.int_val != 0);
+		break;
+
+	case TYPE_INT:
+		writer.Int64(val->val.int_val);
+		break;
+
+	case TYPE_COUNT:
+		writer.Uint64(val->val.uint_val);
+		break;
+
+	case TYPE_DOUBLE:
+		writer.Double(val->val.double_val);
+		break;
+
+	case TYPE_STRING:
+		writer.String(util::json_escape_utf8(
+			              std::string(val->val.string_val.data, val->val.string_val.length)));
+		break;
+
+	case TYPE_VECTOR:
+		writer.StartArray();
+
+		for ( bro_int_t idx = 0; idx < val->val.vector_val.size; idx++ )
+			reference_json(writer, val->val.vector_val.vals[idx]);
+
+		writer.EndArray();
+		break;
+
+	default:
+		break;
+	}
+	}
+
+TEST_CASE("matches rapidjson")
+	{
+	std::vector<Value*> vals;
+	std::vector<Field*> fields;
+
+	auto add = [&](Value* v)
+		{
+		fields.push_back(new Field(util::fmt("f\"%zu\\", vals.size()), nullptr, v->type,
+		                           TYPE_VOID, true));
+		vals.push_back(v);
+		};
+
+	auto str = [](const std::string& s)
+		{
+		auto v = new Value(TYPE_STRING, true);
+		v->val.string_val.data = new char[s.size()];
+		memcpy(v->val.string_val.data, s.data(), s.size());
+		v->val.string_val.length = s.size();
+		return v;
+		};
+
+	for ( double d : {0.0, -0.0, 1.0, 0.1, 3.14, 1e20, 1e21, 1e-7, 123456.789e-300,
+	                  1.0 / 3, -2.5e15, double(NAN), double(INFINITY)} )
+		{
+		auto v = new Value(TYPE_DOUBLE, true);
+		v->val.double_val = d;
+		add(v);
+		}
+
+	for ( int64_t i : {INT64_MIN, int64_t(-1), int64_t(0), INT64_MAX} )
+		{
+		auto v = new Value(TYPE_INT, true);
+		v->val.int_val = i;
+		add(v);
+		}
+
+	auto c = new Value(TYPE_COUNT, true);
+	c->val.uint_val = UINT64_MAX;
+	add(c);
+
+	auto b = new Value(TYPE_BOOL, true);
+	b->val.int_val = 1;
+	add(b);
+
+	add(new Value(TYPE_COUNT, false));
+	add(str(""));
+	add(str("a plain string, long enough for a few vector rounds"));
+	add(str(std::string("quote\" backslash\\ ctrl\b\f\n\r\t\x01\x1f\x7f nul") + '\0'));
+	add(str("utf-8 \xc3\xb1 \xe2\x82\xa1 invalid \xc3\x28 \xf0 and \"more\" after it"));
+
+	auto vec = new Value(TYPE_VECTOR, true);
+	vec->val.vector_val.size = 3;
+	vec->val.vector_val.vals = new Value*[3];
+	vec->val.vector_val.vals[0] = str("x\ty");
+	vec->val.vector_val.vals[1] = new Value(TYPE_STRING, false);
+	vec->val.vector_val.vals[2] = str("z");
+	add(vec);
+
+	rapidjson::StringBuffer rbuf;
+	JSON::NullDoubleWriter writer(rbuf);
+	writer.StartObject();
+
+	for ( size_t i = 0; i < vals.size(); i++ )
+		{
+		if ( ! vals[i]->present )
+			continue;
+
+		writer.Key(fields[i]->name);
+		reference_json(writer, vals[i]);
+		}
+
+	writer.EndObject();
+
+	JSON json(nullptr, JSON::TS_EPOCH);
+	ODesc desc;
+
+	// Twice, to use the cached keys.
+	for ( int i = 0; i < 2; i++ )
+		{
+		desc.Clear();
+		CHECK(json.Describe(&desc, vals.size(), fields.data(), vals.data()));
+		CHECK(std::string(reinterpret_cast<const char*>(desc.Bytes()), desc.Len()) ==
+		      rbuf.GetString());
+		}
+
+	for ( auto v : vals )
+		delete v;
+
+	for ( auto f : fields )
+		delete f;
+	}
+
+TEST_SUITE_END();
+
 } // namespace zeek::threading::formatter
@@ -2,6 +2,10 @@
 
 #pragma once
 
+#include <time.h>
+#include <string>
+#include <vector>
+
 #define RAPIDJSON_HAS_STDSTRING 1
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
@@ -38,10 +42,28 @@ public:
 	};
 
 private:
-	void BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
+	// The following append JSON directly to a buffer, producing the same
+	// output as rapidjson's writer would, but without its per-value
+	// overhead.
+	void AppendValue(std::string* buf, const Value* val) const;
+	void AppendTime(std::string* buf, double t) const;
+	static void AppendString(std::string* buf, const char* data, size_t len);
+	static void AppendDouble(std::string* buf, double d);
+
+	// Returns the keys for a set of fields, i.e., their names as JSON
+	// strings followed by a colon. They are computed once per fields array.
+	const std::vector<std::string>& Keys(int num_fields, const Field* const* fields) const;
 
 	TimeFormat timestamps;
 	bool surrounding_braces;
+
+	// Per-thread state reused across Describe() calls.
+	mutable std::string buffer;
+	mutable const Field* const* key_fields = nullptr;
+	mutable std::vector<std::string> keys;
+	mutable bool have_iso_second = false;
+	mutable time_t iso_second;	// Second of the ISO 8601 time cached.
+	mutable std::string iso_prefix;	// That second, formatted.
 };
 
 } // namespace zeek::threading::formatter
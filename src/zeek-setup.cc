@@ -525,7 +525,10 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr();
+	if ( options.timer_wheel_resolution )
+		timer_mgr = new Wheel_TimerMgr(*options.timer_wheel_resolution);
+	else
+		timer_mgr = new PQ_TimerMgr();
 
 	auto zeekygen_cfg = options.zeekygen_config_file.value_or("");
 	zeekygen_mgr = new zeekygen::detail::Manager(zeekygen_cfg, zeek_argv[0]);
@@ -720,8 +723,14 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 
 	if ( ! all_signature_files.empty() )
 		{
+		// When precompiling, we build all DFAs from scratch.
+		const char* dfa_file = nullptr;
+
+		if ( ! options.signature_dfa_output_file )
+			dfa_file = id::find_val("signature_dfa_file")->AsString()->CheckString();
+
 		rule_matcher = new RuleMatcher(options.signature_re_level);
-		if ( ! rule_matcher->ReadFiles(all_signature_files) )
+		if ( ! rule_matcher->ReadFiles(all_signature_files, dfa_file) )
 			{
 			delete dns_mgr;
 			exit(1);
@@ -733,6 +742,20 @@ SetupResult setup(int argc, char** argv, Options* zopts)
 		file_mgr->InitMagic();
 		}
 
+	if ( options.signature_dfa_output_file )
+		{
+		// This option is precompile-and-exit.
+		bool success = false;
+
+		if ( rule_matcher )
+			success = rule_matcher->PrecompileDFAs(options.signature_dfa_output_file->c_str());
+		else
+			reporter->Error("no signatures to precompile");
+
+		delete dns_mgr;
+		exit(success ? 0 : 1);
+		}
+
 	if ( g_policy_debug )
 		// ### Add support for debug command file.
 		dbg_init_debugger(nullptr);
@@ -0,0 +1,82 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Counts heap allocations for the benchmarks. Preloaded into Zeek, it
+// provides the counters that the logging benchmark's plugin looks up. This
+// relies on glibc's internal allocator entry points.
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+static uint64_t total;
+static __thread uint64_t per_thread;
+
+static inline void count(void)
+	{
+	__atomic_fetch_add(&total, 1, __ATOMIC_RELAXED);
+	++per_thread;
+	}
+
+void* malloc(size_t size)
+	{
+	count();
+	return __libc_malloc(size);
+	}
+
+void* calloc(size_t n, size_t size)
+	{
+	count();
+	return __libc_calloc(n, size);
+	}
+
+void* realloc(void* p, size_t size)
+	{
+	count();
+	return __libc_realloc(p, size);
+	}
+
+// Aligned allocations, such as by C++'s operator new for over-aligned
+// types, bypass malloc(). glibc implements them all through memalign.
+void* memalign(size_t alignment, size_t size)
+	{
+	count();
+	return __libc_memalign(alignment, size);
+	}
+
+void* aligned_alloc(size_t alignment, size_t size)
+	{
+	count();
+	return __libc_memalign(alignment, size);
+	}
+
+int posix_memalign(void** p, size_t alignment, size_t size)
+	{
+	if ( alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 )
+		return EINVAL;
+
+	count();
+	void* mem = __libc_memalign(alignment, size);
+
+	if ( ! mem )
+		return ENOMEM;
+
+	*p = mem;
+	return 0;
+	}
+
+// Allocations by the calling thread so far.
+uint64_t zeek_alloc_counter_thread(void)
+	{
+	return per_thread;
+	}
+
+// Allocations by all threads so far.
+uint64_t zeek_alloc_counter_total(void)
+	{
+	return __atomic_load_n(&total, __ATOMIC_RELAXED);
+	}
@@ -0,0 +1,94 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+// Measures the throughput of in_cksum() for each kernel the CPU supports,
+// across payload sizes from minimal packets to jumbo frames.  Run it
+// through the "benchmark-checksum" build target.  On x86-64 it reports
+// bytes per TSC cycle, which matches core cycles only as long as the CPU
+// runs at its nominal frequency; elsewhere it reports bytes per
+// nanosecond.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include "zeek/net_util.h"
+
+using namespace zeek::detail;
+
+static uint64_t now()
+	{
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+int main(int argc, char** argv)
+	{
+	// Total number of bytes to checksum per kernel and size.
+	uint64_t volume = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1ULL << 30;
+
+	const int sizes[] = { 64, 128, 256, 512, 1500, 4096, 9000 };
+
+	// Start payloads at the offset they'd typically have within a
+	// captured Ethernet frame, rather than nicely aligned.
+	const int offset = 14 + 20;
+
+	std::mt19937 rng(42);
+	std::vector<uint8_t> buf(offset + 9000);
+
+	for ( auto& b : buf )
+		b = rng();
+
+	auto orig = get_checksum_kernel();
+
+#ifdef HAVE_RDTSC
+	printf("%-8s %6s %12s\n", "kernel", "size", "bytes/cycle");
+#else
+	printf("%-8s %6s %12s\n", "kernel", "size", "bytes/ns");
+#endif
+
+	for ( auto k : { CKSUM_SCALAR, CKSUM_SSE2, CKSUM_AVX2 } )
+		{
+		set_checksum_kernel(k);
+
+		// Not supported by this CPU.
+		if ( get_checksum_kernel() != k )
+			continue;
+
+		for ( auto size : sizes )
+			{
+			uint64_t iterations = volume / size + 1;
+			volatile uint16_t sink = 0;
+
+			// Warm up.
+			for ( int i = 0; i < 1000; ++i )
+				sink = in_cksum(&buf[offset], size);
+
+			auto start = now();
+
+			for ( uint64_t i = 0; i < iterations; ++i )
+				sink = in_cksum(&buf[offset], size);
+
+			auto elapsed = now() - start;
+			(void)sink;
+
+			printf("%-8s %6d %12.2f\n", checksum_kernel_name(k), size,
+			       double(iterations * size) / elapsed);
+			}
+		}
+
+	set_checksum_kernel(orig);
+
+	return 0;
+	}
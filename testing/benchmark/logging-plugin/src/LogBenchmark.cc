@@ -0,0 +1,157 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "LogBenchmark.h"
+
+#include <dlfcn.h>
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <thread>
+#include <vector>
+
+#include "zeek/Val.h"
+#include "zeek/ID.h"
+#include "zeek/Reporter.h"
+#include "zeek/logging/Manager.h"
+
+#include "benchmark.bif.h"
+
+namespace zeek::plugin::Testing_LogBenchmark {
+
+using steady_clock = std::chrono::steady_clock;
+using alloc_counter_func = uint64_t (*)();
+
+// Provided by the allocation counter, if preloaded.
+static alloc_counter_func thread_allocs()
+	{
+	static auto f = reinterpret_cast<alloc_counter_func>(dlsym(RTLD_DEFAULT, "zeek_alloc_counter_thread"));
+	return f;
+	}
+
+static alloc_counter_func total_allocs()
+	{
+	static auto f = reinterpret_cast<alloc_counter_func>(dlsym(RTLD_DEFAULT, "zeek_alloc_counter_total"));
+	return f;
+	}
+
+LogBenchmark::LogBenchmark(EnumVal* arg_id, double arg_rate) : id(arg_id), rate(arg_rate)
+	{
+	}
+
+uint64_t LogBenchmark::PendingMessages()
+	{
+	return log_mgr->PendingMessages(id);
+	}
+
+RecordValPtr LogBenchmark::Run(const VectorVal* records, uint64_t num_records)
+	{
+	auto result = make_intrusive<RecordVal>(BifType::Record::Benchmark::LogResult);
+
+	if ( records->Size() == 0 )
+		num_records = 0;
+
+	std::vector<uint64_t> latencies;
+	latencies.reserve(num_records);
+
+	uint64_t max_pending = 0;
+	uint64_t allocs_main = thread_allocs() ? thread_allocs()() : 0;
+	uint64_t allocs_all = total_allocs() ? total_allocs()() : 0;
+
+	auto start = steady_clock::now();
+	std::chrono::nanoseconds write_time{0};
+
+	for ( uint64_t i = 0; i < num_records; ++i )
+		{
+		if ( rate > 0 )
+			{
+			auto due = start + std::chrono::duration_cast<steady_clock::duration>(
+				std::chrono::duration<double>(i / rate));
+
+			while ( steady_clock::now() < due )
+				std::this_thread::yield();
+			}
+
+		auto rec = records->ValAt(i % records->Size());
+
+		auto before = steady_clock::now();
+		log_mgr->Write(id, rec->AsRecordVal());
+		auto took = steady_clock::now() - before;
+
+		write_time += took;
+		latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+
+		// Sampling costs more than a write, so don't do it for each.
+		if ( i % 1024 == 1023 )
+			max_pending = std::max(max_pending, PendingMessages());
+		}
+
+	uint64_t allocs_main_written = thread_allocs() ? thread_allocs()() - allocs_main : 0;
+
+	// Push out what the frontends have buffered and wait for the writers
+	// to catch up, unless one of them got stuck.
+	log_mgr->Flush(id);
+
+	auto timeout = std::chrono::duration<double>(
+		id::find_val("Benchmark::log_timeout")->AsInterval());
+	auto deadline = steady_clock::now() +
+		std::chrono::duration_cast<steady_clock::duration>(timeout);
+
+	while ( uint64_t pending = PendingMessages() )
+		{
+		max_pending = std::max(max_pending, pending);
+
+		if ( steady_clock::now() > deadline )
+			{
+			reporter->Error("Benchmark::log_writes: writers still have %" PRIu64
+			                " messages pending after %.1f seconds, giving up",
+			                pending, timeout.count());
+			break;
+			}
+
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+
+	auto total_time = steady_clock::now() - start;
+	uint64_t allocs_all_written = total_allocs() ? total_allocs()() - allocs_all : 0;
+
+	auto hist = make_intrusive<VectorVal>(zeek::id::index_vec);
+	std::vector<uint64_t> buckets(NUM_LATENCY_BUCKETS);
+
+	for ( auto l : latencies )
+		{
+		int b = l ? 63 - __builtin_clzll(l) : 0;
+		++buckets[std::min(b, NUM_LATENCY_BUCKETS - 1)];
+		}
+
+	for ( auto b : buckets )
+		hist->Append(val_mgr->Count(b));
+
+	auto percentile = [&latencies](double p) -> double
+		{
+		if ( latencies.empty() )
+			return 0;
+
+		auto n = std::min(latencies.size() - 1, size_t(p * latencies.size()));
+		std::nth_element(latencies.begin(), latencies.begin() + n, latencies.end());
+		return latencies[n] / 1e9;
+		};
+
+	double to_sec = 1e-9;
+	double per_record = num_records ? 1.0 / num_records : 0;
+
+	result->Assign(0, num_records);
+	result->AssignInterval(1, write_time.count() * to_sec);
+	result->AssignInterval(2, std::chrono::duration_cast<std::chrono::nanoseconds>(total_time).count() * to_sec);
+	result->Assign(3, std::move(hist));
+	result->AssignInterval(4, percentile(0.5));
+	result->AssignInterval(5, percentile(0.9));
+	result->AssignInterval(6, percentile(0.99));
+	result->AssignInterval(7, percentile(1.0));
+	result->Assign(8, thread_allocs() ? allocs_main_written * per_record : -1.0);
+	result->Assign(9, total_allocs() ? allocs_all_written * per_record : -1.0);
+	result->Assign(10, max_pending);
+
+	return result;
+	}
+
+} // namespace zeek::plugin::Testing_LogBenchmark
@@ -0,0 +1,62 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+
+#include "zeek/IntrusivePtr.h"
+
+namespace zeek {
+
+class EnumVal;
+class RecordVal;
+class VectorVal;
+using RecordValPtr = IntrusivePtr<RecordVal>;
+
+namespace plugin::Testing_LogBenchmark {
+
+/**
+ * Measures the cost of writing log records through the logging framework,
+ * from converting a record for its filters to the writers processing it.
+ * This drives the Benchmark::log_writes() BiF.
+ *
+ * Heap allocations get counted if the process has a counter preloaded
+ * that provides zeek_alloc_counter_thread() and zeek_alloc_counter_total(),
+ * as built by the benchmark targets in testing/benchmark.
+ */
+class LogBenchmark {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param id The stream to write to.
+	 *
+	 * @param rate The number of records to write per second, or zero to
+	 * write as fast as possible.
+	 */
+	LogBenchmark(EnumVal* id, double rate);
+
+	/**
+	 * Writes a number of records, taking them from a vector in turn, and
+	 * waits for the stream's writers to process them, for at most
+	 * Benchmark::log_timeout.
+	 *
+	 * @return A Benchmark::LogResult record with the measurements.
+	 */
+	RecordValPtr Run(const VectorVal* records, uint64_t num_records);
+
+	// Per-record write latencies are counted in buckets of powers of
+	// two nanoseconds.
+	static constexpr int NUM_LATENCY_BUCKETS = 32;
+
+private:
+	// Returns the number of messages the stream's writers have yet to
+	// process.
+	uint64_t PendingMessages();
+
+	EnumVal* id;
+	double rate;
+};
+
+} // namespace plugin::Testing_LogBenchmark
+} // namespace zeek
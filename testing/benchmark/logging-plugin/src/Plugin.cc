@@ -0,0 +1,18 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Plugin.h"
+
+namespace zeek::plugin::Testing_LogBenchmark { Plugin plugin; }
+
+using namespace zeek::plugin::Testing_LogBenchmark;
+
+zeek::plugin::Configuration Plugin::Configure()
+	{
+	zeek::plugin::Configuration config;
+	config.name = "Testing::LogBenchmark";
+	config.description = "Measures the cost of writing log records, for benchmarks and tests";
+	config.version.major = 1;
+	config.version.minor = 0;
+	config.version.patch = 0;
+	return config;
+	}
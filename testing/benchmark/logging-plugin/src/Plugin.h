@@ -0,0 +1,18 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <zeek/plugin/Plugin.h>
+
+namespace zeek::plugin::Testing_LogBenchmark {
+
+class Plugin : public zeek::plugin::Plugin
+{
+protected:
+	// Overridden from zeek::plugin::Plugin.
+	zeek::plugin::Configuration Configure() override;
+};
+
+extern Plugin plugin;
+
+}